@@ -111,9 +111,10 @@ public:
     void emitApplyPrecisionAndRounding(const std::string& reg);
     
 private:
-    // Static members for tracking register usage
-    static std::unordered_set<int> used_registers_;
-    static std::unordered_map<std::string, int> named_registers_;
+    // Register usage is tracked per assembler so JIT contexts on different
+    // threads do not share allocation state
+    std::unordered_set<int> used_registers_;
+    std::unordered_map<std::string, int> named_registers_;
     static std::vector<std::string> register_names_;
 };
 
@@ -4,6 +4,7 @@
 #include "xenoarm_jit/ir.h"
 #include "xenoarm_jit/register_allocation/register_allocator.h" // Include for RegisterMapping
 #include "xenoarm_jit/translation_cache/translation_cache.h" // Include for TranslatedBlock
+#include "xenoarm_jit/memory_model.h" // Include for OrderingLowering
 #include <vector>
 #include <cstdint>
 #include <unordered_map> // Include for std::unordered_map
@@ -22,7 +23,134 @@ public:
         const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map
     );
 
+    // As above, also emitting the spill/reload code produced by live-range splitting.
+    // spill_code must be sorted by instruction index (RegisterAllocator::get_spill_code()).
+    // The block reserves a spill frame of frame_size bytes (a multiple of 16,
+    // RegisterAllocator::get_total_spill_size()) below SP on entry and
+    // releases it at every exit.
+    std::vector<uint8_t> generate(
+        const std::vector<ir::IrInstruction>& ir_instructions,
+        const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map,
+        const std::vector<register_allocation::SpillCode>& spill_code,
+        uint32_t frame_size
+    );
+
+    // Absolute host addresses in the code returned by the last generate() call
+    const std::vector<translation_cache::CodeRelocation>& get_relocations() const { return relocations_; }
+
+    // Re-encode a relocated sequence in code to reach target
+    static void apply_relocation(uint8_t* code, const translation_cache::CodeRelocation& relocation, uint64_t target);
+
+    // Fastmem accesses in the code returned by the last generate() call
+    const std::vector<translation_cache::FastmemSite>& get_fastmem_sites() const { return fastmem_sites_; }
+
+    // Guest instruction of each run of host code returned by the last
+    // generate() call, in host offset order
+    const std::vector<translation_cache::SourceMapEntry>& get_source_map() const { return source_map_; }
+
+    // Rewrite the access of a fastmem site of block into a branch to its
+    // thunk, counting the first rewrite in block->fastmem_backpatches.
+    // block must own its code (not shared_code).
+    // Returns the host address of the thunk. Safe to call from a signal handler.
+    static uintptr_t backpatch_fastmem_site(translation_cache::TranslatedBlock* block,
+                                            const translation_cache::FastmemSite& site);
+
+    // Enable/disable static guest register pinning (must match the RegisterAllocator setting)
+    void set_guest_register_pinning(bool enabled) { pin_guest_registers_ = enabled; }
+    bool is_guest_register_pinning_enabled() const { return pin_guest_registers_; }
+
+    // Fastmem: LOAD/STORE access guest memory directly as [X18, Waddr, UXTW]
+    // (must match the RegisterAllocator setting). Otherwise they call the
+    // MemoryManager slow path.
+    void set_fastmem(bool enabled) { fastmem_ = enabled; }
+    bool is_fastmem_enabled() const { return fastmem_; }
+
+    // Lowering of ACQUIRE loads and RELEASE stores (IrMemoryOrder): LDAPR or
+    // LDAR, and STLR, on fastmem accesses. The slow path and LOWERING_BARRIERS
+    // use plain accesses with DMB ISHLD after an acquire and DMB ISH before a release.
+    void set_ordering_lowering(MemoryModel::OrderingLowering lowering) { ordering_lowering_ = lowering; }
+    MemoryModel::OrderingLowering get_ordering_lowering() const { return ordering_lowering_; }
+
+    // Lowering of the ATOMIC_* read-modify-writes on fastmem: ARMv8.1 LSE
+    // (LDADDAL, LDCLRAL, LDSETAL, LDEORAL, SWPAL, CASAL) when enabled,
+    // LDAXR/STLXR loops followed by DMB ISH otherwise. Without fastmem they
+    // are a slow-path read and write between two DMB ISH.
+    void set_lse_atomics(bool enabled) { lse_atomics_ = enabled; }
+    bool is_lse_atomics_enabled() const { return lse_atomics_; }
+
+    // Guest memory functions called by the slow path (MemoryManager::generated_code_read/
+    // write by default, or those of a compile-time GuestMemoryAccess policy)
+    using SlowPathRead = uint64_t (*)(uint32_t guest_address, uint32_t size);
+    using SlowPathWrite = void (*)(uint32_t guest_address, uint64_t value, uint32_t size);
+    void set_memory_slow_path(SlowPathRead read, SlowPathWrite write) {
+        slow_path_read_ = read;
+        slow_path_write_ = write;
+    }
+
+    // Dispatcher trampolines for pinned mode and fastmem.
+    // Entry is called as entry(guest_context, block_code, fastmem_base): it saves the host
+    // callee-saved registers, loads X18 with fastmem_base (fastmem only) and the pinned guest
+    // state from the context (pinned mode only), and branches to the block.
+    // Exit stores the pinned guest state back, restores the host registers and returns.
+    // Code generation only: the execute path (Jit_ExecuteBlock) does not run
+    // generated code and does not enter through these yet.
+    std::vector<uint8_t> generate_dispatcher_entry();
+    std::vector<uint8_t> generate_dispatcher_exit();
+
+    // Block linking: patch an exit of source_block to branch directly to target_block
+    // (used as the TranslationCache chain/replace callback)
+    void patch_branch(translation_cache::TranslatedBlock* source_block, 
+                     const translation_cache::TranslatedBlock::ControlFlowExit& exit, 
+                     translation_cache::TranslatedBlock* target_block);
+                     
+    void patch_branch_false(translation_cache::TranslatedBlock* source_block, 
+                          const translation_cache::TranslatedBlock::ControlFlowExit& exit, 
+                          translation_cache::TranslatedBlock* target_block);
+
 private:
+    // Load/store the pinned guest GPRs and EFLAGS from/to the guest context (X27)
+    void emit_load_pinned_guest_state(std::vector<uint8_t>& code);
+    void emit_store_pinned_guest_state(std::vector<uint8_t>& code);
+    
+    // Store/load a split vreg to/from its SP-relative stack slot
+    void emit_spill_code(std::vector<uint8_t>& code, const register_allocation::SpillCode& spill);
+    
+    // SUB/ADD SP, SP, #frame_size: reserve or release the spill frame
+    void emit_spill_frame(std::vector<uint8_t>& code, uint32_t frame_size, bool release);
+    
+    // Call a host function, spilling pinned guest state around it when required
+    void emit_host_call(std::vector<uint8_t>& code, uint64_t target);
+    
+    // Guest LOAD/STORE: a direct fastmem access or a slow-path call
+    void emit_memory_access(std::vector<uint8_t>& code, const ir::IrInstruction& instruction,
+        const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map);
+    
+    // Compute a guest effective address; returns the W register holding it
+    // (the base register itself when there is nothing to add, unless to_scratch)
+    uint32_t emit_effective_address(std::vector<uint8_t>& code, const ir::MemoryOperand& mem,
+        const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map,
+        bool to_scratch);
+    
+    // Load/store of size bytes at the guest address in W17 through MemoryManager,
+    // preserving every caller-saved register and allocatable vector register
+    // except the loaded one
+    void emit_slow_path_access(std::vector<uint8_t>& code, bool is_load, uint32_t size, uint32_t value_reg,
+                               ir::IrMemoryOrder memory_order = ir::IrMemoryOrder::PLAIN);
+    
+    // Guest ATOMIC_* read-modify-write (see set_lse_atomics)
+    void emit_atomic(std::vector<uint8_t>& code, const ir::IrInstruction& instruction,
+        const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map);
+    
+    // New value of an ATOMIC_* from the old one in Xold (LL/SC and slow-path
+    // lowerings); returns the register to store. value holds operand 1 (or the
+    // expected EDX:EAX of CMPXCHG8B, whose new ECX:EBX is in new64).
+    uint32_t emit_atomic_update(std::vector<uint8_t>& code, const ir::IrInstruction& instruction,
+        const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map,
+        uint32_t old_reg, uint32_t result_reg, uint32_t value_reg, uint32_t new64_reg);
+    
+    // Append the slow-path thunk of every fastmem access emitted so far
+    void emit_fastmem_thunks(std::vector<uint8_t>& code);
+    
     // Internal helper methods for generating specific AArch64 instructions
     void emit_instruction(std::vector<uint8_t>& code, uint32_t instruction);
     
@@ -30,14 +158,35 @@ private:
         const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map) const;
     uint32_t get_eflags_reg() const;
     
-    // Using the complete TranslatedBlock definition from translation_cache.h
-    void patch_branch(translation_cache::TranslatedBlock* source_block, 
-                     const translation_cache::TranslatedBlock::ControlFlowExit& exit, 
-                     translation_cache::TranslatedBlock* target_block);
-                     
-    void patch_branch_false(translation_cache::TranslatedBlock* source_block, 
-                          const translation_cache::TranslatedBlock::ControlFlowExit& exit, 
-                          translation_cache::TranslatedBlock* target_block);
+    // Whether guest GPRs/EFLAGS are statically pinned to callee-saved registers
+    bool pin_guest_registers_;
+    
+    // Whether guest memory is accessed through the fastmem base in X18
+    bool fastmem_;
+    
+    // How ACQUIRE/RELEASE accesses are lowered
+    MemoryModel::OrderingLowering ordering_lowering_;
+    
+    // Whether ATOMIC_* use LSE instructions
+    bool lse_atomics_;
+    
+    SlowPathRead slow_path_read_;
+    SlowPathWrite slow_path_write_;
+    
+    std::vector<translation_cache::CodeRelocation> relocations_;
+    
+    // Fastmem accesses awaiting their thunk, and the finished sites
+    struct PendingFastmemThunk {
+        uint32_t access_offset;
+        bool is_load;
+        uint32_t size;
+        uint32_t value_reg;
+        uint32_t address_reg;
+        ir::IrMemoryOrder memory_order;
+    };
+    std::vector<PendingFastmemThunk> pending_fastmem_thunks_;
+    std::vector<translation_cache::FastmemSite> fastmem_sites_;
+    std::vector<translation_cache::SourceMapEntry> source_map_;
 };
 
 } // namespace aarch64
@@ -3,6 +3,8 @@
 
 #include <cstdint>
 #include <cstddef> // For size_t
+#include <vector>
+#include <unordered_map>
 #include "xenoarm_jit/translation_cache/translation_cache.h"
 #include "xenoarm_jit/register_allocation/register_allocator.h"
 #include "xenoarm_jit/aarch64/code_generator.h"
@@ -10,6 +12,12 @@
 #include "xenoarm_jit/memory_manager.h" // Include for memory manager
 #include "xenoarm_jit/memory_model.h" // Include for memory model
 #include "xenoarm_jit/signal_handler.h" // Include for signal handler
+#include "xenoarm_jit/compile_thread_pool.h" // Include for background compilation
+#include "xenoarm_jit/translation_cache/shared_code_store.h" // Include for cross-context code sharing
+#include "xenoarm_jit/translation_cache/persistent_code_cache.h" // Include for warm starts
+#include "xenoarm_jit/translation_cache/perf_map_writer.h" // Include for perf profiling
+#include <atomic>
+#include <string>
 
 namespace XenoARM_JIT {
 
@@ -86,6 +94,22 @@ enum BarrierType {
     BARRIER_TYPE_LOAD = 3   // Load barrier
 };
 
+// Lowering of TSO-ordered guest memory accesses (JitConfig::memory_ordering_lowering)
+enum MemoryOrderingLowering {
+    MEMORY_ORDERING_AUTO = 0,            // Best the host CPU supports (HWCAP): RCpc if available, else barriers
+    MEMORY_ORDERING_BARRIERS = 1,        // Plain loads and stores with DMB barriers
+    MEMORY_ORDERING_ACQUIRE_RELEASE = 2, // LDAR/STLR (ARMv8.0)
+    MEMORY_ORDERING_RCPC = 3             // LDAPR/STLR (ARMv8.3 LRCPC); LDAR/STLR on cores without it
+};
+
+// Ordering policy of a guest memory region (Jit_SetMemoryOrderingPolicy)
+enum MemoryOrderingPolicy {
+    MEMORY_POLICY_DEFAULT = 0, // As conservative_memory_model says (removes a policy)
+    MEMORY_POLICY_RELAXED = 1, // Private to the guest CPU: never fenced
+    MEMORY_POLICY_TSO = 2,     // Shared with other agents (GPU push buffers, APU DMA): x86 ordering
+    MEMORY_POLICY_DEVICE = 3   // MMIO: ordered against everything around it, always through the callbacks
+};
+
 // Error handling constants
 enum JitErrorCodes {
     JIT_ERROR_NONE = 0,
@@ -96,6 +120,79 @@ enum JitErrorCodes {
     JIT_ERROR_NOT_IMPLEMENTED = 5
 };
 
+// Asynchronous translation request states (Jit_QueryTranslation)
+enum TranslationStatus {
+    TRANSLATION_STATUS_NONE = 0,    // Not requested
+    TRANSLATION_STATUS_PENDING = 1, // Being translated; keep running the guest on the slow path
+    TRANSLATION_STATUS_READY = 2,   // Translated and installed in the cache
+    TRANSLATION_STATUS_FAILED = 3   // Translation failed
+};
+
+// Speculative pre-translation statistics (Jit_GetSpeculationStats)
+struct JitSpeculationStats {
+    uint64_t requested;  // Successor addresses queued speculatively
+    uint64_t translated; // Speculative blocks installed in the cache
+    uint64_t hits;       // Speculative blocks later executed by the guest
+    uint64_t wasted;     // Speculative blocks invalidated before being executed
+    uint64_t cancelled;  // Speculative requests dropped by invalidation before completing
+    double hit_ratio;    // hits / translated
+    double waste_ratio;  // (wasted + cancelled) / requested
+};
+
+// Shared code store statistics (Jit_GetSharedCodeStats)
+struct JitSharedCodeStats {
+    uint64_t entries;    // Live shared translations
+    uint64_t code_bytes; // Host code resident in the store
+    uint64_t hits;       // Translations served from the store
+    uint64_t misses;     // Translations compiled and published
+    double hit_ratio;    // hits / (hits + misses)
+};
+
+// Persistent translation cache statistics (Jit_GetPersistentCacheStats)
+struct JitPersistentCacheStats {
+    uint64_t file_entries; // Blocks in the cache file mapped at startup
+    uint64_t loaded;       // Blocks installed from the file instead of translated
+    uint64_t rejected;     // File blocks whose guest bytes no longer matched
+    uint64_t saved;        // Blocks written by the last save
+};
+
+// Fastmem statistics of one translated block (Jit_GetFastmemBlockStats)
+struct JitFastmemBlockStats {
+    uint32_t access_sites; // Direct guest loads/stores in the block
+    uint32_t backpatched;  // Sites that faulted and now go through their slow-path thunk
+};
+
+// Self-modifying code statistics (Jit_GetSmcStats). Code pages start out
+// write-protected; pages where stores fault on data next to code switch to
+// inline store checks, and pages whose code keeps being rewritten switch to
+// self-verifying blocks.
+struct JitSmcStats {
+    uint32_t protected_pages;      // Code pages trapping writes
+    uint32_t inline_check_pages;   // Code pages whose stores are checked in software
+    uint32_t self_verifying_pages; // Code pages whose blocks verify their guest bytes
+    uint64_t code_writes;          // Code pages invalidated after guest writes (once per safe point)
+    uint64_t data_faults;          // Faults on code pages that hit only data
+    uint64_t self_verify_checks;   // Dispatches of self-verifying blocks
+    uint64_t self_verify_failures; // Checks that found the guest bytes changed
+};
+
+// Memory ordering statistics (Jit_GetMemoryOrderingStats), summed over the
+// blocks translated so far. Barriers per kilo-instruction before elision are
+// naive_barriers * 1000 / instructions, after it emitted_barriers * 1000 / instructions.
+struct JitMemoryOrderingStats {
+    uint64_t instructions;     // IR instructions translated, fences excluded
+    uint64_t naive_barriers;   // Guest fences plus a barrier after every store (conservative model)
+    uint64_t emitted_barriers; // Barriers left in the generated code
+    uint64_t ordered_accesses; // Loads/stores ordered by acquire/release instead of barriers
+    uint64_t relaxed_accesses; // Non-stack accesses left unordered by a RELAXED region
+    uint64_t device_accesses;  // Accesses to DEVICE regions
+    MemoryOrderingLowering lowering; // As resolved for this host
+    bool lse_atomics;                // Locked instructions lowered to LSE on this host
+};
+
+// Handle to a code store shared by contexts running the same title
+using SharedCodeStore = xenoarm_jit::translation_cache::SharedCodeStore;
+
 // Configuration structure for the JIT
 struct JitConfig {
     // User data for callbacks
@@ -117,6 +214,15 @@ struct JitConfig {
     WriteMemoryU64Callback write_memory_u64;
     WriteMemoryBlockCallback write_memory_block;
     
+    // Guest memory functions called from generated code when an access does
+    // not go through fastmem. nullptr selects the callbacks above. Hosts that
+    // link statically can pass GuestMemoryAccess<Policy>::generated_code_read/
+    // write (memory_manager.h) so those accesses inline into their memory code;
+    // they then call GuestMemoryAccess<Policy>::set_executing on each thread
+    // that runs translated code.
+    uint64_t (*generated_code_read)(uint32_t guest_address, uint32_t size);
+    void (*generated_code_write)(uint32_t guest_address, uint64_t value, uint32_t size);
+    
     // Exception handling
     GuestExceptionCallback exception_callback;
     
@@ -129,8 +235,62 @@ struct JitConfig {
     // Enable SMC detection
     bool enable_smc_detection;
     
+    // Host mapping of guest memory, if the host keeps guest RAM in one block
+    // (guest address 0 at guest_memory_base). Protection faults inside it are
+    // routed to this context when several contexts share the process.
+    void* guest_memory_base;
+    size_t guest_memory_size;
+    
+    // Fastmem: generated loads and stores access guest memory directly at
+    // guest_memory_base, which must then be a 4 GB reservation covering the
+    // whole guest address space. Pages the host leaves inaccessible (MMIO,
+    // unmapped) fault and are completed through the memory callbacks; locked
+    // instructions (LOCK prefix, XCHG) are not, and must target guest RAM.
+    bool enable_fastmem;
+    
     // Memory model settings
-    bool conservative_memory_model; // If true, use more memory barriers for compatibility
+    // If true, order shared (non-stack) stores as x86 TSO requires; if false,
+    // only the guest's own fences are honoured. Redundant barriers are elided.
+    // Regions given a policy with Jit_SetMemoryOrderingPolicy override this.
+    bool conservative_memory_model;
+    // How those accesses are ordered; AUTO is resolved at Jit_Init
+    MemoryOrderingLowering memory_ordering_lowering;
+    // LOCK-prefixed instructions and XCHG with memory use ARMv8.1 LSE atomics
+    // when the host has them (cleared at Jit_Init otherwise), LDAXR/STLXR loops if not
+    bool use_lse_atomics;
+    
+    // Register allocation settings
+    bool pin_guest_registers; // If true, keep x86 GPRs/EFLAGS in fixed host registers across blocks
+    
+    // Tiered compilation settings
+    bool enable_tiered_compilation; // If true, translate at tier 0 first and re-translate hot blocks at tier 1
+    uint32_t tier_up_threshold;     // Dispatches of a tier-0 block before it is queued for tier 1
+    
+    // Background compilation (0 = translate synchronously on the calling thread).
+    // With compile threads, the read_memory_block callback is called from worker threads.
+    uint32_t compile_threads;
+    
+    // Speculative pre-translation of static branch targets (requires compile_threads > 0)
+    bool enable_speculative_translation;
+    uint32_t speculation_depth; // Successor levels translated ahead of the guest
+    
+    // Optional store shared with other contexts (Jit_CreateSharedCodeStore).
+    // Must outlive every context configured with it.
+    SharedCodeStore* shared_code_store;
+    
+    // Persistent translation cache file (empty = disabled). Blocks found in it
+    // are used instead of translating and are checked against guest memory
+    // before their first execution; the file is rewritten at Jit_Shutdown.
+    std::string persistent_cache_path;
+    bool persistent_cache_eager_load; // Install every cached block at Jit_Init
+    
+    // Profiling with Linux perf: describe translated blocks in
+    // /tmp/perf-<pid>.map, and in jitdump_directory/jit-<pid>.dump with
+    // their code and guest EIPs (perf record -k mono, then perf inject --jit).
+    // Records are buffered and written out in large chunks.
+    bool emit_perf_map;
+    bool emit_jitdump;
+    std::string jitdump_directory;
     
     // Constructor with defaults
     JitConfig() 
@@ -142,11 +302,29 @@ struct JitConfig {
           write_memory_u8(nullptr), write_memory_u16(nullptr),
           write_memory_u32(nullptr), write_memory_u64(nullptr),
           write_memory_block(nullptr),
+          generated_code_read(nullptr),
+          generated_code_write(nullptr),
           exception_callback(nullptr),
           code_cache_size(16 * 1024 * 1024), // 16MB default
           page_size(4096), // 4KB default
           enable_smc_detection(true),
-          conservative_memory_model(true)
+          guest_memory_base(nullptr),
+          guest_memory_size(0),
+          enable_fastmem(false),
+          conservative_memory_model(true),
+          memory_ordering_lowering(MEMORY_ORDERING_AUTO),
+          use_lse_atomics(true),
+          pin_guest_registers(false),
+          enable_tiered_compilation(false),
+          tier_up_threshold(1000),
+          compile_threads(0),
+          enable_speculative_translation(false),
+          speculation_depth(2),
+          shared_code_store(nullptr),
+          persistent_cache_eager_load(false),
+          emit_perf_map(false),
+          emit_jitdump(false),
+          jitdump_directory("/tmp")
     {}
 };
 
@@ -166,10 +344,47 @@ struct JitContext {
     // Guest CPU state (registers, flags, etc.)
     // This would be defined in a separate header
     void* cpu_state;
+    
+    // Tiered compilation: guest addresses of hot tier-0 blocks awaiting tier 1
+    std::vector<uint32_t> tier_up_queue;
+    std::atomic<uint64_t> tier0_translations{0};
+    std::atomic<uint64_t> tier1_translations{0};
+    
+    // Background compilation workers (nullptr when compile_threads == 0)
+    xenoarm_jit::CompileThreadPool* compile_pool = nullptr;
+    
+    // Speculative pre-translation: outstanding requests (guest address -> depth),
+    // bytes of speculative code not executed yet, and counters
+    std::unordered_map<uint32_t, uint32_t> speculative_requests;
+    size_t speculative_bytes_outstanding = 0;
+    JitSpeculationStats speculation_stats = {};
+    
+    // Persistent translation cache (nullptr unless persistent_cache_path is set)
+    xenoarm_jit::translation_cache::PersistentCodeCache* persistent_cache = nullptr;
+    std::atomic<uint64_t> persistent_loaded{0};
+    std::atomic<uint64_t> persistent_rejected{0};
+    uint64_t persistent_saved = 0;
+    
+    // perf map/jitdump output (nullptr unless emit_perf_map or emit_jitdump)
+    xenoarm_jit::translation_cache::PerfMapWriter* perf_map_writer = nullptr;
+    
+    // Self-verifying block checks at dispatch (see JitSmcStats)
+    uint64_t self_verify_checks = 0;
+    uint64_t self_verify_failures = 0;
+    
+    // Barrier elision counters (see JitMemoryOrderingStats)
+    std::atomic<uint64_t> ordered_instructions{0};
+    std::atomic<uint64_t> naive_barriers{0};
+    std::atomic<uint64_t> emitted_barriers{0};
+    std::atomic<uint64_t> ordered_accesses{0};
+    std::atomic<uint64_t> relaxed_accesses{0};
+    std::atomic<uint64_t> device_accesses{0};
 };
 
 // Initialize the JIT
-// Returns a JitContext handle on success, nullptr on failure
+// Returns a JitContext handle on success, nullptr on failure.
+// Any number of contexts may coexist; each owns all of its state, and
+// different contexts may be driven from different threads.
 JitContext* Jit_Init(const JitConfig& config);
 
 // Shutdown the JIT and free resources
@@ -179,6 +394,75 @@ void Jit_Shutdown(JitContext* context);
 // Returns a pointer to the translated host code on success, nullptr on failure
 void* Jit_TranslateBlock(JitContext* context, uint32_t guest_address);
 
+// Request asynchronous translation of the block at guest_address
+// Returns true if the block is queued or already translated. Without compile
+// threads the block is translated synchronously.
+bool Jit_RequestTranslation(JitContext* context, uint32_t guest_address);
+
+// Query an asynchronous translation request, installing any finished blocks.
+// On TRANSLATION_STATUS_READY, *code_ptr (if non-null) receives the translated code.
+TranslationStatus Jit_QueryTranslation(JitContext* context, uint32_t guest_address, void** code_ptr);
+
+// Get speculative pre-translation statistics
+bool Jit_GetSpeculationStats(JitContext* context, JitSpeculationStats* stats);
+
+// Translate ahead of time every block reachable from entry_points through
+// direct jumps, branches and calls without leaving [start, start + size).
+// Without entry points, start is the only one. Blocks are translated in
+// parallel (on the context's compile threads, or one thread per host core)
+// and installed in the translation cache; with a persistent cache the file
+// is rewritten as well. Returns the number of blocks installed.
+size_t Jit_PretranslateRange(JitContext* context, uint32_t start, size_t size,
+                             const uint32_t* entry_points = nullptr, size_t entry_count = 0);
+
+// Register the calling thread as one that executes translated code.
+// Blocks invalidated by other threads are not freed until every registered
+// thread has passed a quiescent state. Jit_TranslateBlock is itself a
+// quiescent state for the calling thread.
+bool Jit_RegisterThread(JitContext* context);
+void Jit_UnregisterThread(JitContext* context);
+
+// Declare that the calling thread holds no translated block or code pointer
+// obtained before this call
+void Jit_QuiescentState(JitContext* context);
+
+// Create/destroy a code store that contexts running the same guest code can
+// share (JitConfig::shared_code_store). Identical blocks are translated once
+// and their host code is resident once; each context keeps its own cache
+// entries, so invalidation in one context does not affect the others.
+SharedCodeStore* Jit_CreateSharedCodeStore();
+void Jit_DestroySharedCodeStore(SharedCodeStore* store);
+bool Jit_GetSharedCodeStats(SharedCodeStore* store, JitSharedCodeStats* stats);
+
+// Write the blocks translated so far to JitConfig::persistent_cache_path.
+// Jit_Shutdown does this automatically.
+bool Jit_SavePersistentCache(JitContext* context);
+
+// Get persistent translation cache statistics
+bool Jit_GetPersistentCacheStats(JitContext* context, JitPersistentCacheStats* stats);
+
+// Get the fastmem statistics of the block translated at guest_address.
+// Returns false if there is no such block.
+bool Jit_GetFastmemBlockStats(JitContext* context, uint32_t guest_address, JitFastmemBlockStats* stats);
+
+// Get self-modifying code statistics
+bool Jit_GetSmcStats(JitContext* context, JitSmcStats* stats);
+
+// Get memory ordering (barrier elision) statistics
+bool Jit_GetMemoryOrderingStats(JitContext* context, JitMemoryOrderingStats* stats);
+
+// Set the ordering policy of [guest_address, guest_address + size), so that
+// only memory other agents really share pays for x86 ordering; with TSO and
+// DEVICE regions declared, conservative_memory_model can be false. Accesses
+// at absolute addresses are ordered at translation time. Accesses through
+// pointers are ordered by the policy only when they reach the memory
+// callbacks: always without fastmem, and with it for pages left
+// inaccessible in guest_memory_base (MMIO always is). Every translation is
+// discarded when the policies change, so set them before running the guest.
+// Call from the dispatcher thread.
+bool Jit_SetMemoryOrderingPolicy(JitContext* context, uint32_t guest_address, size_t size,
+                                 MemoryOrderingPolicy policy);
+
 // Execute the translated code block
 // This function will jump into the JITted code
 // The JITted code is expected to eventually return control to the host
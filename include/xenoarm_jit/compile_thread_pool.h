@@ -0,0 +1,116 @@
+#ifndef XENOARM_JIT_COMPILE_THREAD_POOL_H
+#define XENOARM_JIT_COMPILE_THREAD_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "xenoarm_jit/decoder.h"
+#include "xenoarm_jit/register_allocation/register_allocator.h"
+#include "xenoarm_jit/aarch64/code_generator.h"
+#include "xenoarm_jit/translation_cache/translation_cache.h"
+
+namespace xenoarm_jit {
+
+// Translation pipeline owned by a single compile thread. None of these
+// components are thread-safe, so every worker gets its own instances.
+struct CompileWorkerContext {
+    decoder::X86Decoder decoder;
+    register_allocation::RegisterAllocator register_allocator;
+    aarch64::CodeGenerator code_generator;
+};
+
+// State of an asynchronous translation request
+enum class TranslationRequestStatus {
+    NONE,    // Not requested (or already collected)
+    PENDING, // Queued or being translated
+    READY,   // Translated, waiting to be collected by take_completed()
+    FAILED   // Translation failed
+};
+
+/**
+ * Background compilation thread pool.
+ * Workers translate requested guest addresses into TranslatedBlocks but never
+ * touch the TranslationCache; the dispatcher thread collects finished blocks
+ * with take_completed() and installs them itself.
+ */
+class CompileThreadPool {
+public:
+    // Translates guest_address with the worker's pipeline; returns nullptr on failure
+    using TranslateFunction = std::function<translation_cache::TranslatedBlock*(CompileWorkerContext&, uint32_t)>;
+    // Configures a worker's pipeline once, on the worker thread
+    using WorkerInitFunction = std::function<void(CompileWorkerContext&)>;
+
+    CompileThreadPool(size_t thread_count, TranslateFunction translate, WorkerInitFunction init = nullptr);
+    ~CompileThreadPool();
+
+    // Queue guest_address for translation. Returns false if it is already pending or ready.
+    bool request(uint32_t guest_address);
+
+    // Current state of the request for guest_address
+    TranslationRequestStatus get_status(uint32_t guest_address) const;
+
+    // Block until the request for guest_address is no longer pending
+    void wait(uint32_t guest_address);
+
+    // Hand over all finished blocks to the caller (who takes ownership).
+    // Cheap when nothing has completed: a single acquire load.
+    std::vector<translation_cache::TranslatedBlock*> take_completed();
+
+    // Forget a failed request so that it can be requested again
+    void clear_failed(uint32_t guest_address);
+
+    // Drop requests overlapping [start_address, end_address] (guest code was modified).
+    // Requests already being translated are discarded when their worker finishes.
+    void cancel_range(uint64_t start_address, uint64_t end_address);
+
+    // Block until no worker is translating. With nothing queued (after
+    // cancel_range over everything), workers are then idle until the next request.
+    void wait_idle();
+
+    size_t get_thread_count() const { return workers_.size(); }
+    size_t get_pending_count() const;
+
+private:
+    struct Request {
+        uint32_t guest_address;
+        TranslationRequestStatus status;
+        translation_cache::TranslatedBlock* block;
+        bool cancelled;
+        bool in_flight;
+        uint64_t start_epoch; // invalidation_epoch_ when the worker picked it up
+    };
+
+    void worker_loop();
+
+    TranslateFunction translate_;
+    WorkerInitFunction init_;
+    std::vector<std::thread> workers_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable work_done_;
+    std::deque<std::shared_ptr<Request>> queue_;
+    std::unordered_map<uint32_t, std::shared_ptr<Request>> requests_;
+    std::vector<std::shared_ptr<Request>> completed_;
+    bool stopping_;
+
+    // Ranges invalidated while translations were in flight, tagged with their epoch
+    uint64_t invalidation_epoch_;
+    size_t in_flight_count_;
+    std::vector<std::pair<uint64_t, std::pair<uint64_t, uint64_t>>> recent_invalidations_;
+
+    // Published with release after a block is fully built, read with acquire by the dispatcher
+    std::atomic<size_t> completed_count_;
+};
+
+} // namespace xenoarm_jit
+
+#endif // XENOARM_JIT_COMPILE_THREAD_POOL_H
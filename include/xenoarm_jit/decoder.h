@@ -23,7 +23,7 @@ public:
 private:
     // Helper function to decode a single instruction
     // and return the corresponding IR instructions.
-    std::vector<ir::IrInstruction> decode_instruction(const uint8_t* instruction_bytes, size_t& bytes_read, size_t max_bytes_for_instruction);
+    std::vector<ir::IrInstruction> decode_instruction(const uint8_t* instruction_bytes, uint64_t instruction_address, size_t& bytes_read, size_t max_bytes_for_instruction);
 
     // TODO: Add internal state and helper methods for decoding prefixes,
     // operands, etc. in later stages of Phase 1.
@@ -10,23 +10,32 @@ namespace xenoarm_jit {
 // They operate on 80-bit extended precision floating point values
 // In a real implementation, these would be optimized assembly routines
 
+// x87 control/status words of the guest FPU a helper operates on. They belong
+// to the guest's SIMDState, so each JIT context has its own.
+struct FpuWords {
+    uint16_t& status_word;
+    uint16_t control_word;
+};
+
 // Sine computation helpers
-void compute_sine_f80(const uint8_t* src, uint8_t* dst);
-void compute_sine_large_f80(const uint8_t* src, uint8_t* dst);
+void compute_sine_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu);
+void compute_sine_large_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu);
 
 // Cosine computation helpers
-void compute_cosine_f80(const uint8_t* src, uint8_t* dst);
-void compute_cosine_large_f80(const uint8_t* src, uint8_t* dst);
+void compute_cosine_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu);
+void compute_cosine_large_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu);
 
 // Tangent computation helpers
-void compute_tangent_f80(const uint8_t* src, uint8_t* dst);
-bool compute_tangent_f80_with_status(const uint8_t* src, uint8_t* dst, uint16_t* status_flags);
+void compute_tangent_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu);
+// Status is returned in *status_flags rather than applied to a status word
+bool compute_tangent_f80_with_status(const uint8_t* src, uint8_t* dst, uint16_t* status_flags,
+                                     uint16_t control_word = 0x037F);
 
 // 2^x-1 computation helper
-void compute_2_to_x_minus_1_f80(const uint8_t* src, uint8_t* dst);
+void compute_2_to_x_minus_1_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu);
 
 // y * log2(x) computation helper
-void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* dst);
+void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* dst, FpuWords fpu);
 
 // Helper functions to load special values
 void load_fpu_qnan(uint8_t* dst);
@@ -41,11 +50,11 @@ void load_fpu_constant_ln2(uint8_t* dst);
 void load_fpu_constant_lg2e(uint8_t* dst);
 
 // FPU status and exception handling helpers
-void set_fpu_c2_flag(uint16_t flag_value);
-void set_fpu_c1_flag(uint16_t flag_value);
-void set_fpu_c0_flag(uint16_t flag_value);
-void set_fpu_c3_flag(uint16_t flag_value);
-void handle_fpu_exception(uint16_t exception_flags);
+void set_fpu_c2_flag(uint16_t flag_value, FpuWords fpu);
+void set_fpu_c1_flag(uint16_t flag_value, FpuWords fpu);
+void set_fpu_c0_flag(uint16_t flag_value, FpuWords fpu);
+void set_fpu_c3_flag(uint16_t flag_value, FpuWords fpu);
+void handle_fpu_exception(uint16_t exception_flags, FpuWords fpu);
 
 // IEEE-754 special value checks
 bool is_nan_f80(const uint8_t* src);
@@ -68,7 +77,7 @@ enum FPUExceptionFlags {
 // Enhanced precision control helpers
 void apply_precision_control_f80(uint8_t* value, uint16_t control_word);
 void apply_rounding_mode_f80(uint8_t* value, uint16_t control_word);
-void handle_denormal_value_f80(uint8_t* value, uint16_t control_word);
+void handle_denormal_value_f80(uint8_t* value, FpuWords fpu);
 
 } // namespace xenoarm_jit
 
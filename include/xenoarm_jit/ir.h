@@ -36,6 +36,8 @@ struct IrBasicBlock;
 
 // Represents a memory operand
 struct MemoryOperand {
+    static constexpr uint32_t NO_REGISTER = 0xFFFFFFFF; // The -1 below
+
     uint32_t base_reg_idx;  // Index of the base register (or -1 if no base)
     uint32_t index_reg_idx; // Index of the index register (or -1 if no index)
     uint8_t scale;          // Scale for the index register (1, 2, 4, 8)
@@ -150,6 +152,14 @@ enum class IrInstructionType {
     NOP, DEBUG_BREAK,
     // Memory barriers
     MEM_FENCE, // Memory fence instruction for x86 memory model support
+    // Atomic read-modify-write (LOCK prefix, XCHG with memory). Each is a
+    // full barrier, like the x86 instruction it comes from. Operand 0 is the
+    // memory destination.
+    ATOMIC_ADD, ATOMIC_SUB, ATOMIC_AND, ATOMIC_OR, ATOMIC_XOR, // mem, reg/imm (INC/DEC: imm 1)
+    ATOMIC_XADD,      // mem, reg: reg receives the old value
+    ATOMIC_XCHG,      // mem, reg
+    ATOMIC_CMPXCHG,   // mem, EAX, new: EAX receives the old value, flags as CMP EAX, old
+    ATOMIC_CMPXCHG8B, // mem, EAX, EDX, EBX, ECX: 64-bit compare EDX:EAX, store ECX:EBX; sets ZF
 
     // SIMD (MMX & SSE)
     VEC_MOV, // Generic vector move (e.g., MOVDQA, MOVUPS)
@@ -183,10 +193,21 @@ enum class IrInstructionType {
     FNSTSW,     // Store FPU Status Word
 };
 
+// Ordering a LOAD/STORE carries itself, set by MemoryModel::order_memory_accesses
+// when shared accesses are lowered to acquire loads and release stores
+enum class IrMemoryOrder : uint8_t {
+    PLAIN,
+    ACQUIRE, // Later accesses stay after it (LDAPR/LDAR)
+    RELEASE, // Earlier accesses stay before it (STLR)
+    DEVICE   // MMIO: always through the slow path, which fences it on both sides
+};
+
 // Represents a single IR instruction
 struct IrInstruction {
     IrInstructionType type;
     std::vector<IrOperand> operands;
+    IrMemoryOrder memory_order = IrMemoryOrder::PLAIN;
+    uint32_t guest_address = 0; // Guest instruction it was decoded from (0 if synthesised)
 
     // Constructor
     IrInstruction(IrInstructionType type, const std::vector<IrOperand>& operands = {})
@@ -206,10 +227,11 @@ struct IrBasicBlock {
 // Represents a translated function in IR
 struct IrFunction {
     uint64_t guest_address; // The original guest address of the function
+    uint32_t guest_size;    // Number of guest bytes consumed by the decoder
     std::vector<IrBasicBlock> basic_blocks;
 
     // Constructor
-    IrFunction(uint64_t address) : guest_address(address) {}
+    IrFunction(uint64_t address) : guest_address(address), guest_size(0) {}
 };
 
 } // namespace ir
@@ -0,0 +1,30 @@
+#ifndef XENOARM_JIT_IR_OPTIMIZER_H
+#define XENOARM_JIT_IR_OPTIMIZER_H
+
+#include "xenoarm_jit/ir.h"
+#include <cstddef>
+
+namespace xenoarm_jit {
+namespace ir {
+
+// Counts of what the optimisation passes removed
+struct IrOptimizationStats {
+    size_t nops_removed = 0;
+    size_t dead_moves_removed = 0;
+};
+
+// Removes NOP instructions from a basic block.
+size_t remove_nops(IrBasicBlock& block);
+
+// Removes full-width register MOVs whose result is overwritten by a later MOV
+// in the same block before being read. Control flow, host calls and memory
+// operands end the analysis window, so guest-visible state is preserved.
+size_t eliminate_dead_moves(IrBasicBlock& block);
+
+// Runs the tier-1 pass pipeline over every basic block of the function.
+IrOptimizationStats optimize_ir_function(IrFunction& ir_func);
+
+} // namespace ir
+} // namespace xenoarm_jit
+
+#endif // XENOARM_JIT_IR_OPTIMIZER_H
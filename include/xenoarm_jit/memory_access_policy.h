@@ -0,0 +1,80 @@
+#ifndef XENOARM_JIT_MEMORY_ACCESS_POLICY_H
+#define XENOARM_JIT_MEMORY_ACCESS_POLICY_H
+
+#include <cstdint>
+#include <functional>
+
+namespace xenoarm_jit {
+
+// Guest memory access policies.
+//
+// A policy is any type with the members below; it is how MemoryManager and
+// GuestMemoryAccess<Policy> (memory_manager.h) reach the host's guest memory:
+//
+//   uint8_t  read_u8(uint32_t guest_address);
+//   uint16_t read_u16(uint32_t guest_address);
+//   uint32_t read_u32(uint32_t guest_address);
+//   uint64_t read_u64(uint32_t guest_address);
+//   void     read_block(uint32_t guest_address, void* host_buffer, uint32_t size);
+//   void     write_u8(uint32_t guest_address, uint8_t value);
+//   void     write_u16(uint32_t guest_address, uint16_t value);
+//   void     write_u32(uint32_t guest_address, uint32_t value);
+//   void     write_u64(uint32_t guest_address, uint64_t value);
+//   void     write_block(uint32_t guest_address, const void* host_buffer, uint32_t size);
+//
+// Hosts that link the JIT statically pass their own policy type, so guest
+// loads and stores inline into the host's memory implementation.
+// CallbackMemoryPolicy is the runtime policy for hosts that only hand over
+// callbacks.
+
+// Runtime policy: host callbacks bound at run time
+class CallbackMemoryPolicy {
+public:
+    using ReadU8 = std::function<uint8_t(uint32_t)>;
+    using ReadU16 = std::function<uint16_t(uint32_t)>;
+    using ReadU32 = std::function<uint32_t(uint32_t)>;
+    using ReadU64 = std::function<uint64_t(uint32_t)>;
+    using ReadBlock = std::function<void(uint32_t, void*, uint32_t)>;
+
+    using WriteU8 = std::function<void(uint32_t, uint8_t)>;
+    using WriteU16 = std::function<void(uint32_t, uint16_t)>;
+    using WriteU32 = std::function<void(uint32_t, uint32_t)>;
+    using WriteU64 = std::function<void(uint32_t, uint64_t)>;
+    using WriteBlock = std::function<void(uint32_t, const void*, uint32_t)>;
+
+    CallbackMemoryPolicy() = default;
+    CallbackMemoryPolicy(ReadU8 read_u8_cb, ReadU16 read_u16_cb, ReadU32 read_u32_cb, ReadU64 read_u64_cb,
+                         ReadBlock read_block_cb, WriteU8 write_u8_cb, WriteU16 write_u16_cb,
+                         WriteU32 write_u32_cb, WriteU64 write_u64_cb, WriteBlock write_block_cb);
+
+    // Missing callbacks log an error and read as zero; missing 16/64-bit
+    // write and block callbacks fall back to narrower accesses
+    uint8_t read_u8(uint32_t guest_address) const;
+    uint16_t read_u16(uint32_t guest_address) const;
+    uint32_t read_u32(uint32_t guest_address) const;
+    uint64_t read_u64(uint32_t guest_address) const;
+    void read_block(uint32_t guest_address, void* host_buffer, uint32_t size) const;
+
+    void write_u8(uint32_t guest_address, uint8_t value) const;
+    void write_u16(uint32_t guest_address, uint16_t value) const;
+    void write_u32(uint32_t guest_address, uint32_t value) const;
+    void write_u64(uint32_t guest_address, uint64_t value) const;
+    void write_block(uint32_t guest_address, const void* host_buffer, uint32_t size) const;
+
+private:
+    ReadU8 read_u8_;
+    ReadU16 read_u16_;
+    ReadU32 read_u32_;
+    ReadU64 read_u64_;
+    ReadBlock read_block_;
+
+    WriteU8 write_u8_;
+    WriteU16 write_u16_;
+    WriteU32 write_u32_;
+    WriteU64 write_u64_;
+    WriteBlock write_block_;
+};
+
+} // namespace xenoarm_jit
+
+#endif // XENOARM_JIT_MEMORY_ACCESS_POLICY_H
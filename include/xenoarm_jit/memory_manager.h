@@ -1,13 +1,20 @@
 #ifndef XENOARM_JIT_MEMORY_MANAGER_H
 #define XENOARM_JIT_MEMORY_MANAGER_H
 
+#include "xenoarm_jit/memory_access_policy.h"
+#include "xenoarm_jit/memory_model.h"
+
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstddef>
-#include <unordered_map>
 #include <functional>
+#include <map>
+#include <unordered_map>
 #include <vector>
 #include <mutex>
 #include <memory>
+#include <utility>
 
 namespace xenoarm_jit {
 
@@ -24,13 +31,23 @@ enum MemoryProtectionFlags {
     PROT_EXEC  = 1 << 2
 };
 
-// Memory page information
-struct MemoryPage {
-    uint32_t guest_address;        // Starting guest address (page-aligned)
-    uint32_t size;                 // Size of the page in bytes
-    int protection;                // Current protection flags
-    bool has_translated_code;      // Whether this page contains translated code
-    bool is_dirty;                 // Whether this page has been modified
+// Guest page attributes: one byte per page in MemoryManager's page table
+enum PageAttributeFlags : uint8_t {
+    PAGE_PROTECTION_MASK = PROT_READ | PROT_WRITE | PROT_EXEC, // Current protection flags
+    PAGE_TRACKED         = 1 << 3,  // Protection was set; untracked pages are read/write
+    PAGE_HAS_CODE        = 1 << 4,  // Page contains translated code
+    PAGE_DIRTY           = 1 << 5,  // Page has been modified since it was translated
+    PAGE_INLINE_CHECKS   = 1 << 6,  // Stores are checked in software instead of trapping
+    PAGE_SELF_VERIFY     = 1 << 7   // Blocks verify their guest bytes on entry instead
+};
+
+// SMC handling counters per page mode (MemoryManager::get_smc_stats)
+struct SmcStats {
+    uint32_t protected_pages;      // Code pages trapping writes
+    uint32_t inline_check_pages;   // Code pages whose stores are checked in software
+    uint32_t self_verifying_pages; // Code pages whose blocks verify their guest bytes
+    uint64_t code_writes;          // Code pages invalidated at a safe point after writes
+    uint64_t data_faults;          // Faults on code pages that hit only data
 };
 
 /**
@@ -60,36 +77,132 @@ public:
     void read_block(uint32_t guest_address, void* host_buffer, uint32_t size);
     void write_block(uint32_t guest_address, const void* host_buffer, uint32_t size);
 
+    // Access of size 1, 2, 4 or 8 bytes through the callbacks above (the slow
+    // path of generated loads and stores). Reads are zero-extended, and
+    // fenced as the ordering policy of their region requires.
+    uint64_t read_sized(uint32_t guest_address, uint32_t size);
+    void write_sized(uint32_t guest_address, uint64_t value, uint32_t size);
+
+    // Slow-path entry points called from generated code. They act on the
+    // memory manager executing translated code on the calling thread, so the
+    // code calling them does not depend on the context.
+    static uint64_t generated_code_read(uint32_t guest_address, uint32_t size);
+    static void generated_code_write(uint32_t guest_address, uint64_t value, uint32_t size);
+    static void set_executing_manager(MemoryManager* memory_manager);
+    static MemoryManager* get_executing_manager();
+
+    // Fastmem: host address of guest address 0 in a 4 GB reservation used by
+    // generated code (nullptr when disabled). Faulting accesses inside it that
+    // are not SMC are backpatched to their slow-path thunk.
+    void set_fastmem_base(void* base) { fastmem_base_ = base; }
+    void* get_fastmem_base() const { return fastmem_base_; }
+
+    translation_cache::TranslationCache* get_translation_cache() const { return translation_cache_; }
+
+    // Region ordering policies for the slow path. Accesses through pointers
+    // cannot be matched to a region at translation time; those reaching the
+    // slow path (all of them without fastmem, faulting MMIO with it) get
+    // their region's fences here (MemoryModel::fence_before/after_access).
+    void set_memory_model(const MemoryModel* memory_model) { memory_model_ = memory_model; }
+    MemoryModel::RegionPolicy ordering_policy(uint32_t guest_address, uint32_t size) const {
+        return memory_model_ ? memory_model_->region_policy(guest_address, size) : MemoryModel::REGION_DEFAULT;
+    }
+
+    // SMC handling for a store by another accessor (GuestMemoryAccess): call
+    // after storing size bytes at guest_address. A store overlapping
+    // translated code unprotects its page and queues the bytes for
+    // invalidation at the next safe point. Stores outside code pages cost a
+    // single load from the page table.
+    void note_guest_write(uint32_t guest_address, uint32_t size) {
+        if (is_code_page(guest_address) || is_code_page(guest_address + size - 1)) {
+            queue_code_write(guest_address, size);
+        }
+    }
+
+    // Invalidate the translations covering code writes queued since the last
+    // call, adjacent and overlapping writes coalesced into one range. The
+    // dispatcher calls this at its safe point, before looking up a block.
+    // Pages the writes unprotected stay writable until code on them is next
+    // translated (register_code_page). Returns the ranges as (start, size).
+    std::vector<std::pair<uint32_t, uint32_t>> apply_pending_invalidations();
+    bool has_pending_invalidations() const { return invalidations_pending_.load(std::memory_order_acquire); }
+
     // Memory protection management
     bool protect_guest_memory(uint32_t guest_address, uint32_t size, int protection);
     int get_protection(uint32_t guest_address);
 
+    // Whether the page of guest_address holds translated code
+    bool is_code_page(uint32_t guest_address) const {
+        return (page_attributes(guest_address) & PAGE_HAS_CODE) != 0;
+    }
+
+    // Whether any of the size bytes at guest_address has been translated.
+    // Code pages track their translated bytes in a bitmap, so data sharing a
+    // page with code (jump tables, globals in .text) can be written without
+    // invalidating anything. Self-verifying pages report none.
+    bool has_code_bytes(uint32_t guest_address, uint32_t size) const;
+
+    // Protection faults on a code page that hit no translated bytes. After
+    // INLINE_STORE_CHECK_THRESHOLD of them the page stops trapping: it is
+    // left writable, and stores reach it through the checked slow path
+    // (fastmem stores are backpatched to their thunk on the next fault).
+    static constexpr uint32_t INLINE_STORE_CHECK_THRESHOLD = 8;
+    uint32_t get_data_fault_count(uint32_t guest_address) const;
+    bool has_inline_store_checks(uint32_t guest_address) const {
+        return (page_attributes(guest_address) & PAGE_INLINE_CHECKS) != 0;
+    }
+
+    // Writes hitting translated bytes of one page. When SELF_VERIFY_THRESHOLD
+    // of them arrive within SMC_RATE_WINDOW_MS the page stops trapping and
+    // invalidating: it is left writable, its translations are dropped once,
+    // and blocks translated from it verify their guest bytes on every entry
+    // (TranslatedBlock::self_verifying) and are retranslated on a mismatch.
+    static constexpr uint32_t SELF_VERIFY_THRESHOLD = 8;
+    static constexpr uint32_t SMC_RATE_WINDOW_MS = 1000;
+
+    // Protection faults recorded between two safe points before the fault
+    // handler falls back to flagging an overflow
+    static constexpr uint32_t FAULT_RING_SIZE = 256;
+
+    bool is_self_verifying(uint32_t guest_address) const {
+        return (page_attributes(guest_address) & PAGE_SELF_VERIFY) != 0;
+    }
+    // Whether any page of [guest_address, guest_address + size) is self-verifying
+    bool has_self_verifying_page(uint32_t guest_address, uint32_t size) const;
+
+    SmcStats get_smc_stats() const;
+
     // Register a page as containing translated code
     void register_code_page(uint32_t guest_address, uint32_t size);
     
     // Notify that a guest memory page may have been modified
     void notify_memory_modified(uint32_t guest_address, uint32_t size);
 
-    // Process protection fault (called by signal handler or exception handler)
-    void handle_protection_fault(uint32_t guest_address);
+    // Process protection fault (called by signal handler or exception handler).
+    // Async-signal-safe: no locking, allocation or logging. A fault on a code
+    // page leaves the page writable so the access can be retried and records
+    // the address for the next safe point (apply_pending_invalidations),
+    // which tells code writes from data writes and does the invalidation.
+    // Returns false if the page holds no translated code.
+    bool handle_protection_fault(uint32_t guest_address);
 
     // ARM Memory barrier helpers
     void insert_data_memory_barrier();       // DMB - Data Memory Barrier
     void insert_data_sync_barrier();         // DSB - Data Synchronization Barrier
     void insert_instruction_sync_barrier();  // ISB - Instruction Synchronization Barrier
 
-    // Register host memory callbacks
-    using HostReadU8Callback = std::function<uint8_t(uint32_t)>;
-    using HostReadU16Callback = std::function<uint16_t(uint32_t)>;
-    using HostReadU32Callback = std::function<uint32_t(uint32_t)>;
-    using HostReadU64Callback = std::function<uint64_t(uint32_t)>;
-    using HostReadBlockCallback = std::function<void(uint32_t, void*, uint32_t)>;
+    // Register host memory callbacks (the runtime access policy)
+    using HostReadU8Callback = CallbackMemoryPolicy::ReadU8;
+    using HostReadU16Callback = CallbackMemoryPolicy::ReadU16;
+    using HostReadU32Callback = CallbackMemoryPolicy::ReadU32;
+    using HostReadU64Callback = CallbackMemoryPolicy::ReadU64;
+    using HostReadBlockCallback = CallbackMemoryPolicy::ReadBlock;
     
-    using HostWriteU8Callback = std::function<void(uint32_t, uint8_t)>;
-    using HostWriteU16Callback = std::function<void(uint32_t, uint16_t)>;
-    using HostWriteU32Callback = std::function<void(uint32_t, uint32_t)>;
-    using HostWriteU64Callback = std::function<void(uint32_t, uint64_t)>;
-    using HostWriteBlockCallback = std::function<void(uint32_t, const void*, uint32_t)>;
+    using HostWriteU8Callback = CallbackMemoryPolicy::WriteU8;
+    using HostWriteU16Callback = CallbackMemoryPolicy::WriteU16;
+    using HostWriteU32Callback = CallbackMemoryPolicy::WriteU32;
+    using HostWriteU64Callback = CallbackMemoryPolicy::WriteU64;
+    using HostWriteBlockCallback = CallbackMemoryPolicy::WriteBlock;
 
     void set_host_memory_callbacks(
         HostReadU8Callback read_u8_cb,
@@ -107,31 +220,170 @@ public:
 private:
     translation_cache::TranslationCache* translation_cache_;
     size_t page_size_;
+    uint32_t page_shift_;
+    void* fastmem_base_;
+    const MemoryModel* memory_model_ = nullptr;
     
     // Host memory callbacks
-    HostReadU8Callback host_read_u8_;
-    HostReadU16Callback host_read_u16_;
-    HostReadU32Callback host_read_u32_;
-    HostReadU64Callback host_read_u64_;
-    HostReadBlockCallback host_read_block_;
+    CallbackMemoryPolicy callbacks_;
     
-    HostWriteU8Callback host_write_u8_;
-    HostWriteU16Callback host_write_u16_;
-    HostWriteU32Callback host_write_u32_;
-    HostWriteU64Callback host_write_u64_;
-    HostWriteBlockCallback host_write_block_;
+    // Guest page table: PageAttributeFlags for every page of the 32-bit
+    // guest space, indexed by guest_address >> page_shift_ (1 MB at 4 KB
+    // pages). Entries are updated atomically, so readers never lock.
+    std::unique_ptr<std::atomic<uint8_t>[]> page_table_;
     
-    // Guest memory page map
-    std::unordered_map<uint32_t, MemoryPage> pages_;
-    std::mutex pages_mutex_;  // Protect access to pages_
+    // Translated bytes of each code page (one bit per byte), keyed by page
+    // index. Only consulted for stores and faults on code pages.
+    struct CodePageBytes {
+        std::vector<uint64_t> bitmap;
+        uint32_t data_faults = 0;
+        uint32_t code_writes = 0;  // Within the window starting at window_start
+        std::chrono::steady_clock::time_point window_start;
+    };
+    std::unordered_map<uint32_t, CodePageBytes> code_bytes_;
+    mutable std::mutex code_bytes_mutex_;  // Protect access to code_bytes_
+    std::atomic<uint64_t> code_writes_{0};
+    std::atomic<uint64_t> data_faults_{0};
+    
+    // Code writes awaiting invalidation (start -> inclusive end), coalesced
+    std::map<uint64_t, uint64_t> pending_invalidations_;
+    std::mutex pending_mutex_;  // Protect access to pending_invalidations_ and fault_ring_tail_
+    std::atomic<bool> invalidations_pending_{false};
+    
+    // Faulting guest addresses awaiting the safe point: a bounded lock-free
+    // ring with per-slot sequence numbers, pushed by the fault handler and
+    // drained under pending_mutex_. When it is full the fault sets
+    // fault_ring_overflow_ and the drain rescans the unprotected code pages.
+    struct FaultSlot {
+        std::atomic<uint32_t> sequence;
+        uint32_t guest_address;
+    };
+    FaultSlot fault_ring_[FAULT_RING_SIZE];
+    std::atomic<uint32_t> fault_ring_head_{0};
+    uint32_t fault_ring_tail_ = 0;
+    std::atomic<bool> fault_ring_overflow_{false};
+    bool push_fault(uint32_t guest_address);
+    void drain_faults_locked();
+    
+    uint8_t page_attributes(uint32_t guest_address) const {
+        return page_table_[guest_address >> page_shift_].load(std::memory_order_acquire);
+    }
+    // Set the protection of count pages starting at first_page (an index)
+    void set_page_protection(uint64_t first_page, uint64_t count, int protection);
+    uint64_t page_count(uint32_t guest_address, uint32_t size) const;
     
     // Helper methods
     uint32_t align_to_page(uint32_t address);
+    void queue_code_write(uint32_t guest_address, uint32_t size);
+    void add_pending_range_locked(uint64_t start, uint64_t end);
+    void note_data_fault(uint32_t guest_address);
+    void mark_code_bytes(uint32_t guest_address, uint32_t size);
+    // Count a write to translated bytes of the page; may make it self-verifying
+    void note_code_write(uint32_t guest_address);
+    // Sub-ranges of [guest_address, guest_address + size) split at page
+    // boundaries that overlap translated bytes
+    std::vector<std::pair<uint32_t, uint32_t>> find_code_ranges(uint32_t guest_address, uint32_t size) const;
     bool is_page_protected(uint32_t guest_address);
-    bool invalidate_translations_for_page(uint32_t guest_address);
+    bool invalidate_translations_for_range(uint32_t guest_address, uint32_t size);
     void reprotect_page(uint32_t guest_address, int new_protection);
 };
 
+/**
+ * Guest memory accessor over a compile-time access policy (see
+ * memory_access_policy.h). Reads go straight to the policy and stores are
+ * followed by the memory manager's SMC check, so every access inlines as
+ * far as the policy's members do. Hosts that link the JIT statically use
+ * this in place of MemoryManager's runtime callbacks; generated code reaches
+ * it through generated_code_read/write (JitConfig::generated_code_read/write)
+ * once the thread's accessor is set with set_executing.
+ */
+template <typename Policy>
+class GuestMemoryAccess {
+public:
+    explicit GuestMemoryAccess(MemoryManager* memory_manager, Policy policy = Policy())
+        : memory_manager_(memory_manager), policy_(std::move(policy)) {}
+
+    Policy& policy() { return policy_; }
+
+    uint8_t read_u8(uint32_t guest_address) { return policy_.read_u8(guest_address); }
+    uint16_t read_u16(uint32_t guest_address) { return policy_.read_u16(guest_address); }
+    uint32_t read_u32(uint32_t guest_address) { return policy_.read_u32(guest_address); }
+    uint64_t read_u64(uint32_t guest_address) { return policy_.read_u64(guest_address); }
+    void read_block(uint32_t guest_address, void* host_buffer, uint32_t size) {
+        policy_.read_block(guest_address, host_buffer, size);
+    }
+
+    void write_u8(uint32_t guest_address, uint8_t value) {
+        store(guest_address, 1, [&] { policy_.write_u8(guest_address, value); });
+    }
+    void write_u16(uint32_t guest_address, uint16_t value) {
+        store(guest_address, 2, [&] { policy_.write_u16(guest_address, value); });
+    }
+    void write_u32(uint32_t guest_address, uint32_t value) {
+        store(guest_address, 4, [&] { policy_.write_u32(guest_address, value); });
+    }
+    void write_u64(uint32_t guest_address, uint64_t value) {
+        store(guest_address, 8, [&] { policy_.write_u64(guest_address, value); });
+    }
+
+    // Translations covering the block are queued for invalidation
+    void write_block(uint32_t guest_address, const void* host_buffer, uint32_t size) {
+        policy_.write_block(guest_address, host_buffer, size);
+        memory_manager_->notify_memory_modified(guest_address, size);
+    }
+
+    // As MemoryManager::read_sized/write_sized
+    uint64_t read_sized(uint32_t guest_address, uint32_t size) {
+        MemoryModel::RegionPolicy ordering = memory_manager_->ordering_policy(guest_address, size);
+        MemoryModel::fence_before_access(ordering, false);
+        uint64_t value;
+        switch (size) {
+            case 1: value = read_u8(guest_address); break;
+            case 2: value = read_u16(guest_address); break;
+            case 4: value = read_u32(guest_address); break;
+            default: value = read_u64(guest_address); break;
+        }
+        MemoryModel::fence_after_access(ordering, false);
+        return value;
+    }
+    void write_sized(uint32_t guest_address, uint64_t value, uint32_t size) {
+        MemoryModel::RegionPolicy ordering = memory_manager_->ordering_policy(guest_address, size);
+        MemoryModel::fence_before_access(ordering, true);
+        switch (size) {
+            case 1: write_u8(guest_address, static_cast<uint8_t>(value)); break;
+            case 2: write_u16(guest_address, static_cast<uint16_t>(value)); break;
+            case 4: write_u32(guest_address, static_cast<uint32_t>(value)); break;
+            default: write_u64(guest_address, value); break;
+        }
+        MemoryModel::fence_after_access(ordering, true);
+    }
+
+    // Slow-path entry points for generated code, acting on the accessor set
+    // for the calling thread
+    static uint64_t generated_code_read(uint32_t guest_address, uint32_t size) {
+        return executing_->read_sized(guest_address, size);
+    }
+    static void generated_code_write(uint32_t guest_address, uint64_t value, uint32_t size) {
+        executing_->write_sized(guest_address, value, size);
+    }
+    static void set_executing(GuestMemoryAccess* access) { executing_ = access; }
+
+private:
+    template <typename Store>
+    void store(uint32_t guest_address, uint32_t size, Store do_store) {
+        do_store();
+        memory_manager_->note_guest_write(guest_address, size);
+    }
+
+    MemoryManager* memory_manager_;
+    Policy policy_;
+
+    static thread_local GuestMemoryAccess* executing_;
+};
+
+template <typename Policy>
+thread_local GuestMemoryAccess<Policy>* GuestMemoryAccess<Policy>::executing_ = nullptr;
+
 } // namespace xenoarm_jit
 
 #endif // XENOARM_JIT_MEMORY_MANAGER_H 
\ No newline at end of file
@@ -1,7 +1,11 @@
 #ifndef XENOARM_JIT_MEMORY_MODEL_H
 #define XENOARM_JIT_MEMORY_MODEL_H
 
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "xenoarm_jit/ir.h"
 
 namespace xenoarm_jit {
@@ -53,7 +57,120 @@ public:
     // Helper method to determine if a memory barrier is needed between two memory operations
     bool needs_barrier_between(const ir::IrInstruction& first, const ir::IrInstruction& second);
     
+    // Dataflow form: whether the instruction at index second of a block must
+    // be ordered after the one at index first by a barrier that is not
+    // already in [first, second). Fences in between (MEM_FENCE) count.
+    bool needs_barrier_between(const std::vector<ir::IrInstruction>& instructions,
+                               size_t first, size_t second) const;
+    
+    // Accesses to ESP/EBP-based addresses (and PUSH/POP) are thread-private
+    // and never need ordering; anything else may be seen by another agent
+    enum AccessClass {
+        ACCESS_NONE = 0, // Not a guest memory access
+        ACCESS_STACK,    // Stack-relative, thread-private
+        ACCESS_SHARED    // Potentially shared
+    };
+    static AccessClass classify_access(const ir::IrInstruction& insn);
+    
+    // How TSO ordering of shared accesses reaches the generated code
+    enum OrderingLowering {
+        LOWERING_BARRIERS = 0, // Plain LDR/STR, DMB where needed
+        LOWERING_LDAR_STLR,    // Acquire loads and release stores (ARMv8.0, RCsc)
+        LOWERING_LDAPR_STLR    // RCpc acquire loads (ARMv8.3 LRCPC) and release stores
+    };
+    
+    // Host CPU features relevant to memory ordering, from HWCAP on AArch64
+    // Linux (all false elsewhere)
+    struct HostFeatures {
+        bool rcpc = false;        // LDAPR (HWCAP_LRCPC)
+        bool lse_atomics = false; // ARMv8.1 LSE atomics (HWCAP_ATOMICS)
+    };
+    static HostFeatures detect_host_features();
+    
+    // Best lowering for these features: RCpc acquire/release if available,
+    // barriers otherwise (LDAR is RCsc and no cheaper than DMB on such cores)
+    static OrderingLowering best_lowering(const HostFeatures& features);
+    
+    // Ordering the host declares for a guest address range. Only the host
+    // knows which memory other agents (GPU, APU, DMA) see: RELAXED memory is
+    // private to the guest CPU and never fenced, TSO memory is shared and
+    // ordered as x86 would, DEVICE memory (MMIO) is ordered against
+    // everything around it. Memory in no region is DEFAULT, ordered as the
+    // tso argument of order_memory_accesses says.
+    enum RegionPolicy : uint8_t {
+        REGION_DEFAULT = 0,
+        REGION_RELAXED,
+        REGION_TSO,
+        REGION_DEVICE
+    };
+    
+    struct Region {
+        uint32_t start;
+        uint64_t end; // Exclusive
+        RegionPolicy policy;
+    };
+    
+    // Set the policy of [start, start + size), replacing what overlapping
+    // regions said about it; REGION_DEFAULT removes them. Safe to call while
+    // compile threads and slow-path accesses read the table, but code
+    // translated before the call keeps the ordering it was generated with.
+    void set_region_policy(uint32_t start, uint64_t size, RegionPolicy policy);
+    
+    // Policy of the size bytes at guest_address: that of the region covering
+    // them, or the strongest one overlapping them when they straddle regions
+    // (uncovered bytes count as DEFAULT, which only RELAXED is weaker than)
+    RegionPolicy region_policy(uint32_t guest_address, uint32_t size = 1) const;
+    
+    // Regions in address order, adjacent ones with the same policy merged
+    std::vector<Region> get_regions() const;
+    
+    // Fences for an access completed by host code (the slow path) under
+    // policy: DEVICE accesses are fenced on both sides, TSO stores release
+    // and TSO loads acquire. Static accesses are ordered at translation
+    // time; these cover those whose address is only known at run time.
+    static void fence_before_access(RegionPolicy policy, bool is_store);
+    static void fence_after_access(RegionPolicy policy, bool is_store);
+    
+    // Barrier counts of order_memory_accesses, for barriers per kilo-instruction
+    struct BarrierStats {
+        uint64_t instructions = 0;     // IR instructions other than fences
+        uint64_t naive_barriers = 0;   // A barrier per guest fence and after every store
+        uint64_t emitted_barriers = 0; // Barriers left after elision
+        uint64_t ordered_accesses = 0; // Loads and stores lowered to acquire/release
+        uint64_t relaxed_accesses = 0; // Non-stack accesses a RELAXED region left unordered
+        uint64_t device_accesses = 0;  // Accesses to DEVICE regions
+    };
+    
+    // Lower the block's memory ordering: with tso, shared accesses are
+    // ordered against every later shared access, by DMB ISH after a store and
+    // DMB ISHLD after loads only (AArch64 lets later loads and stores pass a
+    // load, x86 does not); without, only the guest's own fences are kept.
+    // Barriers are placed lazily, just before the next shared access or block
+    // exit that needs them, so adjacent fences merge and fences with nothing
+    // to order are dropped. With an acquire/release lowering, shared loads
+    // and stores are marked ACQUIRE/RELEASE instead (TSO lets a store pass a
+    // later load, as RCpc does) and barriers remain only for guest fences,
+    // host calls and other instructions accessing shared memory.
+    // Accesses at absolute addresses follow the region table instead: those
+    // in RELAXED regions are treated as private, those in TSO regions as
+    // shared under tso, and loads and stores to DEVICE regions are marked
+    // IrMemoryOrder::DEVICE and order themselves like locked instructions.
+    // Safe to call from compile threads.
+    BarrierStats order_memory_accesses(std::vector<ir::IrInstruction>& instructions, bool tso,
+                                       OrderingLowering lowering = LOWERING_BARRIERS) const;
+    
+    // AArch64 encoding of the barrier a MEM_FENCE of this type lowers to
+    static uint32_t barrier_encoding(BarrierType barrier_type);
+    
 private:
+    // Region table, replaced (never modified) under regions_mutex_ so that
+    // readers can keep a snapshot without holding the lock
+    std::shared_ptr<const std::vector<Region>> regions_;
+    mutable std::mutex regions_mutex_;
+    std::atomic<bool> has_regions_{false};
+    std::shared_ptr<const std::vector<Region>> region_snapshot() const;
+    static RegionPolicy lookup_region_policy(const std::vector<Region>& regions, uint32_t guest_address, uint32_t size);
+    
     // Helper methods to emit specific ARM barriers
     static void emit_arm_dmb_ish(aarch64::CodeGenerator* code_gen);  // Data Memory Barrier
     static void emit_arm_dsb_ish(aarch64::CodeGenerator* code_gen);  // Data Sync Barrier
@@ -5,26 +5,11 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
-#include <map>
-#include <unordered_set>
+#include <cstdint>
 
 namespace xenoarm_jit {
 namespace register_allocation {
 
-// Structure to represent a register access in an instruction (Phase 8)
-struct RegisterAccess {
-    size_t inst_idx;      // Instruction index
-    size_t operand_idx;   // Operand index within the instruction
-};
-
-// Structure to represent the lifetime of a register (Phase 8)
-struct RegisterLifetime {
-    uint32_t start;       // First instruction where register is used
-    uint32_t end;         // Last instruction where register is used
-    uint32_t uses;        // Number of times the register is used
-    std::vector<RegisterAccess> accesses;  // List of all accesses to this register
-};
-
 // Represents a mapping from IR virtual register to AArch64 physical register
 // Define the types of physical registers
 enum class PhysicalRegisterType {
@@ -39,6 +24,43 @@ struct RegisterMapping {
     int gpr_physical_reg_idx;               // Physical GPR register number (if type is GPR)
     int neon_physical_reg_idx;              // Physical NEON register number (if type is NEON)
     int32_t stack_offset;                   // Offset from the stack pointer if spilled
+    bool is_pinned;                         // Statically pinned guest register (never spilled)
+};
+
+// Static guest register pinning.
+// When enabled, the x86 GPRs (vregs 0-7 in x86 encoding order EAX, ECX, EDX, EBX,
+// ESP, EBP, ESI, EDI) and EFLAGS live permanently in AArch64 callee-saved registers
+// across all translated blocks. Blocks expect the registers to hold guest state on
+// entry and only store/reload it around host calls, so chained blocks carry no
+// prologue/epilogue traffic. Loading it before the first block and storing it after
+// the last is left to the caller (CodeGenerator::generate_dispatcher_entry/exit emit
+// trampolines for this; Jit_ExecuteBlock does not use them yet).
+struct GuestRegisterPinning {
+    static constexpr uint32_t NUM_PINNED_GPRS = 8;   // EAX..EDI
+    static constexpr int FIRST_PINNED_GPR = 19;      // EAX..EDI -> X19..X26
+    static constexpr int GUEST_CONTEXT_REG = 27;     // X27 holds the guest context pointer
+    static constexpr int EFLAGS_REG = 28;            // X28 holds EFLAGS (see CodeGenerator::get_eflags_reg)
+    static constexpr uint32_t EFLAGS_CONTEXT_INDEX = 9; // EFLAGS slot in the guest context (JIT_REG_EFLAGS)
+
+    // Returns true if the virtual register is a pinned guest GPR
+    static bool is_pinned_vreg(uint32_t vreg_id) { return vreg_id < NUM_PINNED_GPRS; }
+
+    // Physical register holding a pinned guest GPR
+    static int physical_reg_for(uint32_t vreg_id) { return FIRST_PINNED_GPR + static_cast<int>(vreg_id); }
+
+    // Returns true if the physical GPR is reserved by the pinning scheme
+    static bool is_reserved_physical_reg(int reg) { return reg >= FIRST_PINNED_GPR && reg <= EFLAGS_REG; }
+};
+
+// Fastmem register convention.
+// Guest memory is a 4 GB host reservation; generated loads and stores address
+// it as [X18, Waddr, UXTW]. Blocks expect X18 to hold the base on entry (see
+// CodeGenerator::generate_dispatcher_entry), and the allocator never hands it
+// out while fastmem is enabled.
+struct FastmemRegisters {
+    static constexpr int BASE_REG = 18;    // Host address of guest address 0
+    static constexpr int ADDRESS_REG = 17; // Effective address scratch (IP1)
+    static constexpr int HOST_ADDRESS_REG = 16; // Host address of acquire/release accesses (IP0)
 };
 
 // Structure to represent the lifetime of a virtual register (Phase 8)
@@ -51,30 +73,104 @@ struct VRegLifetime {
     bool is_active;             // Whether this register is currently active in the allocation
     bool is_loop_register;      // Whether this register is used in a loop (Phase 8)
     bool is_x86_mapped;         // Whether this is a direct mapping of an x86 register
+    uint32_t loop_depth;        // Number of loops the lifetime overlaps
     float priority;             // Priority score for allocation (higher = more important) (Phase 8)
 };
 
+// Spill code produced by live-range splitting. A split vreg lives in a register
+// until a high-pressure point, in its stack slot across it, and is reloaded
+// (possibly into a different register) right before its next use.
+enum class SpillCodeType {
+    SPILL,  // Store the register to the stack slot
+    RELOAD  // Load the stack slot into the register; the vreg lives there from now on
+};
+
+// A backward branch to instruction q enters after q's spill code; the allocator
+// emits spill code before the branch that puts every value live at q back
+// where q's code expects it.
+struct SpillCode {
+    uint32_t inst_idx;              // Emitted immediately before this IR instruction
+    SpillCodeType type;             // Store or load
+    uint32_t vreg_id;               // Virtual register being moved
+    PhysicalRegisterType reg_type;  // GPR or NEON
+    int physical_reg_idx;           // Register stored from / loaded into
+    int32_t stack_offset;           // Offset of the stack slot from SP
+    ir::IrDataType data_type;       // Width of the transfer
+};
+
+// Spill traffic produced by the last allocation
+struct SpillStatistics {
+    uint32_t spill_count;           // Stores to stack slots
+    uint32_t reload_count;          // Loads from stack slots
+    uint32_t loop_spill_count;      // Stores placed inside a loop body
+    uint32_t loop_reload_count;     // Loads placed inside a loop body
+};
+
 // Class for managing spill locations (Phase 8)
+// Slots are assigned after allocation: values whose stack ranges do not overlap
+// share a slot (interval coloring within each size class), slots are naturally
+// aligned, and the most frequently accessed slots are packed into the first
+// cache line of the spill area.
 class SpillAllocator {
 public:
+    // Size of the cache line the hot slots are packed into
+    static constexpr uint32_t HOT_AREA_SIZE = 64;
+    
     SpillAllocator();
     
-    // Allocate a new spill slot for a register
-    int32_t allocate_spill_slot(uint32_t vreg_id, ir::IrDataType data_type);
+    // Register a value that needs a stack slot; returns a request ID
+    uint32_t add_spill_request(uint32_t vreg_id, ir::IrDataType data_type);
     
-    // Free a spill slot
-    void free_spill_slot(int32_t offset);
+    // Record an access to the slot at an instruction position. The slot is live
+    // between the first and last recorded position; weight measures how hot it is.
+    void record_access(uint32_t request_id, uint32_t position, uint32_t weight);
+    
+    // Color the requests into slots and lay out the frame
+    void assign_slots();
+    
+    // Offset of a request's slot from the stack pointer (valid after assign_slots)
+    int32_t get_slot_offset(uint32_t request_id) const;
     
     // Get the total size of spill area needed
     int32_t get_total_spill_size() const;
     
+    // Number of distinct slots after coloring
+    uint32_t get_slot_count() const { return static_cast<uint32_t>(slots_.size()); }
+    
     // Reset the spill allocator for a new function
     void reset();
     
+    // Size in bytes (and natural alignment) of a spill slot for a data type
+    static uint32_t get_slot_size(ir::IrDataType data_type);
+    
 private:
-    // Map from stack offset to size of the allocation
-    std::map<int32_t, uint32_t> allocated_slots_;
-    int32_t current_offset_;
+    struct SpillRequest {
+        uint32_t vreg_id;
+        uint32_t size;
+        uint32_t start;     // First position the slot holds this value
+        uint32_t end;       // Last position the slot holds this value
+        uint32_t weight;    // Access frequency estimate
+        uint32_t slot;      // Slot index after coloring
+    };
+    
+    struct SpillSlot {
+        uint32_t size;
+        uint32_t end;       // End of the last range colored into this slot
+        uint32_t weight;    // Sum of the weights of its requests
+        int32_t offset;     // Offset in the spill area
+    };
+    
+    // Requests in creation order
+    std::vector<SpillRequest> requests_;
+    
+    // Colored slots
+    std::vector<SpillSlot> slots_;
+    
+    // Scratch orderings reused between calls
+    std::vector<uint32_t> request_order_;
+    std::vector<uint32_t> slot_order_;
+    
+    int32_t total_size_;
 };
 
 class RegisterAllocator {
@@ -86,6 +182,14 @@ public:
     // Returns a mapping of IR virtual registers to AArch64 physical registers
     std::unordered_map<uint32_t, RegisterMapping> allocate(const std::vector<ir::IrInstruction>& ir_instructions);
 
+    // Performs register allocation without building a result map. All state lives in
+    // flat arrays reused across calls, so once they have grown to the largest block
+    // seen no further heap allocation takes place. Query results with get_mapping().
+    void allocate_in_place(const std::vector<ir::IrInstruction>& ir_instructions);
+
+    // Mapping for a virtual register from the last allocation (nullptr if unused)
+    const RegisterMapping* get_mapping(uint32_t vreg_id) const;
+
     // Sets up initial ARM registers for function prologue (Phase 8)
     void setup_function_prologue(const std::vector<ir::IrInstruction>& ir_instructions);
 
@@ -97,52 +201,144 @@ public:
     int32_t get_spill_offset(uint32_t vreg_id) const;
     int32_t get_total_spill_size() const;
 
+    // Loop nesting depth of an instruction in the last allocation
+    uint32_t get_loop_depth(uint32_t position) const {
+        return position < loop_depths_.size() ? loop_depths_[position] : 0;
+    }
+
+    // Spill/reload instructions required by the last allocation, sorted by position
+    const std::vector<SpillCode>& get_spill_code() const { return spill_code_; }
+    SpillStatistics get_spill_statistics() const { return spill_stats_; }
+
+    // Enable/disable live-range splitting. When disabled, a victim stays in its stack
+    // slot for its whole remaining lifetime and no spill code is produced.
+    void set_live_range_splitting(bool enabled) { live_range_splitting_ = enabled; }
+    bool is_live_range_splitting_enabled() const { return live_range_splitting_; }
+
+    // Enable/disable static guest register pinning across blocks
+    void set_guest_register_pinning(bool enabled);
+    bool is_guest_register_pinning_enabled() const { return pin_guest_registers_; }
+    
+    // Reserve the fastmem base register (must match the CodeGenerator setting)
+    void set_fastmem(bool enabled);
+    bool is_fastmem_enabled() const { return fastmem_; }
+
 private:
-    // Helper method to analyze register lifetimes (Phase 8)
-    void analyze_register_lifetimes(
-        const std::vector<ir::IrInstruction>& instructions,
-        std::map<uint32_t, RegisterLifetime>& register_lifetimes);
+    // Reset the free GPR/NEON bitmasks, honouring the pinning reservation
+    void reset_free_register_pools();
+    
+    // Build one live interval per virtual register in a single pass (Phase 8)
+    void compute_lifetimes(const std::vector<ir::IrInstruction>& ir_instructions);
+    
+    // Mark intervals overlapping a backward-branch region as loop registers (Phase 8)
+    void detect_loops(const std::vector<ir::IrInstruction>& ir_instructions);
+    
+    // Compute interval priorities based on usage patterns (Phase 8)
+    void compute_register_priorities();
+    
+    // Linear scan over intervals sorted by start point, spilling whole lifetimes (Phase 8)
+    void linear_scan_register_allocation();
+    
+    // Second-chance binpacking: walk instructions, splitting victims around
+    // high-pressure regions and reloading them before their next use
+    void split_linear_scan_register_allocation(const std::vector<ir::IrInstruction>& ir_instructions);
+    
+    // Build per-interval use positions and per-position loop/block information
+    void compute_split_positions(const std::vector<ir::IrInstruction>& ir_instructions);
+    
+    // Give an interval a register at position, evicting another interval if needed
+    int assign_split_register(uint32_t interval_idx, uint32_t position);
     
-    // Helper method to compute virtual register lifetimes (Phase 8)
-    std::vector<VRegLifetime> compute_lifetimes(const std::vector<ir::IrInstruction>& ir_instructions);
+    // Assign a register and record the home register or emit the reload
+    void place_split_interval(uint32_t interval_idx, uint32_t position);
     
-    // Helper method to compute register priorities based on usage patterns (Phase 8)
-    void compute_register_priorities(std::vector<VRegLifetime>& lifetimes);
+    // Drop an interval from its register (its value must be in its slot)
+    void release_split_interval(uint32_t interval_idx);
     
-    // Helper method to detect loops in the instruction stream (Phase 8)
-    void detect_loops(const std::vector<ir::IrInstruction>& ir_instructions, std::vector<VRegLifetime>& lifetimes);
+    // Move every value live at a loop header back to its location there
+    void resolve_back_edge(size_t loop, uint32_t position);
     
-    // Helper method to detect loops and identify hot registers (Phase 8 enhancement)
-    void detect_loops_and_hot_registers(
-        const std::vector<ir::IrInstruction>& instructions,
-        std::unordered_set<uint32_t>& loop_registers);
+    // Choose where to store an evicted interval: lowest loop depth after its last use,
+    // preferring block boundaries
+    uint32_t select_split_position(uint32_t interval_idx, uint32_t position) const;
     
-    // Linear scan register allocation implementation (Phase 8)
-    void linear_scan_register_allocation(const std::vector<VRegLifetime>& lifetimes);
+    // Next use of an interval at or after position (UINT32_MAX if none)
+    uint32_t next_use(uint32_t interval_idx, uint32_t position);
     
-    // Helper method to spill a register (Phase 8)
-    void spill_register(uint32_t vreg_id, ir::IrDataType data_type);
+    // Append a spill/reload and update statistics
+    void add_spill_code(uint32_t inst_idx, SpillCodeType type, uint32_t interval_idx, int reg);
     
-    // Helper method to choose a register to spill based on priority (Phase 8)
-    uint32_t select_register_to_spill(const std::vector<uint32_t>& candidates);
+    // Release registers of active intervals ending before position
+    void expire_old_intervals(std::vector<uint32_t>& active, uint64_t& free_mask, uint32_t position);
     
-    // Maps from virtual register ID to physical register mapping
-    std::unordered_map<uint32_t, RegisterMapping> register_mappings_;
+    // Insert an interval into an active list kept sorted by end point
+    void insert_active(std::vector<uint32_t>& active, uint32_t interval_idx);
     
-    // List of available physical GPR registers (initialized in constructor)
-    std::vector<uint32_t> free_gpr_registers_;
+    // Move an interval to a stack slot for the rest of its lifetime (Phase 8)
+    void spill_interval(uint32_t interval_idx, uint32_t position);
     
-    // List of available NEON registers (initialized in constructor)
-    std::vector<uint32_t> free_neon_registers_;
+    // Stack slot request for an interval, created on first spill
+    uint32_t get_spill_request(uint32_t interval_idx);
     
-    // List of active virtual registers during allocation
-    std::vector<uint32_t> active_registers_;
+    // Write the colored slot offsets back into mappings and spill code
+    void finalize_spill_slots();
+    
+    // One live interval per virtual register, in first-use order
+    std::vector<VRegLifetime> intervals_;
+    
+    // Mapping for each interval (same indexing as intervals_)
+    std::vector<RegisterMapping> mappings_;
+    
+    // Dense lookup from virtual register ID to interval index (-1 if unused)
+    std::vector<int32_t> vreg_to_interval_;
+    
+    // Interval indices sorted by start point
+    std::vector<uint32_t> sorted_intervals_;
+    
+    // Active GPR/NEON intervals, sorted by increasing end point
+    std::vector<uint32_t> active_gpr_;
+    std::vector<uint32_t> active_neon_;
+    
+    // Backward-branch regions (target, branch) found in the current block
+    std::vector<std::pair<uint32_t, uint32_t>> loops_;
+    
+    // (guest address, first IR index) of every decoded instruction, sorted
+    std::vector<std::pair<uint32_t, uint32_t>> address_indices_;
+    
+    // Whether a branch targets a later instruction of the block
+    bool forward_internal_branch_;
+    
+    // Live-range splitting state (indexed like intervals_ unless noted)
+    std::vector<uint32_t> use_offsets_;     // Start of each interval's range in use_positions_
+    std::vector<uint32_t> use_positions_;   // All use positions, grouped by interval, ascending
+    std::vector<uint32_t> use_cursors_;     // Next unvisited entry in use_positions_
+    std::vector<int32_t> current_regs_;     // Register currently holding the interval (-1 if none)
+    std::vector<uint32_t> lock_stamps_;     // Position + 1 at which the interval was last used
+    std::vector<uint32_t> loop_depths_;     // Loop depth per instruction position
+    std::vector<uint32_t> prev_shallower_;  // Latest earlier position with smaller loop depth
+    std::vector<uint32_t> prev_boundaries_; // Latest block boundary at or before each position
+    std::vector<uint32_t> relocated_at_;    // Back-edge that last moved the interval (stores go below it)
+    std::vector<int32_t> loop_entry_regs_;  // Per loop, per interval: register at the header
+    
+    std::vector<int32_t> spill_requests_;   // SpillAllocator request per interval (-1 if none)
+    
+    // Spill code and statistics from the last allocation
+    std::vector<SpillCode> spill_code_;
+    SpillStatistics spill_stats_;
+    bool live_range_splitting_;
+    
+    // Bit N set = physical register N is free
+    uint64_t free_gpr_mask_;
+    uint64_t free_neon_mask_;
     
     // Spill allocator for managing stack slots (Phase 8)
     SpillAllocator spill_allocator_;
     
-    // Map from vreg ID to its lifetime
-    std::unordered_map<uint32_t, VRegLifetime> lifetime_map_;
+    // Whether guest GPRs/EFLAGS are statically pinned to callee-saved registers
+    bool pin_guest_registers_;
+    
+    // Whether X18 holds the fastmem base
+    bool fastmem_;
 };
 
 } // namespace register_allocation
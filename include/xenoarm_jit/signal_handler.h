@@ -1,45 +1,80 @@
 #ifndef XENOARM_JIT_SIGNAL_HANDLER_H
 #define XENOARM_JIT_SIGNAL_HANDLER_H
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <mutex>
 #include <signal.h>
+#include <vector>
 
 namespace xenoarm_jit {
 
 // Forward declaration
 class MemoryManager;
 
-// Class for handling signals related to memory protection
+// Class for handling signals related to memory protection.
+// SIGSEGV is process-wide, so one handler is shared by every JIT context:
+// each context's MemoryManager registers itself, together with the host
+// address ranges that map its guest memory, and faults are dispatched to the
+// owner of the faulting address.
 class SignalHandler {
 public:
-    // Initialize the signal handler with a memory manager
+    static const size_t MAX_RANGES = 64;
+
+    // Register a memory manager for fault dispatch. The SIGSEGV handler is
+    // installed with the first registration.
     static bool initialize(MemoryManager* memory_manager);
-    
-    // Cleanup the signal handler
-    static void cleanup();
-    
+
+    // Unregister a memory manager and its ranges. The previous handler is
+    // restored when the last one goes away.
+    static void cleanup(MemoryManager* memory_manager);
+
+    // Route faults in [host_start, host_start + size) to memory_manager, as
+    // guest address guest_start + (fault - host_start)
+    static bool add_range(MemoryManager* memory_manager, uintptr_t host_start, size_t size, uint32_t guest_start);
+
     // Get the instance of the signal handler
     static SignalHandler* get_instance();
-    
+
+    // Find the memory manager owning a host fault address
+    MemoryManager* find_owner(uintptr_t fault_address, uint32_t* guest_address) const;
+
     // Called by the signal handler to handle memory access faults
     void handle_segv(int signum, siginfo_t* info, void* context);
-    
+
 private:
     // Private constructor - use initialize() instead
-    SignalHandler(MemoryManager* memory_manager);
+    SignalHandler();
     ~SignalHandler();
-    
+
+    struct FaultRange {
+        std::atomic<MemoryManager*> owner; // nullptr = free slot
+        uintptr_t host_start;
+        size_t size;
+        uint32_t guest_start;
+    };
+
     // Previous signal handlers
     struct sigaction prev_segv_action_;
-    
-    // Memory manager reference
-    MemoryManager* memory_manager_;
-    
-    // Singleton instance
-    static SignalHandler* instance_;
+
+    // Registered host ranges, read lock-free from the signal handler
+    FaultRange ranges_[MAX_RANGES];
+
+    // Registered memory managers. A lone manager without ranges receives
+    // every fault, with the fault address taken as a guest address
+    // (single-context setups that do not describe their host mapping).
+    std::vector<MemoryManager*> managers_;
+    std::atomic<MemoryManager*> sole_manager_;
+
+    void update_sole_manager_locked();
+
+    // Singleton instance and registration lock
+    static std::atomic<SignalHandler*> instance_;
+    static std::mutex registry_mutex_;
 };
 
 } // namespace xenoarm_jit
 
-#endif // XENOARM_JIT_SIGNAL_HANDLER_H 
\ No newline at end of file
+#endif // XENOARM_JIT_SIGNAL_HANDLER_H
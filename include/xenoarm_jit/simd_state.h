@@ -13,10 +13,6 @@ namespace tests {
 
 namespace simd {
 
-// FPU control and status word - accessible to other modules
-extern uint16_t fpu_status_word;
-extern uint16_t fpu_control_word;
-
 // Structure to hold a register value (XMM, MMX, or FPU)
 struct RegisterValue {
     uint8_t data[16]; // 128 bits for XMM registers (MMX and FPU use fewer bits)
@@ -0,0 +1,68 @@
+#ifndef XENOARM_JIT_TRANSLATION_CACHE_EPOCH_RECLAIMER_H
+#define XENOARM_JIT_TRANSLATION_CACHE_EPOCH_RECLAIMER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace xenoarm_jit {
+namespace translation_cache {
+
+// Quiescent-state-based reclamation (QSBR) for objects unlinked from a
+// lock-free structure.
+//
+// Reader threads register once and call quiescent_state() at points where
+// they hold no pointers obtained from the structure (e.g. between dispatches).
+// A retired object is freed only after every registered thread has passed
+// such a point since the object was retired. Threads that never register are
+// assumed to hold no references between calls into the structure.
+//
+// register_thread/unregister_thread/quiescent_state may be called from any
+// thread. retire/reclaim must be serialised by the caller (the owning
+// structure's writer lock).
+class EpochReclaimer {
+public:
+    static const size_t MAX_THREADS = 64;
+
+    EpochReclaimer();
+    ~EpochReclaimer(); // Frees everything still retired
+
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    // Reader thread management
+    bool register_thread();     // False if the thread table is full
+    void unregister_thread();
+    bool is_thread_registered() const;
+    void quiescent_state();
+
+    // Writer side
+    void retire(void* object, void (*deleter)(void*));
+    size_t reclaim();           // Returns the number of objects freed
+    size_t get_pending_count() const { return retired_.size(); }
+
+private:
+    struct alignas(64) ThreadRecord {
+        std::atomic<bool> in_use{false};
+        std::atomic<uint64_t> epoch{0}; // Last observed global epoch, 0 = offline
+    };
+
+    struct RetiredObject {
+        void* object;
+        void (*deleter)(void*);
+        uint64_t epoch;
+    };
+
+    int find_thread_slot() const;
+
+    const uint64_t id_; // Distinguishes reclaimers in thread-local registrations
+    std::atomic<uint64_t> global_epoch_;
+    ThreadRecord threads_[MAX_THREADS];
+    std::vector<RetiredObject> retired_;
+};
+
+} // namespace translation_cache
+} // namespace xenoarm_jit
+
+#endif // XENOARM_JIT_TRANSLATION_CACHE_EPOCH_RECLAIMER_H
@@ -0,0 +1,81 @@
+#ifndef XENOARM_JIT_TRANSLATION_CACHE_PERF_MAP_WRITER_H
+#define XENOARM_JIT_TRANSLATION_CACHE_PERF_MAP_WRITER_H
+
+#include "xenoarm_jit/translation_cache/translation_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace xenoarm_jit {
+namespace translation_cache {
+
+// Describes translated blocks to Linux perf, so time in generated code is
+// attributed to guest code instead of [unknown].
+//
+// Two outputs, each optional:
+//   - perf map (/tmp/perf-<pid>.map): a "start size name" line per block,
+//     read by perf report for any process
+//   - jitdump (<dir>/jit-<pid>.dump): a code load record per block carrying
+//     its code bytes, preceded by a debug info record mapping host PCs to
+//     guest EIPs (reported as line numbers of the file "guest"). perf inject
+//     --jit turns it into per-block ELF images, so perf annotate can show
+//     the generated code against the guest instructions it came from.
+//
+// Records are appended to per-output buffers and written out in large
+// chunks (when a buffer fills, on flush() and on destruction), so writing a
+// block costs a few memcpys. Not thread-safe: TranslationCache calls it
+// under its writer lock.
+class PerfMapWriter {
+public:
+    // ELF machine of the code described (EM_AARCH64)
+    static constexpr uint32_t ELF_MACHINE = 183;
+    static constexpr size_t BUFFER_SIZE = 256 * 1024;
+
+    // Default output paths for this process
+    static std::string default_perf_map_path();
+    static std::string default_jitdump_path(const std::string& directory = "/tmp");
+
+    // Empty paths disable the corresponding output
+    PerfMapWriter(const std::string& perf_map_path, const std::string& jitdump_path);
+    ~PerfMapWriter();
+
+    // Create the outputs. The jitdump file is mapped executable once, which
+    // is how perf record finds it. Returns false if an output could not be
+    // created (the others are still written).
+    bool open();
+
+    // Describe a block published with its code at code_ptr
+    void write_block(const TranslatedBlock* block);
+
+    // Write buffered records out to the files
+    void flush();
+
+    uint64_t get_blocks_written() const { return blocks_written_; }
+
+private:
+    struct Output {
+        std::string path;
+        int fd = -1;
+        std::vector<uint8_t> buffer;
+
+        void append(const void* data, size_t size);
+        void flush();
+    };
+
+    Output perf_map_;
+    Output jitdump_;
+    void* jitdump_marker_; // Executable mapping of the jitdump file
+    uint64_t code_index_;
+    uint64_t blocks_written_;
+
+    void write_perf_map_entry(const TranslatedBlock* block, const std::string& name);
+    void write_jitdump_records(const TranslatedBlock* block, const std::string& name);
+    void close();
+};
+
+} // namespace translation_cache
+} // namespace xenoarm_jit
+
+#endif // XENOARM_JIT_TRANSLATION_CACHE_PERF_MAP_WRITER_H
@@ -0,0 +1,87 @@
+#ifndef XENOARM_JIT_TRANSLATION_CACHE_PERSISTENT_CODE_CACHE_H
+#define XENOARM_JIT_TRANSLATION_CACHE_PERSISTENT_CODE_CACHE_H
+
+#include "xenoarm_jit/translation_cache/translation_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace xenoarm_jit {
+namespace translation_cache {
+
+// One translation read back from a cache file. Relocation targets are
+// already resolved for the current process image.
+struct PersistentBlock {
+    uint64_t guest_address;
+    uint32_t guest_size;
+    uint64_t guest_hash;
+    CompilationTier tier;
+    std::vector<std::pair<uint64_t, uint32_t>> superblock_ranges;
+    std::vector<uint64_t> static_successors;
+    std::vector<TranslatedBlock::ControlFlowExit> exits;
+    std::vector<CodeRelocation> relocations;
+    std::vector<FastmemSite> fastmem_sites;
+    const uint8_t* code; // Points into the mapped file
+    size_t code_size;
+};
+
+// Translated blocks saved to disk so the next launch of a title can skip
+// translation (warm start).
+//
+// The file is versioned and tagged with a key for the translation-relevant
+// configuration; a file that does not match is ignored. It is mapped
+// read-only and only its index is parsed on open: each record is decoded on
+// find(), and the caller checks the record's guest hash against current guest
+// memory before executing it. Host call targets are stored relative to the
+// base of the image containing this library, so they survive ASLR.
+// Not thread-safe for save() concurrent with find(); find() is safe to call
+// from several threads once open() has returned.
+class PersistentCodeCache {
+public:
+    static const uint32_t FORMAT_VERSION = 2;
+
+    PersistentCodeCache(const std::string& path, uint64_t config_key);
+    ~PersistentCodeCache();
+
+    // Map and index the file. Returns false if it is missing, unreadable or
+    // was written by an incompatible version or configuration.
+    bool open();
+
+    // Decode the record for guest_address, if the file has one
+    bool find(uint64_t guest_address, PersistentBlock* block) const;
+
+    // Guest addresses of every record in the mapped file
+    std::vector<uint64_t> get_addresses() const;
+    size_t get_entry_count() const { return index_.size(); }
+
+    // Write blocks to the file, keeping mapped records that blocks does not
+    // supersede. The file is replaced atomically. Blocks with patched
+    // (chained) exits or host call targets outside this image are skipped.
+    // Returns the number of records written, or -1 on I/O failure.
+    long save(const std::vector<const TranslatedBlock*>& blocks);
+
+private:
+    std::string path_;
+    uint64_t config_key_;
+
+    // Read-only mapping of the file opened by open()
+    const uint8_t* mapping_;
+    size_t mapping_size_;
+
+    // Guest address -> record offset in the mapping
+    std::unordered_map<uint64_t, uint64_t> index_;
+
+    // Size in bytes of the well-formed record at offset, or 0
+    size_t record_size(uint64_t offset) const;
+
+    void unmap();
+};
+
+} // namespace translation_cache
+} // namespace xenoarm_jit
+
+#endif // XENOARM_JIT_TRANSLATION_CACHE_PERSISTENT_CODE_CACHE_H
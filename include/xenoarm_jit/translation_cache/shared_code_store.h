@@ -0,0 +1,74 @@
+#ifndef XENOARM_JIT_TRANSLATION_CACHE_SHARED_CODE_STORE_H
+#define XENOARM_JIT_TRANSLATION_CACHE_SHARED_CODE_STORE_H
+
+#include "xenoarm_jit/translation_cache/translation_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace xenoarm_jit {
+namespace translation_cache {
+
+// Immutable translation shared between contexts. Contexts hold it through
+// TranslatedBlock::shared_code; it is freed with the last reference.
+struct SharedCode {
+    uint64_t key;
+    uint64_t guest_address;
+    uint32_t guest_size;
+    CompilationTier tier;
+    std::vector<std::pair<uint64_t, uint32_t>> superblock_ranges;
+    std::vector<uint64_t> static_successors;
+    std::vector<CodeRelocation> relocations;
+    std::vector<FastmemSite> fastmem_sites;
+    uint64_t guest_hash;
+    std::vector<uint8_t> code;
+};
+
+struct SharedCodeStats {
+    size_t entries;    // Live shared translations
+    size_t code_bytes; // Host code held by live entries
+    uint64_t hits;     // Translations served from the store
+    uint64_t misses;   // Translations compiled and published
+};
+
+// Content-addressed store of translations, keyed by a hash of the guest
+// bytes a block covers plus everything else its code depends on (guest
+// address, tier, translation-relevant configuration). Contexts running the
+// same title look up before compiling and publish what they compile, so
+// identical code is translated and resident once. Thread-safe.
+class SharedCodeStore {
+public:
+    SharedCodeStore();
+    ~SharedCodeStore();
+
+    // Incremental 64-bit FNV-1a over guest bytes and key material
+    static uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL);
+
+    // Returns the live translation for key, or nullptr
+    std::shared_ptr<const SharedCode> acquire(uint64_t key);
+
+    // Publish a freshly compiled translation. If another context published
+    // the same key first, that entry is returned instead.
+    std::shared_ptr<const SharedCode> publish(std::shared_ptr<SharedCode> code);
+
+    SharedCodeStats get_stats();
+
+private:
+    // Entries are weak so resident code follows the contexts that map it
+    std::unordered_map<uint64_t, std::weak_ptr<const SharedCode>> entries_;
+    std::mutex mutex_;
+    uint64_t hits_;
+    uint64_t misses_;
+
+    void prune_locked();
+};
+
+} // namespace translation_cache
+} // namespace xenoarm_jit
+
+#endif // XENOARM_JIT_TRANSLATION_CACHE_SHARED_CODE_STORE_H
@@ -1,17 +1,56 @@
 #ifndef XENOARM_JIT_TRANSLATION_CACHE_TRANSLATION_CACHE_H
 #define XENOARM_JIT_TRANSLATION_CACHE_TRANSLATION_CACHE_H
 
+#include "xenoarm_jit/translation_cache/epoch_reclaimer.h"
+
+#include <atomic>
 #include <cstdint>
-#include <unordered_map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <set>
 #include <functional>
+#include <utility>
 
 namespace xenoarm_jit {
 namespace translation_cache {
 
 // Forward declarations
 class CodeGenerator;
+struct SharedCode;
+class PerfMapWriter;
+
+// Compilation tier of a translated block (tiered compilation)
+enum class CompilationTier : uint8_t {
+    TIER0, // Baseline: template translation, no IR passes, trivial allocation
+    TIER1  // Optimised: superblock formation, IR passes, full allocation
+};
+
+// Absolute host address embedded in generated code. Recorded so the code can
+// be moved to another process image (persistent translation cache).
+struct CodeRelocation {
+    enum class Kind : uint32_t {
+        HOST_CALL_ABS64 // MOVZ/MOVK X16 sequence materialising a host function address
+    };
+    Kind kind;
+    uint32_t offset; // Byte offset of the first instruction of the sequence
+    uint64_t target; // Host address currently encoded
+};
+
+// Fastmem load/store in generated code and its out-of-line slow-path thunk.
+// The first fault at the access rewrites it into a branch to the thunk, which
+// performs the access through MemoryManager and branches back after it.
+struct FastmemSite {
+    uint32_t access_offset; // Byte offset of the LDR/STR
+    uint32_t thunk_offset;  // Byte offset of the thunk
+};
+
+// Start of the host code of a guest instruction: the code from host_offset
+// up to the next entry's was translated from the instruction at guest_address
+struct SourceMapEntry {
+    uint32_t host_offset;
+    uint32_t guest_address;
+};
 
 // Represents a block of translated AArch64 code
 struct TranslatedBlock {
@@ -21,6 +60,51 @@ struct TranslatedBlock {
     void* code_ptr;         // Executable pointer to the code (after copying to executable memory)
     bool is_linked;         // Whether this block is linked to other blocks
 
+    // Tiered compilation state
+    CompilationTier tier;      // Tier this block was compiled at
+    uint32_t execution_count;  // Dispatch count, only maintained for tier-0 blocks
+    bool tier_up_pending;      // Queued for tier-1 re-translation
+
+    // Additional guest ranges folded into this block by superblock formation
+    // (guest_address/guest_size describe the entry range)
+    std::vector<std::pair<uint64_t, uint32_t>> superblock_ranges;
+
+    // Direct branch/call targets and fallthrough address known at decode time
+    std::vector<uint64_t> static_successors;
+
+    // Speculative pre-translation state
+    uint32_t speculation_depth; // 0 for blocks translated on demand
+    bool speculative_unused;    // Speculatively translated and not executed yet
+
+    // Absolute host addresses in the code
+    std::vector<CodeRelocation> relocations;
+
+    // Fastmem accesses, sorted by access_offset, and how many of them have
+    // been backpatched into their thunk (updated from the SIGSEGV handler)
+    std::vector<FastmemSite> fastmem_sites;
+    std::atomic<uint32_t> fastmem_backpatches;
+
+    // Host offset -> guest instruction, for profilers (empty for shared and
+    // persisted blocks)
+    std::vector<SourceMapEntry> source_map;
+
+    // Hash of the guest bytes the block was translated from, in range order
+    // (SharedCodeStore::hash_bytes). Blocks loaded from a persistent cache
+    // without checking guest memory have needs_validation set until their
+    // first execution.
+    uint64_t guest_hash;
+    bool needs_validation;
+
+    // Translated from a page in self-verifying SMC mode: guest_hash is
+    // checked on every dispatch, and the block is never chained into
+    bool self_verifying;
+
+    // Code mapped from a SharedCodeStore instead of owned in `code`. Shared
+    // code is immutable, so such blocks are never patched for chaining, and
+    // their fastmem faults are completed by the fault handler rather than
+    // backpatched (their sites are not indexed).
+    std::shared_ptr<const SharedCode> shared_code;
+
     // Define the types of control flow exits from a translated block
     enum class ControlFlowExitType {
         UNKNOWN,
@@ -49,16 +133,37 @@ struct TranslatedBlock {
     
     // Constructor
     TranslatedBlock(uint64_t addr, uint32_t size) 
-        : guest_address(addr), guest_size(size), code_ptr(nullptr), is_linked(false) {}
+        : guest_address(addr), guest_size(size), code_ptr(nullptr), is_linked(false),
+          tier(CompilationTier::TIER0), execution_count(0), tier_up_pending(false),
+          speculation_depth(0), speculative_unused(false),
+          fastmem_backpatches(0), guest_hash(0), needs_validation(false), self_verifying(false) {}
+
+    // Whether any guest range covered by this block overlaps [start, end]
+    bool overlaps(uint64_t start, uint64_t end) const;
+
+    // Size of the host code, owned or shared
+    size_t code_size() const;
+
+    // Fastmem site whose access instruction is at host_pc, or nullptr
+    const FastmemSite* find_fastmem_site(uintptr_t host_pc) const;
 };
 
+// Guest address -> translated block map.
+//
+// lookup() is lock-free and may run on any thread concurrently with writers.
+// All mutating operations are serialised by an internal writer lock. Blocks
+// removed from the cache are retired rather than deleted, and freed once
+// every registered reader thread has passed a quiescent state, so a block
+// returned by lookup() stays valid until the caller's next quiescent_state().
+// Fields of a block other than code_ptr/code (links, exits, counters) are
+// writer-side state and must only be touched by the thread driving the cache.
 class TranslationCache {
 public:
     TranslationCache();
     ~TranslationCache();
 
     // Looks up a translated block by guest address
-    TranslatedBlock* lookup(uint64_t guest_address);
+    TranslatedBlock* lookup(uint64_t guest_address) const;
 
     // Stores a translated block
     void store(TranslatedBlock* block);
@@ -66,22 +171,116 @@ public:
     // Chain blocks wherever possible
     void chain_blocks(TranslatedBlock* block, std::function<void(TranslatedBlock*, TranslatedBlock*, const TranslatedBlock::ControlFlowExit&)> patch_callback);
     
+    // Replace the block at new_block->guest_address with new_block (tier-up).
+    // Incoming links of the old block are re-patched to the new block through
+    // patch_callback, and the old block is retired. Returns false if there
+    // was no block to replace (new_block is then stored normally).
+    bool replace_block(TranslatedBlock* new_block, std::function<void(TranslatedBlock*, TranslatedBlock*, const TranslatedBlock::ControlFlowExit&)> patch_callback);
+    
     // Invalidate a single block
     void invalidate(uint64_t guest_address);
     
     // Invalidate a range of addresses
     void invalidate_range(uint64_t start_address, uint64_t end_address);
     
+    // Called with each block just before invalidate() retires it
+    void set_invalidation_callback(std::function<void(const TranslatedBlock*)> callback) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        invalidation_callback_ = std::move(callback);
+    }
+    
+    // Describe every block published from now on (store, replace_block) to
+    // perf through writer; nullptr stops. The writer is used under the
+    // writer lock and must outlive the cache or be detached first.
+    void set_perf_map_writer(PerfMapWriter* writer) {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        perf_map_writer_ = writer;
+    }
+    
+    // Reader threads executing translated code (see EpochReclaimer)
+    bool register_reader_thread() { return reclaimer_.register_thread(); }
+    void unregister_reader_thread() { reclaimer_.unregister_thread(); }
+    void quiescent_state() { reclaimer_.quiescent_state(); }
+    
+    // Free retired blocks no registered reader can still reference
+    size_t reclaim();
+    
+    // Published block with a fastmem access at host_pc (see FastmemSite), or
+    // nullptr (always for shared code). Lock-free and async-signal-safe: meant for the SIGSEGV handler
+    // of the thread running that code.
+    TranslatedBlock* lookup_fastmem_site(uintptr_t host_pc) const;
+    
+    // Call fn with every block in the cache, under the writer lock
+    void for_each_block(const std::function<void(const TranslatedBlock*)>& fn) const;
+    
     // Get statistics
-    size_t get_block_count() const { return cache_.size(); }
+    size_t get_block_count() const { return block_count_.load(std::memory_order_relaxed); }
     size_t get_chained_block_count() const;
+    size_t get_retired_block_count() const;
     
     // Flush the entire cache
     void flush();
 
 private:
-    // Map from guest address to translated block
-    std::unordered_map<uint64_t, TranslatedBlock*> cache_;
+    // Open-addressed table, linear probing. A key is never cleared once
+    // written: removal nulls the block so concurrent probes stay intact, and
+    // dead keys are dropped when the table is rebuilt on growth.
+    struct Slot {
+        std::atomic<uint64_t> key;
+        std::atomic<TranslatedBlock*> block;
+    };
+    struct Table {
+        explicit Table(size_t capacity);
+        size_t mask;
+        size_t used; // Slots with a key written (writer-only)
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    static const uint64_t EMPTY_KEY = ~0ULL;
+    static const size_t INITIAL_CAPACITY = 1024;
+
+    static size_t slot_index(uint64_t guest_address, size_t mask) {
+        return static_cast<size_t>((guest_address * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    }
+
+    // Lock-free probe (acquire loads); nullptr if key is absent
+    static TranslatedBlock* probe(const Table* table, uint64_t key);
+    static Slot* find_slot(const Table* table, uint64_t key);
+    // Add an absent key, growing the table first if live entries fill it
+    void insert_locked(std::atomic<Table*>& table, size_t live, uint64_t key, TranslatedBlock* block);
+    void grow_locked(std::atomic<Table*>& table, size_t live);
+
+    Slot* find_slot_locked(uint64_t guest_address) const;
+    TranslatedBlock* lookup_locked(uint64_t guest_address) const;
+    void publish_locked(TranslatedBlock* block);
+    void invalidate_locked(uint64_t guest_address);
+    void retire_block_locked(TranslatedBlock* block);
+
+    template <typename Fn>
+    void for_each_block_locked(Fn fn) const {
+        const Table* table = table_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i <= table->mask; ++i) {
+            TranslatedBlock* block = table->slots[i].block.load(std::memory_order_relaxed);
+            if (block) {
+                fn(block);
+            }
+        }
+    }
+
+    std::atomic<Table*> table_;
+    std::atomic<size_t> block_count_;
+    mutable std::mutex writer_mutex_;
+    EpochReclaimer reclaimer_;
+    
+    std::function<void(const TranslatedBlock*)> invalidation_callback_;
+    PerfMapWriter* perf_map_writer_ = nullptr;
+    
+    // Host address of each fastmem access -> block, for published blocks.
+    // Same table layout as table_, so the fault handler can probe it.
+    std::atomic<Table*> fastmem_table_;
+    size_t fastmem_site_count_; // Live entries (writer-only)
+    void index_fastmem_sites_locked(TranslatedBlock* block);
+    void unindex_fastmem_sites_locked(TranslatedBlock* block);
     
     // Break links to and from a specific block
     void unchain_block(TranslatedBlock* block);
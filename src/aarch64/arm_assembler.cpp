@@ -9,8 +9,6 @@ namespace xenoarm_jit {
 namespace aarch64 {
 
 // Class static members
-std::unordered_set<int> ArmAssembler::used_registers_;
-std::unordered_map<std::string, int> ArmAssembler::named_registers_;
 std::vector<std::string> ArmAssembler::register_names_ = {
     "x0", "x1", "x2", "x3", "x4", "x5", "x6", "x7",
     "x8", "x9", "x10", "x11", "x12", "x13", "x14", "x15",
@@ -5,12 +5,18 @@
 #include <vector> // Include vector for emit_instruction
 #include <unordered_map> // Include for unordered_map
 #include "xenoarm_jit/register_allocation/register_allocator.h" // Include for RegisterMapping
+#include "xenoarm_jit/memory_manager.h" // Include for the guest memory slow path
+#include <algorithm>
 #include <cstring>
 
 namespace xenoarm_jit {
 namespace aarch64 {
 
-CodeGenerator::CodeGenerator() {
+CodeGenerator::CodeGenerator()
+    : pin_guest_registers_(false), fastmem_(false),
+      ordering_lowering_(MemoryModel::LOWERING_BARRIERS), lse_atomics_(false),
+      slow_path_read_(&MemoryManager::generated_code_read),
+      slow_path_write_(&MemoryManager::generated_code_write) {
     LOG_DEBUG("AArch64 CodeGenerator created.");
     // TODO: Initialize EFLAGS state location (e.g., allocate a dedicated register or memory)
 }
@@ -51,17 +57,732 @@ uint32_t CodeGenerator::get_eflags_reg() const {
     return 28; // Example: Use X28/W28 for EFLAGS
 }
 
+// Pinned guest state lives in the guest context as 32-bit slots indexed like JIT_REG_*
+// (EAX..EDI at 0..28, EFLAGS at 36), addressed relative to X27.
+void CodeGenerator::emit_load_pinned_guest_state(std::vector<uint8_t>& code) {
+    using register_allocation::GuestRegisterPinning;
+    const uint32_t ctx = GuestRegisterPinning::GUEST_CONTEXT_REG;
+    
+    // LDP Wt1, Wt2, [X27, #off]: 0x29400000 | (imm7 << 15) | (Rt2 << 10) | (Rn << 5) | Rt
+    for (uint32_t vreg = 0; vreg < GuestRegisterPinning::NUM_PINNED_GPRS; vreg += 2) {
+        uint32_t rt = GuestRegisterPinning::physical_reg_for(vreg);
+        uint32_t imm7 = vreg; // (vreg * 4) / 4
+        emit_instruction(code, 0x29400000 | (imm7 << 15) | ((rt + 1) << 10) | (ctx << 5) | rt);
+    }
+    
+    // LDR W28, [X27, #36]: 0xB9400000 | (imm12 << 10) | (Rn << 5) | Rt
+    emit_instruction(code, 0xB9400000 | (GuestRegisterPinning::EFLAGS_CONTEXT_INDEX << 10) | (ctx << 5) | get_eflags_reg());
+}
+
+void CodeGenerator::emit_store_pinned_guest_state(std::vector<uint8_t>& code) {
+    using register_allocation::GuestRegisterPinning;
+    const uint32_t ctx = GuestRegisterPinning::GUEST_CONTEXT_REG;
+    
+    // STP Wt1, Wt2, [X27, #off]: 0x29000000 | (imm7 << 15) | (Rt2 << 10) | (Rn << 5) | Rt
+    for (uint32_t vreg = 0; vreg < GuestRegisterPinning::NUM_PINNED_GPRS; vreg += 2) {
+        uint32_t rt = GuestRegisterPinning::physical_reg_for(vreg);
+        uint32_t imm7 = vreg;
+        emit_instruction(code, 0x29000000 | (imm7 << 15) | ((rt + 1) << 10) | (ctx << 5) | rt);
+    }
+    
+    // STR W28, [X27, #36]: 0xB9000000 | (imm12 << 10) | (Rn << 5) | Rt
+    emit_instruction(code, 0xB9000000 | (GuestRegisterPinning::EFLAGS_CONTEXT_INDEX << 10) | (ctx << 5) | get_eflags_reg());
+}
+
+void CodeGenerator::emit_host_call(std::vector<uint8_t>& code, uint64_t target) {
+    // The host may inspect or modify guest state through the context, so it must be
+    // in memory for the duration of the call. X27 itself is callee-saved.
+    if (pin_guest_registers_) {
+        emit_store_pinned_guest_state(code);
+    }
+    
+    // MOVZ X16, #imm16 / MOVK X16, #imm16, LSL #16/#32/#48. Always all four
+    // halves, so the sequence can be re-encoded in place for another target.
+    translation_cache::CodeRelocation relocation;
+    relocation.kind = translation_cache::CodeRelocation::Kind::HOST_CALL_ABS64;
+    relocation.offset = static_cast<uint32_t>(code.size());
+    relocation.target = target;
+    relocations_.push_back(relocation);
+    
+    code.resize(code.size() + 16);
+    apply_relocation(code.data(), relocation, target);
+    
+    // BLR X16
+    emit_instruction(code, 0xD63F0000 | (16 << 5));
+    
+    if (pin_guest_registers_) {
+        emit_load_pinned_guest_state(code);
+    }
+}
+
+void CodeGenerator::apply_relocation(uint8_t* code, const translation_cache::CodeRelocation& relocation, uint64_t target) {
+    // HOST_CALL_ABS64: MOVZ X16 then MOVK X16 for each remaining halfword
+    uint8_t* sequence = code + relocation.offset;
+    for (uint32_t hw = 0; hw < 4; hw++) {
+        uint32_t imm16 = static_cast<uint32_t>((target >> (hw * 16)) & 0xFFFF);
+        uint32_t instruction = (hw == 0 ? 0xD2800000 : 0xF2800000) | (hw << 21) | (imm16 << 5) | 16;
+        for (uint32_t byte = 0; byte < 4; byte++) {
+            sequence[hw * 4 + byte] = static_cast<uint8_t>((instruction >> (byte * 8)) & 0xFF);
+        }
+    }
+}
+
+// Bytes accessed by a guest load/store of the given value type
+static uint32_t memory_access_size(ir::IrDataType data_type) {
+    switch (data_type) {
+        case ir::IrDataType::I8:
+        case ir::IrDataType::U8:
+            return 1;
+        case ir::IrDataType::I16:
+        case ir::IrDataType::U16:
+            return 2;
+        case ir::IrDataType::I64:
+        case ir::IrDataType::U64:
+        case ir::IrDataType::PTR:
+            return 8;
+        default:
+            return 4;
+    }
+}
+
+uint32_t CodeGenerator::emit_effective_address(
+    std::vector<uint8_t>& code, const ir::MemoryOperand& mem,
+    const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map,
+    bool to_scratch) {
+    const uint32_t scratch = register_allocation::FastmemRegisters::ADDRESS_REG;
+    const bool has_base = mem.base_reg_idx != ir::MemoryOperand::NO_REGISTER;
+    const bool has_index = mem.index_reg_idx != ir::MemoryOperand::NO_REGISTER;
+    const int64_t disp = mem.displacement;
+    uint32_t address_reg = scratch;
+    
+    if (has_base) {
+        uint32_t base_reg = get_physical_reg(mem.base_reg_idx, register_map);
+        if (disp == 0) {
+            address_reg = base_reg;
+        } else if (disp > 0 && disp < 0x1000) {
+            // ADD W17, Wbase, #disp: 0x11000000 | (imm12 << 10) | (Rn << 5) | Rd
+            emit_instruction(code, 0x11000000 | (static_cast<uint32_t>(disp) << 10) | (base_reg << 5) | scratch);
+        } else if (disp < 0 && -disp < 0x1000) {
+            // SUB W17, Wbase, #-disp: 0x51000000 | (imm12 << 10) | (Rn << 5) | Rd
+            emit_instruction(code, 0x51000000 | (static_cast<uint32_t>(-disp) << 10) | (base_reg << 5) | scratch);
+        } else {
+            // MOVZ/MOVK W17, #disp then ADD W17, W17, Wbase
+            uint32_t value = static_cast<uint32_t>(mem.displacement);
+            emit_instruction(code, 0x52800000 | ((value & 0xFFFF) << 5) | scratch);
+            emit_instruction(code, 0x72A00000 | ((value >> 16) << 5) | scratch);
+            emit_instruction(code, 0x0B000000 | (base_reg << 16) | (scratch << 5) | scratch);
+        }
+    } else {
+        // Absolute address: MOVZ W17, #lo / MOVK W17, #hi, LSL #16
+        uint32_t value = static_cast<uint32_t>(mem.displacement);
+        emit_instruction(code, 0x52800000 | ((value & 0xFFFF) << 5) | scratch);
+        if (value >> 16) {
+            emit_instruction(code, 0x72A00000 | ((value >> 16) << 5) | scratch);
+        }
+    }
+    
+    if (has_index) {
+        uint32_t shift = 0;
+        switch (mem.scale) {
+            case 1: shift = 0; break;
+            case 2: shift = 1; break;
+            case 4: shift = 2; break;
+            case 8: shift = 3; break;
+            default:
+                LOG_ERROR("Unsupported memory operand scale " + std::to_string(mem.scale));
+                break;
+        }
+        // ADD W17, Wn, Windex, LSL #shift: 0x0B000000 | (Rm << 16) | (imm6 << 10) | (Rn << 5) | Rd
+        uint32_t index_reg = get_physical_reg(mem.index_reg_idx, register_map);
+        emit_instruction(code, 0x0B000000 | (index_reg << 16) | (shift << 10) | (address_reg << 5) | scratch);
+        address_reg = scratch;
+    }
+    
+    if (to_scratch && address_reg != scratch) {
+        // MOV W17, Wn (ORR W17, WZR, Wn)
+        emit_instruction(code, 0x2A0003E0 | (address_reg << 16) | scratch);
+        address_reg = scratch;
+    }
+    return address_reg;
+}
+
+void CodeGenerator::emit_slow_path_access(std::vector<uint8_t>& code, bool is_load, uint32_t size, uint32_t value_reg,
+                                          ir::IrMemoryOrder memory_order) {
+    const uint32_t scratch = register_allocation::FastmemRegisters::ADDRESS_REG;
+    
+    if (memory_order == ir::IrMemoryOrder::RELEASE) {
+        emit_instruction(code, MemoryModel::barrier_encoding(MemoryModel::BARRIER_DMB_ISH));
+    }
+    
+    // Save X0-X15, X18 and X30, which the host may clobber: STP X0, X1, [SP, #-144]!
+    // then STP Xn, Xn+1, [SP, #16 * k]
+    emit_instruction(code, 0xA9800000 | ((static_cast<uint32_t>(-18) & 0x7F) << 15) | (1 << 10) | (31 << 5) | 0);
+    for (uint32_t pair = 1; pair < 8; pair++) {
+        emit_instruction(code, 0xA9000000 | ((pair * 2) << 15) | ((pair * 2 + 1) << 10) | (31 << 5) | (pair * 2));
+    }
+    emit_instruction(code, 0xA9000000 | (16 << 15) | (30 << 10) | (31 << 5) | 18);
+    
+    // Likewise Q8-Q31, the allocator's NEON pool: Q16-Q31 are caller-saved and
+    // only the low halves of V8-V15 are preserved. STP Q8, Q9, [SP, #-384]!
+    // then STP Qn, Qn+1, [SP, #32 * k]
+    emit_instruction(code, 0xAD800000 | ((static_cast<uint32_t>(-24) & 0x7F) << 15) | (9 << 10) | (31 << 5) | 8);
+    for (uint32_t pair = 1; pair < 12; pair++) {
+        emit_instruction(code, 0xAD000000 | ((pair * 2) << 15) | ((pair * 2 + 9) << 10) | (31 << 5) | (pair * 2 + 8));
+    }
+    
+    // Arguments: W0 = guest address, (X1 = value,) W1/W2 = size
+    if (!is_load) {
+        emit_instruction(code, 0xAA0003E0 | (value_reg << 16) | 1); // MOV X1, Xvalue
+    }
+    emit_instruction(code, 0x2A0003E0 | (scratch << 16) | 0); // MOV W0, W17
+    emit_instruction(code, 0x52800000 | (size << 5) | (is_load ? 1 : 2)); // MOVZ Wn, #size
+    
+    emit_host_call(code, is_load
+        ? reinterpret_cast<uint64_t>(slow_path_read_)
+        : reinterpret_cast<uint64_t>(slow_path_write_));
+    if (is_load) {
+        emit_instruction(code, 0xAA0003E0 | (0 << 16) | scratch); // MOV X17, X0
+    }
+    
+    // Restore, then LDP Q8, Q9, [SP], #384 and LDP X0, X1, [SP], #144
+    for (uint32_t pair = 11; pair >= 1; pair--) {
+        emit_instruction(code, 0xAD400000 | ((pair * 2) << 15) | ((pair * 2 + 9) << 10) | (31 << 5) | (pair * 2 + 8));
+    }
+    emit_instruction(code, 0xACC00000 | (24 << 15) | (9 << 10) | (31 << 5) | 8);
+    emit_instruction(code, 0xA9400000 | (16 << 15) | (30 << 10) | (31 << 5) | 18);
+    for (uint32_t pair = 7; pair >= 1; pair--) {
+        emit_instruction(code, 0xA9400000 | ((pair * 2) << 15) | ((pair * 2 + 1) << 10) | (31 << 5) | (pair * 2));
+    }
+    emit_instruction(code, 0xA8C00000 | (18 << 15) | (1 << 10) | (31 << 5) | 0);
+    
+    if (is_load) {
+        // MOV Rt, X17 (the value is already zero-extended)
+        emit_instruction(code, (size == 8 ? 0xAA0003E0 : 0x2A0003E0) | (scratch << 16) | value_reg);
+    }
+    
+    if (memory_order == ir::IrMemoryOrder::ACQUIRE) {
+        emit_instruction(code, MemoryModel::barrier_encoding(MemoryModel::BARRIER_LFENCE)); // DMB ISHLD
+    }
+}
+
+void CodeGenerator::emit_memory_access(
+    std::vector<uint8_t>& code, const ir::IrInstruction& instruction,
+    const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map) {
+    const bool is_load = instruction.type == ir::IrInstructionType::LOAD;
+    if (instruction.operands.size() != 2) {
+        LOG_ERROR("IR_LOAD/IR_STORE instruction has incorrect number of operands.");
+        return;
+    }
+    const ir::IrOperand& value_op = instruction.operands[is_load ? 0 : 1];
+    const ir::IrOperand& mem_op = instruction.operands[is_load ? 1 : 0];
+    if (value_op.type != ir::IrOperandType::REGISTER || mem_op.type != ir::IrOperandType::MEMORY) {
+        LOG_ERROR("Unsupported operand types for IR_LOAD/IR_STORE.");
+        return;
+    }
+    
+    uint32_t value_reg = get_physical_reg(value_op.reg_idx, register_map);
+    uint32_t size = memory_access_size(value_op.data_type);
+    const ir::IrMemoryOrder order = instruction.memory_order;
+    
+    // Device memory is never mapped for fastmem: call the slow path (which
+    // fences it) directly rather than fault and backpatch
+    if (!fastmem_ || order == ir::IrMemoryOrder::DEVICE) {
+        emit_effective_address(code, mem_op.mem_info, register_map, true);
+        emit_slow_path_access(code, is_load, size, value_reg, order);
+        return;
+    }
+    
+    static const uint32_t size_bits[9] = {0, 0, 1, 0, 2, 0, 0, 0, 3};
+    const uint32_t base = register_allocation::FastmemRegisters::BASE_REG;
+    uint32_t address_reg = emit_effective_address(code, mem_op.mem_info, register_map, false);
+    
+    if (order != ir::IrMemoryOrder::PLAIN && ordering_lowering_ != MemoryModel::LOWERING_BARRIERS) {
+        // Acquire/release forms take a bare base register:
+        // ADD X16, X18, Waddr, UXTW then LDAPR/LDAR/STLR Rt, [X16]
+        const uint32_t host_address = register_allocation::FastmemRegisters::HOST_ADDRESS_REG;
+        emit_instruction(code, 0x8B204000 | (address_reg << 16) | (base << 5) | host_address);
+        uint32_t opcode = 0x089FFC00; // STLR
+        if (is_load) {
+            opcode = ordering_lowering_ == MemoryModel::LOWERING_LDAPR_STLR ? 0x38BFC000 : 0x08DFFC00; // LDAPR : LDAR
+        }
+        pending_fastmem_thunks_.push_back({static_cast<uint32_t>(code.size()), is_load, size, value_reg, address_reg, order});
+        emit_instruction(code, opcode | (size_bits[size] << 30) | (host_address << 5) | value_reg);
+        return;
+    }
+    
+    // LDR/STR Rt, [X18, Wm, UXTW] (register offset, option = 010, S = 0).
+    // Bits 31:30 give the size; bit 22 selects load. Ordered accesses under
+    // LOWERING_BARRIERS get the barriers of the slow path around them.
+    if (order == ir::IrMemoryOrder::RELEASE) {
+        emit_instruction(code, MemoryModel::barrier_encoding(MemoryModel::BARRIER_DMB_ISH));
+    }
+    uint32_t aarch64_inst = 0x38204800 | (size_bits[size] << 30) | (is_load ? (1u << 22) : 0) |
+                            (address_reg << 16) | (base << 5) | value_reg;
+    pending_fastmem_thunks_.push_back({static_cast<uint32_t>(code.size()), is_load, size, value_reg, address_reg,
+                                       ir::IrMemoryOrder::PLAIN});
+    emit_instruction(code, aarch64_inst);
+    if (order == ir::IrMemoryOrder::ACQUIRE) {
+        emit_instruction(code, MemoryModel::barrier_encoding(MemoryModel::BARRIER_LFENCE)); // DMB ISHLD
+    }
+}
+
+// Even-numbered X0-X14 that, with the register after them, hold none of
+// instruction's operands. The slow path preserves X0-X15, so these pairs
+// are pushed and used as temporaries by the atomic lowerings.
+static std::vector<uint32_t> free_register_pairs(const std::vector<uint32_t>& used, size_t count) {
+    std::vector<uint32_t> pairs;
+    for (uint32_t reg = 0; reg < 16 && pairs.size() < count; reg += 2) {
+        if (std::find(used.begin(), used.end(), reg) == used.end() &&
+            std::find(used.begin(), used.end(), reg + 1) == used.end()) {
+            pairs.push_back(reg);
+        }
+    }
+    return pairs;
+}
+
+uint32_t CodeGenerator::emit_atomic_update(
+    std::vector<uint8_t>& code, const ir::IrInstruction& instruction,
+    const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map,
+    uint32_t old_reg, uint32_t result_reg, uint32_t value_reg, uint32_t new64_reg) {
+    switch (instruction.type) {
+        case ir::IrInstructionType::ATOMIC_ADD:
+        case ir::IrInstructionType::ATOMIC_XADD:
+            emit_instruction(code, 0x0B000000 | (value_reg << 16) | (old_reg << 5) | result_reg); // ADD
+            return result_reg;
+        case ir::IrInstructionType::ATOMIC_SUB:
+            emit_instruction(code, 0x4B000000 | (value_reg << 16) | (old_reg << 5) | result_reg); // SUB
+            return result_reg;
+        case ir::IrInstructionType::ATOMIC_AND:
+            emit_instruction(code, 0x0A000000 | (value_reg << 16) | (old_reg << 5) | result_reg); // AND
+            return result_reg;
+        case ir::IrInstructionType::ATOMIC_OR:
+            emit_instruction(code, 0x2A000000 | (value_reg << 16) | (old_reg << 5) | result_reg); // ORR
+            return result_reg;
+        case ir::IrInstructionType::ATOMIC_XOR:
+            emit_instruction(code, 0x4A000000 | (value_reg << 16) | (old_reg << 5) | result_reg); // EOR
+            return result_reg;
+        case ir::IrInstructionType::ATOMIC_XCHG:
+            return value_reg;
+        case ir::IrInstructionType::ATOMIC_CMPXCHG: {
+            // CMP WEAX, Wold; CSEL Wresult, Wnew, Wold, EQ
+            uint32_t eax = get_physical_reg(instruction.operands[1].reg_idx, register_map);
+            emit_instruction(code, 0x6B00001F | (old_reg << 16) | (eax << 5));
+            emit_instruction(code, 0x1A800000 | (old_reg << 16) | (value_reg << 5) | result_reg);
+            return result_reg;
+        }
+        case ir::IrInstructionType::ATOMIC_CMPXCHG8B:
+            // CMP Xold, Xexpected; CSEL Xresult, Xnew, Xold, EQ
+            emit_instruction(code, 0xEB00001F | (value_reg << 16) | (old_reg << 5));
+            emit_instruction(code, 0x9A800000 | (old_reg << 16) | (new64_reg << 5) | result_reg);
+            return result_reg;
+        default:
+            return result_reg;
+    }
+}
+
+void CodeGenerator::emit_atomic(
+    std::vector<uint8_t>& code, const ir::IrInstruction& instruction,
+    const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map) {
+    const ir::IrInstructionType type = instruction.type;
+    const bool cmpxchg8b = type == ir::IrInstructionType::ATOMIC_CMPXCHG8B;
+    const size_t operand_count = cmpxchg8b ? 5 : (type == ir::IrInstructionType::ATOMIC_CMPXCHG ? 3 : 2);
+    if (instruction.operands.size() != operand_count || instruction.operands[0].type != ir::IrOperandType::MEMORY) {
+        LOG_ERROR("Atomic IR instruction has incorrect operands.");
+        return;
+    }
+    const bool has_immediate = instruction.operands[1].type == ir::IrOperandType::IMMEDIATE;
+    if (has_immediate && (type == ir::IrInstructionType::ATOMIC_XADD || type == ir::IrInstructionType::ATOMIC_XCHG ||
+                          type == ir::IrInstructionType::ATOMIC_CMPXCHG || cmpxchg8b)) {
+        LOG_ERROR("Atomic IR instruction takes register operands only.");
+        return;
+    }
+    
+    // Registers the instruction uses, which the temporaries must avoid
+    const ir::MemoryOperand& mem = instruction.operands[0].mem_info;
+    std::vector<uint32_t> used;
+    std::vector<uint32_t> regs(operand_count, 0);
+    for (size_t i = 1; i < operand_count; i++) {
+        if (instruction.operands[i].type == ir::IrOperandType::REGISTER) {
+            regs[i] = get_physical_reg(instruction.operands[i].reg_idx, register_map);
+            used.push_back(regs[i]);
+        }
+    }
+    if (mem.base_reg_idx != ir::MemoryOperand::NO_REGISTER) {
+        used.push_back(get_physical_reg(mem.base_reg_idx, register_map));
+    }
+    if (mem.index_reg_idx != ir::MemoryOperand::NO_REGISTER) {
+        used.push_back(get_physical_reg(mem.index_reg_idx, register_map));
+    }
+    
+    static const uint32_t size_bits[9] = {0, 0, 1, 0, 2, 0, 0, 0, 3};
+    const uint32_t size = memory_access_size(instruction.operands[0].data_type);
+    const uint32_t sf = size_bits[size] << 30;
+    const uint32_t base = register_allocation::FastmemRegisters::BASE_REG;
+    const uint32_t host_address = register_allocation::FastmemRegisters::HOST_ADDRESS_REG;
+    const uint32_t scratch = register_allocation::FastmemRegisters::ADDRESS_REG;
+    const uint32_t dmb_ish = MemoryModel::barrier_encoding(MemoryModel::BARRIER_DMB_ISH);
+    
+    // Operand 1 for the arithmetic forms: the register, or the immediate
+    // materialised (negated for SUB, inverted for AND under LSE) in a temporary
+    uint32_t immediate = has_immediate ? static_cast<uint32_t>(instruction.operands[1].imm_value) : 0;
+    auto move_immediate = [&](uint32_t reg, uint32_t value) {
+        // MOVZ/MOVK Wd, #value
+        emit_instruction(code, 0x52800000 | ((value & 0xFFFF) << 5) | reg);
+        if (value >> 16) {
+            emit_instruction(code, 0x72A00000 | ((value >> 16) << 5) | reg);
+        }
+    };
+    
+    if (fastmem_ && lse_atomics_) {
+        // ADD X16, X18, Waddr, UXTW
+        uint32_t address_reg = emit_effective_address(code, mem, register_map, false);
+        emit_instruction(code, 0x8B204000 | (address_reg << 16) | (base << 5) | host_address);
+        
+        uint32_t op = 0; // LD<op>AL opc: ADD 0, CLR 1, EOR 2, SET 3
+        switch (type) {
+            case ir::IrInstructionType::ATOMIC_ADD:
+            case ir::IrInstructionType::ATOMIC_SUB:
+            case ir::IrInstructionType::ATOMIC_AND:
+            case ir::IrInstructionType::ATOMIC_OR:
+            case ir::IrInstructionType::ATOMIC_XOR: {
+                bool negate = type == ir::IrInstructionType::ATOMIC_SUB;
+                bool invert = type == ir::IrInstructionType::ATOMIC_AND; // AND is CLR of the complement
+                op = invert ? 1 : (type == ir::IrInstructionType::ATOMIC_XOR ? 2 : (type == ir::IrInstructionType::ATOMIC_OR ? 3 : 0));
+                uint32_t value_reg = regs[1];
+                if (has_immediate) {
+                    move_immediate(scratch, negate ? 0u - immediate : (invert ? ~immediate : immediate));
+                    value_reg = scratch;
+                } else if (negate) {
+                    emit_instruction(code, 0x4B0003E0 | (value_reg << 16) | scratch); // NEG W17, Wsrc
+                    value_reg = scratch;
+                } else if (invert) {
+                    emit_instruction(code, 0x2A2003E0 | (value_reg << 16) | scratch); // MVN W17, Wsrc
+                    value_reg = scratch;
+                }
+                // LD<op>AL Wvalue, W17, [X16] (the old value is discarded)
+                emit_instruction(code, 0x38E00000 | sf | (value_reg << 16) | (op << 12) | (host_address << 5) | scratch);
+                break;
+            }
+            case ir::IrInstructionType::ATOMIC_XADD:
+                // LDADDAL Wr, Wr, [X16]
+                emit_instruction(code, 0x38E00000 | sf | (regs[1] << 16) | (host_address << 5) | regs[1]);
+                break;
+            case ir::IrInstructionType::ATOMIC_XCHG:
+                // SWPAL Wr, Wr, [X16]
+                emit_instruction(code, 0x38E08000 | sf | (regs[1] << 16) | (host_address << 5) | regs[1]);
+                break;
+            case ir::IrInstructionType::ATOMIC_CMPXCHG:
+                // MOV W17, WEAX; CASAL W17, Wnew, [X16]; CMP WEAX, W17; MOV WEAX, W17
+                emit_instruction(code, 0x2A0003E0 | (regs[1] << 16) | scratch);
+                emit_instruction(code, 0x08E0FC00 | sf | (scratch << 16) | (host_address << 5) | regs[2]);
+                emit_instruction(code, 0x6B00001F | (scratch << 16) | (regs[1] << 5));
+                emit_instruction(code, 0x2A0003E0 | (scratch << 16) | regs[1]);
+                break;
+            case ir::IrInstructionType::ATOMIC_CMPXCHG8B: {
+                // A 64-bit CASAL on EDX:EAX and ECX:EBX, built in a pushed pair
+                std::vector<uint32_t> pairs = free_register_pairs(used, 1);
+                uint32_t expected = pairs[0], desired = pairs[0] + 1;
+                emit_instruction(code, 0xA9800000 | ((static_cast<uint32_t>(-2) & 0x7F) << 15) | (desired << 10) | (31 << 5) | expected);
+                // MOV Wt, Wlo; ORR Xt, Xt, Xhi, LSL #32
+                emit_instruction(code, 0x2A0003E0 | (regs[1] << 16) | expected);
+                emit_instruction(code, 0xAA000000 | (regs[2] << 16) | (32 << 10) | (expected << 5) | expected);
+                emit_instruction(code, 0x2A0003E0 | (regs[3] << 16) | desired);
+                emit_instruction(code, 0xAA000000 | (regs[4] << 16) | (32 << 10) | (desired << 5) | desired);
+                emit_instruction(code, 0x08E0FC00 | sf | (expected << 16) | (host_address << 5) | desired); // CASAL
+                // ZF: the old value against EDX:EAX, rebuilt in X17
+                emit_instruction(code, 0x2A0003E0 | (regs[1] << 16) | scratch);
+                emit_instruction(code, 0xAA000000 | (regs[2] << 16) | (32 << 10) | (scratch << 5) | scratch);
+                emit_instruction(code, 0xEB00001F | (scratch << 16) | (expected << 5)); // CMP Xold, X17
+                emit_instruction(code, 0x2A0003E0 | (expected << 16) | regs[1]); // MOV WEAX, Wold
+                emit_instruction(code, 0xD360FC00 | (expected << 5) | regs[2]); // LSR XEDX, Xold, #32
+                emit_instruction(code, 0xA8C00000 | (2 << 15) | (desired << 10) | (31 << 5) | expected);
+                break;
+            }
+            default:
+                break;
+        }
+        return;
+    }
+    
+    // LL/SC loop or slow path. Temporaries: t[0] old value, t[1] value to
+    // store (holding the guest address on the slow path until the write),
+    // t[2] operand 1 immediate or expected EDX:EAX, t[3] new ECX:EBX.
+    std::vector<uint32_t> pairs = free_register_pairs(used, 2);
+    const uint32_t t[4] = {pairs[0], pairs[0] + 1, pairs[1], pairs[1] + 1};
+    for (uint32_t pair : pairs) {
+        emit_instruction(code, 0xA9800000 | ((static_cast<uint32_t>(-2) & 0x7F) << 15) | ((pair + 1) << 10) | (31 << 5) | pair);
+    }
+    
+    if (fastmem_) {
+        uint32_t address_reg = emit_effective_address(code, mem, register_map, false);
+        emit_instruction(code, 0x8B204000 | (address_reg << 16) | (base << 5) | host_address);
+    } else {
+        emit_instruction(code, dmb_ish);
+        emit_effective_address(code, mem, register_map, true);
+        emit_instruction(code, 0x2A0003E0 | (scratch << 16) | t[1]); // MOV Wt1, W17
+    }
+    
+    uint32_t value_reg = regs[1];
+    if (has_immediate) {
+        move_immediate(t[2], immediate);
+        value_reg = t[2];
+    } else if (cmpxchg8b) {
+        emit_instruction(code, 0x2A0003E0 | (regs[1] << 16) | t[2]);
+        emit_instruction(code, 0xAA000000 | (regs[2] << 16) | (32 << 10) | (t[2] << 5) | t[2]);
+        emit_instruction(code, 0x2A0003E0 | (regs[3] << 16) | t[3]);
+        emit_instruction(code, 0xAA000000 | (regs[4] << 16) | (32 << 10) | (t[3] << 5) | t[3]);
+        value_reg = t[2];
+    } else if (type == ir::IrInstructionType::ATOMIC_CMPXCHG) {
+        value_reg = regs[2];
+    }
+    
+    if (fastmem_) {
+        // loop: LDAXR Xold, [X16]; <update>; STLXR W17, Xnew, [X16]; CBNZ W17, loop
+        uint32_t loop = static_cast<uint32_t>(code.size());
+        emit_instruction(code, 0x085FFC00 | sf | (host_address << 5) | t[0]);
+        uint32_t store_reg = emit_atomic_update(code, instruction, register_map, t[0], t[1], value_reg, t[3]);
+        emit_instruction(code, 0x0800FC00 | sf | (scratch << 16) | (host_address << 5) | store_reg);
+        int32_t offset = (static_cast<int32_t>(loop) - static_cast<int32_t>(code.size())) / 4;
+        emit_instruction(code, 0x35000000 | ((static_cast<uint32_t>(offset) & 0x7FFFF) << 5) | scratch);
+        // Locked x86 instructions are full barriers
+        emit_instruction(code, dmb_ish);
+    } else {
+        emit_slow_path_access(code, true, size, t[0]);
+        emit_instruction(code, 0x2A0003E0 | (t[1] << 16) | scratch); // MOV W17, Wt1
+        uint32_t store_reg = emit_atomic_update(code, instruction, register_map, t[0], t[1], value_reg, t[3]);
+        emit_slow_path_access(code, false, size, store_reg);
+        // The host call clobbered the flags of the comparison
+        if (type == ir::IrInstructionType::ATOMIC_CMPXCHG) {
+            emit_instruction(code, 0x6B00001F | (t[0] << 16) | (regs[1] << 5));
+        } else if (cmpxchg8b) {
+            emit_instruction(code, 0xEB00001F | (t[2] << 16) | (t[0] << 5));
+        }
+        emit_instruction(code, dmb_ish);
+    }
+    
+    // Results: the old value to the register operand (XADD, XCHG) or EAX (CMPXCHG, and EDX for CMPXCHG8B)
+    if (type == ir::IrInstructionType::ATOMIC_XADD || type == ir::IrInstructionType::ATOMIC_XCHG ||
+        type == ir::IrInstructionType::ATOMIC_CMPXCHG || cmpxchg8b) {
+        emit_instruction(code, 0x2A0003E0 | (t[0] << 16) | regs[1]);
+    }
+    if (cmpxchg8b) {
+        emit_instruction(code, 0xD360FC00 | (t[0] << 5) | regs[2]); // LSR XEDX, Xold, #32
+    }
+    for (size_t i = pairs.size(); i-- > 0;) {
+        emit_instruction(code, 0xA8C00000 | (2 << 15) | ((pairs[i] + 1) << 10) | (31 << 5) | pairs[i]);
+    }
+}
+
+void CodeGenerator::emit_fastmem_thunks(std::vector<uint8_t>& code) {
+    const uint32_t scratch = register_allocation::FastmemRegisters::ADDRESS_REG;
+    
+    for (const auto& thunk : pending_fastmem_thunks_) {
+        translation_cache::FastmemSite site;
+        site.access_offset = thunk.access_offset;
+        site.thunk_offset = static_cast<uint32_t>(code.size());
+        
+        if (thunk.address_reg != scratch) {
+            emit_instruction(code, 0x2A0003E0 | (thunk.address_reg << 16) | scratch); // MOV W17, Waddr
+        }
+        emit_slow_path_access(code, thunk.is_load, thunk.size, thunk.value_reg, thunk.memory_order);
+        
+        // B back to the instruction after the access
+        int32_t offset = (static_cast<int32_t>(thunk.access_offset + 4) - static_cast<int32_t>(code.size())) / 4;
+        emit_instruction(code, 0x14000000 | (static_cast<uint32_t>(offset) & 0x3FFFFFF));
+        
+        fastmem_sites_.push_back(site);
+    }
+    pending_fastmem_thunks_.clear();
+}
+
+uintptr_t CodeGenerator::backpatch_fastmem_site(translation_cache::TranslatedBlock* block,
+                                                const translation_cache::FastmemSite& site) {
+    // Only blocks owning their code get here: shared code is immutable and
+    // its sites are not indexed (see TranslatedBlock::shared_code)
+    uint8_t* code = static_cast<uint8_t*>(block->code_ptr);
+    uint32_t* access = reinterpret_cast<uint32_t*>(code + site.access_offset);
+    int32_t offset = (static_cast<int32_t>(site.thunk_offset) - static_cast<int32_t>(site.access_offset)) / 4;
+    uint32_t branch = 0x14000000 | (static_cast<uint32_t>(offset) & 0x3FFFFFF);
+    
+    // Several threads may fault on the same access; only the first rewrites it
+    uint32_t expected = __atomic_load_n(access, __ATOMIC_RELAXED);
+    if (expected != branch &&
+        __atomic_compare_exchange_n(access, &expected, branch, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        __builtin___clear_cache(reinterpret_cast<char*>(access), reinterpret_cast<char*>(access + 1));
+        block->fastmem_backpatches.fetch_add(1, std::memory_order_relaxed);
+    }
+    return reinterpret_cast<uintptr_t>(code + site.thunk_offset);
+}
+
+std::vector<uint8_t> CodeGenerator::generate_dispatcher_entry() {
+    std::vector<uint8_t> code;
+    
+    // STP X29, X30, [SP, #-96]! followed by X19-X28 into the rest of the frame
+    emit_instruction(code, 0xA9800000 | ((static_cast<uint32_t>(-12) & 0x7F) << 15) | (30 << 10) | (31 << 5) | 29);
+    for (uint32_t pair = 0; pair < 5; pair++) {
+        uint32_t rt = 19 + pair * 2;
+        uint32_t imm7 = 2 + pair * 2; // (16 + pair * 16) / 8
+        emit_instruction(code, 0xA9000000 | (imm7 << 15) | ((rt + 1) << 10) | (31 << 5) | rt);
+    }
+    
+    if (fastmem_) {
+        // MOV X18, X2
+        emit_instruction(code, 0xAA0003E0 | (2 << 16) | register_allocation::FastmemRegisters::BASE_REG);
+    }
+    
+    if (pin_guest_registers_) {
+        // MOV X27, X0 (ORR X27, XZR, X0)
+        emit_instruction(code, 0xAA0003E0 | (0 << 16) | register_allocation::GuestRegisterPinning::GUEST_CONTEXT_REG);
+        emit_load_pinned_guest_state(code);
+    }
+    
+    // BR X1
+    emit_instruction(code, 0xD61F0000 | (1 << 5));
+    
+    LOG_DEBUG("Generated dispatcher entry (" + std::to_string(code.size()) + " bytes)");
+    return code;
+}
+
+std::vector<uint8_t> CodeGenerator::generate_dispatcher_exit() {
+    std::vector<uint8_t> code;
+    
+    if (pin_guest_registers_) {
+        emit_store_pinned_guest_state(code);
+    }
+    
+    // Restore X19-X28, then LDP X29, X30, [SP], #96
+    for (uint32_t pair = 0; pair < 5; pair++) {
+        uint32_t rt = 19 + pair * 2;
+        uint32_t imm7 = 2 + pair * 2;
+        emit_instruction(code, 0xA9400000 | (imm7 << 15) | ((rt + 1) << 10) | (31 << 5) | rt);
+    }
+    emit_instruction(code, 0xA8C00000 | (12 << 15) | (30 << 10) | (31 << 5) | 29);
+    
+    // RET
+    emit_instruction(code, 0xD65F03C0);
+    
+    LOG_DEBUG("Generated dispatcher exit (" + std::to_string(code.size()) + " bytes)");
+    return code;
+}
+
+
+void CodeGenerator::emit_spill_code(std::vector<uint8_t>& code, const register_allocation::SpillCode& spill) {
+    bool is_load = spill.type == register_allocation::SpillCodeType::RELOAD;
+    uint32_t size = register_allocation::SpillAllocator::get_slot_size(spill.data_type);
+    uint32_t base;
+    
+    // Unsigned-offset LDR/STR forms; the immediate is scaled by the access size
+    if (spill.reg_type == register_allocation::PhysicalRegisterType::NEON) {
+        if (size <= 4) {
+            size = 4;
+            base = is_load ? 0xBD400000 : 0xBD000000; // LDR/STR St
+        } else if (size == 8) {
+            base = is_load ? 0xFD400000 : 0xFD000000; // LDR/STR Dt
+        } else {
+            size = 16;
+            base = is_load ? 0x3DC00000 : 0x3D800000; // LDR/STR Qt
+        }
+    } else {
+        switch (size) {
+            case 1: base = is_load ? 0x39400000 : 0x39000000; break; // LDRB/STRB Wt
+            case 2: base = is_load ? 0x79400000 : 0x79000000; break; // LDRH/STRH Wt
+            case 4: base = is_load ? 0xB9400000 : 0xB9000000; break; // LDR/STR Wt
+            default:
+                size = 8;
+                base = is_load ? 0xF9400000 : 0xF9000000; // LDR/STR Xt
+                break;
+        }
+    }
+    
+    uint32_t imm12 = static_cast<uint32_t>(spill.stack_offset) / size;
+    if (imm12 > 0xFFF) {
+        LOG_ERROR("Spill slot offset " + std::to_string(spill.stack_offset) + " out of range.");
+        return;
+    }
+    
+    // [SP, #offset]: Rn = 31
+    emit_instruction(code, base | (imm12 << 10) | (31 << 5) | static_cast<uint32_t>(spill.physical_reg_idx));
+}
+
+void CodeGenerator::emit_spill_frame(std::vector<uint8_t>& code, uint32_t frame_size, bool release) {
+    if (frame_size == 0) {
+        return;
+    }
+    if (frame_size > 0xFFFFFF) {
+        LOG_ERROR("Spill frame of " + std::to_string(frame_size) + " bytes out of range.");
+        return;
+    }
+    
+    // ADD/SUB (immediate) with Rd = Rn = SP; sizes above 4 KiB take a second, LSL #12 step
+    uint32_t base = release ? 0x910003FF : 0xD10003FF;
+    if (frame_size >> 12) {
+        emit_instruction(code, base | (1u << 22) | ((frame_size >> 12) << 10));
+    }
+    if (frame_size & 0xFFF) {
+        emit_instruction(code, base | ((frame_size & 0xFFF) << 10));
+    }
+}
 
 std::vector<uint8_t> CodeGenerator::generate(
     const std::vector<ir::IrInstruction>& ir_instructions,
     const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& register_map
+) {
+    static const std::vector<register_allocation::SpillCode> no_spill_code;
+    return generate(ir_instructions, register_map, no_spill_code, 0);
+}
+
+std::vector<uint8_t> CodeGenerator::generate(
+    const std::vector<ir::IrInstruction>& ir_instructions,
+    const std::unordered_map<uint32_t, register_allocation::RegisterMapping>& base_register_map,
+    const std::vector<register_allocation::SpillCode>& spill_code,
+    uint32_t frame_size
 ) {
     LOG_DEBUG("Generating AArch64 code from IR.");
     std::vector<uint8_t> compiled_code;
+    relocations_.clear();
+    pending_fastmem_thunks_.clear();
+    fastmem_sites_.clear();
+    source_map_.clear();
+
+    // Live-range splitting moves vregs between registers; track their current location
+    std::unordered_map<uint32_t, register_allocation::RegisterMapping> split_register_map;
+    if (!spill_code.empty()) {
+        split_register_map = base_register_map;
+    }
+    const auto& register_map = spill_code.empty() ? base_register_map : split_register_map;
+    auto next_spill = spill_code.begin();
 
     // TODO: Load initial EFLAGS state into the dedicated register/memory location
 
-    for (const auto& instruction : ir_instructions) {
+    for (size_t inst_idx = 0; inst_idx < ir_instructions.size(); inst_idx++) {
+        const auto& instruction = ir_instructions[inst_idx];
+
+        // Code up to the next guest instruction, spill code included, is
+        // attributed to this one; synthesised instructions extend the run
+        if (instruction.guest_address != 0 &&
+            (source_map_.empty() || source_map_.back().guest_address != instruction.guest_address)) {
+            source_map_.push_back({static_cast<uint32_t>(compiled_code.size()), instruction.guest_address});
+        }
+
+        // Spill slots are addressed from SP: reserve them before any spill
+        // code, so that a back-edge to instruction 0 does not reserve again
+        if (inst_idx == 0) {
+            emit_spill_frame(compiled_code, frame_size, false);
+        }
+
+        // Spill/reload code scheduled before this instruction
+        for (; next_spill != spill_code.end() && next_spill->inst_idx <= inst_idx; ++next_spill) {
+            emit_spill_code(compiled_code, *next_spill);
+            if (next_spill->type == register_allocation::SpillCodeType::RELOAD) {
+                auto& mapping = split_register_map[next_spill->vreg_id];
+                if (next_spill->reg_type == register_allocation::PhysicalRegisterType::NEON) {
+                    mapping.neon_physical_reg_idx = next_spill->physical_reg_idx;
+                } else {
+                    mapping.gpr_physical_reg_idx = next_spill->physical_reg_idx;
+                }
+            }
+        }
+
         // !!!!! DEBUGGING: Check for VEC_ADD_PS explicitly !!!!!
         if (instruction.type == ir::IrInstructionType::VEC_ADD_PS) {
             LOG_DEBUG("DEBUG: Explicit IF detected IR_VEC_ADD_PS. instruction.type cast to int: " + std::to_string(static_cast<int>(instruction.type)));
@@ -509,6 +1230,7 @@ std::vector<uint8_t> CodeGenerator::generate(
              case ir::IrInstructionType::RET: {
                  // RET instruction
                  // D65F03C0
+                 emit_spill_frame(compiled_code, frame_size, true);
                  uint32_t aarch64_inst = 0xD65F03C0;
                  emit_instruction(compiled_code, aarch64_inst);
                  LOG_DEBUG("Generated AArch64 RET for IR_RET.");
@@ -736,6 +1458,54 @@ std::vector<uint8_t> CodeGenerator::generate(
                 break;
             }
 
+            case ir::IrInstructionType::LOAD:
+            case ir::IrInstructionType::STORE: {
+                emit_memory_access(compiled_code, instruction, register_map);
+                LOG_DEBUG(std::string("Generated AArch64 ") + (fastmem_ ? "fastmem" : "slow-path") +
+                          " access for IR_LOAD/IR_STORE.");
+                break;
+            }
+
+            case ir::IrInstructionType::ATOMIC_ADD:
+            case ir::IrInstructionType::ATOMIC_SUB:
+            case ir::IrInstructionType::ATOMIC_AND:
+            case ir::IrInstructionType::ATOMIC_OR:
+            case ir::IrInstructionType::ATOMIC_XOR:
+            case ir::IrInstructionType::ATOMIC_XADD:
+            case ir::IrInstructionType::ATOMIC_XCHG:
+            case ir::IrInstructionType::ATOMIC_CMPXCHG:
+            case ir::IrInstructionType::ATOMIC_CMPXCHG8B: {
+                emit_atomic(compiled_code, instruction, register_map);
+                LOG_DEBUG(std::string("Generated AArch64 ") + (!fastmem_ ? "slow-path" : (lse_atomics_ ? "LSE" : "LL/SC")) +
+                          " atomic.");
+                break;
+            }
+
+            case ir::IrInstructionType::MEM_FENCE: {
+                // Placed by MemoryModel::order_memory_accesses
+                MemoryModel::BarrierType barrier_type = MemoryModel::BARRIER_MFENCE;
+                if (!instruction.operands.empty() &&
+                    instruction.operands[0].type == ir::IrOperandType::IMMEDIATE) {
+                    barrier_type = static_cast<MemoryModel::BarrierType>(instruction.operands[0].imm_value);
+                }
+                if (barrier_type != MemoryModel::BARRIER_NONE) {
+                    emit_instruction(compiled_code, MemoryModel::barrier_encoding(barrier_type));
+                }
+                break;
+            }
+
+            case ir::IrInstructionType::HOST_CALL: {
+                // Assuming HOST_CALL with one operand: host function address
+                if (!instruction.operands.empty() &&
+                    instruction.operands[0].type == ir::IrOperandType::IMMEDIATE) {
+                    emit_host_call(compiled_code, instruction.operands[0].imm_value);
+                    LOG_DEBUG("Generated AArch64 BLR for IR_HOST_CALL.");
+                } else {
+                    LOG_ERROR("Unsupported operand type for IR_HOST_CALL.");
+                }
+                break;
+            }
+
             default:
                 LOG_ERROR("Unsupported IR instruction type for AArch64 generation. Type: " + std::to_string(static_cast<int>(instruction.type)));
                 // For unsupported instructions, emit a trap or an illegal instruction
@@ -747,6 +1517,14 @@ std::vector<uint8_t> CodeGenerator::generate(
 
     // TODO: Save final EFLAGS state from the dedicated register/memory location
 
+    // The block also exits by running off its end
+    if (ir_instructions.empty() || ir_instructions.back().type != ir::IrInstructionType::RET) {
+        emit_spill_frame(compiled_code, frame_size, true);
+    }
+
+    // Fastmem slow-path thunks go after the block's final exit
+    emit_fastmem_thunks(compiled_code);
+
     LOG_DEBUG("Finished AArch64 code generation.");
     return compiled_code;
 }
@@ -755,19 +1533,25 @@ std::vector<uint8_t> CodeGenerator::generate(
 void CodeGenerator::patch_branch(translation_cache::TranslatedBlock* source_block, 
                              const translation_cache::TranslatedBlock::ControlFlowExit& exit, 
                              translation_cache::TranslatedBlock* target_block) {
+    // Shared code is mapped by other contexts and never patched; a block
+    // from the shared code store keeps its code at code_ptr, not in code
+    if (!source_block->code_ptr || !target_block->code_ptr || source_block->shared_code) {
+        LOG_ERROR("Cannot patch a branch without private source code and target code.");
+        return;
+    }
+    uint8_t* source_code = static_cast<uint8_t*>(source_block->code_ptr);
+    
     // Calculate the relative branch offset (in units of instructions, not bytes)
     // AArch64 branches use pc-relative addressing with units of 4 bytes (32-bit instructions)
-    int64_t relative_offset = (reinterpret_cast<int64_t>(target_block->code.data()) - 
-                              reinterpret_cast<int64_t>(source_block->code.data() + 
-                              exit.instruction_offset)) / 4;
+    int64_t relative_offset = (reinterpret_cast<int64_t>(target_block->code_ptr) - 
+                              reinterpret_cast<int64_t>(source_code + exit.instruction_offset)) / 4;
 
     if (relative_offset > 0x7FFFFF || relative_offset < -0x800000) {
         // Offset is too large for immediate branch; we need a register-based solution
         LOG_ERROR("Branch offset too large for direct branch. Need to implement long branches.");
     } else {
         // Get a pointer to the instruction to patch (previously emitted B or BL)
-        uint32_t* instruction_ptr = reinterpret_cast<uint32_t*>(source_block->code.data() + 
-                                   exit.instruction_offset);
+        uint32_t* instruction_ptr = reinterpret_cast<uint32_t*>(source_code + exit.instruction_offset);
         
         // Patch a B (Unconditional Branch) instruction
         // Format: 0x14000000 | imm26  (imm26 is a 26-bit signed immediate, units of 4 bytes)
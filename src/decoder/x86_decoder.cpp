@@ -5,6 +5,139 @@
 namespace xenoarm_jit {
 namespace decoder {
 
+namespace {
+
+uint32_t read_u32(const uint8_t* bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+// Memory form of a ModRM operand: [rm], [rm + disp8], [rm + disp32], or
+// [disp32] for mod 0 / rm 5. Returns the length of ModRM and displacement,
+// or 0 for register forms, SIB addressing (not decoded yet) and truncated
+// input.
+size_t decode_memory_operand(const uint8_t* modrm_bytes, size_t max_bytes, ir::IrDataType data_type,
+                             ir::IrOperand& mem_op) {
+    if (max_bytes < 1) {
+        return 0;
+    }
+    uint8_t modrm = modrm_bytes[0];
+    uint8_t mod = (modrm >> 6) & 0x3;
+    uint8_t rm = modrm & 0x7;
+    if (mod == 3 || rm == 4) {
+        return 0;
+    }
+    
+    bool absolute = mod == 0 && rm == 5;
+    size_t disp_size = (mod == 2 || absolute) ? 4 : (mod == 1 ? 1 : 0);
+    if (max_bytes < 1 + disp_size) {
+        return 0;
+    }
+    int32_t displacement = 0;
+    if (disp_size == 1) {
+        displacement = static_cast<int8_t>(modrm_bytes[1]);
+    } else if (disp_size == 4) {
+        displacement = static_cast<int32_t>(read_u32(modrm_bytes + 1));
+    }
+    mem_op = ir::IrOperand::make_mem(absolute ? ir::MemoryOperand::NO_REGISTER : rm,
+                                     ir::MemoryOperand::NO_REGISTER, 1, displacement, data_type);
+    return 1 + disp_size;
+}
+
+// LOCK-prefixed read-modify-write instructions (32-bit forms) and XCHG with
+// a memory operand, which is locked without the prefix. bytes starts after
+// any LOCK prefix. Returns the length, or 0 if the bytes are not one of
+// these instructions or are incomplete.
+size_t decode_atomic(const uint8_t* bytes, size_t max_bytes, std::vector<ir::IrInstruction>& result) {
+    const uint32_t EAX = 0, ECX = 1, EDX = 2, EBX = 3;
+    bool two_byte = max_bytes >= 1 && bytes[0] == 0x0F;
+    size_t opcode_length = two_byte ? 2 : 1;
+    if (max_bytes < opcode_length + 1) {
+        return 0;
+    }
+    uint8_t opcode = bytes[opcode_length - 1];
+    uint8_t reg = (bytes[opcode_length] >> 3) & 0x7;
+    ir::IrOperand reg_op = ir::IrOperand::make_reg(reg, ir::IrDataType::I32);
+    
+    ir::IrOperand mem_op;
+    bool is_cmpxchg8b = two_byte && opcode == 0xC7;
+    size_t length = decode_memory_operand(bytes + opcode_length, max_bytes - opcode_length,
+                                          is_cmpxchg8b ? ir::IrDataType::I64 : ir::IrDataType::I32, mem_op);
+    if (length == 0) {
+        return 0;
+    }
+    length += opcode_length;
+    
+    if (two_byte) {
+        switch (opcode) {
+            case 0xC1: // XADD r/m32, r32
+                result.push_back(ir::IrInstruction(ir::IrInstructionType::ATOMIC_XADD, {mem_op, reg_op}));
+                return length;
+            case 0xB1: // CMPXCHG r/m32, r32
+                result.push_back(ir::IrInstruction(ir::IrInstructionType::ATOMIC_CMPXCHG, {
+                    mem_op, ir::IrOperand::make_reg(EAX, ir::IrDataType::I32), reg_op}));
+                return length;
+            case 0xC7: // CMPXCHG8B m64 (/1)
+                if (reg != 1) {
+                    return 0;
+                }
+                result.push_back(ir::IrInstruction(ir::IrInstructionType::ATOMIC_CMPXCHG8B, {
+                    mem_op,
+                    ir::IrOperand::make_reg(EAX, ir::IrDataType::I32), ir::IrOperand::make_reg(EDX, ir::IrDataType::I32),
+                    ir::IrOperand::make_reg(EBX, ir::IrDataType::I32), ir::IrOperand::make_reg(ECX, ir::IrDataType::I32)}));
+                return length;
+            default:
+                return 0;
+        }
+    }
+    
+    switch (opcode) {
+        case 0x01: // ADD r/m32, r32
+        case 0x09: // OR
+        case 0x21: // AND
+        case 0x29: // SUB
+        case 0x31: { // XOR
+            ir::IrInstructionType type = opcode == 0x01 ? ir::IrInstructionType::ATOMIC_ADD
+                : opcode == 0x09 ? ir::IrInstructionType::ATOMIC_OR
+                : opcode == 0x21 ? ir::IrInstructionType::ATOMIC_AND
+                : opcode == 0x29 ? ir::IrInstructionType::ATOMIC_SUB
+                : ir::IrInstructionType::ATOMIC_XOR;
+            result.push_back(ir::IrInstruction(type, {mem_op, reg_op}));
+            return length;
+        }
+        case 0x87: // XCHG r/m32, r32
+            result.push_back(ir::IrInstruction(ir::IrInstructionType::ATOMIC_XCHG, {mem_op, reg_op}));
+            return length;
+        case 0x81: // Group 1 r/m32, imm32
+        case 0x83: { // Group 1 r/m32, imm8 (sign-extended)
+            static const ir::IrInstructionType group1[8] = {
+                ir::IrInstructionType::ATOMIC_ADD, ir::IrInstructionType::ATOMIC_OR,
+                ir::IrInstructionType::NOP, ir::IrInstructionType::NOP, // ADC, SBB
+                ir::IrInstructionType::ATOMIC_AND, ir::IrInstructionType::ATOMIC_SUB,
+                ir::IrInstructionType::ATOMIC_XOR, ir::IrInstructionType::NOP // CMP
+            };
+            size_t imm_size = opcode == 0x81 ? 4 : 1;
+            if (group1[reg] == ir::IrInstructionType::NOP || max_bytes < length + imm_size) {
+                return 0;
+            }
+            int32_t imm = imm_size == 4 ? static_cast<int32_t>(read_u32(bytes + length))
+                                        : static_cast<int8_t>(bytes[length]);
+            result.push_back(ir::IrInstruction(group1[reg], {mem_op, ir::IrOperand::make_imm(imm, ir::IrDataType::I32)}));
+            return length + imm_size;
+        }
+        case 0xFF: // INC r/m32 (/0), DEC r/m32 (/1)
+            if (reg > 1) {
+                return 0;
+            }
+            result.push_back(ir::IrInstruction(reg == 0 ? ir::IrInstructionType::ATOMIC_ADD : ir::IrInstructionType::ATOMIC_SUB,
+                                               {mem_op, ir::IrOperand::make_imm(1, ir::IrDataType::I32)}));
+            return length;
+        default:
+            return 0;
+    }
+}
+
+} // anonymous namespace
+
 X86Decoder::X86Decoder() {
     // Initialize decoder state
     LOG_DEBUG("X86Decoder created");
@@ -28,7 +161,7 @@ ir::IrFunction X86Decoder::decode_block(const uint8_t* guest_code, uint64_t gues
     while (offset < max_bytes) {
         // Try to decode a single instruction
         size_t bytes_read = 0;
-        std::vector<ir::IrInstruction> instructions = decode_instruction(guest_code + offset, bytes_read, max_bytes - offset);
+        std::vector<ir::IrInstruction> instructions = decode_instruction(guest_code + offset, guest_address + offset, bytes_read, max_bytes - offset);
         
         // If we couldn't decode an instruction, stop processing
         if (bytes_read == 0 || instructions.empty()) {
@@ -37,17 +170,16 @@ ir::IrFunction X86Decoder::decode_block(const uint8_t* guest_code, uint64_t gues
         }
         
         // Add decoded instructions to the basic block
-        for (const auto& instr : instructions) {
+        for (auto& instr : instructions) {
+            instr.guest_address = static_cast<uint32_t>(guest_address + offset);
             block.instructions.push_back(instr);
             
             // If this is a terminator instruction, end the block
             if (instr.type == ir::IrInstructionType::JMP || 
                 instr.type == ir::IrInstructionType::CALL || 
                 instr.type == ir::IrInstructionType::RET ||
-                instr.type == ir::IrInstructionType::BR_EQ ||
-                instr.type == ir::IrInstructionType::BR_NE ||
-                // Add other branch types as needed
-                false) {
+                (instr.type >= ir::IrInstructionType::BR_EQ &&
+                 instr.type <= ir::IrInstructionType::BR_NOT_CARRY)) {
                 
                 offset += bytes_read;
                 goto end_block;  // Break out of both loops
@@ -61,6 +193,7 @@ ir::IrFunction X86Decoder::decode_block(const uint8_t* guest_code, uint64_t gues
 end_block:
     // Add the block to the function
     func.basic_blocks.push_back(block);
+    func.guest_size = static_cast<uint32_t>(offset);
     
     LOG_DEBUG("Decoded " + std::to_string(offset) + " bytes into " + 
               std::to_string(func.basic_blocks.size()) + " basic blocks with " +
@@ -69,7 +202,7 @@ end_block:
     return func;
 }
 
-std::vector<ir::IrInstruction> X86Decoder::decode_instruction(const uint8_t* instruction_bytes, size_t& bytes_read, size_t max_bytes_for_instruction) {
+std::vector<ir::IrInstruction> X86Decoder::decode_instruction(const uint8_t* instruction_bytes, uint64_t instruction_address, size_t& bytes_read, size_t max_bytes_for_instruction) {
     // This is a simplified decoder for demonstration purposes
     std::vector<ir::IrInstruction> result;
     
@@ -107,6 +240,139 @@ std::vector<ir::IrInstruction> X86Decoder::decode_instruction(const uint8_t* ins
         } else {
             bytes_read = 0;  // Not enough bytes available
         }
+    } else if (instruction_bytes[0] == 0xEB || instruction_bytes[0] == 0xE9) {
+        // JMP rel8 / JMP rel32: the IR carries the absolute guest target so
+        // later stages (chaining, superblock formation) need no re-decoding
+        size_t length = (instruction_bytes[0] == 0xEB) ? 2 : 5;
+        if (max_bytes_for_instruction >= length) {
+            int32_t displacement;
+            if (length == 2) {
+                displacement = static_cast<int8_t>(instruction_bytes[1]);
+            } else {
+                displacement = static_cast<int32_t>(
+                    instruction_bytes[1] |
+                    (instruction_bytes[2] << 8) |
+                    (instruction_bytes[3] << 16) |
+                    (static_cast<uint32_t>(instruction_bytes[4]) << 24));
+            }
+            uint32_t target = static_cast<uint32_t>(instruction_address + length + displacement);
+            
+            std::vector<ir::IrOperand> operands = {ir::IrOperand::make_imm(target, ir::IrDataType::U32)};
+            result.push_back(ir::IrInstruction(ir::IrInstructionType::JMP, operands));
+            bytes_read = length;
+        } else {
+            bytes_read = 0;  // Not enough bytes available
+        }
+    } else if (instruction_bytes[0] == 0xE8) {
+        // CALL rel32
+        if (max_bytes_for_instruction >= 5) {
+            int32_t displacement = static_cast<int32_t>(
+                instruction_bytes[1] |
+                (instruction_bytes[2] << 8) |
+                (instruction_bytes[3] << 16) |
+                (static_cast<uint32_t>(instruction_bytes[4]) << 24));
+            uint32_t target = static_cast<uint32_t>(instruction_address + 5 + displacement);
+            
+            std::vector<ir::IrOperand> operands = {ir::IrOperand::make_imm(target, ir::IrDataType::U32)};
+            result.push_back(ir::IrInstruction(ir::IrInstructionType::CALL, operands));
+            bytes_read = 5;
+        } else {
+            bytes_read = 0;  // Not enough bytes available
+        }
+    } else if ((instruction_bytes[0] >= 0x70 && instruction_bytes[0] <= 0x7F) ||
+               (instruction_bytes[0] == 0x0F && max_bytes_for_instruction >= 2 &&
+                instruction_bytes[1] >= 0x80 && instruction_bytes[1] <= 0x8F)) {
+        // Jcc rel8 / Jcc rel32: the branch-not-taken path is the next instruction
+        static const ir::IrInstructionType condition_map[16] = {
+            ir::IrInstructionType::BR_OVERFLOW, ir::IrInstructionType::BR_NOT_OVERFLOW, // JO, JNO
+            ir::IrInstructionType::BR_BL,       ir::IrInstructionType::BR_BHE,          // JB, JAE
+            ir::IrInstructionType::BR_EQ,       ir::IrInstructionType::BR_NE,           // JE, JNE
+            ir::IrInstructionType::BR_BE,       ir::IrInstructionType::BR_BH,           // JBE, JA
+            ir::IrInstructionType::BR_SIGN,     ir::IrInstructionType::BR_NOT_SIGN,     // JS, JNS
+            ir::IrInstructionType::BR_PARITY,   ir::IrInstructionType::BR_NOT_PARITY,   // JP, JNP
+            ir::IrInstructionType::BR_LT,       ir::IrInstructionType::BR_GE,           // JL, JGE
+            ir::IrInstructionType::BR_LE,       ir::IrInstructionType::BR_GT            // JLE, JG
+        };
+        bool is_near = instruction_bytes[0] == 0x0F;
+        size_t length = is_near ? 6 : 2;
+        if (max_bytes_for_instruction >= length) {
+            int32_t displacement;
+            uint8_t condition;
+            if (is_near) {
+                condition = instruction_bytes[1] & 0x0F;
+                displacement = static_cast<int32_t>(
+                    instruction_bytes[2] |
+                    (instruction_bytes[3] << 8) |
+                    (instruction_bytes[4] << 16) |
+                    (static_cast<uint32_t>(instruction_bytes[5]) << 24));
+            } else {
+                condition = instruction_bytes[0] & 0x0F;
+                displacement = static_cast<int8_t>(instruction_bytes[1]);
+            }
+            uint32_t target = static_cast<uint32_t>(instruction_address + length + displacement);
+            
+            std::vector<ir::IrOperand> operands = {ir::IrOperand::make_imm(target, ir::IrDataType::U32)};
+            result.push_back(ir::IrInstruction(condition_map[condition], operands));
+            bytes_read = length;
+        } else {
+            bytes_read = 0;  // Not enough bytes available
+        }
+    } else if (instruction_bytes[0] == 0x89 || instruction_bytes[0] == 0x8B) {
+        // MOV r/m32, r32 (89) / MOV r32, r/m32 (8B). Memory forms become
+        // STORE mem, reg / LOAD reg, mem; SIB addressing is not decoded yet.
+        bool is_load = instruction_bytes[0] == 0x8B;
+        if (max_bytes_for_instruction >= 2) {
+            uint8_t modrm = instruction_bytes[1];
+            uint8_t mod = (modrm >> 6) & 0x3;
+            uint8_t reg = (modrm >> 3) & 0x7;
+            uint8_t rm = modrm & 0x7;
+
+            ir::IrOperand reg_op = ir::IrOperand::make_reg(reg, ir::IrDataType::I32);
+            if (mod == 3) {
+                ir::IrOperand rm_op = ir::IrOperand::make_reg(rm, ir::IrDataType::I32);
+                std::vector<ir::IrOperand> operands = is_load
+                    ? std::vector<ir::IrOperand>{reg_op, rm_op}
+                    : std::vector<ir::IrOperand>{rm_op, reg_op};
+                result.push_back(ir::IrInstruction(ir::IrInstructionType::MOV, operands));
+                bytes_read = 2;
+            } else if (rm != 4) {
+                ir::IrOperand mem_op;
+                size_t length = 1 + decode_memory_operand(instruction_bytes + 1, max_bytes_for_instruction - 1,
+                                                          ir::IrDataType::I32, mem_op);
+                if (length > 1) {
+                    std::vector<ir::IrOperand> operands = is_load
+                        ? std::vector<ir::IrOperand>{reg_op, mem_op}
+                        : std::vector<ir::IrOperand>{mem_op, reg_op};
+                    result.push_back(ir::IrInstruction(
+                        is_load ? ir::IrInstructionType::LOAD : ir::IrInstructionType::STORE, operands));
+                    bytes_read = length;
+                } else {
+                    bytes_read = 0;  // Not enough bytes available
+                }
+            } else {
+                LOG_WARNING("MOV with SIB addressing is not supported yet");
+                bytes_read = 0;
+            }
+        } else {
+            bytes_read = 0;  // Not enough bytes available
+        }
+    } else if (instruction_bytes[0] == 0xF0) {
+        // LOCK prefix: only the read-modify-write forms decode_atomic knows
+        // may follow; anything else would raise #UD on the guest
+        bytes_read = decode_atomic(instruction_bytes + 1, max_bytes_for_instruction - 1, result);
+        if (bytes_read == 0) {
+            LOG_WARNING("Unsupported LOCK-prefixed instruction at 0x" + std::to_string(instruction_address));
+        } else {
+            bytes_read += 1;
+        }
+    } else if (instruction_bytes[0] == 0x87 && max_bytes_for_instruction >= 2 &&
+               (instruction_bytes[1] >> 6) != 3) {
+        // XCHG with memory is locked even without the prefix
+        bytes_read = decode_atomic(instruction_bytes, max_bytes_for_instruction, result);
+    } else if (instruction_bytes[0] == 0xC3) {
+        // RET
+        result.push_back(ir::IrInstruction(ir::IrInstructionType::RET));
+        bytes_read = 1;
     } else {
         // For testing, just create a NOP for any other instruction
         ir::IrInstruction nop(ir::IrInstructionType::NOP);
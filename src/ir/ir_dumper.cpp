@@ -143,6 +143,18 @@ const char* ir_instruction_type_to_string(IrInstructionType type) {
         // Host Calls
         case IrInstructionType::HOST_CALL: return "HOST_CALL";
         
+        // Memory barriers and atomics
+        case IrInstructionType::MEM_FENCE: return "MEM_FENCE";
+        case IrInstructionType::ATOMIC_ADD: return "ATOMIC_ADD";
+        case IrInstructionType::ATOMIC_SUB: return "ATOMIC_SUB";
+        case IrInstructionType::ATOMIC_AND: return "ATOMIC_AND";
+        case IrInstructionType::ATOMIC_OR: return "ATOMIC_OR";
+        case IrInstructionType::ATOMIC_XOR: return "ATOMIC_XOR";
+        case IrInstructionType::ATOMIC_XADD: return "ATOMIC_XADD";
+        case IrInstructionType::ATOMIC_XCHG: return "ATOMIC_XCHG";
+        case IrInstructionType::ATOMIC_CMPXCHG: return "ATOMIC_CMPXCHG";
+        case IrInstructionType::ATOMIC_CMPXCHG8B: return "ATOMIC_CMPXCHG8B";
+        
         // Miscellaneous
         case IrInstructionType::NOP: return "NOP";
         case IrInstructionType::DEBUG_BREAK: return "DEBUG_BREAK";
@@ -177,6 +189,13 @@ const char* ir_instruction_type_to_string(IrInstructionType type) {
 // Helper to dump a single IrInstruction
 void dump_ir_instruction(std::ostream& os, const IrInstruction& instruction) {
     os << "    " << ir_instruction_type_to_string(instruction.type);
+    if (instruction.memory_order == IrMemoryOrder::ACQUIRE) {
+        os << ".ACQ";
+    } else if (instruction.memory_order == IrMemoryOrder::RELEASE) {
+        os << ".REL";
+    } else if (instruction.memory_order == IrMemoryOrder::DEVICE) {
+        os << ".DEV";
+    }
     for (size_t i = 0; i < instruction.operands.size(); ++i) {
         os << (i == 0 ? " " : ", ");
         dump_ir_operand(os, instruction.operands[i]);
@@ -0,0 +1,108 @@
+#include "xenoarm_jit/ir_optimizer.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace xenoarm_jit {
+namespace ir {
+
+namespace {
+
+// Instructions after which register contents are observable outside the block
+bool ends_analysis_window(IrInstructionType type) {
+    switch (type) {
+        case IrInstructionType::JMP:
+        case IrInstructionType::CALL:
+        case IrInstructionType::RET:
+        case IrInstructionType::LABEL:
+        case IrInstructionType::HOST_CALL:
+        case IrInstructionType::DEBUG_BREAK:
+        case IrInstructionType::MEM_FENCE:
+            return true;
+        default:
+            return type >= IrInstructionType::BR_EQ && type <= IrInstructionType::BR_COND;
+    }
+}
+
+bool is_full_width(IrDataType type) {
+    return type == IrDataType::I32 || type == IrDataType::U32 ||
+           type == IrDataType::I64 || type == IrDataType::U64;
+}
+
+} // anonymous namespace
+
+size_t remove_nops(IrBasicBlock& block) {
+    size_t before = block.instructions.size();
+    block.instructions.erase(
+        std::remove_if(block.instructions.begin(), block.instructions.end(),
+                       [](const IrInstruction& instr) { return instr.type == IrInstructionType::NOP; }),
+        block.instructions.end());
+    return before - block.instructions.size();
+}
+
+size_t eliminate_dead_moves(IrBasicBlock& block) {
+    // Backward scan: 'overwritten' holds registers that are fully redefined
+    // later in the window without an intervening read
+    std::unordered_set<uint32_t> overwritten;
+    std::vector<bool> dead(block.instructions.size(), false);
+    size_t removed = 0;
+
+    for (size_t i = block.instructions.size(); i-- > 0;) {
+        const IrInstruction& instr = block.instructions[i];
+
+        if (ends_analysis_window(instr.type)) {
+            overwritten.clear();
+            continue;
+        }
+
+        bool is_reg_move = instr.type == IrInstructionType::MOV &&
+                           instr.operands.size() == 2 &&
+                           instr.operands[0].type == IrOperandType::REGISTER &&
+                           is_full_width(instr.operands[0].data_type);
+
+        if (is_reg_move && overwritten.count(instr.operands[0].reg_idx)) {
+            dead[i] = true;
+            removed++;
+            continue;
+        }
+
+        if (is_reg_move) {
+            overwritten.insert(instr.operands[0].reg_idx);
+        }
+
+        // Everything this instruction reads becomes live again. Operand 0 of a
+        // non-MOV is read-modify-write, so all register operands count as reads.
+        for (size_t op = is_reg_move ? 1 : 0; op < instr.operands.size(); ++op) {
+            const IrOperand& operand = instr.operands[op];
+            if (operand.type == IrOperandType::REGISTER) {
+                overwritten.erase(operand.reg_idx);
+            } else if (operand.type == IrOperandType::MEMORY) {
+                // Address registers are not tracked precisely
+                overwritten.clear();
+            }
+        }
+    }
+
+    if (removed > 0) {
+        size_t out = 0;
+        for (size_t i = 0; i < block.instructions.size(); ++i) {
+            if (!dead[i]) {
+                block.instructions[out++] = block.instructions[i];
+            }
+        }
+        block.instructions.erase(block.instructions.begin() + out, block.instructions.end());
+    }
+
+    return removed;
+}
+
+IrOptimizationStats optimize_ir_function(IrFunction& ir_func) {
+    IrOptimizationStats stats;
+    for (auto& block : ir_func.basic_blocks) {
+        stats.nops_removed += remove_nops(block);
+        stats.dead_moves_removed += eliminate_dead_moves(block);
+    }
+    return stats;
+}
+
+} // namespace ir
+} // namespace xenoarm_jit
@@ -0,0 +1,199 @@
+#include "xenoarm_jit/compile_thread_pool.h"
+#include "logging/logger.h"
+
+namespace xenoarm_jit {
+
+CompileThreadPool::CompileThreadPool(size_t thread_count, TranslateFunction translate, WorkerInitFunction init)
+    : translate_(std::move(translate)), init_(std::move(init)), stopping_(false),
+      invalidation_epoch_(0), in_flight_count_(0), completed_count_(0) {
+    workers_.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back(&CompileThreadPool::worker_loop, this);
+    }
+    LOG_INFO("CompileThreadPool started with " + std::to_string(thread_count) + " threads");
+}
+
+CompileThreadPool::~CompileThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_available_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+
+    // Free blocks nobody collected
+    for (auto& entry : requests_) {
+        delete entry.second->block;
+    }
+    LOG_DEBUG("CompileThreadPool destroyed");
+}
+
+bool CompileThreadPool::request(uint32_t guest_address) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = requests_.find(guest_address);
+        if (it != requests_.end()) {
+            if (it->second->status != TranslationRequestStatus::FAILED) {
+                return false;
+            }
+            requests_.erase(it); // Retry a failed translation
+        }
+
+        auto request = std::make_shared<Request>(Request{guest_address, TranslationRequestStatus::PENDING, nullptr, false, false, 0});
+        requests_[guest_address] = request;
+        queue_.push_back(request);
+    }
+    work_available_.notify_one();
+    return true;
+}
+
+TranslationRequestStatus CompileThreadPool::get_status(uint32_t guest_address) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = requests_.find(guest_address);
+    return it != requests_.end() ? it->second->status : TranslationRequestStatus::NONE;
+}
+
+void CompileThreadPool::wait(uint32_t guest_address) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_done_.wait(lock, [this, guest_address]() {
+        auto it = requests_.find(guest_address);
+        return it == requests_.end() || it->second->status != TranslationRequestStatus::PENDING;
+    });
+}
+
+std::vector<translation_cache::TranslatedBlock*> CompileThreadPool::take_completed() {
+    std::vector<translation_cache::TranslatedBlock*> blocks;
+    if (completed_count_.load(std::memory_order_acquire) == 0) {
+        return blocks;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& request : completed_) {
+        if (request->cancelled || request->status != TranslationRequestStatus::READY) {
+            continue;
+        }
+        blocks.push_back(request->block);
+        request->block = nullptr;
+        requests_.erase(request->guest_address);
+    }
+    completed_.clear();
+    completed_count_.store(0, std::memory_order_relaxed);
+    return blocks;
+}
+
+void CompileThreadPool::clear_failed(uint32_t guest_address) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = requests_.find(guest_address);
+    if (it != requests_.end() && it->second->status == TranslationRequestStatus::FAILED) {
+        requests_.erase(it);
+    }
+}
+
+void CompileThreadPool::cancel_range(uint64_t start_address, uint64_t end_address) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // In-flight translations may already have read the old bytes; their blocks
+    // are checked against this range when they complete
+    if (in_flight_count_ > 0) {
+        recent_invalidations_.push_back({++invalidation_epoch_, {start_address, end_address}});
+    }
+    
+    for (auto it = requests_.begin(); it != requests_.end();) {
+        Request& request = *it->second;
+        bool affected = false;
+        if (request.block) {
+            affected = request.block->overlaps(start_address, end_address);
+        } else if (!request.in_flight) {
+            affected = request.guest_address >= start_address && request.guest_address <= end_address;
+        }
+        if (!affected) {
+            ++it;
+            continue;
+        }
+        request.cancelled = true;
+        delete request.block;
+        request.block = nullptr;
+        it = requests_.erase(it);
+    }
+    work_done_.notify_all();
+}
+
+void CompileThreadPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_done_.wait(lock, [this]() { return in_flight_count_ == 0; });
+}
+
+size_t CompileThreadPool::get_pending_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t count = 0;
+    for (const auto& entry : requests_) {
+        if (entry.second->status == TranslationRequestStatus::PENDING) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void CompileThreadPool::worker_loop() {
+    CompileWorkerContext worker;
+    if (init_) {
+        init_(worker);
+    }
+
+    while (true) {
+        std::shared_ptr<Request> request;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_available_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            request = queue_.front();
+            queue_.pop_front();
+            if (request->cancelled) {
+                continue;
+            }
+            request->in_flight = true;
+            request->start_epoch = invalidation_epoch_;
+            in_flight_count_++;
+        }
+
+        translation_cache::TranslatedBlock* block = translate_(worker, request->guest_address);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            request->in_flight = false;
+            in_flight_count_--;
+            
+            for (const auto& invalidation : recent_invalidations_) {
+                if (block && invalidation.first > request->start_epoch &&
+                    block->overlaps(invalidation.second.first, invalidation.second.second)) {
+                    // Guest code changed while we were translating it
+                    request->cancelled = true;
+                    auto it = requests_.find(request->guest_address);
+                    if (it != requests_.end() && it->second == request) {
+                        requests_.erase(it);
+                    }
+                    break;
+                }
+            }
+            if (in_flight_count_ == 0) {
+                recent_invalidations_.clear();
+            }
+            
+            if (request->cancelled) {
+                delete block;
+            } else {
+                request->block = block;
+                request->status = block ? TranslationRequestStatus::READY : TranslationRequestStatus::FAILED;
+                completed_.push_back(request);
+                completed_count_.fetch_add(1, std::memory_order_release);
+            }
+        }
+        work_done_.notify_all();
+    }
+}
+
+} // namespace xenoarm_jit
@@ -3,9 +3,15 @@
 #include "xenoarm_jit/simd_state.h"
 #include "xenoarm_jit/ir.h"
 #include "xenoarm_jit/decoder.h"
+#include "xenoarm_jit/ir_optimizer.h"
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <memory>
+#include <set>
 #include <sstream>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 
 namespace XenoARM_JIT {
@@ -13,9 +19,6 @@ namespace XenoARM_JIT {
 // Thread-local error code storage
 thread_local int g_last_error = JIT_ERROR_NONE;
 
-// Global static to track JIT initialization state
-static bool g_jit_initialized = false;
-
 // Set the last error code
 void set_last_error(int error_code) {
     g_last_error = error_code;
@@ -34,15 +37,580 @@ static void log_callback_adapter(int level, const char* message) {
     }
 }
 
-JitContext* Jit_Init(const JitConfig& config) {
-    std::ostringstream oss_init_debug_entry;
-    oss_init_debug_entry << "Jit_Init entered. g_jit_initialized = " << (g_jit_initialized ? "true" : "false");
-    LOG_DEBUG(oss_init_debug_entry.str());
+// Host reservation required for fastmem: the whole 32-bit guest address space
+static const uint64_t FASTMEM_RESERVATION_SIZE = 1ULL << 32;
+
+// Maximum number of guest blocks folded into one tier-1 superblock
+static const size_t MAX_SUPERBLOCK_BLOCKS = 4;
+
+// Bumped whenever generated code changes shape, so stale shared or persisted
+// translations never match
+static const uint32_t GENERATED_CODE_VERSION = 6;
+
+// Everything in the configuration that the generated code depends on
+static uint64_t translation_config_key(const JitContext* context) {
+    using xenoarm_jit::translation_cache::SharedCodeStore;
+    const uint8_t config_bits[] = {
+        static_cast<uint8_t>(context->config.pin_guest_registers),
+        static_cast<uint8_t>(context->config.conservative_memory_model),
+        static_cast<uint8_t>(context->config.memory_ordering_lowering),
+        static_cast<uint8_t>(context->config.use_lse_atomics),
+        static_cast<uint8_t>(context->config.enable_fastmem),
+        static_cast<uint8_t>(context->config.generated_code_read != nullptr)
+    };
+    uint64_t key = SharedCodeStore::hash_bytes(&GENERATED_CODE_VERSION, sizeof(GENERATED_CODE_VERSION));
+    key = SharedCodeStore::hash_bytes(config_bits, sizeof(config_bits), key);
+    // Region ordering policies decide the barriers of absolute-address accesses
+    if (context->memory_model) {
+        for (const xenoarm_jit::MemoryModel::Region& region : context->memory_model->get_regions()) {
+            const uint64_t fields[] = {region.start, region.end, region.policy};
+            key = SharedCodeStore::hash_bytes(fields, sizeof(fields), key);
+        }
+    }
+    return key;
+}
+
+// Shared code store key: guest bytes covered by the block plus everything
+// else the generated code depends on
+static uint64_t shared_code_key(const JitContext* context, uint64_t content_hash,
+                                uint32_t guest_address, xenoarm_jit::translation_cache::CompilationTier tier) {
+    using xenoarm_jit::translation_cache::SharedCodeStore;
+    const uint8_t tier_bits = static_cast<uint8_t>(tier);
+    uint64_t key = translation_config_key(context);
+    key = SharedCodeStore::hash_bytes(&content_hash, sizeof(content_hash), key);
+    key = SharedCodeStore::hash_bytes(&guest_address, sizeof(guest_address), key);
+    return SharedCodeStore::hash_bytes(&tier_bits, sizeof(tier_bits), key);
+}
+
+// Guest byte hash of a block as computed at translation time: each covered
+// range in order, entry range first
+static uint64_t hash_guest_ranges(JitContext* context, uint64_t guest_address, uint32_t guest_size,
+                                  const std::vector<std::pair<uint64_t, uint32_t>>& superblock_ranges) {
+    std::vector<uint8_t> bytes(guest_size);
+    context->config.read_memory_block(static_cast<uint32_t>(guest_address), bytes.data(), guest_size, context->config.user_data);
+    uint64_t hash = xenoarm_jit::translation_cache::SharedCodeStore::hash_bytes(bytes.data(), bytes.size());
+    for (const auto& range : superblock_ranges) {
+        bytes.resize(range.second);
+        context->config.read_memory_block(static_cast<uint32_t>(range.first), bytes.data(), range.second, context->config.user_data);
+        hash = xenoarm_jit::translation_cache::SharedCodeStore::hash_bytes(bytes.data(), bytes.size(), hash);
+    }
+    return hash;
+}
+
+// Private block with a copy of a persisted translation, relocated for this
+// process. Guest bytes are not checked here.
+static xenoarm_jit::translation_cache::TranslatedBlock* block_from_persistent(
+    const xenoarm_jit::translation_cache::PersistentBlock& persisted) {
+    xenoarm_jit::translation_cache::TranslatedBlock* block =
+        new xenoarm_jit::translation_cache::TranslatedBlock(persisted.guest_address, persisted.guest_size);
+    block->code.assign(persisted.code, persisted.code + persisted.code_size);
+    for (const auto& relocation : persisted.relocations) {
+        xenoarm_jit::aarch64::CodeGenerator::apply_relocation(block->code.data(), relocation, relocation.target);
+    }
+    block->tier = persisted.tier;
+    block->superblock_ranges = persisted.superblock_ranges;
+    block->static_successors = persisted.static_successors;
+    block->exits = persisted.exits;
+    block->relocations = persisted.relocations;
+    block->fastmem_sites = persisted.fastmem_sites;
+    block->guest_hash = persisted.guest_hash;
+    return block;
+}
+
+// Use a block from the persistent cache instead of translating, if the file
+// has one for guest_address at tier or better and guest memory still holds
+// the bytes it was translated from
+static xenoarm_jit::translation_cache::TranslatedBlock* load_persistent_block(
+    JitContext* context, uint32_t guest_address, xenoarm_jit::translation_cache::CompilationTier tier) {
+    xenoarm_jit::translation_cache::PersistentBlock persisted;
+    if (!context->persistent_cache->find(guest_address, &persisted) || persisted.tier < tier) {
+        return nullptr;
+    }
+    if (hash_guest_ranges(context, persisted.guest_address, persisted.guest_size,
+                          persisted.superblock_ranges) != persisted.guest_hash) {
+        context->persistent_rejected++;
+        return nullptr;
+    }
+    context->persistent_loaded++;
+    return block_from_persistent(persisted);
+}
+
+// Private block mapping shared code
+static xenoarm_jit::translation_cache::TranslatedBlock* block_from_shared_code(
+    std::shared_ptr<const xenoarm_jit::translation_cache::SharedCode> shared) {
+    xenoarm_jit::translation_cache::TranslatedBlock* block =
+        new xenoarm_jit::translation_cache::TranslatedBlock(shared->guest_address, shared->guest_size);
+    block->tier = shared->tier;
+    block->superblock_ranges = shared->superblock_ranges;
+    block->static_successors = shared->static_successors;
+    block->relocations = shared->relocations;
+    block->fastmem_sites = shared->fastmem_sites;
+    block->guest_hash = shared->guest_hash;
+    block->code_ptr = const_cast<uint8_t*>(shared->code.data());
+    block->shared_code = std::move(shared);
+    return block;
+}
+
+// Direct branch/call targets and fallthrough address of a block ending in
+// instructions.back(); fallthrough is the guest address after the block
+static std::vector<uint64_t> static_successors_of(
+    const std::vector<xenoarm_jit::ir::IrInstruction>& instructions, uint64_t fallthrough) {
+    std::vector<uint64_t> successors;
+    const xenoarm_jit::ir::IrInstruction& last = instructions.back();
+    bool is_conditional = last.type >= xenoarm_jit::ir::IrInstructionType::BR_EQ &&
+                          last.type <= xenoarm_jit::ir::IrInstructionType::BR_NOT_CARRY;
+    if ((last.type == xenoarm_jit::ir::IrInstructionType::JMP ||
+         last.type == xenoarm_jit::ir::IrInstructionType::CALL || is_conditional) &&
+        last.operands.size() == 1 && last.operands[0].type == xenoarm_jit::ir::IrOperandType::IMMEDIATE) {
+        successors.push_back(last.operands[0].imm_value);
+    }
+    if (last.type == xenoarm_jit::ir::IrInstructionType::CALL || is_conditional) {
+        successors.push_back(fallthrough);
+    }
+    return successors;
+}
+
+// Lowering of TSO-ordered accesses, from the resolved config
+static xenoarm_jit::MemoryModel::OrderingLowering ordering_lowering(const JitConfig& config) {
+    switch (config.memory_ordering_lowering) {
+        case MEMORY_ORDERING_ACQUIRE_RELEASE:
+            return xenoarm_jit::MemoryModel::LOWERING_LDAR_STLR;
+        case MEMORY_ORDERING_RCPC:
+            return xenoarm_jit::MemoryModel::LOWERING_LDAPR_STLR;
+        default:
+            return xenoarm_jit::MemoryModel::LOWERING_BARRIERS;
+    }
+}
+
+// Runs the translation pipeline for guest_address at the requested tier and
+// returns an unstored block, or nullptr on failure. The pipeline components are
+// passed explicitly so compile threads can use their own instances.
+// Tier 0 is a template translation: no IR passes and whole-lifetime allocation.
+// Tier 1 follows direct jumps to form a superblock, runs the IR passes and
+// allocates with live-range splitting.
+static xenoarm_jit::translation_cache::TranslatedBlock* translate_at_tier(
+    JitContext* context, xenoarm_jit::decoder::X86Decoder& decoder,
+    xenoarm_jit::register_allocation::RegisterAllocator& register_allocator,
+    xenoarm_jit::aarch64::CodeGenerator& code_generator,
+    uint32_t guest_address, xenoarm_jit::translation_cache::CompilationTier tier) {
+    using xenoarm_jit::translation_cache::CompilationTier;
     
-    if (g_jit_initialized) {
-        LOG_ERROR("JIT already initialized");
+    // (With eager loading every file block was installed at Jit_Init)
+    if (context->persistent_cache && !context->config.persistent_cache_eager_load) {
+        if (xenoarm_jit::translation_cache::TranslatedBlock* persisted = load_persistent_block(context, guest_address, tier)) {
+            return persisted;
+        }
+    }
+    
+    // 1. Read Guest Code
+    const size_t MAX_GUEST_BLOCK_BYTES_TO_READ = 256; // Increased read size
+    std::vector<uint8_t> guest_code_bytes(MAX_GUEST_BLOCK_BYTES_TO_READ);
+    // Assuming read_memory_block fills the buffer or up to an actual end.
+    // We don't get bytes_read back, which is a limitation.
+    context->config.read_memory_block(guest_address, guest_code_bytes.data(), MAX_GUEST_BLOCK_BYTES_TO_READ, context->config.user_data);
+
+    // 2. Decode instructions and generate IR Function
+    xenoarm_jit::ir::IrFunction ir_function = decoder.decode_block(
+        guest_code_bytes.data(),
+        guest_address,
+        MAX_GUEST_BLOCK_BYTES_TO_READ // Decoder should not read past this from the buffer
+    );
+
+    if (ir_function.basic_blocks.empty() || ir_function.basic_blocks[0].instructions.empty()) {
+        LOG_WARNING("Decoder produced no IR for guest_address: 0x" + std::to_string(guest_address));
+        set_last_error(JIT_ERROR_TRANSLATION_FAILED);
+        return nullptr; // Nothing to translate
+    }
+    
+    // Assuming we operate on the first basic block for now
+    std::vector<xenoarm_jit::ir::IrInstruction>& ir_instructions = ir_function.basic_blocks[0].instructions;
+    std::vector<std::pair<uint64_t, uint32_t>> superblock_ranges;
+    
+    // Hash of the guest bytes, for shared and persistent caches
+    xenoarm_jit::translation_cache::SharedCodeStore* shared_store = context->config.shared_code_store;
+    uint64_t content_hash = xenoarm_jit::translation_cache::SharedCodeStore::hash_bytes(
+        guest_code_bytes.data(), std::min<size_t>(ir_function.guest_size, MAX_GUEST_BLOCK_BYTES_TO_READ));
+
+    if (tier == CompilationTier::TIER1) {
+        // Superblock formation: fold the targets of trailing direct jumps into
+        // this block. Back-edges to an already included block stay as exits.
+        std::set<uint64_t> included = {guest_address};
+        while (superblock_ranges.size() + 1 < MAX_SUPERBLOCK_BLOCKS &&
+               ir_instructions.back().type == xenoarm_jit::ir::IrInstructionType::JMP &&
+               ir_instructions.back().operands.size() == 1 &&
+               ir_instructions.back().operands[0].type == xenoarm_jit::ir::IrOperandType::IMMEDIATE) {
+            uint32_t target = static_cast<uint32_t>(ir_instructions.back().operands[0].imm_value);
+            if (included.count(target)) {
+                break;
+            }
+            
+            context->config.read_memory_block(target, guest_code_bytes.data(), MAX_GUEST_BLOCK_BYTES_TO_READ, context->config.user_data);
+            xenoarm_jit::ir::IrFunction next = decoder.decode_block(
+                guest_code_bytes.data(), target, MAX_GUEST_BLOCK_BYTES_TO_READ);
+            if (next.basic_blocks.empty() || next.basic_blocks[0].instructions.empty()) {
+                break;
+            }
+            
+            ir_instructions.pop_back(); // The jump becomes a fallthrough
+            ir_instructions.insert(ir_instructions.end(),
+                                   next.basic_blocks[0].instructions.begin(),
+                                   next.basic_blocks[0].instructions.end());
+            superblock_ranges.push_back({target, next.guest_size});
+            included.insert(target);
+            content_hash = xenoarm_jit::translation_cache::SharedCodeStore::hash_bytes(
+                guest_code_bytes.data(), std::min<size_t>(next.guest_size, MAX_GUEST_BLOCK_BYTES_TO_READ), content_hash);
+        }
+    }
+    
+    // Successors known statically from the final terminator (speculative pre-translation)
+    std::vector<uint64_t> static_successors = static_successors_of(
+        ir_instructions,
+        superblock_ranges.empty()
+            ? guest_address + ir_function.guest_size
+            : superblock_ranges.back().first + superblock_ranges.back().second);
+
+    // Another context may already have translated identical code
+    uint64_t shared_key = 0;
+    if (shared_store) {
+        shared_key = shared_code_key(context, content_hash, guest_address, tier);
+        std::shared_ptr<const xenoarm_jit::translation_cache::SharedCode> shared = shared_store->acquire(shared_key);
+        if (shared) {
+            return block_from_shared_code(std::move(shared));
+        }
+    }
+
+    if (tier == CompilationTier::TIER1) {
+        xenoarm_jit::ir::optimize_ir_function(ir_function);
+        if (ir_instructions.empty()) {
+            // Keep an entry point even if every instruction was optimised away
+            ir_instructions.push_back(xenoarm_jit::ir::IrInstruction(xenoarm_jit::ir::IrInstructionType::NOP));
+        }
+    }
+
+    // Memory ordering: TSO barriers for shared accesses under the conservative
+    // model, the guest's own fences otherwise; redundant ones are elided
+    if (context->memory_model) {
+        xenoarm_jit::MemoryModel::BarrierStats barrier_stats = context->memory_model->order_memory_accesses(
+            ir_instructions, context->config.conservative_memory_model, ordering_lowering(context->config));
+        context->ordered_instructions += barrier_stats.instructions;
+        context->naive_barriers += barrier_stats.naive_barriers;
+        context->emitted_barriers += barrier_stats.emitted_barriers;
+        context->ordered_accesses += barrier_stats.ordered_accesses;
+        context->relaxed_accesses += barrier_stats.relaxed_accesses;
+        context->device_accesses += barrier_stats.device_accesses;
+    }
+
+    // 3. Perform Register Allocation
+    register_allocator.set_live_range_splitting(tier == CompilationTier::TIER1);
+    auto register_map = register_allocator.allocate(ir_instructions);
+
+    // 4. Generate AArch64 Code
+    std::vector<uint8_t> machine_code = code_generator.generate(
+        ir_instructions, register_map, register_allocator.get_spill_code(),
+        register_allocator.get_spill_code().empty() ? 0 : static_cast<uint32_t>(register_allocator.get_total_spill_size()));
+
+    if (machine_code.empty()) {
+        LOG_ERROR("Code generator produced empty machine code for guest_address: 0x" + std::to_string(guest_address));
+        set_last_error(JIT_ERROR_TRANSLATION_FAILED);
         return nullptr;
     }
+
+    if (tier == CompilationTier::TIER1) {
+        context->tier1_translations++;
+    } else {
+        context->tier0_translations++;
+    }
+    
+    if (shared_store) {
+        auto shared = std::make_shared<xenoarm_jit::translation_cache::SharedCode>();
+        shared->key = shared_key;
+        shared->guest_address = guest_address;
+        shared->guest_size = ir_function.guest_size;
+        shared->tier = tier;
+        shared->superblock_ranges = std::move(superblock_ranges);
+        shared->static_successors = std::move(static_successors);
+        shared->relocations = code_generator.get_relocations();
+        shared->fastmem_sites = code_generator.get_fastmem_sites();
+        shared->guest_hash = content_hash;
+        shared->code = std::move(machine_code);
+        return block_from_shared_code(shared_store->publish(std::move(shared)));
+    }
+
+    xenoarm_jit::translation_cache::TranslatedBlock* new_block =
+        new xenoarm_jit::translation_cache::TranslatedBlock(guest_address, ir_function.guest_size);
+    new_block->code = std::move(machine_code); // Store the raw machine code bytes
+    new_block->tier = tier;
+    new_block->superblock_ranges = std::move(superblock_ranges);
+    new_block->static_successors = std::move(static_successors);
+    new_block->relocations = code_generator.get_relocations();
+    new_block->fastmem_sites = code_generator.get_fastmem_sites();
+    new_block->source_map = code_generator.get_source_map();
+    new_block->guest_hash = content_hash;
+    return new_block;
+}
+
+// Resolve MEMORY_ORDERING_AUTO, and RCpc on cores without it, for this host
+static MemoryOrderingLowering resolve_memory_ordering_lowering(MemoryOrderingLowering requested) {
+    xenoarm_jit::MemoryModel::HostFeatures features = xenoarm_jit::MemoryModel::detect_host_features();
+    if (requested == MEMORY_ORDERING_AUTO) {
+        return xenoarm_jit::MemoryModel::best_lowering(features) == xenoarm_jit::MemoryModel::LOWERING_LDAPR_STLR
+            ? MEMORY_ORDERING_RCPC : MEMORY_ORDERING_BARRIERS;
+    }
+    if (requested == MEMORY_ORDERING_RCPC && !features.rcpc) {
+        LOG_WARNING("Host CPU lacks LDAPR (LRCPC); using LDAR/STLR for memory ordering");
+        return MEMORY_ORDERING_ACQUIRE_RELEASE;
+    }
+    return requested;
+}
+
+// Settings that allocator and code generator must agree on: static guest
+// register pinning, fastmem, the memory slow path, memory ordering and atomics
+static void configure_pipeline(const JitConfig& config,
+                               xenoarm_jit::register_allocation::RegisterAllocator& register_allocator,
+                               xenoarm_jit::aarch64::CodeGenerator& code_generator) {
+    register_allocator.set_guest_register_pinning(config.pin_guest_registers);
+    code_generator.set_guest_register_pinning(config.pin_guest_registers);
+    register_allocator.set_fastmem(config.enable_fastmem);
+    code_generator.set_fastmem(config.enable_fastmem);
+    if (config.generated_code_read && config.generated_code_write) {
+        code_generator.set_memory_slow_path(config.generated_code_read, config.generated_code_write);
+    }
+    code_generator.set_ordering_lowering(ordering_lowering(config));
+    code_generator.set_lse_atomics(config.use_lse_atomics);
+}
+
+// Mark every guest range covered by block as containing translated code (for
+// SMC detection). Blocks touching a self-verifying page check themselves.
+static void register_block_code_pages(JitContext* context, xenoarm_jit::translation_cache::TranslatedBlock* block) {
+    xenoarm_jit::MemoryManager* memory_manager = context->memory_manager;
+    memory_manager->register_code_page(block->guest_address, block->guest_size);
+    bool self_verifying = memory_manager->has_self_verifying_page(block->guest_address, block->guest_size);
+    for (const auto& range : block->superblock_ranges) {
+        memory_manager->register_code_page(range.first, range.second);
+        self_verifying = self_verifying || memory_manager->has_self_verifying_page(range.first, range.second);
+    }
+    block->self_verifying = self_verifying;
+}
+
+// Install every block of the persistent cache without reading guest memory;
+// each is validated on its first execution instead
+static void install_persistent_blocks(JitContext* context) {
+    xenoarm_jit::translation_cache::PersistentBlock persisted;
+    for (uint64_t guest_address : context->persistent_cache->get_addresses()) {
+        if (!context->persistent_cache->find(guest_address, &persisted)) {
+            continue;
+        }
+        xenoarm_jit::translation_cache::TranslatedBlock* block = block_from_persistent(persisted);
+        block->needs_validation = true;
+        context->translation_cache->store(block);
+        register_block_code_pages(context, block);
+        context->persistent_loaded++;
+    }
+    LOG_INFO("Installed " + std::to_string(context->persistent_loaded.load()) + " blocks from the persistent cache");
+}
+
+// Write the translation cache out, keeping file blocks not reached this run
+static bool save_persistent_cache(JitContext* context) {
+    std::vector<const xenoarm_jit::translation_cache::TranslatedBlock*> blocks;
+    context->translation_cache->for_each_block([&blocks](const xenoarm_jit::translation_cache::TranslatedBlock* block) {
+        blocks.push_back(block);
+    });
+    long saved = context->persistent_cache->save(blocks);
+    if (saved < 0) {
+        return false;
+    }
+    context->persistent_saved = static_cast<uint64_t>(saved);
+    return true;
+}
+
+// Recursive descent from entry_points over direct branches, calls and
+// fallthroughs, staying inside [start, end). Returns block entry addresses in
+// discovery order.
+static std::vector<uint32_t> discover_blocks(JitContext* context, uint64_t start, uint64_t end,
+                                             const std::vector<uint32_t>& entry_points) {
+    const size_t MAX_GUEST_BLOCK_BYTES_TO_READ = 256; // Same window as translation
+    const size_t MAX_X86_INSTRUCTION_BYTES = 15;
+    std::vector<uint8_t> guest_code_bytes(MAX_GUEST_BLOCK_BYTES_TO_READ);
+    std::vector<uint32_t> blocks;
+    std::unordered_set<uint32_t> visited;
+    std::vector<uint32_t> worklist(entry_points.rbegin(), entry_points.rend());
+    
+    while (!worklist.empty()) {
+        uint32_t guest_address = worklist.back();
+        worklist.pop_back();
+        if (guest_address < start || guest_address >= end || !visited.insert(guest_address).second) {
+            continue;
+        }
+        
+        context->config.read_memory_block(guest_address, guest_code_bytes.data(), MAX_GUEST_BLOCK_BYTES_TO_READ, context->config.user_data);
+        xenoarm_jit::ir::IrFunction ir_function = context->decoder->decode_block(
+            guest_code_bytes.data(), guest_address, MAX_GUEST_BLOCK_BYTES_TO_READ);
+        if (ir_function.basic_blocks.empty() || ir_function.basic_blocks[0].instructions.empty()) {
+            continue;
+        }
+        blocks.push_back(guest_address);
+        
+        uint64_t fallthrough = guest_address + ir_function.guest_size;
+        std::vector<uint64_t> successors = static_successors_of(ir_function.basic_blocks[0].instructions, fallthrough);
+        if (successors.empty() && ir_function.guest_size + MAX_X86_INSTRUCTION_BYTES > MAX_GUEST_BLOCK_BYTES_TO_READ &&
+            ir_function.basic_blocks[0].instructions.back().type != xenoarm_jit::ir::IrInstructionType::RET &&
+            ir_function.basic_blocks[0].instructions.back().type != xenoarm_jit::ir::IrInstructionType::JMP) {
+            successors.push_back(fallthrough); // Cut short by the decode window, not by a terminator
+        }
+        // Depth-first, first successor next
+        for (auto it = successors.rbegin(); it != successors.rend(); ++it) {
+            worklist.push_back(static_cast<uint32_t>(*it));
+        }
+    }
+    return blocks;
+}
+
+// Tier used for a block's first translation
+static xenoarm_jit::translation_cache::CompilationTier initial_tier(const JitContext* context) {
+    // Without tiering every block goes straight to the optimising tier
+    return context->config.enable_tiered_compilation
+        ? xenoarm_jit::translation_cache::CompilationTier::TIER0
+        : xenoarm_jit::translation_cache::CompilationTier::TIER1;
+}
+
+// Speculative code may occupy at most this fraction of the code cache
+static const size_t SPECULATION_BUDGET_DIVISOR = 8;
+
+// Queue the static successors of block for background translation, up to the
+// configured depth and while speculative code stays within its budget
+static void speculate_successors(JitContext* context, const xenoarm_jit::translation_cache::TranslatedBlock* block) {
+    if (!context->config.enable_speculative_translation || !context->compile_pool) {
+        return;
+    }
+    uint32_t depth = block->speculation_depth + 1;
+    if (depth > context->config.speculation_depth) {
+        return;
+    }
+    
+    const size_t budget = context->config.code_cache_size / SPECULATION_BUDGET_DIVISOR;
+    for (uint64_t successor : block->static_successors) {
+        if (context->speculative_bytes_outstanding >= budget) {
+            break;
+        }
+        uint32_t address = static_cast<uint32_t>(successor);
+        if (context->translation_cache->lookup(address) || context->speculative_requests.count(address)) {
+            continue;
+        }
+        if (context->compile_pool->request(address)) {
+            context->speculative_requests[address] = depth;
+            context->speculation_stats.requested++;
+        }
+    }
+}
+
+// Account for the first execution of a speculatively translated block
+static void note_block_executed(JitContext* context, xenoarm_jit::translation_cache::TranslatedBlock* block) {
+    if (block->speculative_unused) {
+        block->speculative_unused = false;
+        context->speculative_bytes_outstanding -= block->code_size();
+        context->speculation_stats.hits++;
+    }
+}
+
+// Forget speculative requests the compile pool has dropped because of invalidation
+static void sweep_cancelled_speculation(JitContext* context) {
+    for (auto it = context->speculative_requests.begin(); it != context->speculative_requests.end();) {
+        if (context->compile_pool->get_status(it->first) == xenoarm_jit::TranslationRequestStatus::NONE) {
+            context->speculation_stats.cancelled++;
+            it = context->speculative_requests.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Drop queued and in-flight translations of guest code that has changed
+static void cancel_pending_translations(JitContext* context, uint32_t start_address, uint32_t end_address) {
+    if (!context->compile_pool) {
+        return;
+    }
+    context->compile_pool->cancel_range(start_address, end_address);
+    sweep_cancelled_speculation(context);
+}
+
+// Register the code pages of a block translated off the dispatcher thread and
+// store it. Writes to the pages are only caught once they are registered; one
+// made while the block was being translated shows in its bytes, and the stale
+// block is deleted instead. Returns whether the block was stored.
+static bool install_translated_block(JitContext* context, xenoarm_jit::translation_cache::TranslatedBlock* block) {
+    register_block_code_pages(context, block);
+    if (hash_guest_ranges(context, block->guest_address, block->guest_size,
+                          block->superblock_ranges) != block->guest_hash) {
+        delete block;
+        return false;
+    }
+    context->translation_cache->store(block);
+    return true;
+}
+
+// Move blocks finished by the compile threads into the translation cache.
+// Only the dispatcher thread writes to the cache.
+static void install_completed_translations(JitContext* context) {
+    if (!context->compile_pool) {
+        return;
+    }
+    for (xenoarm_jit::translation_cache::TranslatedBlock* block : context->compile_pool->take_completed()) {
+        auto speculative = context->speculative_requests.find(static_cast<uint32_t>(block->guest_address));
+        bool is_speculative = speculative != context->speculative_requests.end();
+        if (is_speculative) {
+            block->speculation_depth = speculative->second;
+            block->speculative_unused = true;
+            context->speculative_requests.erase(speculative);
+        }
+        if (context->translation_cache->lookup(block->guest_address)) {
+            delete block; // Translated synchronously in the meantime
+            continue;
+        }
+        if (!install_translated_block(context, block)) {
+            continue;
+        }
+        
+        if (is_speculative) {
+            context->speculative_bytes_outstanding += block->code_size();
+            context->speculation_stats.translated++;
+        }
+        speculate_successors(context, block);
+    }
+}
+
+// Re-translate queued hot blocks at tier 1 and swap them into the cache.
+// Runs at dispatch entry, so no previously returned tier-0 code is still executing.
+static void process_tier_up_queue(JitContext* context) {
+    using xenoarm_jit::translation_cache::CompilationTier;
+    using xenoarm_jit::translation_cache::TranslatedBlock;
+    
+    std::vector<uint32_t> queue;
+    queue.swap(context->tier_up_queue);
+    
+    for (uint32_t guest_address : queue) {
+        TranslatedBlock* old_block = context->translation_cache->lookup(guest_address);
+        if (!old_block || old_block->tier != CompilationTier::TIER0) {
+            continue; // Invalidated or already replaced since it was queued
+        }
+        
+        TranslatedBlock* new_block = translate_at_tier(context, *context->decoder, *context->register_allocator,
+                                                       *context->code_generator, guest_address, CompilationTier::TIER1);
+        if (!new_block) {
+            LOG_WARNING("Tier-1 re-translation failed for 0x" + std::to_string(guest_address) + ", keeping tier-0 code");
+            continue; // tier_up_pending stays set so the block is not queued again
+        }
+        
+        xenoarm_jit::aarch64::CodeGenerator* code_generator = context->code_generator;
+        context->translation_cache->replace_block(new_block,
+            [code_generator](TranslatedBlock* source, TranslatedBlock* target, const TranslatedBlock::ControlFlowExit& exit) {
+                code_generator->patch_branch(source, exit, target);
+            });
+        register_block_code_pages(context, new_block);
+    }
+}
+
+JitContext* Jit_Init(const JitConfig& config) {
+    LOG_DEBUG("Jit_Init entered");
     
     // Set up logging first
     if (config.log_callback) {
@@ -55,6 +623,9 @@ JitContext* Jit_Init(const JitConfig& config) {
     // Create a new JIT context
     JitContext* context = new JitContext;
     context->config = config;
+    context->config.memory_ordering_lowering = resolve_memory_ordering_lowering(config.memory_ordering_lowering);
+    context->config.use_lse_atomics =
+        config.use_lse_atomics && xenoarm_jit::MemoryModel::detect_host_features().lse_atomics;
     context->cpu_state = new xenoarm_jit::simd::SIMDState();
     
     // Initialize JIT components
@@ -62,14 +633,50 @@ JitContext* Jit_Init(const JitConfig& config) {
         // Core components
         context->decoder = new xenoarm_jit::decoder::X86Decoder();
         context->translation_cache = new xenoarm_jit::translation_cache::TranslationCache();
+        if (config.emit_perf_map || config.emit_jitdump) {
+            using xenoarm_jit::translation_cache::PerfMapWriter;
+            context->perf_map_writer = new PerfMapWriter(
+                config.emit_perf_map ? PerfMapWriter::default_perf_map_path() : std::string(),
+                config.emit_jitdump ? PerfMapWriter::default_jitdump_path(config.jitdump_directory) : std::string());
+            // Profiling output is best effort: translation goes on without it
+            context->perf_map_writer->open();
+            context->translation_cache->set_perf_map_writer(context->perf_map_writer);
+        }
         context->register_allocator = new xenoarm_jit::register_allocation::RegisterAllocator();
         context->code_generator = new xenoarm_jit::aarch64::CodeGenerator();
         
+        // Static guest register pinning and fastmem must be agreed on by allocator and code generator
+        configure_pipeline(context->config, *context->register_allocator, *context->code_generator);
+        
+        // Background compilation: each worker configures its own pipeline the same way
+        if (config.compile_threads > 0) {
+            context->compile_pool = new xenoarm_jit::CompileThreadPool(
+                config.compile_threads,
+                [context](xenoarm_jit::CompileWorkerContext& worker, uint32_t guest_address) {
+                    return translate_at_tier(context, worker.decoder, worker.register_allocator,
+                                             worker.code_generator, guest_address, initial_tier(context));
+                },
+                [context](xenoarm_jit::CompileWorkerContext& worker) {
+                    configure_pipeline(context->config, worker.register_allocator, worker.code_generator);
+                });
+        }
+        
         // Phase 6 components
         context->memory_model = new xenoarm_jit::MemoryModel();
         
-        // Memory manager needs the translation cache
+        // Speculative blocks invalidated before they ever ran are wasted work
+        context->translation_cache->set_invalidation_callback(
+            [context](const xenoarm_jit::translation_cache::TranslatedBlock* block) {
+                if (block->speculative_unused) {
+                    context->speculative_bytes_outstanding -= block->code_size();
+                    context->speculation_stats.wasted++;
+                }
+            });
+        
+        // Memory manager needs the translation cache, and the memory model for
+        // the region ordering policies of slow-path accesses
         context->memory_manager = new xenoarm_jit::MemoryManager(context->translation_cache, config.page_size);
+        context->memory_manager->set_memory_model(context->memory_model);
         
         // Set up memory callbacks
         if (config.read_memory_u8 && config.write_memory_u8) {
@@ -84,15 +691,18 @@ JitContext* Jit_Init(const JitConfig& config) {
                 [context](uint32_t addr, uint8_t val) { 
                     context->config.write_memory_u8(addr, val, context->config.user_data); 
                 },
-                [context](uint32_t addr, uint16_t val) { 
-                    context->config.write_memory_u16(addr, val, context->config.user_data); 
-                },
+                // Optional: without them 16/64-bit writes are split
+                config.write_memory_u16 ? xenoarm_jit::MemoryManager::HostWriteU16Callback(
+                    [context](uint32_t addr, uint16_t val) { 
+                        context->config.write_memory_u16(addr, val, context->config.user_data); 
+                    }) : nullptr,
                 [context](uint32_t addr, uint32_t val) { 
                     context->config.write_memory_u32(addr, val, context->config.user_data); 
                 },
-                [context](uint32_t addr, uint64_t val) { 
-                    context->config.write_memory_u64(addr, val, context->config.user_data); 
-                },
+                config.write_memory_u64 ? xenoarm_jit::MemoryManager::HostWriteU64Callback(
+                    [context](uint32_t addr, uint64_t val) { 
+                        context->config.write_memory_u64(addr, val, context->config.user_data); 
+                    }) : nullptr,
                 [context](uint32_t addr, const void* buf, uint32_t size) { 
                     context->config.write_memory_block(addr, buf, size, context->config.user_data); 
                 }
@@ -114,21 +724,49 @@ JitContext* Jit_Init(const JitConfig& config) {
         
         LOG_INFO("Initializing MemoryManager");
         
-        // Set up SMC detection if enabled
-        if (config.enable_smc_detection) {
+        // Generated code may touch any guest address through the fastmem base
+        if (config.enable_fastmem) {
+            if (!config.guest_memory_base || config.guest_memory_size < FASTMEM_RESERVATION_SIZE) {
+                LOG_ERROR("Fastmem requires guest_memory_base to be a 4 GB reservation");
+                set_last_error(JIT_ERROR_INVALID_PARAMETER);
+                Jit_Shutdown(context);
+                return nullptr;
+            }
+            context->memory_manager->set_fastmem_base(config.guest_memory_base);
+        }
+        
+        // Set up SMC detection if enabled; fastmem faults arrive the same way
+        if (config.enable_smc_detection || config.enable_fastmem) {
             if (!xenoarm_jit::SignalHandler::initialize(context->memory_manager)) {
                 LOG_ERROR("Failed to initialize signal handler for SMC detection");
                 Jit_Shutdown(context);
                 return nullptr;
             }
             
+            // Faults in this context's host mapping of guest memory are routed to it
+            if (config.guest_memory_base &&
+                !xenoarm_jit::SignalHandler::add_range(context->memory_manager,
+                    reinterpret_cast<uintptr_t>(config.guest_memory_base), config.guest_memory_size, 0)) {
+                LOG_ERROR("Failed to register guest memory range for SMC detection");
+                Jit_Shutdown(context);
+                return nullptr;
+            }
+            
             LOG_INFO("SIGSEGV handler installed for SMC detection");
         }
         
+        // Warm start from translations saved by an earlier run
+        if (!config.persistent_cache_path.empty()) {
+            context->persistent_cache = new xenoarm_jit::translation_cache::PersistentCodeCache(
+                config.persistent_cache_path, translation_config_key(context));
+            if (context->persistent_cache->open() && config.persistent_cache_eager_load) {
+                install_persistent_blocks(context);
+            }
+        }
+        
         // Create any other necessary components
         
         LOG_INFO("JIT initialized successfully");
-        g_jit_initialized = true;
         return context;
     }
     catch (const std::exception& e) {
@@ -144,9 +782,7 @@ JitContext* Jit_Init(const JitConfig& config) {
 }
 
 void Jit_Shutdown(JitContext* context) {
-    std::ostringstream oss_shutdown_debug_entry;
-    oss_shutdown_debug_entry << "Jit_Shutdown entered. g_jit_initialized = " << (g_jit_initialized ? "true" : "false");
-    LOG_DEBUG(oss_shutdown_debug_entry.str());
+    LOG_DEBUG("Jit_Shutdown entered");
     
     if (!context) {
         LOG_WARNING("Jit_Shutdown called with null context");
@@ -154,15 +790,25 @@ void Jit_Shutdown(JitContext* context) {
     }
     
     // Clean up SMC detection
-    if (context->config.enable_smc_detection) {
-        xenoarm_jit::SignalHandler::cleanup();
+    if (context->config.enable_smc_detection || context->config.enable_fastmem) {
+        xenoarm_jit::SignalHandler::cleanup(context->memory_manager);
+    }
+    
+    // Stop the compile threads before the components they read from go away
+    delete context->compile_pool;
+    context->compile_pool = nullptr;
+    
+    if (context->persistent_cache && context->translation_cache) {
+        save_persistent_cache(context);
     }
+    delete context->persistent_cache;
     
     // Deallocate JIT components
     delete context->memory_model;
     delete context->memory_manager;
     delete context->decoder;
     delete context->translation_cache;
+    delete context->perf_map_writer; // Flushes what is still buffered
     delete context->register_allocator;
     delete context->code_generator;
     
@@ -174,7 +820,6 @@ void Jit_Shutdown(JitContext* context) {
     // Deallocate the context itself
     delete context;
     
-    g_jit_initialized = false;
     LOG_INFO("JIT shutdown complete");
 }
 
@@ -189,79 +834,87 @@ void* Jit_TranslateBlock(JitContext* context, uint32_t guest_address) {
         return nullptr;
     }
 
+    // The caller is between blocks: nothing from an earlier lookup is live
+    context->translation_cache->quiescent_state();
+
+    // Safe point: apply the SMC invalidations guest writes queued since the
+    // last dispatch, and drop background translations of the old bytes
+    for (const auto& range : context->memory_manager->apply_pending_invalidations()) {
+        cancel_pending_translations(context, range.first, range.first + range.second - 1);
+    }
+
+    const bool tiered = context->config.enable_tiered_compilation;
+    if (tiered && !context->tier_up_queue.empty()) {
+        process_tier_up_queue(context);
+    }
+    install_completed_translations(context);
+
     // Check if the code is already in the translation cache
     xenoarm_jit::translation_cache::TranslatedBlock* cached_block = context->translation_cache->lookup(guest_address);
+    if (cached_block && cached_block->needs_validation) {
+        // Eagerly loaded from the persistent cache: check guest memory on first execution
+        if (hash_guest_ranges(context, cached_block->guest_address, cached_block->guest_size,
+                              cached_block->superblock_ranges) == cached_block->guest_hash) {
+            cached_block->needs_validation = false;
+        } else {
+            context->persistent_loaded--;
+            context->persistent_rejected++;
+            context->translation_cache->invalidate(guest_address);
+            cached_block = nullptr;
+        }
+    }
+    if (cached_block && cached_block->self_verifying) {
+        // Translated from a page whose code keeps changing: it is not write-protected,
+        // so compare the guest bytes before every run and retranslate on a mismatch
+        context->self_verify_checks++;
+        if (hash_guest_ranges(context, cached_block->guest_address, cached_block->guest_size,
+                              cached_block->superblock_ranges) != cached_block->guest_hash) {
+            context->self_verify_failures++;
+            context->translation_cache->invalidate(guest_address);
+            cached_block = nullptr;
+        }
+    }
     if (cached_block && cached_block->code_ptr) {
         LOG_DEBUG("Found translated block in cache for 0x" + std::to_string(guest_address));
+        note_block_executed(context, cached_block);
+        
+        // Count dispatches of tier-0 blocks and queue hot ones for tier 1
+        if (tiered && cached_block->tier == xenoarm_jit::translation_cache::CompilationTier::TIER0 &&
+            !cached_block->tier_up_pending &&
+            ++cached_block->execution_count >= context->config.tier_up_threshold) {
+            cached_block->tier_up_pending = true;
+            context->tier_up_queue.push_back(guest_address);
+        }
         return cached_block->code_ptr;
     }
 
-    LOG_INFO("No translated block in cache for 0x" + std::to_string(guest_address) + ". Starting translation pipeline");
-
-    // 1. Read Guest Code
-    const size_t MAX_GUEST_BLOCK_BYTES_TO_READ = 256; // Increased read size
-    std::vector<uint8_t> guest_code_bytes(MAX_GUEST_BLOCK_BYTES_TO_READ);
-    // Assuming read_memory_block fills the buffer or up to an actual end.
-    // We don't get bytes_read back, which is a limitation.
-    context->config.read_memory_block(guest_address, guest_code_bytes.data(), MAX_GUEST_BLOCK_BYTES_TO_READ, context->config.user_data);
-
-    // 2. Decode instructions and generate IR Function
-    // X86Decoder::decode_block is expected to return an IrFunction.
-    // It needs to determine the actual block end and consumed bytes.
-    xenoarm_jit::ir::IrFunction ir_function = context->decoder->decode_block(
-        guest_code_bytes.data(),
-        guest_address,
-        MAX_GUEST_BLOCK_BYTES_TO_READ // Decoder should not read past this from the buffer
-    );
-
-    // TODO: Need a way to get actual_guest_block_size from ir_function or decode_block result.
-    // For now, if we have IR, assume it consumed *some* bytes. This is a major placeholder.
-    uint32_t actual_guest_block_size = 0; 
-    if (!ir_function.basic_blocks.empty() && !ir_function.basic_blocks[0].instructions.empty()) {
-        // Placeholder: sum of lengths of original x86 instructions if IR stored them,
-        // or an estimate. For now, use a fixed size if non-empty, or 0.
-        // This is incorrect but allows proceeding.
-        actual_guest_block_size = 1; // Needs proper calculation.
-                                     // A better decoder would return consumed size or IrFunction would store it.
-    }
-
-
-    if (ir_function.basic_blocks.empty() || ir_function.basic_blocks[0].instructions.empty()) {
-        LOG_WARNING("Decoder produced no IR for guest_address: 0x" + std::to_string(guest_address));
-        set_last_error(JIT_ERROR_TRANSLATION_FAILED);
-        return nullptr; // Nothing to translate
+    // A compile thread is already on it: waiting is cheaper than translating twice
+    if (context->compile_pool &&
+        context->compile_pool->get_status(guest_address) == xenoarm_jit::TranslationRequestStatus::PENDING) {
+        context->compile_pool->wait(guest_address);
+        install_completed_translations(context);
+        cached_block = context->translation_cache->lookup(guest_address);
+        if (cached_block && cached_block->code_ptr) {
+            note_block_executed(context, cached_block);
+            return cached_block->code_ptr;
+        }
     }
-    
-    // Assuming we operate on the first basic block for now
-    const std::vector<xenoarm_jit::ir::IrInstruction>& ir_instructions = ir_function.basic_blocks[0].instructions;
 
-    // 3. Perform Register Allocation
-    auto register_map = context->register_allocator->allocate(ir_instructions);
-
-    // 4. Generate AArch64 Code
-    std::vector<uint8_t> machine_code = context->code_generator->generate(ir_instructions, register_map);
+    LOG_INFO("No translated block in cache for 0x" + std::to_string(guest_address) + ". Starting translation pipeline");
 
-    if (machine_code.empty()) {
-        LOG_ERROR("Code generator produced empty machine code for guest_address: 0x" + std::to_string(guest_address));
-        set_last_error(JIT_ERROR_TRANSLATION_FAILED);
+    xenoarm_jit::translation_cache::TranslatedBlock* new_block = translate_at_tier(
+        context, *context->decoder, *context->register_allocator, *context->code_generator,
+        guest_address, initial_tier(context));
+    if (!new_block) {
         return nullptr;
     }
 
     // 5. Add to Translation Cache
-    // Create a new TranslatedBlock object
-    xenoarm_jit::translation_cache::TranslatedBlock* new_block =
-        new xenoarm_jit::translation_cache::TranslatedBlock(guest_address, actual_guest_block_size); // actual_guest_block_size is still a placeholder
-    
-    new_block->code = machine_code; // Store the raw machine code bytes
-
-    // Store in cache. Assume TranslationCache::store or an internal mechanism
-    // allocates executable memory, copies code, and sets new_block->code_ptr.
+    // Store in cache. TranslationCache::store sets new_block->code_ptr.
     context->translation_cache->store(new_block);
 
     if (!new_block->code_ptr) {
         LOG_ERROR("TranslationCache failed to set executable code_ptr for block at 0x" + std::to_string(guest_address));
-        // Clean up new_block if store doesn't take ownership on failure or if code_ptr is essential
-        // delete new_block; // This might be risky if store partly succeeded or took ownership
         set_last_error(JIT_ERROR_TRANSLATION_FAILED);
         return nullptr;
     }
@@ -271,19 +924,346 @@ void* Jit_TranslateBlock(JitContext* context, uint32_t guest_address) {
     // context->memory_manager->flush_instruction_cache(new_block->code_ptr, machine_code.size()); // Commented out as API is unknown
 
     // Mark the guest memory page as containing translated code (for SMC detection)
-    context->memory_manager->register_code_page(guest_address, actual_guest_block_size);
+    register_block_code_pages(context, new_block);
+    speculate_successors(context, new_block);
 
     // Using a stringstream to build the log message with pointer address
     std::ostringstream log_msg_stream;
     log_msg_stream << "Successfully translated and cached block for guest_address: 0x" << std::hex << guest_address
                    << ", Host Code Ptr: " << new_block->code_ptr
-                   << ", Guest Size (Placeholder): " << std::dec << actual_guest_block_size
-                   << ", Host Code Size: " << machine_code.size();
+                   << ", Guest Size: " << std::dec << new_block->guest_size
+                   << ", Host Code Size: " << new_block->code_size();
     LOG_INFO(log_msg_stream.str());
 
     return new_block->code_ptr;
 }
 
+bool Jit_RequestTranslation(JitContext* context, uint32_t guest_address) {
+    if (!context || !context->translation_cache) {
+        LOG_ERROR("Jit_RequestTranslation called with null or incomplete context");
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    if (!context->compile_pool) {
+        return Jit_TranslateBlock(context, guest_address) != nullptr;
+    }
+    
+    install_completed_translations(context);
+    if (context->translation_cache->lookup(guest_address)) {
+        return true;
+    }
+    context->compile_pool->request(guest_address);
+    return true;
+}
+
+TranslationStatus Jit_QueryTranslation(JitContext* context, uint32_t guest_address, void** code_ptr) {
+    if (!context || !context->translation_cache) {
+        LOG_ERROR("Jit_QueryTranslation called with null or incomplete context");
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return TRANSLATION_STATUS_NONE;
+    }
+    
+    install_completed_translations(context);
+    
+    xenoarm_jit::translation_cache::TranslatedBlock* block = context->translation_cache->lookup(guest_address);
+    if (block && block->code_ptr) {
+        note_block_executed(context, block);
+        if (code_ptr) {
+            *code_ptr = block->code_ptr;
+        }
+        return TRANSLATION_STATUS_READY;
+    }
+    
+    if (!context->compile_pool) {
+        return TRANSLATION_STATUS_NONE;
+    }
+    switch (context->compile_pool->get_status(guest_address)) {
+        case xenoarm_jit::TranslationRequestStatus::PENDING:
+        case xenoarm_jit::TranslationRequestStatus::READY: // Finished after we drained the pool
+            return TRANSLATION_STATUS_PENDING;
+        case xenoarm_jit::TranslationRequestStatus::FAILED:
+            // Report the failure once; a later request retries
+            context->compile_pool->clear_failed(guest_address);
+            set_last_error(JIT_ERROR_TRANSLATION_FAILED);
+            return TRANSLATION_STATUS_FAILED;
+        default:
+            return TRANSLATION_STATUS_NONE;
+    }
+}
+
+bool Jit_GetSpeculationStats(JitContext* context, JitSpeculationStats* stats) {
+    if (!context || !stats) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    if (context->compile_pool) {
+        sweep_cancelled_speculation(context);
+    }
+    *stats = context->speculation_stats;
+    stats->hit_ratio = stats->translated ? static_cast<double>(stats->hits) / stats->translated : 0.0;
+    stats->waste_ratio = stats->requested
+        ? static_cast<double>(stats->wasted + stats->cancelled) / stats->requested : 0.0;
+    set_last_error(JIT_ERROR_NONE);
+    return true;
+}
+
+size_t Jit_PretranslateRange(JitContext* context, uint32_t start, size_t size,
+                             const uint32_t* entry_points, size_t entry_count) {
+    if (!context || !context->translation_cache || !context->decoder || size == 0 ||
+        (entry_count > 0 && !entry_points)) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return 0;
+    }
+    
+    std::vector<uint32_t> entries(entry_points, entry_points + entry_count);
+    if (entries.empty()) {
+        entries.push_back(start);
+    }
+    std::vector<uint32_t> discovered = discover_blocks(context, start, static_cast<uint64_t>(start) + size, entries);
+    LOG_INFO("Pre-translation discovered " + std::to_string(discovered.size()) + " blocks from 0x" +
+             std::to_string(start));
+    
+    // The context's compile threads if it has them, otherwise one per core for this call
+    std::unique_ptr<xenoarm_jit::CompileThreadPool> local_pool;
+    xenoarm_jit::CompileThreadPool* pool = context->compile_pool;
+    if (!pool) {
+        local_pool.reset(new xenoarm_jit::CompileThreadPool(
+            std::max(1u, std::thread::hardware_concurrency()),
+            [context](xenoarm_jit::CompileWorkerContext& worker, uint32_t guest_address) {
+                return translate_at_tier(context, worker.decoder, worker.register_allocator,
+                                         worker.code_generator, guest_address, initial_tier(context));
+            },
+            [context](xenoarm_jit::CompileWorkerContext& worker) {
+                configure_pipeline(context->config, worker.register_allocator, worker.code_generator);
+            }));
+        pool = local_pool.get();
+    }
+    
+    std::vector<uint32_t> requested;
+    for (uint32_t guest_address : discovered) {
+        if (!context->translation_cache->lookup(guest_address) && pool->request(guest_address)) {
+            requested.push_back(guest_address);
+        }
+    }
+    for (uint32_t guest_address : requested) {
+        pool->wait(guest_address);
+        if (pool->get_status(guest_address) == xenoarm_jit::TranslationRequestStatus::FAILED) {
+            pool->clear_failed(guest_address);
+        }
+    }
+    
+    size_t blocks_before = context->translation_cache->get_block_count();
+    if (local_pool) {
+        for (xenoarm_jit::translation_cache::TranslatedBlock* block : local_pool->take_completed()) {
+            if (context->translation_cache->lookup(block->guest_address)) {
+                delete block;
+                continue;
+            }
+            install_translated_block(context, block);
+        }
+    } else {
+        install_completed_translations(context);
+    }
+    size_t installed = context->translation_cache->get_block_count() - blocks_before;
+    
+    if (context->persistent_cache && !save_persistent_cache(context)) {
+        LOG_WARNING("Failed to write pre-translated blocks to the persistent cache");
+    }
+    
+    LOG_INFO("Pre-translated " + std::to_string(installed) + " blocks");
+    set_last_error(JIT_ERROR_NONE);
+    return installed;
+}
+
+bool Jit_RegisterThread(JitContext* context) {
+    if (!context || !context->translation_cache) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    if (!context->translation_cache->register_reader_thread()) {
+        set_last_error(JIT_ERROR_MEMORY_ALLOCATION);
+        return false;
+    }
+    set_last_error(JIT_ERROR_NONE);
+    return true;
+}
+
+void Jit_UnregisterThread(JitContext* context) {
+    if (!context || !context->translation_cache) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return;
+    }
+    
+    context->translation_cache->unregister_reader_thread();
+    set_last_error(JIT_ERROR_NONE);
+}
+
+void Jit_QuiescentState(JitContext* context) {
+    if (!context || !context->translation_cache) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return;
+    }
+    
+    context->translation_cache->quiescent_state();
+}
+
+bool Jit_SavePersistentCache(JitContext* context) {
+    if (!context || !context->persistent_cache) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    install_completed_translations(context);
+    if (!save_persistent_cache(context)) {
+        set_last_error(JIT_ERROR_EXECUTION_FAILED);
+        return false;
+    }
+    set_last_error(JIT_ERROR_NONE);
+    return true;
+}
+
+bool Jit_GetSmcStats(JitContext* context, JitSmcStats* stats) {
+    if (!context || !context->memory_manager || !stats) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    xenoarm_jit::SmcStats page_stats = context->memory_manager->get_smc_stats();
+    stats->protected_pages = page_stats.protected_pages;
+    stats->inline_check_pages = page_stats.inline_check_pages;
+    stats->self_verifying_pages = page_stats.self_verifying_pages;
+    stats->code_writes = page_stats.code_writes;
+    stats->data_faults = page_stats.data_faults;
+    stats->self_verify_checks = context->self_verify_checks;
+    stats->self_verify_failures = context->self_verify_failures;
+    set_last_error(JIT_ERROR_NONE);
+    return true;
+}
+
+bool Jit_GetMemoryOrderingStats(JitContext* context, JitMemoryOrderingStats* stats) {
+    if (!context || !stats) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    stats->instructions = context->ordered_instructions.load();
+    stats->naive_barriers = context->naive_barriers.load();
+    stats->emitted_barriers = context->emitted_barriers.load();
+    stats->ordered_accesses = context->ordered_accesses.load();
+    stats->relaxed_accesses = context->relaxed_accesses.load();
+    stats->device_accesses = context->device_accesses.load();
+    stats->lowering = context->config.memory_ordering_lowering;
+    stats->lse_atomics = context->config.use_lse_atomics;
+    set_last_error(JIT_ERROR_NONE);
+    return true;
+}
+
+bool Jit_SetMemoryOrderingPolicy(JitContext* context, uint32_t guest_address, size_t size,
+                                 MemoryOrderingPolicy policy) {
+    if (!context || !context->memory_model || size == 0 ||
+        policy < MEMORY_POLICY_DEFAULT || policy > MEMORY_POLICY_DEVICE) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    uint64_t old_key = translation_config_key(context);
+    context->memory_model->set_region_policy(guest_address, size,
+                                             static_cast<xenoarm_jit::MemoryModel::RegionPolicy>(policy));
+    if (translation_config_key(context) == old_key) {
+        set_last_error(JIT_ERROR_NONE);
+        return true;
+    }
+    
+    // Any block may hold an absolute-address access into the range, ordered
+    // under the old policies; translate everything again
+    if (context->translation_cache) {
+        context->translation_cache->invalidate_range(0, 0xFFFFFFFF);
+    }
+    cancel_pending_translations(context, 0, 0xFFFFFFFF);
+    
+    // Persisted translations were keyed by the old policies as well: reopen
+    // the file under the new key, which matches it if a run with the same
+    // policies saved it. Compile threads read the cache while translating,
+    // so let the ones still running finish first.
+    if (context->persistent_cache) {
+        if (context->compile_pool) {
+            context->compile_pool->wait_idle();
+        }
+        delete context->persistent_cache;
+        context->persistent_cache = new xenoarm_jit::translation_cache::PersistentCodeCache(
+            context->config.persistent_cache_path, translation_config_key(context));
+        if (context->persistent_cache->open() && context->config.persistent_cache_eager_load) {
+            install_persistent_blocks(context);
+        }
+    }
+    
+    LOG_INFO("Memory ordering policy " + std::to_string(policy) + " set for 0x" +
+             std::to_string(guest_address) + " + " + std::to_string(size));
+    set_last_error(JIT_ERROR_NONE);
+    return true;
+}
+
+bool Jit_GetPersistentCacheStats(JitContext* context, JitPersistentCacheStats* stats) {
+    if (!context || !stats) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    stats->file_entries = context->persistent_cache ? context->persistent_cache->get_entry_count() : 0;
+    stats->loaded = context->persistent_loaded.load();
+    stats->rejected = context->persistent_rejected.load();
+    stats->saved = context->persistent_saved;
+    set_last_error(JIT_ERROR_NONE);
+    return true;
+}
+
+bool Jit_GetFastmemBlockStats(JitContext* context, uint32_t guest_address, JitFastmemBlockStats* stats) {
+    if (!context || !context->translation_cache || !stats) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    xenoarm_jit::translation_cache::TranslatedBlock* block = context->translation_cache->lookup(guest_address);
+    if (!block) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    stats->access_sites = static_cast<uint32_t>(block->fastmem_sites.size());
+    stats->backpatched = block->fastmem_backpatches.load(std::memory_order_relaxed);
+    set_last_error(JIT_ERROR_NONE);
+    return true;
+}
+
+SharedCodeStore* Jit_CreateSharedCodeStore() {
+    SharedCodeStore* store = new (std::nothrow) SharedCodeStore();
+    set_last_error(store ? JIT_ERROR_NONE : JIT_ERROR_MEMORY_ALLOCATION);
+    return store;
+}
+
+void Jit_DestroySharedCodeStore(SharedCodeStore* store) {
+    delete store;
+}
+
+bool Jit_GetSharedCodeStats(SharedCodeStore* store, JitSharedCodeStats* stats) {
+    if (!store || !stats) {
+        set_last_error(JIT_ERROR_INVALID_PARAMETER);
+        return false;
+    }
+    
+    xenoarm_jit::translation_cache::SharedCodeStats store_stats = store->get_stats();
+    stats->entries = store_stats.entries;
+    stats->code_bytes = store_stats.code_bytes;
+    stats->hits = store_stats.hits;
+    stats->misses = store_stats.misses;
+    uint64_t lookups = store_stats.hits + store_stats.misses;
+    stats->hit_ratio = lookups ? static_cast<double>(store_stats.hits) / lookups : 0.0;
+    set_last_error(JIT_ERROR_NONE);
+    return true;
+}
+
 uint32_t Jit_ExecuteTranslatedBlock(JitContext* context, void* translated_code_ptr) {
     LOG_DEBUG("Jit_ExecuteTranslatedBlock called");
     
@@ -304,7 +1284,10 @@ void Jit_ExecuteBlock(JitContext* context, void* translated_code_ptr) {
     if (!context || !translated_code_ptr) {
         return;
     }
-    
+
+    // Slow-path guest memory accesses made by the block resolve to this context
+    xenoarm_jit::MemoryManager::set_executing_manager(context->memory_manager);
+
     // In a real implementation, this would cast translated_code_ptr to a function pointer
     // and call it. This requires platform-specific code to handle executable memory.
     // For now, it remains a stub.
@@ -341,6 +1324,7 @@ void Jit_InvalidateRange(JitContext* context, uint32_t guest_address, size_t siz
     
     // Invalidate blocks in the translation cache
     context->translation_cache->invalidate_range(guest_address, guest_address + size - 1);
+    cancel_pending_translations(context, guest_address, guest_address + size - 1);
 }
 
 void Jit_RegisterCodeMemory(JitContext* context, uint32_t guest_address, size_t size) {
@@ -367,6 +1351,7 @@ void Jit_NotifyMemoryModified(JitContext* context, uint32_t guest_address, size_
     
     // Notify that memory was modified and invalidate any affected blocks
     context->translation_cache->invalidate_range(guest_address, guest_address + size - 1);
+    cancel_pending_translations(context, guest_address, guest_address + size - 1);
     
     // Update protection if SMC detection is enabled
     if (context->config.enable_smc_detection && context->memory_manager) {
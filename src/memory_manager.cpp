@@ -7,8 +7,19 @@
 
 namespace xenoarm_jit {
 
+// Memory manager whose translated code is running on this thread
+static thread_local MemoryManager* executing_manager = nullptr;
+
 MemoryManager::MemoryManager(translation_cache::TranslationCache* tc, size_t page_size)
-    : translation_cache_(tc), page_size_(page_size) {
+    : translation_cache_(tc), page_size_(page_size), page_shift_(0), fastmem_base_(nullptr) {
+    while ((size_t(1) << page_shift_) < page_size_) {
+        page_shift_++;
+    }
+    // Zero-initialized: every page starts untracked
+    page_table_.reset(new std::atomic<uint8_t>[(uint64_t(1) << 32) >> page_shift_]());
+    for (uint32_t i = 0; i < FAULT_RING_SIZE; i++) {
+        fault_ring_[i].sequence.store(i, std::memory_order_relaxed);
+    }
     LOG_DEBUG("MemoryManager created with page size: " + std::to_string(page_size_));
 }
 
@@ -28,42 +39,52 @@ bool MemoryManager::initialize() {
     return true;
 }
 
-// Memory access callbacks (used internally by JIT)
-uint8_t MemoryManager::read_u8(uint32_t guest_address) {
-    if (host_read_u8_) {
-        return host_read_u8_(guest_address);
+CallbackMemoryPolicy::CallbackMemoryPolicy(
+    ReadU8 read_u8_cb, ReadU16 read_u16_cb, ReadU32 read_u32_cb, ReadU64 read_u64_cb, ReadBlock read_block_cb,
+    WriteU8 write_u8_cb, WriteU16 write_u16_cb, WriteU32 write_u32_cb, WriteU64 write_u64_cb, WriteBlock write_block_cb)
+    : read_u8_(std::move(read_u8_cb)), read_u16_(std::move(read_u16_cb)),
+      read_u32_(std::move(read_u32_cb)), read_u64_(std::move(read_u64_cb)),
+      read_block_(std::move(read_block_cb)),
+      write_u8_(std::move(write_u8_cb)), write_u16_(std::move(write_u16_cb)),
+      write_u32_(std::move(write_u32_cb)), write_u64_(std::move(write_u64_cb)),
+      write_block_(std::move(write_block_cb)) {
+}
+
+uint8_t CallbackMemoryPolicy::read_u8(uint32_t guest_address) const {
+    if (read_u8_) {
+        return read_u8_(guest_address);
     }
     LOG_ERROR("Host read_u8 callback not set");
     return 0;
 }
 
-uint16_t MemoryManager::read_u16(uint32_t guest_address) {
-    if (host_read_u16_) {
-        return host_read_u16_(guest_address);
+uint16_t CallbackMemoryPolicy::read_u16(uint32_t guest_address) const {
+    if (read_u16_) {
+        return read_u16_(guest_address);
     }
     LOG_ERROR("Host read_u16 callback not set");
     return 0;
 }
 
-uint32_t MemoryManager::read_u32(uint32_t guest_address) {
-    if (host_read_u32_) {
-        return host_read_u32_(guest_address);
+uint32_t CallbackMemoryPolicy::read_u32(uint32_t guest_address) const {
+    if (read_u32_) {
+        return read_u32_(guest_address);
     }
     LOG_ERROR("Host read_u32 callback not set");
     return 0;
 }
 
-uint64_t MemoryManager::read_u64(uint32_t guest_address) {
-    if (host_read_u64_) {
-        return host_read_u64_(guest_address);
+uint64_t CallbackMemoryPolicy::read_u64(uint32_t guest_address) const {
+    if (read_u64_) {
+        return read_u64_(guest_address);
     }
     LOG_ERROR("Host read_u64 callback not set");
     return 0;
 }
 
-void MemoryManager::read_block(uint32_t guest_address, void* host_buffer, uint32_t size) {
-    if (host_read_block_) {
-        host_read_block_(guest_address, host_buffer, size);
+void CallbackMemoryPolicy::read_block(uint32_t guest_address, void* host_buffer, uint32_t size) const {
+    if (read_block_) {
+        read_block_(guest_address, host_buffer, size);
         return;
     }
     
@@ -74,186 +95,223 @@ void MemoryManager::read_block(uint32_t guest_address, void* host_buffer, uint32
     }
 }
 
-void MemoryManager::write_u8(uint32_t guest_address, uint8_t value) {
-    // Check if this write affects a code page, handle SMC if necessary
-    uint32_t page_addr = align_to_page(guest_address);
-    bool is_code_page = false;
-    
-    {
-        std::lock_guard<std::mutex> lock(pages_mutex_);
-        auto it = pages_.find(page_addr);
-        if (it != pages_.end() && it->second.has_translated_code) {
-            is_code_page = true;
-        }
+void CallbackMemoryPolicy::write_u8(uint32_t guest_address, uint8_t value) const {
+    if (write_u8_) {
+        write_u8_(guest_address, value);
+    } else {
+        LOG_ERROR("Host write_u8 callback not set");
     }
-    
-    if (is_code_page) {
-        // This is SMC - handle it before the write
-        LOG_INFO("SMC detected: Writing to code page at address 0x" + 
-                 std::to_string(guest_address) + ", invalidating translations");
-        
-        // Unprotect the page temporarily
-        int old_protection = get_protection(page_addr);
-        protect_guest_memory(page_addr, page_size_, PROT_READ | PROT_WRITE);
-        
-        // Invalidate any translations for this page
-        invalidate_translations_for_page(page_addr);
-        
-        // Do the write
-        if (host_write_u8_) {
-            host_write_u8_(guest_address, value);
-        } else {
-            LOG_ERROR("Host write_u8 callback not set");
-        }
-        
-        // Reprotect with original protection
-        protect_guest_memory(page_addr, page_size_, old_protection);
-        
-        // Synchronize instruction cache with data cache
-        // This is crucial for ARM processors when modifying code
-        insert_data_sync_barrier();       // DSB - ensure all memory writes are complete
-        insert_instruction_sync_barrier(); // ISB - flush pipeline
+}
+
+void CallbackMemoryPolicy::write_u16(uint32_t guest_address, uint16_t value) const {
+    if (write_u16_) {
+        write_u16_(guest_address, value);
     } else {
-        // Normal write to data page
-        if (host_write_u8_) {
-            host_write_u8_(guest_address, value);
-        } else {
-            LOG_ERROR("Host write_u8 callback not set");
-        }
+        write_u8(guest_address, static_cast<uint8_t>(value));
+        write_u8(guest_address + 1, static_cast<uint8_t>(value >> 8));
     }
 }
 
-void MemoryManager::write_u16(uint32_t guest_address, uint16_t value) {
-    // For simplicity in this implementation, handle as two 8-bit writes
-    // A real implementation would be more optimized
-    uint8_t low_byte = static_cast<uint8_t>(value & 0xFF);
-    uint8_t high_byte = static_cast<uint8_t>((value >> 8) & 0xFF);
+void CallbackMemoryPolicy::write_u32(uint32_t guest_address, uint32_t value) const {
+    if (write_u32_) {
+        write_u32_(guest_address, value);
+    } else {
+        LOG_ERROR("Host write_u32 callback not set");
+    }
+}
+
+void CallbackMemoryPolicy::write_u64(uint32_t guest_address, uint64_t value) const {
+    if (write_u64_) {
+        write_u64_(guest_address, value);
+    } else {
+        write_u32(guest_address, static_cast<uint32_t>(value));
+        write_u32(guest_address + 4, static_cast<uint32_t>(value >> 32));
+    }
+}
+
+void CallbackMemoryPolicy::write_block(uint32_t guest_address, const void* host_buffer, uint32_t size) const {
+    if (write_block_) {
+        write_block_(guest_address, host_buffer, size);
+        return;
+    }
     
-    // Handle byte order (assuming little-endian x86)
-    write_u8(guest_address, low_byte);
-    write_u8(guest_address + 1, high_byte);
+    // Fallback to byte by byte
+    const uint8_t* buffer = static_cast<const uint8_t*>(host_buffer);
+    for (uint32_t i = 0; i < size; i++) {
+        write_u8(guest_address + i, buffer[i]);
+    }
+}
+
+// Memory access callbacks (used internally by JIT)
+uint8_t MemoryManager::read_u8(uint32_t guest_address) {
+    return callbacks_.read_u8(guest_address);
+}
+
+uint16_t MemoryManager::read_u16(uint32_t guest_address) {
+    return callbacks_.read_u16(guest_address);
+}
+
+uint32_t MemoryManager::read_u32(uint32_t guest_address) {
+    return callbacks_.read_u32(guest_address);
+}
+
+uint64_t MemoryManager::read_u64(uint32_t guest_address) {
+    return callbacks_.read_u64(guest_address);
+}
+
+void MemoryManager::read_block(uint32_t guest_address, void* host_buffer, uint32_t size) {
+    callbacks_.read_block(guest_address, host_buffer, size);
+}
+
+uint64_t MemoryManager::read_sized(uint32_t guest_address, uint32_t size) {
+    MemoryModel::RegionPolicy ordering = ordering_policy(guest_address, size);
+    MemoryModel::fence_before_access(ordering, false);
+    uint64_t value;
+    switch (size) {
+        case 1: value = read_u8(guest_address); break;
+        case 2: value = read_u16(guest_address); break;
+        case 4: value = read_u32(guest_address); break;
+        case 8: value = read_u64(guest_address); break;
+        default:
+            LOG_ERROR("Unsupported guest read size: " + std::to_string(size));
+            return 0;
+    }
+    MemoryModel::fence_after_access(ordering, false);
+    return value;
+}
+
+void MemoryManager::write_sized(uint32_t guest_address, uint64_t value, uint32_t size) {
+    MemoryModel::RegionPolicy ordering = ordering_policy(guest_address, size);
+    MemoryModel::fence_before_access(ordering, true);
+    switch (size) {
+        case 1: write_u8(guest_address, static_cast<uint8_t>(value)); break;
+        case 2: write_u16(guest_address, static_cast<uint16_t>(value)); break;
+        case 4: write_u32(guest_address, static_cast<uint32_t>(value)); break;
+        case 8: write_u64(guest_address, value); break;
+        default:
+            LOG_ERROR("Unsupported guest write size: " + std::to_string(size));
+            break;
+    }
+    MemoryModel::fence_after_access(ordering, true);
+}
+
+uint64_t MemoryManager::generated_code_read(uint32_t guest_address, uint32_t size) {
+    if (!executing_manager) {
+        LOG_ERROR("Guest read from generated code without an executing memory manager");
+        return 0;
+    }
+    return executing_manager->read_sized(guest_address, size);
+}
+
+void MemoryManager::generated_code_write(uint32_t guest_address, uint64_t value, uint32_t size) {
+    if (!executing_manager) {
+        LOG_ERROR("Guest write from generated code without an executing memory manager");
+        return;
+    }
+    executing_manager->write_sized(guest_address, value, size);
+}
+
+void MemoryManager::set_executing_manager(MemoryManager* memory_manager) {
+    executing_manager = memory_manager;
+}
+
+MemoryManager* MemoryManager::get_executing_manager() {
+    return executing_manager;
+}
+
+void MemoryManager::write_u8(uint32_t guest_address, uint8_t value) {
+    callbacks_.write_u8(guest_address, value);
+    note_guest_write(guest_address, 1);
+}
+
+void MemoryManager::write_u16(uint32_t guest_address, uint16_t value) {
+    callbacks_.write_u16(guest_address, value);
+    note_guest_write(guest_address, 2);
 }
 
 void MemoryManager::write_u32(uint32_t guest_address, uint32_t value) {
-    // Check if this write affects a code page, handle SMC if necessary
-    uint32_t page_addr = align_to_page(guest_address);
-    bool is_code_page = false;
-    
-    {
-        std::lock_guard<std::mutex> lock(pages_mutex_);
-        auto it = pages_.find(page_addr);
-        if (it != pages_.end() && it->second.has_translated_code) {
-            is_code_page = true;
-        }
+    callbacks_.write_u32(guest_address, value);
+    note_guest_write(guest_address, 4);
+}
+
+void MemoryManager::write_u64(uint32_t guest_address, uint64_t value) {
+    callbacks_.write_u64(guest_address, value);
+    note_guest_write(guest_address, 8);
+}
+
+void MemoryManager::write_block(uint32_t guest_address, const void* host_buffer, uint32_t size) {
+    // One write, then one bitmap test and at most one queued range per page
+    callbacks_.write_block(guest_address, host_buffer, size);
+    queue_code_write(guest_address, size);
+}
+
+void MemoryManager::queue_code_write(uint32_t guest_address, uint32_t size) {
+    // Identify the translated code this write overlaps, page by page
+    std::vector<std::pair<uint32_t, uint32_t>> code_ranges = find_code_ranges(guest_address, size);
+    if (code_ranges.empty()) {
+        return; // Data next to code: no translated byte is overwritten
     }
     
-    if (is_code_page) {
-        // Handle as SMC, similar to write_u8
-        LOG_INFO("SMC detected: Writing 32-bit value to code page at address 0x" + 
-                 std::to_string(guest_address) + ", invalidating translations");
-        
-        // Unprotect the page temporarily
-        int old_protection = get_protection(page_addr);
-        protect_guest_memory(page_addr, page_size_, PROT_READ | PROT_WRITE);
-        
-        // Invalidate any translations for this page
-        invalidate_translations_for_page(page_addr);
-        
-        // Do the write
-        if (host_write_u32_) {
-            host_write_u32_(guest_address, value);
-        } else {
-            LOG_ERROR("Host write_u32 callback not set");
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    for (const auto& range : code_ranges) {
+        // Unprotect once; the page is reprotected when its code is next translated
+        uint32_t page_index = range.first >> page_shift_;
+        if (!(page_table_[page_index].load(std::memory_order_acquire) & PROT_WRITE)) {
+            set_page_protection(page_index, 1, PROT_READ | PROT_WRITE);
         }
         
-        // Reprotect with original protection
-        protect_guest_memory(page_addr, page_size_, old_protection);
-        
-        // Synchronize caches
-        insert_data_sync_barrier();
-        insert_instruction_sync_barrier();
-    } else {
-        // Normal write to data page
-        if (host_write_u32_) {
-            host_write_u32_(guest_address, value);
-        } else {
-            LOG_ERROR("Host write_u32 callback not set");
-        }
+        add_pending_range_locked(range.first, uint64_t(range.first) + range.second - 1);
     }
+    invalidations_pending_.store(true, std::memory_order_release);
 }
 
-void MemoryManager::write_u64(uint32_t guest_address, uint64_t value) {
-    // Handle as two 32-bit writes
-    uint32_t low_dword = static_cast<uint32_t>(value & 0xFFFFFFFF);
-    uint32_t high_dword = static_cast<uint32_t>((value >> 32) & 0xFFFFFFFF);
-    
-    // Assuming little-endian x86
-    write_u32(guest_address, low_dword);
-    write_u32(guest_address + 4, high_dword);
+void MemoryManager::add_pending_range_locked(uint64_t start, uint64_t end) {
+    // Merge with overlapping or adjacent queued ranges
+    auto it = pending_invalidations_.upper_bound(start);
+    if (it != pending_invalidations_.begin() && std::prev(it)->second + 1 >= start) {
+        --it;
+        start = it->first;
+        end = std::max(end, it->second);
+    }
+    while (it != pending_invalidations_.end() && it->first <= end + 1) {
+        end = std::max(end, it->second);
+        it = pending_invalidations_.erase(it);
+    }
+    pending_invalidations_[start] = end;
 }
 
-void MemoryManager::write_block(uint32_t guest_address, const void* host_buffer, uint32_t size) {
-    // Check if this write crosses or is within a code page
-    uint32_t start_page = align_to_page(guest_address);
-    uint32_t end_page = align_to_page(guest_address + size - 1);
-    bool is_smc = false;
-    std::vector<uint32_t> affected_code_pages;
+std::vector<std::pair<uint32_t, uint32_t>> MemoryManager::apply_pending_invalidations() {
+    std::vector<std::pair<uint32_t, uint32_t>> applied;
+    if (!invalidations_pending_.exchange(false, std::memory_order_acq_rel)) {
+        return applied;
+    }
     
-    // Identify affected code pages
+    std::map<uint64_t, uint64_t> ranges;
     {
-        std::lock_guard<std::mutex> lock(pages_mutex_);
-        for (uint32_t page = start_page; page <= end_page; page += page_size_) {
-            auto it = pages_.find(page);
-            if (it != pages_.end() && it->second.has_translated_code) {
-                affected_code_pages.push_back(page);
-                is_smc = true;
-            }
-        }
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        drain_faults_locked();
+        ranges.swap(pending_invalidations_);
     }
     
-    if (is_smc) {
-        LOG_INFO("SMC detected: Block write affecting " + 
-                 std::to_string(affected_code_pages.size()) + " code pages");
-        
-        // For each affected code page, handle SMC
-        for (uint32_t page : affected_code_pages) {
-            // Temporarily unprotect
-            int old_prot = get_protection(page);
-            protect_guest_memory(page, page_size_, PROT_READ | PROT_WRITE);
-            
-            // Invalidate translations
-            invalidate_translations_for_page(page);
-            
-            // Reprotect after write
-            protect_guest_memory(page, page_size_, old_prot);
-        }
+    for (const auto& range : ranges) {
+        uint32_t start = static_cast<uint32_t>(range.first);
+        uint32_t size = static_cast<uint32_t>(range.second - range.first + 1);
+        LOG_INFO("SMC detected: invalidating translations at 0x" + std::to_string(start) +
+                 ", size: " + std::to_string(size));
+        invalidate_translations_for_range(start, size);
+        applied.emplace_back(start, size);
         
-        // Do the write
-        if (host_write_block_) {
-            host_write_block_(guest_address, host_buffer, size);
-        } else {
-            // Fallback to byte by byte
-            const uint8_t* buffer = static_cast<const uint8_t*>(host_buffer);
-            for (uint32_t i = 0; i < size; i++) {
-                write_u8(guest_address + i, buffer[i]);
-            }
-        }
-        
-        // Synchronize caches
-        insert_data_sync_barrier();
-        insert_instruction_sync_barrier();
-    } else {
-        // Normal write to data pages
-        if (host_write_block_) {
-            host_write_block_(guest_address, host_buffer, size);
-        } else {
-            // Fallback to byte by byte
-            const uint8_t* buffer = static_cast<const uint8_t*>(host_buffer);
-            for (uint32_t i = 0; i < size; i++) {
-                write_u8(guest_address + i, buffer[i]);
-            }
+        // Each page rewritten since the last safe point counts once
+        for (uint64_t page = range.first >> page_shift_; page <= (range.second >> page_shift_); page++) {
+            note_code_write(static_cast<uint32_t>(page << page_shift_));
         }
     }
+    
+    // Synchronize instruction cache with data cache
+    // This is crucial for ARM processors when modifying code
+    insert_data_sync_barrier();       // DSB - ensure all memory writes are complete
+    insert_instruction_sync_barrier(); // ISB - flush pipeline
+    return applied;
 }
 
 bool MemoryManager::protect_guest_memory(uint32_t guest_address, uint32_t size, int protection) {
@@ -265,26 +323,14 @@ bool MemoryManager::protect_guest_memory(uint32_t guest_address, uint32_t size,
               " with protection flags: " + std::to_string(protection));
     
     // Update our local page protection info
-    std::lock_guard<std::mutex> lock(pages_mutex_);
-    for (uint32_t addr = aligned_addr; addr < aligned_addr + aligned_size; addr += page_size_) {
-        // Create or update the page info
-        auto& page = pages_[addr];
-        page.guest_address = addr;
-        page.size = page_size_;
-        page.protection = protection;
-        // don't modify has_translated_code flag
-    }
-    
+    set_page_protection(aligned_addr >> page_shift_, page_count(guest_address, size), protection);
     return true;
 }
 
 int MemoryManager::get_protection(uint32_t guest_address) {
-    uint32_t aligned_addr = align_to_page(guest_address);
-    
-    std::lock_guard<std::mutex> lock(pages_mutex_);
-    auto it = pages_.find(aligned_addr);
-    if (it != pages_.end()) {
-        return it->second.protection;
+    uint8_t attributes = page_attributes(guest_address);
+    if (attributes & PAGE_TRACKED) {
+        return attributes & PAGE_PROTECTION_MASK;
     }
     
     // Default to read/write
@@ -298,86 +344,133 @@ void MemoryManager::register_code_page(uint32_t guest_address, uint32_t size) {
     LOG_INFO("Registering code page(s) from 0x" + std::to_string(aligned_addr) + 
              " to 0x" + std::to_string(aligned_addr + aligned_size - 1));
     
-    std::lock_guard<std::mutex> lock(pages_mutex_);
-    for (uint32_t addr = aligned_addr; addr < aligned_addr + aligned_size; addr += page_size_) {
-        // Create or update the page info
-        auto& page = pages_[addr];
-        page.guest_address = addr;
-        page.size = page_size_;
-        page.has_translated_code = true;
-        
-        // If the page wasn't specifically protected before, mark it read-only now for SMC detection
-        if (page.protection == 0 || page.protection == (PROT_READ | PROT_WRITE)) {
-            page.protection = PROT_READ;
-        }
+    // Record the translated bytes before publishing the pages as code pages
+    mark_code_bytes(guest_address, size);
+    
+    uint64_t first_page = aligned_addr >> page_shift_;
+    uint64_t count = page_count(guest_address, size);
+    for (uint64_t page = first_page; page < first_page + count; page++) {
+        std::atomic<uint8_t>& entry = page_table_[page];
+        uint8_t attributes = entry.load(std::memory_order_relaxed);
+        uint8_t updated;
+        do {
+            updated = attributes | PAGE_TRACKED | PAGE_HAS_CODE;
+            
+            // If the page wasn't specifically protected before, mark it read-only now for SMC detection
+            // (pages switched to inline store checks stay writable)
+            int protection = attributes & PAGE_PROTECTION_MASK;
+            if (!(attributes & (PAGE_INLINE_CHECKS | PAGE_SELF_VERIFY)) &&
+                (protection == 0 || protection == (PROT_READ | PROT_WRITE))) {
+                updated = (updated & ~PAGE_PROTECTION_MASK) | PROT_READ;
+            }
+        } while (!entry.compare_exchange_weak(attributes, updated, std::memory_order_acq_rel,
+                                              std::memory_order_relaxed));
     }
 }
 
 void MemoryManager::notify_memory_modified(uint32_t guest_address, uint32_t size) {
-    uint32_t aligned_addr = align_to_page(guest_address);
-    uint32_t aligned_size = ((size + page_size_ - 1) / page_size_) * page_size_;
-    
     LOG_DEBUG("Guest memory modified at 0x" + std::to_string(guest_address) + 
               ", size: " + std::to_string(size));
     
-    // Check if any affected pages have translated code
-    std::vector<uint32_t> code_pages;
-    {
-        std::lock_guard<std::mutex> lock(pages_mutex_);
-        for (uint32_t addr = aligned_addr; addr < aligned_addr + aligned_size; addr += page_size_) {
-            auto it = pages_.find(addr);
-            if (it != pages_.end() && it->second.has_translated_code) {
-                code_pages.push_back(addr);
-            }
-        }
+    // Invalidate the translations covering any modified translated bytes
+    queue_code_write(guest_address, size);
+}
+
+bool MemoryManager::handle_protection_fault(uint32_t guest_address) {
+    // Runs in the SIGSEGV handler: page table and fault ring only
+    uint8_t attributes = page_attributes(guest_address);
+    if (!(attributes & PAGE_HAS_CODE)) {
+        return false; // Expected with fastmem (MMIO windows); the caller decides
+    }
+    
+    // Self-verifying pages are left writable; their blocks catch the change
+    if (attributes & PAGE_SELF_VERIFY) {
+        return true;
     }
     
-    // Invalidate translations for all affected code pages
-    for (uint32_t page_addr : code_pages) {
-        LOG_INFO("Invalidating code page at 0x" + std::to_string(page_addr) + 
-                 " due to memory modification");
-        invalidate_translations_for_page(page_addr);
+    // Leave the page writable so the access can proceed (it is retried by
+    // the host); the safe point reprotects it or invalidates its code
+    if (!(attributes & PROT_WRITE)) {
+        page_table_[guest_address >> page_shift_].fetch_or(PROT_WRITE, std::memory_order_acq_rel);
     }
+    if (!push_fault(guest_address)) {
+        fault_ring_overflow_.store(true, std::memory_order_release);
+    }
+    invalidations_pending_.store(true, std::memory_order_release);
+    return true;
 }
 
-void MemoryManager::handle_protection_fault(uint32_t guest_address) {
-    uint32_t page_addr = align_to_page(guest_address);
-    
-    LOG_WARNING("Protection fault at guest address 0x" + std::to_string(guest_address) + 
-                " (page 0x" + std::to_string(page_addr) + ")");
-    
-    // Get the current page info
-    MemoryPage page;
-    bool is_code_page = false;
-    {
-        std::lock_guard<std::mutex> lock(pages_mutex_);
-        auto it = pages_.find(page_addr);
-        if (it != pages_.end()) {
-            page = it->second;
-            is_code_page = page.has_translated_code;
+bool MemoryManager::push_fault(uint32_t guest_address) {
+    uint32_t position = fault_ring_head_.load(std::memory_order_relaxed);
+    for (;;) {
+        FaultSlot& slot = fault_ring_[position % FAULT_RING_SIZE];
+        uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+        int32_t difference = static_cast<int32_t>(sequence - position);
+        if (difference == 0) {
+            // Slot free for this position: claim it
+            if (fault_ring_head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.guest_address = guest_address;
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false; // Full
+        } else {
+            position = fault_ring_head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void MemoryManager::drain_faults_locked() {
+    if (fault_ring_overflow_.exchange(false, std::memory_order_acq_rel)) {
+        // Faults were dropped: every code page a fault left writable is suspect.
+        // Scan before classifying the recorded faults, which may reprotect pages.
+        LOG_WARNING("Protection fault ring overflowed, invalidating unprotected code pages");
+        uint64_t pages = (uint64_t(1) << 32) >> page_shift_;
+        for (uint64_t page = 0; page < pages; page++) {
+            uint8_t attributes = page_table_[page].load(std::memory_order_relaxed);
+            if ((attributes & PAGE_HAS_CODE) && (attributes & PROT_WRITE) &&
+                !(attributes & (PAGE_INLINE_CHECKS | PAGE_SELF_VERIFY))) {
+                add_pending_range_locked(page << page_shift_, ((page + 1) << page_shift_) - 1);
+            }
         }
     }
     
-    if (is_code_page) {
-        // This is likely SMC! Handle it
-        LOG_INFO("SMC detected: Protection fault in code page");
-        
-        // Temporarily make the page writable
-        int old_protection = page.protection;
-        protect_guest_memory(page_addr, page_size_, PROT_READ | PROT_WRITE);
-        
-        // Invalidate any translations for this page
-        invalidate_translations_for_page(page_addr);
-        
-        // The guest memory access can now proceed (will be retried by the host)
+    for (;;) {
+        FaultSlot& slot = fault_ring_[fault_ring_tail_ % FAULT_RING_SIZE];
+        if (slot.sequence.load(std::memory_order_acquire) != fault_ring_tail_ + 1) {
+            break; // Empty, or a push still in progress
+        }
+        uint32_t guest_address = slot.guest_address;
+        slot.sequence.store(fault_ring_tail_ + FAULT_RING_SIZE, std::memory_order_release);
+        fault_ring_tail_++;
         
-        // After a short delay, restore the protection
-        // In a real implementation, you might want to do this on a background thread
-        // or after the current instruction completes
-        protect_guest_memory(page_addr, page_size_, old_protection);
-    } else {
-        LOG_ERROR("Protection fault in non-code page - unexpected!");
+        // The faulting access is at most 8 bytes wide; if none of them has been
+        // translated this was a write to data sharing the page with code
+        if (has_code_bytes(guest_address, 8)) {
+            LOG_INFO("SMC detected: Protection fault in code page at 0x" + std::to_string(guest_address));
+            add_pending_range_locked(guest_address, std::min(uint64_t(guest_address) + 7, uint64_t(0xFFFFFFFF)));
+        } else {
+            note_data_fault(guest_address);
+        }
+    }
+}
+
+void MemoryManager::note_data_fault(uint32_t guest_address) {
+    uint32_t page_index = guest_address >> page_shift_;
+    data_faults_.fetch_add(1, std::memory_order_relaxed);
+    
+    std::lock_guard<std::mutex> lock(code_bytes_mutex_);
+    uint32_t faults = ++code_bytes_[page_index].data_faults;
+    if (faults == INLINE_STORE_CHECK_THRESHOLD) {
+        // Stop trapping: leave the page writable and check its stores in software
+        LOG_INFO("Code page 0x" + std::to_string(page_index << page_shift_) + " switched to inline store checks");
+        page_table_[page_index].fetch_or(PAGE_INLINE_CHECKS, std::memory_order_acq_rel);
+        return;
     }
+    
+    // Nothing translated was written: trap the next write again
+    page_table_[page_index].fetch_and(static_cast<uint8_t>(~PROT_WRITE), std::memory_order_acq_rel);
 }
 
 // ARM Memory barrier helpers
@@ -408,17 +501,8 @@ void MemoryManager::set_host_memory_callbacks(
     HostWriteU64Callback write_u64_cb,
     HostWriteBlockCallback write_block_cb
 ) {
-    host_read_u8_ = read_u8_cb;
-    host_read_u16_ = read_u16_cb;
-    host_read_u32_ = read_u32_cb;
-    host_read_u64_ = read_u64_cb;
-    host_read_block_ = read_block_cb;
-    
-    host_write_u8_ = write_u8_cb;
-    host_write_u16_ = write_u16_cb;
-    host_write_u32_ = write_u32_cb;
-    host_write_u64_ = write_u64_cb;
-    host_write_block_ = write_block_cb;
+    callbacks_ = CallbackMemoryPolicy(read_u8_cb, read_u16_cb, read_u32_cb, read_u64_cb, read_block_cb,
+                                      write_u8_cb, write_u16_cb, write_u32_cb, write_u64_cb, write_block_cb);
     
     LOG_INFO("Host memory callbacks registered");
 }
@@ -429,43 +513,200 @@ uint32_t MemoryManager::align_to_page(uint32_t address) {
 }
 
 bool MemoryManager::is_page_protected(uint32_t guest_address) {
-    uint32_t page_addr = align_to_page(guest_address);
-    
-    std::lock_guard<std::mutex> lock(pages_mutex_);
-    auto it = pages_.find(page_addr);
-    if (it != pages_.end()) {
-        return (it->second.protection & PROT_WRITE) == 0;
+    uint8_t attributes = page_attributes(guest_address);
+    return (attributes & PAGE_TRACKED) && (attributes & PROT_WRITE) == 0;
+}
+
+uint64_t MemoryManager::page_count(uint32_t guest_address, uint32_t size) const {
+    if (size == 0) {
+        return 0;
     }
-    
-    return false;
+    // Every page touched by [guest_address, guest_address + size), clamped
+    // at the top of the guest address space
+    uint64_t last = std::min(uint64_t(guest_address) + size - 1, uint64_t(0xFFFFFFFF));
+    return (last >> page_shift_) - (guest_address >> page_shift_) + 1;
 }
 
-bool MemoryManager::invalidate_translations_for_page(uint32_t guest_address) {
+void MemoryManager::set_page_protection(uint64_t first_page, uint64_t count, int protection) {
+    uint8_t protection_bits = static_cast<uint8_t>(protection & PAGE_PROTECTION_MASK);
+    for (uint64_t page = first_page; page < first_page + count; page++) {
+        std::atomic<uint8_t>& entry = page_table_[page];
+        uint8_t attributes = entry.load(std::memory_order_relaxed);
+        // Replace the protection bits; the code and dirty flags are kept
+        while (!entry.compare_exchange_weak(attributes,
+                                            (attributes & ~PAGE_PROTECTION_MASK) | PAGE_TRACKED | protection_bits,
+                                            std::memory_order_acq_rel, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+bool MemoryManager::invalidate_translations_for_range(uint32_t guest_address, uint32_t size) {
     if (!translation_cache_) {
         LOG_ERROR("Translation cache is null, cannot invalidate translations");
         return false;
     }
     
-    uint32_t page_addr = align_to_page(guest_address);
+    uint64_t end_address = std::min(uint64_t(guest_address) + size - 1, uint64_t(0xFFFFFFFF));
     
-    // Invalidate all translations in this page
-    translation_cache_->invalidate_range(page_addr, page_addr + page_size_ - 1);
+    // Invalidate every translation overlapping the range
+    translation_cache_->invalidate_range(guest_address, end_address);
     
-    // Mark the page as dirty
-    {
-        std::lock_guard<std::mutex> lock(pages_mutex_);
-        auto it = pages_.find(page_addr);
-        if (it != pages_.end()) {
-            it->second.is_dirty = true;
+    // Mark the pages as dirty
+    for (uint64_t page = guest_address >> page_shift_; page <= (end_address >> page_shift_); page++) {
+        std::atomic<uint8_t>& entry = page_table_[page];
+        if (entry.load(std::memory_order_relaxed) & PAGE_TRACKED) {
+            entry.fetch_or(PAGE_DIRTY, std::memory_order_acq_rel);
         }
     }
     
     return true;
 }
 
+// Set or test bits [first, last] of a code byte bitmap
+static void set_bitmap_range(std::vector<uint64_t>& bitmap, uint32_t first, uint32_t last) {
+    for (uint32_t word = first / 64; word <= last / 64; word++) {
+        uint32_t low = std::max(first, word * 64) % 64;
+        uint32_t high = std::min(last, word * 64 + 63) % 64;
+        bitmap[word] |= (~uint64_t(0) >> (63 - high)) & (~uint64_t(0) << low);
+    }
+}
+
+static bool test_bitmap_range(const std::vector<uint64_t>& bitmap, uint32_t first, uint32_t last) {
+    for (uint32_t word = first / 64; word <= last / 64; word++) {
+        uint32_t low = std::max(first, word * 64) % 64;
+        uint32_t high = std::min(last, word * 64 + 63) % 64;
+        if (bitmap[word] & (~uint64_t(0) >> (63 - high)) & (~uint64_t(0) << low)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MemoryManager::mark_code_bytes(uint32_t guest_address, uint32_t size) {
+    if (size == 0) {
+        return;
+    }
+    uint64_t end_address = std::min(uint64_t(guest_address) + size - 1, uint64_t(0xFFFFFFFF));
+    
+    std::lock_guard<std::mutex> lock(code_bytes_mutex_);
+    for (uint64_t start = guest_address; start <= end_address; ) {
+        uint64_t page_end = (start | (page_size_ - 1));
+        uint64_t last = std::min(end_address, page_end);
+        CodePageBytes& page = code_bytes_[static_cast<uint32_t>(start >> page_shift_)];
+        if (page.bitmap.empty()) {
+            page.bitmap.resize((page_size_ + 63) / 64);
+        }
+        set_bitmap_range(page.bitmap, static_cast<uint32_t>(start & (page_size_ - 1)),
+                         static_cast<uint32_t>(last & (page_size_ - 1)));
+        start = page_end + 1;
+    }
+}
+
+bool MemoryManager::has_code_bytes(uint32_t guest_address, uint32_t size) const {
+    return !find_code_ranges(guest_address, size).empty();
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> MemoryManager::find_code_ranges(uint32_t guest_address, uint32_t size) const {
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    if (size == 0) {
+        return ranges;
+    }
+    uint64_t end_address = std::min(uint64_t(guest_address) + size - 1, uint64_t(0xFFFFFFFF));
+    
+    for (uint64_t start = guest_address; start <= end_address; ) {
+        uint64_t page_end = (start | (page_size_ - 1));
+        uint64_t last = std::min(end_address, page_end);
+        uint32_t page_index = static_cast<uint32_t>(start >> page_shift_);
+        
+        // Only code pages have a bitmap worth locking for; self-verifying
+        // pages never need their translations invalidated
+        uint8_t attributes = page_table_[page_index].load(std::memory_order_acquire);
+        if ((attributes & PAGE_HAS_CODE) && !(attributes & PAGE_SELF_VERIFY)) {
+            std::lock_guard<std::mutex> lock(code_bytes_mutex_);
+            auto it = code_bytes_.find(page_index);
+            if (it != code_bytes_.end() && !it->second.bitmap.empty() &&
+                test_bitmap_range(it->second.bitmap, static_cast<uint32_t>(start & (page_size_ - 1)),
+                                  static_cast<uint32_t>(last & (page_size_ - 1)))) {
+                ranges.emplace_back(static_cast<uint32_t>(start), static_cast<uint32_t>(last - start + 1));
+            }
+        }
+        start = page_end + 1;
+    }
+    return ranges;
+}
+
+void MemoryManager::note_code_write(uint32_t guest_address) {
+    code_writes_.fetch_add(1, std::memory_order_relaxed);
+    
+    uint32_t page_index = guest_address >> page_shift_;
+    {
+        std::lock_guard<std::mutex> lock(code_bytes_mutex_);
+        CodePageBytes& page = code_bytes_[page_index];
+        auto now = std::chrono::steady_clock::now();
+        if (now - page.window_start > std::chrono::milliseconds(SMC_RATE_WINDOW_MS)) {
+            page.window_start = now;
+            page.code_writes = 0;
+        }
+        if (++page.code_writes < SELF_VERIFY_THRESHOLD ||
+            (page_table_[page_index].fetch_or(PAGE_SELF_VERIFY, std::memory_order_acq_rel) & PAGE_SELF_VERIFY)) {
+            return;
+        }
+    }
+    
+    // Stop trapping and invalidating: translations made before the switch do
+    // not verify themselves, so they go once more
+    uint32_t page_addr = align_to_page(guest_address);
+    LOG_INFO("Code page 0x" + std::to_string(page_addr) + " switched to self-verifying translation");
+    set_page_protection(page_index, 1, PROT_READ | PROT_WRITE);
+    invalidate_translations_for_range(page_addr, static_cast<uint32_t>(page_size_));
+}
+
+bool MemoryManager::has_self_verifying_page(uint32_t guest_address, uint32_t size) const {
+    uint64_t first_page = guest_address >> page_shift_;
+    uint64_t count = page_count(guest_address, size);
+    for (uint64_t page = first_page; page < first_page + count; page++) {
+        if (page_table_[page].load(std::memory_order_acquire) & PAGE_SELF_VERIFY) {
+            return true;
+        }
+    }
+    return false;
+}
+
+SmcStats MemoryManager::get_smc_stats() const {
+    SmcStats stats = {};
+    uint64_t pages = (uint64_t(1) << 32) >> page_shift_;
+    for (uint64_t page = 0; page < pages; page++) {
+        uint8_t attributes = page_table_[page].load(std::memory_order_relaxed);
+        if (!(attributes & PAGE_HAS_CODE)) {
+            continue;
+        }
+        if (attributes & PAGE_SELF_VERIFY) {
+            stats.self_verifying_pages++;
+        } else if (attributes & PAGE_INLINE_CHECKS) {
+            stats.inline_check_pages++;
+        } else {
+            stats.protected_pages++;
+        }
+    }
+    stats.code_writes = code_writes_.load(std::memory_order_relaxed);
+    stats.data_faults = data_faults_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+uint32_t MemoryManager::get_data_fault_count(uint32_t guest_address) const {
+    std::lock_guard<std::mutex> lock(code_bytes_mutex_);
+    auto it = code_bytes_.find(guest_address >> page_shift_);
+    return it != code_bytes_.end() ? it->second.data_faults : 0;
+}
+
 void MemoryManager::reprotect_page(uint32_t guest_address, int new_protection) {
     uint32_t page_addr = align_to_page(guest_address);
     
+    // Pages that stopped trapping writes stay writable
+    if (page_attributes(page_addr) & (PAGE_INLINE_CHECKS | PAGE_SELF_VERIFY)) {
+        return;
+    }
+    
     protect_guest_memory(page_addr, page_size_, new_protection);
 }
 
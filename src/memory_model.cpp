@@ -1,9 +1,123 @@
 #include "xenoarm_jit/memory_model.h"
 #include "xenoarm_jit/aarch64/code_generator.h"
 #include "logging/logger.h"
+#include <algorithm>
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
 
 namespace xenoarm_jit {
 
+namespace {
+
+// Guest register indices of the stack and frame pointers (x86 encoding)
+constexpr uint32_t GUEST_ESP = 4;
+constexpr uint32_t GUEST_EBP = 5;
+
+const ir::IrOperand* find_memory_operand(const ir::IrInstruction& insn) {
+    for (const ir::IrOperand& operand : insn.operands) {
+        if (operand.type == ir::IrOperandType::MEMORY) {
+            return &operand;
+        }
+    }
+    return nullptr;
+}
+
+// Stores, and read-modify-write instructions with a memory destination
+bool writes_memory(const ir::IrInstruction& insn) {
+    switch (insn.type) {
+        case ir::IrInstructionType::STORE:
+        case ir::IrInstructionType::PUSH:
+            return true;
+        case ir::IrInstructionType::LOAD:
+        case ir::IrInstructionType::POP:
+        case ir::IrInstructionType::CMP:
+        case ir::IrInstructionType::TEST:
+            return false;
+        default:
+            return !insn.operands.empty() && insn.operands[0].type == ir::IrOperandType::MEMORY;
+    }
+}
+
+// Points where control may leave the block or join it from elsewhere; code
+// on the other side is not analysed, so nothing may stay unordered across them
+bool is_ordering_boundary(ir::IrInstructionType type) {
+    switch (type) {
+        case ir::IrInstructionType::JMP:
+        case ir::IrInstructionType::CALL:
+        case ir::IrInstructionType::RET:
+        case ir::IrInstructionType::LABEL:
+        case ir::IrInstructionType::HOST_CALL:
+        case ir::IrInstructionType::DEBUG_BREAK:
+            return true;
+        default:
+            return type >= ir::IrInstructionType::BR_EQ && type <= ir::IrInstructionType::BR_COND;
+    }
+}
+
+// Locked read-modify-write instructions, which are full barriers themselves
+bool is_atomic(ir::IrInstructionType type) {
+    return type >= ir::IrInstructionType::ATOMIC_ADD && type <= ir::IrInstructionType::ATOMIC_CMPXCHG8B;
+}
+
+MemoryModel::BarrierType fence_type(const ir::IrInstruction& insn) {
+    if (insn.operands.empty() || insn.operands[0].type != ir::IrOperandType::IMMEDIATE) {
+        return MemoryModel::BARRIER_MFENCE;
+    }
+    return static_cast<MemoryModel::BarrierType>(insn.operands[0].imm_value);
+}
+
+// Bytes a memory operand of this type covers, for region lookups
+uint32_t access_size(ir::IrDataType data_type) {
+    switch (data_type) {
+        case ir::IrDataType::I8:
+        case ir::IrDataType::U8:
+            return 1;
+        case ir::IrDataType::I16:
+        case ir::IrDataType::U16:
+            return 2;
+        case ir::IrDataType::I64:
+        case ir::IrDataType::U64:
+        case ir::IrDataType::F64:
+        case ir::IrDataType::V64_B8:
+        case ir::IrDataType::V64_W4:
+        case ir::IrDataType::V64_D2:
+            return 8;
+        case ir::IrDataType::F80:
+            return 10;
+        case ir::IrDataType::V128_B16:
+        case ir::IrDataType::V128_W8:
+        case ir::IrDataType::V128_D4:
+        case ir::IrDataType::V128_Q2:
+            return 16;
+        default:
+            return 4;
+    }
+}
+
+// Order of region policies by the ordering they require
+int policy_strength(MemoryModel::RegionPolicy policy) {
+    switch (policy) {
+        case MemoryModel::REGION_RELAXED: return 0;
+        case MemoryModel::REGION_TSO: return 2;
+        case MemoryModel::REGION_DEVICE: return 3;
+        default: return 1;
+    }
+}
+
+MemoryModel::RegionPolicy stronger_policy(MemoryModel::RegionPolicy a, MemoryModel::RegionPolicy b) {
+    return policy_strength(a) >= policy_strength(b) ? a : b;
+}
+
+ir::IrInstruction make_fence(MemoryModel::BarrierType barrier_type) {
+    return ir::IrInstruction(ir::IrInstructionType::MEM_FENCE,
+                             {ir::IrOperand::make_imm(static_cast<int64_t>(barrier_type), ir::IrDataType::I32)});
+}
+
+} // anonymous namespace
+
 MemoryModel::MemoryModel() {
     LOG_DEBUG("MemoryModel created");
 }
@@ -116,6 +230,11 @@ MemoryModel::BarrierType MemoryModel::analyze_store_operation(const ir::IrInstru
         return BARRIER_NONE;
     }
     
+    // Stack stores are thread-private
+    if (classify_access(insn) == ACCESS_STACK) {
+        return BARRIER_NONE;
+    }
+    
     // For stores in x86 TSO, stores from the same processor are observed in program order
     // The ARM memory model allows stores to be reordered, so we might need a barrier after the store
     
@@ -130,6 +249,11 @@ MemoryModel::BarrierType MemoryModel::analyze_store_operation(const ir::IrInstru
 
 // Helper method to determine if a memory barrier is needed between two memory operations
 bool MemoryModel::needs_barrier_between(const ir::IrInstruction& first, const ir::IrInstruction& second) {
+    // Thread-private stack accesses are never observed by another agent
+    if (classify_access(first) == ACCESS_STACK || classify_access(second) == ACCESS_STACK) {
+        return false;
+    }
+    
     // If both are loads, ARM preserves program order for loads, so no barrier needed
     bool first_is_load = (first.type == ir::IrInstructionType::LOAD);
     bool second_is_load = (second.type == ir::IrInstructionType::LOAD);
@@ -149,9 +273,7 @@ bool MemoryModel::needs_barrier_between(const ir::IrInstruction& first, const ir
     }
     
     // If both are stores, ARM may reorder them, but x86 TSO would not
-    if (first_is_store && !second_is_load) {
-        // In a real implementation, we'd analyze if they could be reordered
-        // For simplicity, we'll insert a barrier to be safe
+    if (first_is_store && classify_access(second) != ACCESS_NONE) {
         return true;
     }
     
@@ -159,6 +281,334 @@ bool MemoryModel::needs_barrier_between(const ir::IrInstruction& first, const ir
     return false;
 }
 
+bool MemoryModel::needs_barrier_between(const std::vector<ir::IrInstruction>& instructions,
+                                        size_t first, size_t second) const {
+    if (first >= second || second >= instructions.size()) {
+        return false;
+    }
+    const ir::IrInstruction& target = instructions[second];
+    if (is_atomic(target.type) ||
+        (classify_access(target) != ACCESS_SHARED && !is_ordering_boundary(target.type))) {
+        return false;
+    }
+    
+    // A shared access (or host code) in the range that no later fence in the
+    // range orders against target
+    bool unordered_access = false;
+    for (size_t i = first; i < second; i++) {
+        const ir::IrInstruction& insn = instructions[i];
+        if (insn.type == ir::IrInstructionType::MEM_FENCE) {
+            BarrierType type = fence_type(insn);
+            if (type != BARRIER_NONE && type != BARRIER_ISB) {
+                unordered_access = false;
+            }
+        } else if (is_atomic(insn.type)) {
+            unordered_access = false;
+        } else if (classify_access(insn) == ACCESS_SHARED || insn.type == ir::IrInstructionType::HOST_CALL) {
+            unordered_access = true;
+        }
+    }
+    return unordered_access;
+}
+
+MemoryModel::AccessClass MemoryModel::classify_access(const ir::IrInstruction& insn) {
+    if (insn.type == ir::IrInstructionType::PUSH || insn.type == ir::IrInstructionType::POP) {
+        return ACCESS_STACK;
+    }
+    const ir::IrOperand* memory = find_memory_operand(insn);
+    if (!memory) {
+        return ACCESS_NONE;
+    }
+    const ir::MemoryOperand& address = memory->mem_info;
+    if ((address.base_reg_idx == GUEST_ESP || address.base_reg_idx == GUEST_EBP) &&
+        address.index_reg_idx == ir::MemoryOperand::NO_REGISTER) {
+        return ACCESS_STACK;
+    }
+    return ACCESS_SHARED;
+}
+
+MemoryModel::HostFeatures MemoryModel::detect_host_features() {
+    HostFeatures features;
+#if defined(__aarch64__) && defined(__linux__)
+#ifndef HWCAP_ATOMICS
+#define HWCAP_ATOMICS (1 << 8)
+#endif
+#ifndef HWCAP_LRCPC
+#define HWCAP_LRCPC (1 << 15)
+#endif
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    features.rcpc = (hwcap & HWCAP_LRCPC) != 0;
+    features.lse_atomics = (hwcap & HWCAP_ATOMICS) != 0;
+#endif
+    return features;
+}
+
+MemoryModel::OrderingLowering MemoryModel::best_lowering(const HostFeatures& features) {
+    return features.rcpc ? LOWERING_LDAPR_STLR : LOWERING_BARRIERS;
+}
+
+void MemoryModel::set_region_policy(uint32_t start, uint64_t size, RegionPolicy policy) {
+    if (size == 0) {
+        return;
+    }
+    const uint64_t end = std::min<uint64_t>(static_cast<uint64_t>(start) + size, uint64_t(1) << 32);
+    
+    std::lock_guard<std::mutex> lock(regions_mutex_);
+    std::vector<Region> regions;
+    if (regions_) {
+        // Keep what existing regions say outside [start, end)
+        for (const Region& region : *regions_) {
+            if (region.end <= start || region.start >= end) {
+                regions.push_back(region);
+                continue;
+            }
+            if (region.start < start) {
+                regions.push_back({region.start, start, region.policy});
+            }
+            if (region.end > end) {
+                regions.push_back({static_cast<uint32_t>(end), region.end, region.policy});
+            }
+        }
+    }
+    if (policy != REGION_DEFAULT) {
+        regions.push_back({start, end, policy});
+    }
+    std::sort(regions.begin(), regions.end(),
+              [](const Region& a, const Region& b) { return a.start < b.start; });
+    
+    std::vector<Region> merged;
+    for (const Region& region : regions) {
+        if (!merged.empty() && merged.back().end == region.start && merged.back().policy == region.policy) {
+            merged.back().end = region.end;
+        } else {
+            merged.push_back(region);
+        }
+    }
+    has_regions_.store(!merged.empty(), std::memory_order_release);
+    regions_ = std::make_shared<const std::vector<Region>>(std::move(merged));
+}
+
+std::shared_ptr<const std::vector<MemoryModel::Region>> MemoryModel::region_snapshot() const {
+    if (!has_regions_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(regions_mutex_);
+    return regions_;
+}
+
+MemoryModel::RegionPolicy MemoryModel::lookup_region_policy(const std::vector<Region>& regions,
+                                                            uint32_t guest_address, uint32_t size) {
+    const uint64_t first = guest_address;
+    const uint64_t last = first + std::max<uint32_t>(size, 1);
+    // Regions are disjoint and sorted, so their ends are sorted too
+    auto it = std::upper_bound(regions.begin(), regions.end(), first,
+                               [](uint64_t address, const Region& region) { return address < region.end; });
+    RegionPolicy policy = REGION_RELAXED;
+    uint64_t covered = first;
+    bool uncovered = false;
+    for (; it != regions.end() && it->start < last; ++it) {
+        uncovered = uncovered || it->start > covered;
+        policy = stronger_policy(policy, it->policy);
+        covered = it->end;
+    }
+    if (uncovered || covered < last) {
+        policy = stronger_policy(policy, REGION_DEFAULT);
+    }
+    return policy;
+}
+
+MemoryModel::RegionPolicy MemoryModel::region_policy(uint32_t guest_address, uint32_t size) const {
+    std::shared_ptr<const std::vector<Region>> regions = region_snapshot();
+    return regions ? lookup_region_policy(*regions, guest_address, size) : REGION_DEFAULT;
+}
+
+std::vector<MemoryModel::Region> MemoryModel::get_regions() const {
+    std::shared_ptr<const std::vector<Region>> regions = region_snapshot();
+    return regions ? *regions : std::vector<Region>();
+}
+
+void MemoryModel::fence_before_access(RegionPolicy policy, bool is_store) {
+    if (policy == REGION_DEVICE) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    } else if (policy == REGION_TSO && is_store) {
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+}
+
+void MemoryModel::fence_after_access(RegionPolicy policy, bool is_store) {
+    if (policy == REGION_DEVICE) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    } else if (policy == REGION_TSO && !is_store) {
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+}
+
+MemoryModel::BarrierStats MemoryModel::order_memory_accesses(std::vector<ir::IrInstruction>& instructions,
+                                                             bool tso, OrderingLowering lowering) const {
+    BarrierStats stats;
+    std::vector<ir::IrInstruction> ordered;
+    ordered.reserve(instructions.size() + 4);
+    std::shared_ptr<const std::vector<Region>> regions = region_snapshot();
+    
+    // Dataflow state since the last barrier placed in ordered
+    bool unordered_store = false; // A shared store (tso) still to be ordered
+    bool unordered_load = false;  // A shared load (tso) still to be ordered
+    bool accessed = false;        // Any shared access, for the guest's fences
+    bool fence_requested = false; // A guest fence with something before it to order
+    auto place_barrier = [&]() {
+        if (unordered_store || fence_requested) {
+            ordered.push_back(make_fence(BARRIER_DMB_ISH));
+            stats.emitted_barriers++;
+        } else if (unordered_load) {
+            // Orders earlier loads against later loads and stores
+            ordered.push_back(make_fence(BARRIER_LFENCE));
+            stats.emitted_barriers++;
+        }
+        unordered_store = false;
+        unordered_load = false;
+        accessed = false;
+        fence_requested = false;
+    };
+    
+    for (ir::IrInstruction& insn : instructions) {
+        if (insn.type == ir::IrInstructionType::MEM_FENCE) {
+            BarrierType type = fence_type(insn);
+            if (type == BARRIER_NONE) {
+                continue;
+            }
+            stats.naive_barriers++;
+            if (type == BARRIER_DSB_ISH || type == BARRIER_ISB) {
+                // Synchronisation barriers stay where they are. DSB orders
+                // everything a DMB would; ISB orders no memory at all.
+                if (type == BARRIER_ISB) {
+                    place_barrier();
+                }
+                ordered.push_back(std::move(insn));
+                stats.emitted_barriers++;
+                unordered_store = false;
+                unordered_load = false;
+                accessed = false;
+                fence_requested = false;
+                continue;
+            }
+            // Merged into the barrier before the next shared access or exit;
+            // with no shared access since the last barrier it orders nothing
+            if (accessed) {
+                fence_requested = true;
+            }
+            continue;
+        }
+        
+        stats.instructions++;
+        AccessClass access = classify_access(insn);
+        bool store = writes_memory(insn);
+        if (tso && store) {
+            stats.naive_barriers++; // Conservative lowering fences after every store
+        }
+        
+        // Accesses at absolute addresses follow the policy of their region;
+        // others are only known at run time, where the slow path applies it
+        RegionPolicy policy = REGION_DEFAULT;
+        const ir::IrOperand* memory = regions && access == ACCESS_SHARED ? find_memory_operand(insn) : nullptr;
+        if (memory && memory->mem_info.base_reg_idx == ir::MemoryOperand::NO_REGISTER &&
+            memory->mem_info.index_reg_idx == ir::MemoryOperand::NO_REGISTER) {
+            policy = lookup_region_policy(*regions, static_cast<uint32_t>(memory->mem_info.displacement),
+                                          access_size(memory->data_type));
+        }
+        if (policy == REGION_RELAXED) {
+            access = ACCESS_STACK; // Private to the guest CPU
+            stats.relaxed_accesses++;
+        } else if (policy == REGION_DEVICE) {
+            stats.device_accesses++;
+            if (insn.type == ir::IrInstructionType::LOAD || insn.type == ir::IrInstructionType::STORE) {
+                // Lowered to the slow path, whose fences order it against
+                // everything before and after it
+                insn.memory_order = ir::IrMemoryOrder::DEVICE;
+                ordered.push_back(std::move(insn));
+                unordered_store = false;
+                unordered_load = false;
+                accessed = false;
+                fence_requested = false;
+                continue;
+            }
+            // Anything else touching device memory gets a barrier on both
+            // sides, the one after placed before the next access or exit
+            fence_requested = true;
+            place_barrier();
+            ordered.push_back(std::move(insn));
+            unordered_store = true;
+            accessed = true;
+            continue;
+        }
+        const bool region_tso = tso || policy == REGION_TSO;
+        
+        if (is_atomic(insn.type)) {
+            // Orders everything before it against everything after it, stack
+            // or not (LOCK OR [ESP], 0 is a common fence idiom)
+            ordered.push_back(std::move(insn));
+            unordered_store = false;
+            unordered_load = false;
+            accessed = false;
+            fence_requested = false;
+            continue;
+        }
+        if (access == ACCESS_SHARED || is_ordering_boundary(insn.type)) {
+            place_barrier();
+        }
+        
+        // The access orders itself: an acquire load keeps later accesses
+        // after it, a release store keeps earlier ones before it
+        bool self_ordered = false;
+        if (region_tso && access == ACCESS_SHARED && lowering != LOWERING_BARRIERS) {
+            if (insn.type == ir::IrInstructionType::LOAD) {
+                insn.memory_order = ir::IrMemoryOrder::ACQUIRE;
+                self_ordered = true;
+            } else if (insn.type == ir::IrInstructionType::STORE) {
+                insn.memory_order = ir::IrMemoryOrder::RELEASE;
+                self_ordered = true;
+            }
+        }
+        if (self_ordered) {
+            stats.ordered_accesses++;
+        }
+        
+        bool host_call = insn.type == ir::IrInstructionType::HOST_CALL;
+        ordered.push_back(std::move(insn));
+        if (access == ACCESS_SHARED || host_call) {
+            // Host code may have touched anything
+            accessed = true;
+            unordered_store = unordered_store || (region_tso && store && !self_ordered) || (tso && host_call);
+            unordered_load = unordered_load || (region_tso && !store && !host_call && !self_ordered);
+        }
+    }
+    // Falling through to the next block is an exit too
+    place_barrier();
+    
+    instructions.swap(ordered);
+    return stats;
+}
+
+uint32_t MemoryModel::barrier_encoding(BarrierType barrier_type) {
+    switch (barrier_type) {
+        case BARRIER_SFENCE:
+            return 0xD5033ABF; // DMB ISHST
+        case BARRIER_LFENCE:
+            return 0xD50339BF; // DMB ISHLD
+        case BARRIER_DSB_ISH:
+            return 0xD5033B9F; // DSB ISH
+        case BARRIER_ISB:
+            return 0xD5033FDF; // ISB
+        case BARRIER_NONE:
+            return 0xD503201F; // NOP
+        case BARRIER_MFENCE:
+        case BARRIER_LOCK_PREFIX:
+        case BARRIER_XCHG:
+        case BARRIER_DMB_ISH:
+        default:
+            return 0xD5033BBF; // DMB ISH
+    }
+}
+
 // Helper methods to emit specific ARM barriers
 void MemoryModel::emit_arm_dmb_ish(aarch64::CodeGenerator* code_gen) {
     // DMB ISH = Data Memory Barrier, Inner Shareable
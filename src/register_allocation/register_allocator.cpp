@@ -1,135 +1,187 @@
 #include "xenoarm_jit/register_allocation/register_allocator.h"
 #include "logging/logger.h"
 #include <algorithm>
-#include <set>
 #include <limits>
-#include <cassert>
-#include <map>
 
 namespace xenoarm_jit {
 namespace register_allocation {
 
-// Structure to represent register usage statistics for smart allocation
-struct RegisterUsageStats {
-    uint32_t vreg_id;
-    uint32_t use_count;         // How many times this register is used
-    bool is_x86_reg_mapped;     // Whether this is a direct mapping of an x86 register
-    bool involved_in_loop;      // Whether this register is used in a loop
-};
+// Cost added per loop level at a victim's next use when choosing what to split
+static const float LOOP_DEPTH_SPILL_WEIGHT = 1000.0f;
+
+// Marker for "no position"
+static const uint32_t NO_POSITION = std::numeric_limits<uint32_t>::max();
+
+// Loop entry locations: the value is in its stack slot, or not live at the header
+static const int32_t IN_MEMORY = -1;
+static const int32_t NOT_LIVE = -2;
+
+// Extra slot access weight per loop level, used to keep hot slots in the first cache line
+static const uint32_t SLOT_LOOP_ACCESS_WEIGHT = 8;
+
+// Virtual registers an operand uses: a register operand itself, or the base
+// and index of a memory operand. Returns the number written to vregs.
+static size_t operand_vregs(const ir::IrOperand& op, uint32_t vregs[2]) {
+    if (op.type == ir::IrOperandType::REGISTER) {
+        vregs[0] = op.reg_idx;
+        return 1;
+    }
+    size_t count = 0;
+    if (op.type == ir::IrOperandType::MEMORY) {
+        if (op.mem_info.base_reg_idx != ir::MemoryOperand::NO_REGISTER) {
+            vregs[count++] = op.mem_info.base_reg_idx;
+        }
+        if (op.mem_info.index_reg_idx != ir::MemoryOperand::NO_REGISTER) {
+            vregs[count++] = op.mem_info.index_reg_idx;
+        }
+    }
+    return count;
+}
 
 // SpillAllocator implementation (Phase 8)
-SpillAllocator::SpillAllocator() : current_offset_(0) {
+SpillAllocator::SpillAllocator() : total_size_(0) {
 }
 
-int32_t SpillAllocator::allocate_spill_slot(uint32_t vreg_id, ir::IrDataType data_type) {
-    // Determine size needed for this data type
-    uint32_t size = 8; // Default to 64-bit
-    
-    // Adjust size based on data type
+uint32_t SpillAllocator::get_slot_size(ir::IrDataType data_type) {
     switch (data_type) {
         case ir::IrDataType::I8:
         case ir::IrDataType::U8:
-            size = 1;
-            break;
+            return 1;
         case ir::IrDataType::I16:
         case ir::IrDataType::U16:
-            size = 2;
-            break;
+            return 2;
         case ir::IrDataType::I32:
         case ir::IrDataType::U32:
         case ir::IrDataType::F32:
-            size = 4;
-            break;
+            return 4;
         case ir::IrDataType::I64:
         case ir::IrDataType::U64:
         case ir::IrDataType::F64:
         case ir::IrDataType::V64_B8:
         case ir::IrDataType::V64_W4:
         case ir::IrDataType::V64_D2:
-            size = 8;
-            break;
+            return 8;
         case ir::IrDataType::F80:
-            size = 16; // Align to 16 for 80-bit floats for simplicity
-            break;
+            return 16; // Align to 16 for 80-bit floats for simplicity
         case ir::IrDataType::V128_B16:
         case ir::IrDataType::V128_W8:
         case ir::IrDataType::V128_D4:
         case ir::IrDataType::V128_Q2:
-            size = 16;
-            break;
+            return 16;
         case ir::IrDataType::PTR:
-            size = 8; // 64-bit pointers on AArch64
-            break;
+            return 8; // 64-bit pointers on AArch64
         default:
-            LOG_WARNING("Unknown data type for spill slot allocation. Defaulting to 8 bytes.");
-            size = 8;
-            break;
+            return 8; // Default to 64-bit
     }
+}
+
+uint32_t SpillAllocator::add_spill_request(uint32_t vreg_id, ir::IrDataType data_type) {
+    SpillRequest request;
+    request.vreg_id = vreg_id;
+    request.size = get_slot_size(data_type);
+    request.start = std::numeric_limits<uint32_t>::max();
+    request.end = 0;
+    request.weight = 0;
+    request.slot = 0;
+    requests_.push_back(request);
     
-    // Ensure proper alignment (align to size)
-    int32_t aligned_offset = (current_offset_ + size - 1) & ~(size - 1);
+    return static_cast<uint32_t>(requests_.size() - 1);
+}
+
+void SpillAllocator::record_access(uint32_t request_id, uint32_t position, uint32_t weight) {
+    SpillRequest& request = requests_[request_id];
+    request.start = std::min(request.start, position);
+    request.end = std::max(request.end, position);
+    request.weight += weight;
+}
+
+void SpillAllocator::assign_slots() {
+    slots_.clear();
     
-    // Store allocation info
-    allocated_slots_[aligned_offset] = size;
+    // Greedy interval coloring per size class: in start order, reuse the slot of
+    // the same size that became free most recently, otherwise open a new one
+    request_order_.resize(requests_.size());
+    for (uint32_t i = 0; i < request_order_.size(); i++) {
+        request_order_[i] = i;
+    }
+    std::sort(request_order_.begin(), request_order_.end(), [this](uint32_t a, uint32_t b) {
+        if (requests_[a].size != requests_[b].size) {
+            return requests_[a].size > requests_[b].size;
+        }
+        return requests_[a].start < requests_[b].start;
+    });
     
-    // Update current offset for next allocation
-    current_offset_ = aligned_offset + size;
+    for (uint32_t request_id : request_order_) {
+        SpillRequest& request = requests_[request_id];
+        
+        uint32_t best = static_cast<uint32_t>(slots_.size());
+        for (uint32_t i = 0; i < slots_.size(); i++) {
+            if (slots_[i].size == request.size && slots_[i].end < request.start &&
+                (best == slots_.size() || slots_[i].end > slots_[best].end)) {
+                best = i;
+            }
+        }
+        
+        if (best == slots_.size()) {
+            slots_.push_back(SpillSlot{request.size, 0, 0, 0});
+        }
+        
+        slots_[best].end = request.end;
+        slots_[best].weight += request.weight;
+        request.slot = best;
+    }
+    
+    // Pick the hottest slots that fit in the first cache line
+    slot_order_.resize(slots_.size());
+    for (uint32_t i = 0; i < slot_order_.size(); i++) {
+        slot_order_[i] = i;
+    }
+    std::sort(slot_order_.begin(), slot_order_.end(), [this](uint32_t a, uint32_t b) {
+        if (slots_[a].weight != slots_[b].weight) {
+            return slots_[a].weight > slots_[b].weight;
+        }
+        return slots_[a].size > slots_[b].size;
+    });
+    
+    uint32_t hot_used = 0;
+    for (uint32_t slot_id : slot_order_) {
+        bool hot = hot_used + slots_[slot_id].size <= HOT_AREA_SIZE;
+        hot_used += hot ? slots_[slot_id].size : 0;
+        slots_[slot_id].offset = hot ? 1 : 0; // Temporary hot marker
+    }
     
-    LOG_DEBUG("Allocated spill slot at offset " + std::to_string(aligned_offset) + " of size " + std::to_string(size) + " for vreg " + std::to_string(vreg_id));
+    // Lay out hot slots first, each group largest size first: with power-of-two
+    // sizes in descending order every slot is naturally aligned without padding
+    std::sort(slot_order_.begin(), slot_order_.end(), [this](uint32_t a, uint32_t b) {
+        if (slots_[a].offset != slots_[b].offset) {
+            return slots_[a].offset > slots_[b].offset;
+        }
+        return slots_[a].size > slots_[b].size;
+    });
+    
+    uint32_t offset = 0;
+    for (uint32_t slot_id : slot_order_) {
+        uint32_t size = slots_[slot_id].size;
+        offset = (offset + size - 1) & ~(size - 1);
+        slots_[slot_id].offset = static_cast<int32_t>(offset);
+        offset += size;
+    }
     
-    return aligned_offset;
+    total_size_ = static_cast<int32_t>(offset);
 }
 
-void SpillAllocator::free_spill_slot(int32_t offset) {
-    // Remove the slot from allocated slots
-    if (allocated_slots_.find(offset) != allocated_slots_.end()) {
-        LOG_DEBUG("Freed spill slot at offset " + std::to_string(offset));
-        allocated_slots_.erase(offset);
-    }
+int32_t SpillAllocator::get_slot_offset(uint32_t request_id) const {
+    return slots_[requests_[request_id].slot].offset;
 }
 
 int32_t SpillAllocator::get_total_spill_size() const {
-    return current_offset_;
+    return total_size_;
 }
 
 void SpillAllocator::reset() {
-    allocated_slots_.clear();
-    current_offset_ = 0;
-}
-
-// Helper function to check if an instruction is likely to modify a register
-bool isRegisterModifyingInstruction(const ir::IrInstruction& inst) {
-    // Check instruction types that typically modify their first operand
-    switch (inst.type) {
-        case ir::IrInstructionType::MOV:
-        case ir::IrInstructionType::ADD:
-        case ir::IrInstructionType::SUB:
-        case ir::IrInstructionType::MUL:
-        case ir::IrInstructionType::DIV:
-        case ir::IrInstructionType::AND:
-        case ir::IrInstructionType::OR:
-        case ir::IrInstructionType::XOR:
-        case ir::IrInstructionType::LOAD:
-        case ir::IrInstructionType::INC:
-        case ir::IrInstructionType::DEC:
-        case ir::IrInstructionType::POP:
-        case ir::IrInstructionType::VEC_MOV:
-        case ir::IrInstructionType::VEC_ADD_PS:
-        case ir::IrInstructionType::VEC_SUB_PS:
-        case ir::IrInstructionType::VEC_MUL_PS:
-        case ir::IrInstructionType::VEC_DIV_PS:
-        case ir::IrInstructionType::VEC_ADD_PD:
-        case ir::IrInstructionType::VEC_SUB_PD:
-        case ir::IrInstructionType::VEC_MUL_PD:
-        case ir::IrInstructionType::VEC_DIV_PD:
-        case ir::IrInstructionType::VEC_ADD_PI8:
-        case ir::IrInstructionType::VEC_SUB_PI8:
-        case ir::IrInstructionType::VEC_MUL_PI16:
-        case ir::IrInstructionType::VEC_ADD_W:
-            return true;
-        default:
-            return false;
-    }
+    requests_.clear();
+    slots_.clear();
+    total_size_ = 0;
 }
 
 // Helper function to check if an instruction is a branch
@@ -182,160 +234,182 @@ bool requiresNeonRegister(ir::IrDataType data_type) {
     }
 }
 
-RegisterAllocator::RegisterAllocator() {
+RegisterAllocator::RegisterAllocator()
+    : forward_internal_branch_(false), spill_stats_{0, 0, 0, 0}, live_range_splitting_(true),
+      free_gpr_mask_(0), free_neon_mask_(0), pin_guest_registers_(false),
+      fastmem_(false) {
     LOG_DEBUG("RegisterAllocator created.");
     
-    // Initialize free register lists
+    // Initialize free register masks
+    reset_free_register_pools();
+}
+
+RegisterAllocator::~RegisterAllocator() {
+    LOG_DEBUG("RegisterAllocator destroyed.");
+}
+
+void RegisterAllocator::set_guest_register_pinning(bool enabled) {
+    pin_guest_registers_ = enabled;
+    reset_free_register_pools();
+    
+    LOG_DEBUG(std::string("Guest register pinning ") + (enabled ? "enabled" : "disabled"));
+}
+
+void RegisterAllocator::set_fastmem(bool enabled) {
+    fastmem_ = enabled;
+    reset_free_register_pools();
+    
+    LOG_DEBUG(std::string("Fastmem ") + (enabled ? "enabled" : "disabled"));
+}
+
+void RegisterAllocator::reset_free_register_pools() {
+    free_gpr_mask_ = 0;
+    free_neon_mask_ = 0;
+    
     // Reserve some GPRs for temporary usage during code generation
     // X28 is reserved as temp, X29 is FP, X30 is LR, X31 is SP/XZR
     for (int i = 0; i < 28; i++) {
-        if (i != 16 && i != 17) { // Reserve x16, x17 for platform use
-            free_gpr_registers_.push_back(i);
+        if (i == 16 || i == 17) { // Reserve x16, x17 for platform use
+            continue;
         }
+        
+        // X19-X28 hold the pinned guest state and are never handed out
+        if (pin_guest_registers_ && GuestRegisterPinning::is_reserved_physical_reg(i)) {
+            continue;
+        }
+        
+        // X18 holds the host base of guest memory
+        if (fastmem_ && i == FastmemRegisters::BASE_REG) {
+            continue;
+        }
+        
+        free_gpr_mask_ |= (1ULL << i);
     }
     
     // For NEON/Vector registers, use V0-V31
     // Reserve V0-V7 for temporary use
     for (int i = 8; i < 32; i++) {
-        free_neon_registers_.push_back(i);
+        free_neon_mask_ |= (1ULL << i);
     }
 }
 
-RegisterAllocator::~RegisterAllocator() {
-    LOG_DEBUG("RegisterAllocator destroyed.");
-}
-
-// Enhanced compute_lifetimes function for Phase 8
-std::vector<VRegLifetime> RegisterAllocator::compute_lifetimes(const std::vector<ir::IrInstruction>& ir_instructions) {
-    // Map from vreg_id to its lifetime
-    std::unordered_map<uint32_t, VRegLifetime> lifetimes;
+// Single pass over the block building one interval per vreg (Phase 8)
+void RegisterAllocator::compute_lifetimes(const std::vector<ir::IrInstruction>& ir_instructions) {
+    // Forget the previous block's vregs; only entries we actually touched need resetting
+    for (const auto& interval : intervals_) {
+        vreg_to_interval_[interval.vreg_id] = -1;
+    }
+    intervals_.clear();
     
-    // First pass: Compute usage statistics and find start/end points for each vreg
     for (size_t i = 0; i < ir_instructions.size(); i++) {
-        const auto& inst = ir_instructions[i];
-        
-        // Check for registers in operands
-        for (const auto& op : inst.operands) {
-            if (op.type == ir::IrOperandType::REGISTER) {
-                uint32_t vreg_id = op.reg_idx;
-                
-                // Initialize or update lifetime
-                if (lifetimes.find(vreg_id) == lifetimes.end()) {
-                    VRegLifetime lifetime;
-                    lifetime.vreg_id = vreg_id;
-                    lifetime.data_type = op.data_type;
-                    lifetime.start = i;
-                    lifetime.end = i;
-                    lifetime.use_count = 1;
-                    lifetime.is_active = false;
-                    lifetime.is_loop_register = false;
-                    lifetime.is_x86_mapped = (vreg_id < 8); // Assume vregs 0-7 are x86 mappings
-                    lifetime.priority = 0.0f;
-                    lifetimes[vreg_id] = lifetime;
-                } else {
-                    // Update end point if this is used later
-                    lifetimes[vreg_id].end = i;
-                    // Update usage count
-                    lifetimes[vreg_id].use_count++;
+        for (const auto& op : ir_instructions[i].operands) {
+            uint32_t vregs[2];
+            size_t vreg_count = operand_vregs(op, vregs);
+            for (size_t v = 0; v < vreg_count; v++) {
+                uint32_t vreg_id = vregs[v];
+                if (vreg_id >= vreg_to_interval_.size()) {
+                    vreg_to_interval_.resize(static_cast<size_t>(vreg_id) + 1, -1);
                 }
-            }
-        }
-        
-        // Special handling for instructions that modify registers (typically first operand)
-        if (isRegisterModifyingInstruction(inst)) {
-            // For instructions that modify their first operand
-            if (!inst.operands.empty() && inst.operands[0].type == ir::IrOperandType::REGISTER) {
-                uint32_t vreg_id = inst.operands[0].reg_idx;
-                
-                // Initialize or update lifetime
-                if (lifetimes.find(vreg_id) == lifetimes.end()) {
+            
+                int32_t idx = vreg_to_interval_[vreg_id];
+                if (idx < 0) {
                     VRegLifetime lifetime;
                     lifetime.vreg_id = vreg_id;
-                    lifetime.data_type = inst.operands[0].data_type;
-                    lifetime.start = i;
-                    lifetime.end = i;
+                    // Guest addresses are 32-bit GPR values
+                    lifetime.data_type = op.type == ir::IrOperandType::REGISTER ? op.data_type : ir::IrDataType::I32;
+                    lifetime.start = static_cast<uint32_t>(i);
+                    lifetime.end = static_cast<uint32_t>(i);
                     lifetime.use_count = 1;
                     lifetime.is_active = false;
                     lifetime.is_loop_register = false;
                     lifetime.is_x86_mapped = (vreg_id < 8); // Assume vregs 0-7 are x86 mappings
+                    lifetime.loop_depth = 0;
                     lifetime.priority = 0.0f;
-                    lifetimes[vreg_id] = lifetime;
+                
+                    vreg_to_interval_[vreg_id] = static_cast<int32_t>(intervals_.size());
+                    intervals_.push_back(lifetime);
                 } else {
-                    // Update end point
-                    lifetimes[vreg_id].end = i;
-                    // Update usage count
-                    lifetimes[vreg_id].use_count++;
+                    VRegLifetime& lifetime = intervals_[idx];
+                    lifetime.end = static_cast<uint32_t>(i);
+                    lifetime.use_count++;
                 }
             }
         }
     }
-    
-    // Convert map to vector for sorting
-    std::vector<VRegLifetime> result;
-    for (const auto& [vreg_id, lifetime] : lifetimes) {
-        result.push_back(lifetime);
-        
-        // Also update our lifetime map for later reference
-        lifetime_map_[vreg_id] = lifetime;
-    }
-    
-    // Sort by start point for linear scan algorithm
-    std::sort(result.begin(), result.end(), 
-              [](const VRegLifetime& a, const VRegLifetime& b) {
-                  return a.start < b.start;
-              });
-    
-    return result;
 }
 
-// New method to detect loops in the instruction stream (Phase 8)
-void RegisterAllocator::detect_loops(const std::vector<ir::IrInstruction>& ir_instructions, std::vector<VRegLifetime>& lifetimes) {
+// Detect loops in the instruction stream (Phase 8)
+void RegisterAllocator::detect_loops(const std::vector<ir::IrInstruction>& ir_instructions) {
     // This is a simplified loop detection algorithm that looks for backward branches
-    std::vector<std::pair<uint32_t, uint32_t>> loops; // start, end pairs of loop regions
+    loops_.clear();
+    forward_internal_branch_ = false;
+    
+    // Branch targets are guest addresses: map them to the first IR instruction
+    // decoded from that address (superblocks are not in address order)
+    address_indices_.clear();
+    for (size_t i = 0; i < ir_instructions.size(); i++) {
+        if (ir_instructions[i].guest_address != 0) {
+            address_indices_.emplace_back(ir_instructions[i].guest_address, static_cast<uint32_t>(i));
+        }
+    }
+    std::sort(address_indices_.begin(), address_indices_.end());
     
     for (size_t i = 0; i < ir_instructions.size(); i++) {
         const auto& inst = ir_instructions[i];
         
-        if (isBranchInstruction(inst)) {
-            // Look for backward branches which might indicate loops
-            if (!inst.operands.empty() && inst.operands[0].type == ir::IrOperandType::IMMEDIATE) {
-                uint32_t target = static_cast<uint32_t>(inst.operands[0].imm_value);
-                
-                // If target is before current instruction, it's a backward branch (potential loop)
-                if (target < i) {
-                    LOG_DEBUG("Detected potential loop from instruction " + 
-                              std::to_string(target) + " to " + std::to_string(i));
-                    
-                    // Add this loop region
-                    loops.emplace_back(target, i);
-                }
+        if (isBranchInstruction(inst) && !inst.operands.empty() &&
+            inst.operands[0].type == ir::IrOperandType::IMMEDIATE) {
+            uint32_t target_address = static_cast<uint32_t>(inst.operands[0].imm_value);
+            auto target = std::lower_bound(address_indices_.begin(), address_indices_.end(),
+                                           std::make_pair(target_address, 0u));
+            if (target == address_indices_.end() || target->first != target_address) {
+                continue; // Leaves the block
+            }
+            
+            // If target is before current instruction, it's a backward branch (potential loop)
+            if (target->second <= i) {
+                loops_.emplace_back(target->second, static_cast<uint32_t>(i));
+            } else {
+                forward_internal_branch_ = true;
             }
         }
     }
     
-    // Mark registers that are used within loop regions
-    for (auto& lifetime : lifetimes) {
-        for (const auto& loop : loops) {
-            // If the register's lifetime overlaps with a loop region, mark it as a loop register
+    if (loops_.empty()) {
+        return;
+    }
+    
+    // Mark registers whose lifetime overlaps a loop region; nested regions add depth
+    for (auto& lifetime : intervals_) {
+        for (const auto& loop : loops_) {
             if (lifetime.start <= loop.second && lifetime.end >= loop.first) {
                 lifetime.is_loop_register = true;
-                
-                // Update in our map as well
-                if (lifetime_map_.find(lifetime.vreg_id) != lifetime_map_.end()) {
-                    lifetime_map_[lifetime.vreg_id].is_loop_register = true;
+                lifetime.loop_depth++;
+            }
+        }
+    }
+    
+    // A value live anywhere in a loop may be live around its back-edge (IR
+    // operands do not say which uses are definitions), so it keeps its
+    // location for the whole loop: from the header to the branch
+    bool extended = true;
+    while (extended) {
+        extended = false;
+        for (auto& lifetime : intervals_) {
+            for (const auto& loop : loops_) {
+                if (lifetime.start <= loop.second && lifetime.end >= loop.first &&
+                    (lifetime.start > loop.first || lifetime.end < loop.second)) {
+                    lifetime.start = std::min(lifetime.start, loop.first);
+                    lifetime.end = std::max(lifetime.end, loop.second);
+                    extended = true;
                 }
-                
-                LOG_DEBUG("Register v" + std::to_string(lifetime.vreg_id) + 
-                          " marked as loop register (used in loop " + 
-                          std::to_string(loop.first) + "-" + std::to_string(loop.second) + ")");
-                break;
             }
         }
     }
 }
 
-// New method to compute register priorities for allocation decisions (Phase 8)
-void RegisterAllocator::compute_register_priorities(std::vector<VRegLifetime>& lifetimes) {
+// Compute register priorities for allocation decisions (Phase 8)
+void RegisterAllocator::compute_register_priorities() {
     // Compute priority based on:
     // 1. Is it an x86 mapped register? (highest priority)
     // 2. Is it used in a loop? (high priority)
@@ -346,23 +420,22 @@ void RegisterAllocator::compute_register_priorities(std::vector<VRegLifetime>& l
     uint32_t max_use_count = 1;
     uint32_t max_lifetime = 1;
     
-    for (const auto& lifetime : lifetimes) {
+    for (const auto& lifetime : intervals_) {
         max_use_count = std::max(max_use_count, lifetime.use_count);
         max_lifetime = std::max(max_lifetime, lifetime.end - lifetime.start + 1);
     }
     
-    // Compute priority for each register
-    for (auto& lifetime : lifetimes) {
+    for (auto& lifetime : intervals_) {
         float priority = 0.0f;
         
         // x86 mapped registers get highest priority
         if (lifetime.is_x86_mapped) {
-            priority += 10000.0f; // Significantly increase priority for x86 mapped registers
+            priority += 10000.0f;
         }
         
-        // Loop registers get high priority
+        // Loop registers get high priority, more so when nested
         if (lifetime.is_loop_register) {
-            priority += 500.0f;
+            priority += 500.0f * static_cast<float>(lifetime.loop_depth);
         }
         
         // Use count (normalized to 0-100)
@@ -373,406 +446,581 @@ void RegisterAllocator::compute_register_priorities(std::vector<VRegLifetime>& l
         priority += 50.0f * (1.0f - lifetime_length / static_cast<float>(max_lifetime));
         
         lifetime.priority = priority;
+    }
+}
+
+void RegisterAllocator::expire_old_intervals(std::vector<uint32_t>& active, uint64_t& free_mask, uint32_t position) {
+    // Active list is sorted by end point, so expired intervals form a prefix
+    size_t expired = 0;
+    while (expired < active.size() && intervals_[active[expired]].end < position) {
+        free_mask |= (1ULL << current_regs_[active[expired]]);
+        current_regs_[active[expired]] = -1;
+        intervals_[active[expired]].is_active = false;
+        expired++;
+    }
+    
+    if (expired > 0) {
+        active.erase(active.begin(), active.begin() + expired);
+    }
+}
+
+void RegisterAllocator::insert_active(std::vector<uint32_t>& active, uint32_t interval_idx) {
+    uint32_t end = intervals_[interval_idx].end;
+    auto pos = std::upper_bound(active.begin(), active.end(), end,
+                                [this](uint32_t value, uint32_t idx) { return value < intervals_[idx].end; });
+    active.insert(pos, interval_idx);
+    intervals_[interval_idx].is_active = true;
+}
+
+void RegisterAllocator::spill_interval(uint32_t interval_idx, uint32_t position) {
+    uint32_t request = get_spill_request(interval_idx);
+    current_regs_[interval_idx] = -1;
+    
+    // One store at the spill point, then every remaining use goes through memory
+    spill_stats_.spill_count++;
+    if (loop_depths_[position] > 0) {
+        spill_stats_.loop_spill_count++;
+    }
+    spill_allocator_.record_access(request, position, 1 + SLOT_LOOP_ACCESS_WEIGHT * loop_depths_[position]);
+    
+    for (uint32_t i = use_offsets_[interval_idx]; i < use_offsets_[interval_idx + 1]; i++) {
+        uint32_t use = use_positions_[i];
+        if (use >= position && use != intervals_[interval_idx].start) {
+            spill_stats_.reload_count++;
+            if (loop_depths_[use] > 0) {
+                spill_stats_.loop_reload_count++;
+            }
+            spill_allocator_.record_access(request, use, 1 + SLOT_LOOP_ACCESS_WEIGHT * loop_depths_[use]);
+        }
+    }
+}
+
+uint32_t RegisterAllocator::get_spill_request(uint32_t interval_idx) {
+    if (spill_requests_[interval_idx] < 0) {
+        spill_requests_[interval_idx] = static_cast<int32_t>(
+            spill_allocator_.add_spill_request(intervals_[interval_idx].vreg_id, intervals_[interval_idx].data_type));
+        mappings_[interval_idx].is_spilled = true;
+    }
+    return static_cast<uint32_t>(spill_requests_[interval_idx]);
+}
+
+void RegisterAllocator::finalize_spill_slots() {
+    spill_allocator_.assign_slots();
+    
+    for (uint32_t idx = 0; idx < intervals_.size(); idx++) {
+        if (spill_requests_[idx] >= 0) {
+            mappings_[idx].stack_offset = spill_allocator_.get_slot_offset(spill_requests_[idx]);
+        }
+    }
+    
+    for (auto& code : spill_code_) {
+        code.stack_offset = mappings_[vreg_to_interval_[code.vreg_id]].stack_offset;
+    }
+}
+
+// Linear scan register allocation implementation (Phase 8)
+void RegisterAllocator::linear_scan_register_allocation() {
+    active_gpr_.clear();
+    active_neon_.clear();
+    
+    for (uint32_t idx : sorted_intervals_) {
+        VRegLifetime& lifetime = intervals_[idx];
+        RegisterMapping& mapping = mappings_[idx];
+        bool needs_neon = requiresNeonRegister(lifetime.data_type);
         
-        // Update in our map as well
-        if (lifetime_map_.find(lifetime.vreg_id) != lifetime_map_.end()) {
-            lifetime_map_[lifetime.vreg_id].priority = priority;
+        mapping.is_spilled = false;
+        mapping.stack_offset = 0;
+        mapping.is_pinned = false;
+        mapping.type = needs_neon ? PhysicalRegisterType::NEON : PhysicalRegisterType::GPR;
+        mapping.gpr_physical_reg_idx = 0;
+        mapping.neon_physical_reg_idx = 0;
+        
+        // Pinned guest GPRs always live in their fixed callee-saved register
+        if (!needs_neon && pin_guest_registers_ && GuestRegisterPinning::is_pinned_vreg(lifetime.vreg_id)) {
+            mapping.gpr_physical_reg_idx = GuestRegisterPinning::physical_reg_for(lifetime.vreg_id);
+            mapping.is_pinned = true;
+            continue;
+        }
+        
+        std::vector<uint32_t>& active = needs_neon ? active_neon_ : active_gpr_;
+        uint64_t& free_mask = needs_neon ? free_neon_mask_ : free_gpr_mask_;
+        
+        expire_old_intervals(active, free_mask, lifetime.start);
+        
+        int reg = -1;
+        if (free_mask != 0) {
+            reg = __builtin_ctzll(free_mask);
+            free_mask &= free_mask - 1;
+        } else {
+            // Pick the lowest-priority active interval, preferring the one ending last
+            size_t victim_pos = active.size();
+            for (size_t i = 0; i < active.size(); i++) {
+                const VRegLifetime& candidate = intervals_[active[i]];
+                if (victim_pos == active.size() ||
+                    candidate.priority < intervals_[active[victim_pos]].priority ||
+                    (candidate.priority == intervals_[active[victim_pos]].priority &&
+                     candidate.end >= intervals_[active[victim_pos]].end)) {
+                    victim_pos = i;
+                }
+            }
+            
+            if (victim_pos < active.size()) {
+                uint32_t victim = active[victim_pos];
+                const VRegLifetime& victim_lifetime = intervals_[victim];
+                bool evict = victim_lifetime.priority < lifetime.priority ||
+                             (victim_lifetime.priority == lifetime.priority && victim_lifetime.end > lifetime.end);
+                
+                if (evict) {
+                    const RegisterMapping& victim_mapping = mappings_[victim];
+                    reg = needs_neon ? victim_mapping.neon_physical_reg_idx : victim_mapping.gpr_physical_reg_idx;
+                    active.erase(active.begin() + victim_pos);
+                    intervals_[victim].is_active = false;
+                    spill_interval(victim, lifetime.start);
+                }
+            }
         }
         
-        LOG_DEBUG("Register v" + std::to_string(lifetime.vreg_id) + 
-                  " priority: " + std::to_string(priority) + 
-                  " (x86_mapped=" + std::to_string(lifetime.is_x86_mapped) + 
-                  ", loop=" + std::to_string(lifetime.is_loop_register) + 
-                  ", uses=" + std::to_string(lifetime.use_count) + 
-                  ", lifetime=" + std::to_string(lifetime.end - lifetime.start + 1) + ")");
+        if (reg < 0) {
+            spill_interval(idx, lifetime.start);
+            continue;
+        }
+        
+        if (needs_neon) {
+            mapping.neon_physical_reg_idx = reg;
+        } else {
+            mapping.gpr_physical_reg_idx = reg;
+        }
+        current_regs_[idx] = reg;
+        insert_active(active, idx);
     }
 }
 
-// New method to select a register to spill based on priorities (Phase 8)
-uint32_t RegisterAllocator::select_register_to_spill(const std::vector<uint32_t>& candidates) {
-    uint32_t spill_candidate = candidates[0];
-    float lowest_priority = std::numeric_limits<float>::max();
+void RegisterAllocator::compute_split_positions(const std::vector<ir::IrInstruction>& ir_instructions) {
+    const size_t num_positions = ir_instructions.size();
+    
+    // Use positions grouped per interval (counting sort, positions come out ascending)
+    use_offsets_.assign(intervals_.size() + 1, 0);
+    for (const auto& inst : ir_instructions) {
+        for (const auto& op : inst.operands) {
+            uint32_t vregs[2];
+            size_t vreg_count = operand_vregs(op, vregs);
+            for (size_t v = 0; v < vreg_count; v++) {
+                use_offsets_[vreg_to_interval_[vregs[v]] + 1]++;
+            }
+        }
+    }
+    for (size_t i = 1; i < use_offsets_.size(); i++) {
+        use_offsets_[i] += use_offsets_[i - 1];
+    }
     
-    for (uint32_t vreg_id : candidates) {
-        if (lifetime_map_.find(vreg_id) != lifetime_map_.end()) {
-            float priority = lifetime_map_[vreg_id].priority;
-            if (priority < lowest_priority) {
-                lowest_priority = priority;
-                spill_candidate = vreg_id;
+    use_positions_.resize(use_offsets_.back());
+    use_cursors_.assign(use_offsets_.begin(), use_offsets_.end() - 1);
+    for (size_t i = 0; i < num_positions; i++) {
+        for (const auto& op : ir_instructions[i].operands) {
+            uint32_t vregs[2];
+            size_t vreg_count = operand_vregs(op, vregs);
+            for (size_t v = 0; v < vreg_count; v++) {
+                use_positions_[use_cursors_[vreg_to_interval_[vregs[v]]]++] = static_cast<uint32_t>(i);
             }
         }
     }
+    use_cursors_.assign(use_offsets_.begin(), use_offsets_.end() - 1);
     
-    LOG_DEBUG("Selected register v" + std::to_string(spill_candidate) + 
-              " for spilling (priority=" + std::to_string(lowest_priority) + ")");
+    // Loop depth per position from the backward-branch regions
+    loop_depths_.assign(num_positions + 1, 0);
+    for (const auto& loop : loops_) {
+        loop_depths_[loop.first]++;
+        loop_depths_[loop.second + 1]--;
+    }
+    for (size_t i = 1; i < loop_depths_.size(); i++) {
+        loop_depths_[i] += loop_depths_[i - 1];
+    }
     
-    return spill_candidate;
+    // Latest earlier position with strictly smaller depth, and latest block boundary
+    prev_shallower_.resize(num_positions);
+    prev_boundaries_.resize(num_positions);
+    for (size_t i = 0; i < num_positions; i++) {
+        uint32_t j = (i == 0) ? NO_POSITION : static_cast<uint32_t>(i - 1);
+        while (j != NO_POSITION && loop_depths_[j] >= loop_depths_[i]) {
+            j = prev_shallower_[j];
+        }
+        prev_shallower_[i] = j;
+        
+        const auto& prev = ir_instructions[i == 0 ? 0 : i - 1];
+        bool is_boundary = (i == 0) || isBranchInstruction(prev) ||
+                           prev.type == ir::IrInstructionType::CALL ||
+                           prev.type == ir::IrInstructionType::RET;
+        prev_boundaries_[i] = is_boundary ? static_cast<uint32_t>(i) : prev_boundaries_[i - 1];
+    }
 }
 
-// New method to spill a register (Phase 8)
-void RegisterAllocator::spill_register(uint32_t vreg_id, ir::IrDataType data_type) {
-    if (register_mappings_.find(vreg_id) == register_mappings_.end()) {
-        LOG_ERROR("Attempted to spill register v" + std::to_string(vreg_id) + 
-                  " that doesn't have a mapping");
-        return;
+uint32_t RegisterAllocator::next_use(uint32_t interval_idx, uint32_t position) {
+    uint32_t& cursor = use_cursors_[interval_idx];
+    const uint32_t end = use_offsets_[interval_idx + 1];
+    while (cursor < end && use_positions_[cursor] < position) {
+        cursor++;
     }
+    return (cursor < end) ? use_positions_[cursor] : NO_POSITION;
+}
+
+uint32_t RegisterAllocator::select_split_position(uint32_t interval_idx, uint32_t position) const {
+    // The value is unchanged between its last use and the eviction point, so the
+    // store can go anywhere in that range; walk to the shallowest loop level in it
+    uint32_t cursor = use_cursors_[interval_idx];
+    uint32_t last_use = (cursor > use_offsets_[interval_idx]) ? use_positions_[cursor - 1] : intervals_[interval_idx].start;
     
-    RegisterMapping& mapping = register_mappings_[vreg_id];
+    // Nor above a back-edge that moved it into its current register
+    last_use = std::max(last_use, relocated_at_[interval_idx]);
     
-    // If already spilled, nothing to do
-    if (mapping.is_spilled) {
-        return;
+    uint32_t best = position;
+    while (prev_shallower_[best] != NO_POSITION && prev_shallower_[best] > last_use) {
+        best = prev_shallower_[best];
     }
     
-    // Allocate a spill slot
-    int32_t offset = spill_allocator_.allocate_spill_slot(vreg_id, data_type);
+    // Prefer a block boundary at the same or shallower depth
+    uint32_t boundary = prev_boundaries_[best];
+    if (boundary > last_use && loop_depths_[boundary] <= loop_depths_[best]) {
+        best = boundary;
+    }
     
-    // Update the mapping
-    mapping.is_spilled = true;
-    mapping.stack_offset = offset;
+    return best;
+}
+
+void RegisterAllocator::add_spill_code(uint32_t inst_idx, SpillCodeType type, uint32_t interval_idx, int reg) {
+    const VRegLifetime& lifetime = intervals_[interval_idx];
     
-    // Free the physical register
-    if (mapping.type == PhysicalRegisterType::GPR) {
-        free_gpr_registers_.push_back(mapping.gpr_physical_reg_idx);
-    } else {
-        free_neon_registers_.push_back(mapping.neon_physical_reg_idx);
+    SpillCode code;
+    code.inst_idx = inst_idx;
+    code.type = type;
+    code.vreg_id = lifetime.vreg_id;
+    code.reg_type = mappings_[interval_idx].type;
+    code.physical_reg_idx = reg;
+    code.stack_offset = 0; // Filled in once slots are colored
+    code.data_type = lifetime.data_type;
+    spill_code_.push_back(code);
+    
+    uint32_t request = get_spill_request(interval_idx);
+    spill_allocator_.record_access(request, inst_idx, 1 + SLOT_LOOP_ACCESS_WEIGHT * loop_depths_[inst_idx]);
+    
+    // Around a back-edge the slot may hold the value anywhere in the loop
+    for (const auto& loop : loops_) {
+        if (loop.first <= inst_idx && inst_idx <= loop.second) {
+            spill_allocator_.record_access(request, loop.first, 0);
+            spill_allocator_.record_access(request, loop.second, 0);
+        }
     }
     
-    LOG_DEBUG("Spilled register v" + std::to_string(vreg_id) + 
-              " to stack offset " + std::to_string(offset));
+    bool in_loop = loop_depths_[inst_idx] > 0;
+    if (type == SpillCodeType::SPILL) {
+        spill_stats_.spill_count++;
+        spill_stats_.loop_spill_count += in_loop ? 1 : 0;
+    } else {
+        spill_stats_.reload_count++;
+        spill_stats_.loop_reload_count += in_loop ? 1 : 0;
+    }
 }
 
-// Linear scan register allocation implementation (Phase 8)
-void RegisterAllocator::linear_scan_register_allocation(const std::vector<VRegLifetime>& lifetimes) {
-    LOG_DEBUG("Performing linear scan register allocation with spilling support.");
-    
-    // Active list starts empty
-    active_registers_.clear();
-    
-    // Process virtual registers in order of increasing start point
-    for (const auto& lifetime : lifetimes) {
-        uint32_t vreg_id = lifetime.vreg_id;
-        ir::IrDataType data_type = lifetime.data_type;
-        bool needs_neon = requiresNeonRegister(data_type);
-        
-        LOG_DEBUG("Processing register v" + std::to_string(vreg_id) + 
-                  " (start=" + std::to_string(lifetime.start) + 
-                  ", end=" + std::to_string(lifetime.end) + 
-                  ", neon=" + std::to_string(needs_neon) + ")");
-        
-        // Expire old intervals
-        for (auto it = active_registers_.begin(); it != active_registers_.end(); ) {
-            uint32_t active_vreg = *it;
-            if (lifetime_map_[active_vreg].end < lifetime.start) {
-                LOG_DEBUG("Register v" + std::to_string(active_vreg) + " expired");
-                
-                // If not spilled, free the physical register
-                if (!register_mappings_[active_vreg].is_spilled) {
-                    if (register_mappings_[active_vreg].type == PhysicalRegisterType::GPR) {
-                        free_gpr_registers_.push_back(register_mappings_[active_vreg].gpr_physical_reg_idx);
-                    } else {
-                        free_neon_registers_.push_back(register_mappings_[active_vreg].neon_physical_reg_idx);
-                    }
-                }
-                
-                it = active_registers_.erase(it);
-            } else {
-                ++it;
+int RegisterAllocator::assign_split_register(uint32_t interval_idx, uint32_t position) {
+    bool needs_neon = mappings_[interval_idx].type == PhysicalRegisterType::NEON;
+    std::vector<uint32_t>& active = needs_neon ? active_neon_ : active_gpr_;
+    uint64_t& free_mask = needs_neon ? free_neon_mask_ : free_gpr_mask_;
+    
+    if (free_mask == 0) {
+        // Evict the interval that is cheapest to have in memory at its next use:
+        // low priority, next use outside loops, and as far away as possible
+        size_t victim_pos = active.size();
+        float victim_cost = 0.0f;
+        uint32_t victim_next_use = 0;
+        for (size_t i = 0; i < active.size(); i++) {
+            uint32_t candidate = active[i];
+            if (lock_stamps_[candidate] == position + 1) {
+                continue; // Operand of the current instruction
+            }
+            
+            uint32_t use = next_use(candidate, position);
+            float cost = intervals_[candidate].priority;
+            if (use != NO_POSITION) {
+                cost += LOOP_DEPTH_SPILL_WEIGHT * static_cast<float>(loop_depths_[use]);
+            }
+            
+            if (victim_pos == active.size() || cost < victim_cost ||
+                (cost == victim_cost && use > victim_next_use)) {
+                victim_pos = i;
+                victim_cost = cost;
+                victim_next_use = use;
             }
         }
         
-        // Try to allocate a register
-        RegisterMapping mapping;
-        mapping.is_spilled = false;
-        mapping.stack_offset = 0;
+        if (victim_pos == active.size()) {
+            return -1;
+        }
         
-        if (needs_neon) {
-            if (!free_neon_registers_.empty()) {
-                // Allocate a NEON register
-                mapping.type = PhysicalRegisterType::NEON;
-                mapping.neon_physical_reg_idx = free_neon_registers_.back();
-                free_neon_registers_.pop_back();
-                
-                LOG_DEBUG("Allocated NEON register v" + std::to_string(mapping.neon_physical_reg_idx) + 
-                          " for virtual register v" + std::to_string(vreg_id));
-            } else {
-                // Need to spill a register
-                if (active_registers_.empty()) {
-                    // Shouldn't happen if we have reasonable register allocation
-                    LOG_ERROR("No active registers to spill but ran out of NEON registers");
-                    
-                    // Create a spill location for this register
-                    mapping.is_spilled = true;
-                    mapping.stack_offset = spill_allocator_.allocate_spill_slot(vreg_id, data_type);
-                    
-                    LOG_DEBUG("Spilled register v" + std::to_string(vreg_id) + 
-                              " to stack offset " + std::to_string(mapping.stack_offset) + 
-                              " because no free NEON registers");
-                } else {
-                    // Find candidates for spilling (must be NEON registers)
-                    std::vector<uint32_t> spill_candidates;
-                    
-                    for (uint32_t active_vreg : active_registers_) {
-                        if (register_mappings_[active_vreg].type == PhysicalRegisterType::NEON && 
-                            !register_mappings_[active_vreg].is_spilled) {
-                            spill_candidates.push_back(active_vreg);
-                        }
-                    }
-                    
-                    if (spill_candidates.empty()) {
-                        // No NEON registers to spill
-                        LOG_ERROR("No NEON registers to spill");
-                        
-                        // Create a spill location for this register
-                        mapping.is_spilled = true;
-                        mapping.stack_offset = spill_allocator_.allocate_spill_slot(vreg_id, data_type);
-                        
-                        LOG_DEBUG("Spilled register v" + std::to_string(vreg_id) + 
-                                  " to stack offset " + std::to_string(mapping.stack_offset) + 
-                                  " because no NEON registers to spill");
-                    } else {
-                        // Select a register to spill
-                        uint32_t spill_vreg = select_register_to_spill(spill_candidates);
-                        
-                        // Spill the selected register
-                        uint32_t neon_reg = register_mappings_[spill_vreg].neon_physical_reg_idx;
-                        spill_register(spill_vreg, lifetime_map_[spill_vreg].data_type);
-                        
-                        // Allocate the freed register to this vreg
-                        mapping.type = PhysicalRegisterType::NEON;
-                        mapping.neon_physical_reg_idx = neon_reg;
-                        
-                        LOG_DEBUG("Allocated NEON register v" + std::to_string(mapping.neon_physical_reg_idx) + 
-                                  " for virtual register v" + std::to_string(vreg_id) + 
-                                  " after spilling v" + std::to_string(spill_vreg));
-                    }
-                }
-            }
-        } else {
-            if (!free_gpr_registers_.empty()) {
-                // Allocate a GPR register
-                mapping.type = PhysicalRegisterType::GPR;
-                mapping.gpr_physical_reg_idx = free_gpr_registers_.back();
-                free_gpr_registers_.pop_back();
-                
-                LOG_DEBUG("Allocated GPR register x" + std::to_string(mapping.gpr_physical_reg_idx) + 
-                          " for virtual register v" + std::to_string(vreg_id));
-            } else {
-                // Need to spill a register
-                if (active_registers_.empty()) {
-                    // Shouldn't happen if we have reasonable register allocation
-                    LOG_ERROR("No active registers to spill but ran out of GPR registers");
-                    
-                    // Create a spill location for this register
-                    mapping.is_spilled = true;
-                    mapping.stack_offset = spill_allocator_.allocate_spill_slot(vreg_id, data_type);
-                    
-                    LOG_DEBUG("Spilled register v" + std::to_string(vreg_id) + 
-                              " to stack offset " + std::to_string(mapping.stack_offset) + 
-                              " because no free GPR registers");
-                } else {
-                    // Find candidates for spilling (must be GPR registers)
-                    std::vector<uint32_t> spill_candidates;
-                    
-                    for (uint32_t active_vreg : active_registers_) {
-                        if (register_mappings_[active_vreg].type == PhysicalRegisterType::GPR && 
-                            !register_mappings_[active_vreg].is_spilled && 
-                            lifetime_map_[active_vreg].end > lifetime.end) {
-                            spill_candidates.push_back(active_vreg);
-                        }
-                    }
-                    
-                    if (spill_candidates.empty()) {
-                        // No GPR registers to spill
-                        LOG_ERROR("No GPR registers to spill");
-                        
-                        // Create a spill location for this register
-                        mapping.is_spilled = true;
-                        mapping.stack_offset = spill_allocator_.allocate_spill_slot(vreg_id, data_type);
-                        
-                        LOG_DEBUG("Spilled register v" + std::to_string(vreg_id) + 
-                                  " to stack offset " + std::to_string(mapping.stack_offset) + 
-                                  " because no GPR registers to spill");
-                    } else {
-                        // Select a register to spill
-                        uint32_t spill_vreg = select_register_to_spill(spill_candidates);
-                        
-                        // Spill the selected register
-                        uint32_t gpr_reg = register_mappings_[spill_vreg].gpr_physical_reg_idx;
-                        spill_register(spill_vreg, lifetime_map_[spill_vreg].data_type);
-                        
-                        // Allocate the freed register to this vreg
-                        mapping.type = PhysicalRegisterType::GPR;
-                        mapping.gpr_physical_reg_idx = gpr_reg;
-                        
-                        LOG_DEBUG("Allocated GPR register x" + std::to_string(mapping.gpr_physical_reg_idx) + 
-                                  " for virtual register v" + std::to_string(vreg_id) + 
-                                  " after spilling v" + std::to_string(spill_vreg));
-                    }
-                }
+        uint32_t victim = active[victim_pos];
+        int victim_reg = current_regs_[victim];
+        uint32_t store_position = select_split_position(victim, position);
+        
+        add_spill_code(store_position, SpillCodeType::SPILL, victim, victim_reg);
+        
+        // A store hoisted to or above the header of an enclosing loop runs
+        // once, before the loop: on the back-edge the value is in its slot
+        for (size_t loop = 0; loop < loops_.size(); loop++) {
+            if (loops_[loop].first >= store_position && loops_[loop].first < position &&
+                loops_[loop].second > position) {
+                loop_entry_regs_[loop * intervals_.size() + victim] = IN_MEMORY;
             }
         }
         
-        // Store the mapping
-        register_mappings_[vreg_id] = mapping;
-        
-        // Add to active list
-        active_registers_.push_back(vreg_id);
+        active.erase(active.begin() + victim_pos);
+        intervals_[victim].is_active = false;
+        current_regs_[victim] = -1;
+        free_mask |= (1ULL << victim_reg);
     }
+    
+    int reg = __builtin_ctzll(free_mask);
+    free_mask &= free_mask - 1;
+    current_regs_[interval_idx] = reg;
+    insert_active(active, interval_idx);
+    return reg;
 }
 
-// Main allocate function enhanced for Phase 8
-std::unordered_map<uint32_t, RegisterMapping> RegisterAllocator::allocate(const std::vector<ir::IrInstruction>& instructions) {
-    register_mappings_.clear();
-    spill_allocator_.reset();
+// Give an interval a register at position: its home register at its first
+// position, a reload from its slot afterwards
+void RegisterAllocator::place_split_interval(uint32_t interval_idx, uint32_t position) {
+    int reg = assign_split_register(interval_idx, position);
+    if (reg < 0) {
+        LOG_ERROR("No register available for vreg " + std::to_string(intervals_[interval_idx].vreg_id) +
+                  " at instruction " + std::to_string(position));
+        return;
+    }
     
-    // First, analyze register lifetimes
-    std::map<uint32_t, RegisterLifetime> register_lifetimes;
-    analyze_register_lifetimes(instructions, register_lifetimes);
+    RegisterMapping& mapping = mappings_[interval_idx];
+    if (position == intervals_[interval_idx].start) {
+        // First appearance: this is the interval's home register
+        if (mapping.type == PhysicalRegisterType::NEON) {
+            mapping.neon_physical_reg_idx = reg;
+        } else {
+            mapping.gpr_physical_reg_idx = reg;
+        }
+    } else {
+        add_spill_code(position, SpillCodeType::RELOAD, interval_idx, reg);
+    }
+}
+
+void RegisterAllocator::release_split_interval(uint32_t interval_idx) {
+    bool needs_neon = mappings_[interval_idx].type == PhysicalRegisterType::NEON;
+    std::vector<uint32_t>& active = needs_neon ? active_neon_ : active_gpr_;
+    uint64_t& free_mask = needs_neon ? free_neon_mask_ : free_gpr_mask_;
     
-    // Phase 8 enhancement: Perform loop detection for better register allocation
-    std::unordered_set<uint32_t> loop_registers;
-    detect_loops_and_hot_registers(instructions, loop_registers);
+    active.erase(std::find(active.begin(), active.end(), interval_idx));
+    intervals_[interval_idx].is_active = false;
+    free_mask |= (1ULL << current_regs_[interval_idx]);
+    current_regs_[interval_idx] = -1;
+}
+
+void RegisterAllocator::resolve_back_edge(size_t loop, uint32_t position) {
+    const int32_t* entry = &loop_entry_regs_[loop * intervals_.size()];
     
-    // Prepare usage statistics for priority-based allocation
-    std::vector<RegisterUsageStats> usage_stats;
-    for (const auto& [vreg_id, lifetime] : register_lifetimes) {
-        RegisterUsageStats stats;
-        stats.vreg_id = vreg_id;
-        stats.use_count = lifetime.uses;
-        stats.is_x86_reg_mapped = (vreg_id < 8); // First 8 virtual registers are typically direct x86 mappings
-        stats.involved_in_loop = loop_registers.count(vreg_id) > 0;
-        usage_stats.push_back(stats);
+    // Stores first, so that no reload below overwrites a value still needed
+    for (uint32_t idx = 0; idx < intervals_.size(); idx++) {
+        if (entry[idx] == NOT_LIVE || current_regs_[idx] < 0 || current_regs_[idx] == entry[idx]) {
+            continue;
+        }
+        add_spill_code(position, SpillCodeType::SPILL, idx, current_regs_[idx]);
+        release_split_interval(idx);
     }
     
-    // Sort registers by priority for allocation
-    // Priority order: loop registers > x86 mapped > high use count
-    std::sort(usage_stats.begin(), usage_stats.end(), [](const RegisterUsageStats& a, const RegisterUsageStats& b) {
-        // First prioritize loop registers
-        if (a.involved_in_loop != b.involved_in_loop) {
-            return a.involved_in_loop > b.involved_in_loop;
+    for (uint32_t idx = 0; idx < intervals_.size(); idx++) {
+        int reg = entry[idx];
+        if (reg < 0 || current_regs_[idx] == reg) {
+            continue;
         }
         
-        // Then prioritize x86 mapped registers
-        if (a.is_x86_reg_mapped != b.is_x86_reg_mapped) {
-            return a.is_x86_reg_mapped > b.is_x86_reg_mapped;
-        }
+        bool needs_neon = mappings_[idx].type == PhysicalRegisterType::NEON;
+        std::vector<uint32_t>& active = needs_neon ? active_neon_ : active_gpr_;
+        uint64_t& free_mask = needs_neon ? free_neon_mask_ : free_gpr_mask_;
         
-        // Finally prioritize by usage count
-        return a.use_count > b.use_count;
-    });
-    
-    // First pass: Create initial mappings for all registers
-    for (const auto& stats : usage_stats) {
-        uint32_t vreg_id = stats.vreg_id;
-        const RegisterLifetime& lifetime = register_lifetimes[vreg_id];
-        
-        // Determine register type (GPR or NEON) based on data type
-        bool needs_neon = false;
-        ir::IrDataType data_type = ir::IrDataType::I32; // Default
-        
-        if (!lifetime.accesses.empty()) {
-            const auto& first_access = lifetime.accesses.front();
-            if (first_access.inst_idx < instructions.size()) {
-                const auto& instr = instructions[first_access.inst_idx];
-                if (!instr.operands.empty() && first_access.operand_idx < instr.operands.size()) {
-                    data_type = instr.operands[first_access.operand_idx].data_type;
-                    needs_neon = requiresNeonRegister(data_type);
-                }
+        // Every value live here is live at the header, so the register is free
+        // unless an interval without a recorded location holds it
+        for (uint32_t other : active) {
+            if (current_regs_[other] == reg) {
+                add_spill_code(position, SpillCodeType::SPILL, other, reg);
+                release_split_interval(other);
+                break;
             }
         }
         
-        // Create a mapping for each register (initially marked as not spilled)
-        RegisterMapping mapping;
+        add_spill_code(position, SpillCodeType::RELOAD, idx, reg);
+        free_mask &= ~(1ULL << reg);
+        current_regs_[idx] = reg;
+        relocated_at_[idx] = position;
+        insert_active(active, idx);
+    }
+}
+
+// Second-chance binpacking (Phase 8): every use gets a register; intervals evicted
+// under pressure are stored once and reloaded right before their next use.
+// At a backward branch every value live at the loop header is moved back to
+// where the header's code expects it.
+void RegisterAllocator::split_linear_scan_register_allocation(const std::vector<ir::IrInstruction>& ir_instructions) {
+    active_gpr_.clear();
+    active_neon_.clear();
+    lock_stamps_.assign(intervals_.size(), 0);
+    relocated_at_.assign(intervals_.size(), 0);
+    loop_entry_regs_.assign(loops_.size() * intervals_.size(), NOT_LIVE);
+    
+    for (uint32_t idx = 0; idx < intervals_.size(); idx++) {
+        const VRegLifetime& lifetime = intervals_[idx];
+        RegisterMapping& mapping = mappings_[idx];
+        bool needs_neon = requiresNeonRegister(lifetime.data_type);
+        
         mapping.is_spilled = false;
         mapping.stack_offset = 0;
+        mapping.is_pinned = false;
         mapping.type = needs_neon ? PhysicalRegisterType::NEON : PhysicalRegisterType::GPR;
-        mapping.gpr_physical_reg_idx = 0;  // Default values, will be set during allocation
+        mapping.gpr_physical_reg_idx = 0;
         mapping.neon_physical_reg_idx = 0;
         
-        register_mappings_[vreg_id] = mapping;
-    }
-    
-    // Second pass: Allocate physical registers based on priority
-    // Reset the free register lists
-    free_gpr_registers_.clear();
-    free_neon_registers_.clear();
-    
-    // Initialize free register lists
-    for (int i = 0; i < 28; i++) {
-        if (i != 16 && i != 17) { // Reserve x16, x17 for platform use
-            free_gpr_registers_.push_back(i);
+        // Pinned guest GPRs always live in their fixed callee-saved register
+        if (!needs_neon && pin_guest_registers_ && GuestRegisterPinning::is_pinned_vreg(lifetime.vreg_id)) {
+            mapping.gpr_physical_reg_idx = GuestRegisterPinning::physical_reg_for(lifetime.vreg_id);
+            mapping.is_pinned = true;
+            current_regs_[idx] = mapping.gpr_physical_reg_idx;
         }
     }
     
-    for (int i = 8; i < 32; i++) {
-        free_neon_registers_.push_back(i);
-    }
-    
-    // Now allocate physical registers
-    for (const auto& stats : usage_stats) {
-        uint32_t vreg_id = stats.vreg_id;
-        const RegisterLifetime& lifetime = register_lifetimes[vreg_id];
-        RegisterMapping& mapping = register_mappings_[vreg_id];
-        
-        // Determine data type for proper spilling if needed
-        ir::IrDataType data_type = ir::IrDataType::I32; // Default
-        if (!lifetime.accesses.empty()) {
-            const auto& first_access = lifetime.accesses.front();
-            if (first_access.inst_idx < instructions.size()) {
-                const auto& instr = instructions[first_access.inst_idx];
-                if (!instr.operands.empty() && first_access.operand_idx < instr.operands.size()) {
-                    data_type = instr.operands[first_access.operand_idx].data_type;
+    size_t next_start = 0;
+    for (uint32_t position = 0; position < ir_instructions.size(); position++) {
+        expire_old_intervals(active_gpr_, free_gpr_mask_, position);
+        expire_old_intervals(active_neon_, free_neon_mask_, position);
+        
+        for (size_t loop = 0; loop < loops_.size(); loop++) {
+            if (loops_[loop].second == position) {
+                resolve_back_edge(loop, position);
+            }
+        }
+        
+        const auto& operands = ir_instructions[position].operands;
+        
+        // Operands of this instruction must not be evicted while it is being processed
+        for (const auto& op : operands) {
+            uint32_t vregs[2];
+            size_t vreg_count = operand_vregs(op, vregs);
+            for (size_t v = 0; v < vreg_count; v++) {
+                lock_stamps_[vreg_to_interval_[vregs[v]]] = position + 1;
+            }
+        }
+        
+        // Intervals extended to a loop header start here without an operand
+        for (; next_start < sorted_intervals_.size() && intervals_[sorted_intervals_[next_start]].start <= position;
+             next_start++) {
+            uint32_t idx = sorted_intervals_[next_start];
+            if (current_regs_[idx] < 0 && lock_stamps_[idx] != position + 1) {
+                place_split_interval(idx, position);
+            }
+        }
+        
+        for (const auto& op : operands) {
+            uint32_t vregs[2];
+            size_t vreg_count = operand_vregs(op, vregs);
+            for (size_t v = 0; v < vreg_count; v++) {
+                uint32_t idx = static_cast<uint32_t>(vreg_to_interval_[vregs[v]]);
+                if (current_regs_[idx] < 0) {
+                    place_split_interval(idx, position);
                 }
             }
         }
         
-        // Attempt register allocation
-        if (mapping.type == PhysicalRegisterType::NEON) {
-            if (!free_neon_registers_.empty()) {
-                int hw_reg = free_neon_registers_.back();
-                free_neon_registers_.pop_back();
-                
-                mapping.neon_physical_reg_idx = hw_reg;
-                
-                LOG_DEBUG("Allocated NEON register v" + std::to_string(hw_reg) + " for vreg " + std::to_string(vreg_id) +
-                         (stats.involved_in_loop ? " (loop register)" : ""));
-            } else {
-                // Need to spill this register
-                mapping.is_spilled = true;
-                mapping.stack_offset = spill_allocator_.allocate_spill_slot(vreg_id, data_type);
-                
-                LOG_DEBUG("Spilled NEON vreg " + std::to_string(vreg_id) + " due to register pressure" +
-                         (stats.involved_in_loop ? " (despite being in loop)" : ""));
+        // Back-edges enter a loop after the header's spill code: record where
+        // each value live there is at that point (-1: in its stack slot)
+        for (size_t loop = 0; loop < loops_.size(); loop++) {
+            if (loops_[loop].first != position) {
+                continue;
             }
-        } else {
-            if (!free_gpr_registers_.empty()) {
-                int hw_reg = free_gpr_registers_.back();
-                free_gpr_registers_.pop_back();
-                
-                mapping.gpr_physical_reg_idx = hw_reg;
-                
-                LOG_DEBUG("Allocated GPR register x" + std::to_string(hw_reg) + " for vreg " + std::to_string(vreg_id) +
-                         (stats.involved_in_loop ? " (loop register)" : ""));
-            } else {
-                // Need to spill this register
-                mapping.is_spilled = true;
-                mapping.stack_offset = spill_allocator_.allocate_spill_slot(vreg_id, data_type);
-                
-                LOG_DEBUG("Spilled GPR vreg " + std::to_string(vreg_id) + " due to register pressure" +
-                         (stats.involved_in_loop ? " (despite being in loop)" : ""));
+            int32_t* entry = &loop_entry_regs_[loop * intervals_.size()];
+            for (uint32_t idx = 0; idx < intervals_.size(); idx++) {
+                if (intervals_[idx].start <= position && intervals_[idx].end >= position &&
+                    !mappings_[idx].is_pinned) {
+                    entry[idx] = current_regs_[idx];
+                }
             }
         }
     }
     
-    return register_mappings_;
+    // Stores may have been hoisted; order by position with stores before loads
+    std::sort(spill_code_.begin(), spill_code_.end(), [](const SpillCode& a, const SpillCode& b) {
+        if (a.inst_idx != b.inst_idx) {
+            return a.inst_idx < b.inst_idx;
+        }
+        return a.type == SpillCodeType::SPILL && b.type == SpillCodeType::RELOAD;
+    });
+}
+
+void RegisterAllocator::allocate_in_place(const std::vector<ir::IrInstruction>& instructions) {
+    spill_allocator_.reset();
+    reset_free_register_pools();
+    
+    spill_code_.clear();
+    spill_stats_ = SpillStatistics{0, 0, 0, 0};
+    
+    compute_lifetimes(instructions);
+    detect_loops(instructions);
+    compute_register_priorities();
+    compute_split_positions(instructions);
+    
+    mappings_.resize(intervals_.size());
+    current_regs_.assign(intervals_.size(), -1);
+    spill_requests_.assign(intervals_.size(), -1);
+    
+    // Intervals are created in first-use order; loop extension may have moved starts up
+    sorted_intervals_.resize(intervals_.size());
+    for (uint32_t i = 0; i < sorted_intervals_.size(); i++) {
+        sorted_intervals_[i] = i;
+    }
+    if (!loops_.empty()) {
+        std::stable_sort(sorted_intervals_.begin(), sorted_intervals_.end(),
+                         [this](uint32_t a, uint32_t b) { return intervals_[a].start < intervals_[b].start; });
+    }
+    
+    // Splitting resolves backward branches only (decoded blocks end at their
+    // first branch); a forward branch inside the block keeps whole lifetimes
+    if (live_range_splitting_ && !forward_internal_branch_) {
+        split_linear_scan_register_allocation(instructions);
+    } else {
+        linear_scan_register_allocation();
+    }
+    
+    finalize_spill_slots();
+}
+
+// Main allocate function enhanced for Phase 8
+std::unordered_map<uint32_t, RegisterMapping> RegisterAllocator::allocate(const std::vector<ir::IrInstruction>& instructions) {
+    allocate_in_place(instructions);
+    
+    std::unordered_map<uint32_t, RegisterMapping> result;
+    result.reserve(intervals_.size());
+    for (size_t i = 0; i < intervals_.size(); i++) {
+        result[intervals_[i].vreg_id] = mappings_[i];
+    }
+    
+    LOG_DEBUG("Allocated " + std::to_string(intervals_.size()) + " virtual registers, spill area " +
+              std::to_string(spill_allocator_.get_total_spill_size()) + " bytes");
+    
+    return result;
+}
+
+const RegisterMapping* RegisterAllocator::get_mapping(uint32_t vreg_id) const {
+    if (vreg_id >= vreg_to_interval_.size() || vreg_to_interval_[vreg_id] < 0) {
+        return nullptr;
+    }
+    
+    return &mappings_[vreg_to_interval_[vreg_id]];
 }
 
 // New functions for Phase 8
 
 void RegisterAllocator::setup_function_prologue(const std::vector<ir::IrInstruction>& ir_instructions) {
     // Allocate registers first
-    allocate(ir_instructions);
+    allocate_in_place(ir_instructions);
     
     // Get the total spill size needed
     int32_t spill_size = spill_allocator_.get_total_spill_size();
@@ -789,20 +1037,17 @@ void RegisterAllocator::generate_function_epilogue() {
 }
 
 bool RegisterAllocator::is_register_spilled(uint32_t vreg_id) const {
-    if (register_mappings_.find(vreg_id) == register_mappings_.end()) {
-        return false;
-    }
-    
-    return register_mappings_.at(vreg_id).is_spilled;
+    const RegisterMapping* mapping = get_mapping(vreg_id);
+    return mapping != nullptr && mapping->is_spilled;
 }
 
 int32_t RegisterAllocator::get_spill_offset(uint32_t vreg_id) const {
-    if (register_mappings_.find(vreg_id) == register_mappings_.end() || 
-        !register_mappings_.at(vreg_id).is_spilled) {
+    const RegisterMapping* mapping = get_mapping(vreg_id);
+    if (mapping == nullptr || !mapping->is_spilled) {
         return -1;
     }
     
-    return register_mappings_.at(vreg_id).stack_offset;
+    return mapping->stack_offset;
 }
 
 int32_t RegisterAllocator::get_total_spill_size() const {
@@ -813,97 +1058,5 @@ int32_t RegisterAllocator::get_total_spill_size() const {
     return (spill_size + 15) & ~15;
 }
 
-// New Phase 8 method to detect loops and identify registers used within loops
-void RegisterAllocator::detect_loops_and_hot_registers(
-    const std::vector<ir::IrInstruction>& instructions,
-    std::unordered_set<uint32_t>& loop_registers) {
-    
-    // Step 1: Find potential backward branches (indicators of loops)
-    std::vector<std::pair<size_t, size_t>> potential_loops; // pairs of (target, branch_instruction)
-    
-    for (size_t i = 0; i < instructions.size(); ++i) {
-        const auto& instr = instructions[i];
-        
-        // Check if this is a branch instruction with an immediate target
-        if (isBranchInstruction(instr) && !instr.operands.empty() && 
-            instr.operands[0].type == ir::IrOperandType::IMMEDIATE) {
-            
-            // Get the branch target
-            size_t target = static_cast<size_t>(instr.operands[0].imm_value);
-            
-            // Check if this is a backward branch (target < current)
-            if (target < i) {
-                potential_loops.push_back({target, i});
-                LOG_DEBUG("Detected potential loop: Branch at " + std::to_string(i) + 
-                          " to target " + std::to_string(target));
-            }
-        }
-    }
-    
-    // Step 2: For each detected loop, find registers used within the loop body
-    for (const auto& [loop_start, loop_end] : potential_loops) {
-        for (size_t i = loop_start; i <= loop_end; ++i) {
-            const auto& instr = instructions[i];
-            
-            // Collect all registers used in this instruction
-            for (size_t op_idx = 0; op_idx < instr.operands.size(); ++op_idx) {
-                const auto& operand = instr.operands[op_idx];
-                if (operand.type == ir::IrOperandType::REGISTER) {
-                    loop_registers.insert(operand.reg_idx);
-                    LOG_DEBUG("Register " + std::to_string(operand.reg_idx) + 
-                             " marked as used in loop");
-                }
-            }
-        }
-    }
-}
-
-// Analyze register lifetimes for allocation (Phase 8)
-void RegisterAllocator::analyze_register_lifetimes(
-    const std::vector<ir::IrInstruction>& instructions,
-    std::map<uint32_t, RegisterLifetime>& register_lifetimes) {
-    
-    LOG_DEBUG("Analyzing register lifetimes for allocation");
-    
-    // Process each instruction
-    for (size_t inst_idx = 0; inst_idx < instructions.size(); ++inst_idx) {
-        const auto& instr = instructions[inst_idx];
-        
-        // Process each operand in the instruction
-        for (size_t op_idx = 0; op_idx < instr.operands.size(); ++op_idx) {
-            const auto& operand = instr.operands[op_idx];
-            
-            // Only process register operands
-            if (operand.type != ir::IrOperandType::REGISTER) {
-                continue;
-            }
-            
-            uint32_t vreg_id = operand.reg_idx;
-            
-            // Create lifetime entry if it doesn't exist
-            if (register_lifetimes.find(vreg_id) == register_lifetimes.end()) {
-                RegisterLifetime lifetime;
-                lifetime.start = inst_idx;
-                lifetime.end = inst_idx;
-                lifetime.uses = 1;
-                register_lifetimes[vreg_id] = lifetime;
-            } else {
-                // Update existing lifetime
-                RegisterLifetime& lifetime = register_lifetimes[vreg_id];
-                lifetime.end = inst_idx;  // Extend end point
-                lifetime.uses++;          // Increment usage count
-                
-                // Record this access
-                RegisterAccess access;
-                access.inst_idx = inst_idx;
-                access.operand_idx = op_idx;
-                lifetime.accesses.push_back(access);
-            }
-        }
-    }
-    
-    LOG_DEBUG("Found " + std::to_string(register_lifetimes.size()) + " virtual registers");
-}
-
 } // namespace register_allocation
-} // namespace xenoarm_jit
\ No newline at end of file
+} // namespace xenoarm_jit
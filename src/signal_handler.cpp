@@ -1,13 +1,94 @@
 #include "xenoarm_jit/signal_handler.h"
 #include "xenoarm_jit/memory_manager.h"
+#include "xenoarm_jit/aarch64/code_generator.h"
+#include "xenoarm_jit/translation_cache/translation_cache.h"
 #include "logging/logger.h"
+#include <algorithm>
 #include <cstring>
 #include <unistd.h>
+#if defined(__aarch64__) && defined(__linux__)
+#include <ucontext.h>
+#endif
 
 namespace xenoarm_jit {
 
+// Rewrite a faulting fastmem access of a translated block into a branch to
+// its slow-path thunk and resume there, so the access never faults again
+static bool backpatch_fastmem_access(MemoryManager* memory_manager, void* context) {
+#if defined(__aarch64__) && defined(__linux__)
+    translation_cache::TranslationCache* translation_cache = memory_manager->get_translation_cache();
+    if (!memory_manager->get_fastmem_base() || !translation_cache || !context) {
+        return false;
+    }
+    
+    mcontext_t& mcontext = static_cast<ucontext_t*>(context)->uc_mcontext;
+    translation_cache::TranslatedBlock* block = translation_cache->lookup_fastmem_site(mcontext.pc);
+    if (!block) {
+        return false;
+    }
+    mcontext.pc = aarch64::CodeGenerator::backpatch_fastmem_site(block, *block->find_fastmem_site(mcontext.pc));
+    return true;
+#else
+    (void)memory_manager;
+    (void)context;
+    return false;
+#endif
+}
+
+// Complete a faulting fastmem access of generated code through the memory
+// manager's slow path and step over it (code without a known site, such as
+// a block already retired from the cache). The host's memory callbacks run
+// inside the signal handler here. Only LDR/STR Rt, [X18, Wm, UXTW] and the
+// acquire/release forms LDAPR/LDAR/STLR Rt, [X16], with X18 holding this
+// manager's fastmem base, qualify.
+static bool complete_fastmem_access(MemoryManager* memory_manager, uint32_t guest_address, void* context) {
+#if defined(__aarch64__) && defined(__linux__)
+    uintptr_t fastmem_base = reinterpret_cast<uintptr_t>(memory_manager->get_fastmem_base());
+    if (!fastmem_base || !context) {
+        return false;
+    }
+    
+    mcontext_t& mcontext = static_cast<ucontext_t*>(context)->uc_mcontext;
+    if (mcontext.regs[18] != fastmem_base) {
+        return false;
+    }
+    uint32_t instruction = *reinterpret_cast<const uint32_t*>(mcontext.pc);
+    bool is_load;
+    if ((instruction & 0x3FA0FFE0) == (0x38204800 | (18 << 5))) {
+        is_load = (instruction & (1u << 22)) != 0;
+    } else if ((instruction & 0x3FFFFFE0) == (0x38BFC000 | (16 << 5)) ||  // LDAPR
+               (instruction & 0x3FFFFFE0) == (0x08DFFC00 | (16 << 5))) {  // LDAR
+        is_load = true;
+    } else if ((instruction & 0x3FFFFFE0) == (0x089FFC00 | (16 << 5))) {  // STLR
+        is_load = false;
+    } else {
+        return false;
+    }
+    
+    uint32_t size = 1u << (instruction >> 30);
+    uint32_t rt = instruction & 0x1F;
+    if (is_load) {
+        uint64_t value = memory_manager->read_sized(guest_address, size);
+        if (rt != 31) {
+            mcontext.regs[rt] = value;
+        }
+    } else {
+        uint64_t value = rt == 31 ? 0 : mcontext.regs[rt];
+        memory_manager->write_sized(guest_address, value, size);
+    }
+    mcontext.pc += 4;
+    return true;
+#else
+    (void)memory_manager;
+    (void)guest_address;
+    (void)context;
+    return false;
+#endif
+}
+
 // Static instance
-SignalHandler* SignalHandler::instance_ = nullptr;
+std::atomic<SignalHandler*> SignalHandler::instance_{nullptr};
+std::mutex SignalHandler::registry_mutex_;
 
 // Signal handler function that redirects to the instance
 static void segv_handler(int signum, siginfo_t* info, void* context) {
@@ -22,14 +103,20 @@ static void segv_handler(int signum, siginfo_t* info, void* context) {
         sa.sa_handler = SIG_DFL;
         sa.sa_flags = 0;
         sigaction(SIGSEGV, &sa, nullptr);
-        
+
         // Re-raise the signal
         raise(signum);
     }
 }
 
-SignalHandler::SignalHandler(MemoryManager* memory_manager)
-    : memory_manager_(memory_manager) {
+SignalHandler::SignalHandler()
+    : sole_manager_(nullptr) {
+    for (auto& range : ranges_) {
+        range.owner.store(nullptr, std::memory_order_relaxed);
+        range.host_start = 0;
+        range.size = 0;
+        range.guest_start = 0;
+    }
     LOG_DEBUG("SignalHandler created");
 }
 
@@ -38,91 +125,188 @@ SignalHandler::~SignalHandler() {
 }
 
 bool SignalHandler::initialize(MemoryManager* memory_manager) {
-    if (instance_) {
-        LOG_WARNING("SignalHandler already initialized");
+    if (!memory_manager) {
+        LOG_ERROR("SignalHandler::initialize called with null memory manager");
         return false;
     }
-    
-    // Create the instance
-    instance_ = new SignalHandler(memory_manager);
-    
-    // Set up the signal handler for SIGSEGV
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_sigaction = segv_handler;
-    sa.sa_flags = SA_SIGINFO;
-    sigemptyset(&sa.sa_mask);
-    
-    // Save previous handler and install new one
-    if (sigaction(SIGSEGV, &sa, &instance_->prev_segv_action_) != 0) {
-        LOG_ERROR("Failed to install SIGSEGV handler");
-        delete instance_;
-        instance_ = nullptr;
-        return false;
+
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+
+    SignalHandler* handler = instance_.load(std::memory_order_relaxed);
+    if (!handler) {
+        // Create the instance
+        handler = new SignalHandler();
+
+        // Set up the signal handler for SIGSEGV
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = segv_handler;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+
+        // Publish before installing so the handler never sees a null instance
+        instance_.store(handler, std::memory_order_release);
+
+        // Save previous handler and install new one
+        if (sigaction(SIGSEGV, &sa, &handler->prev_segv_action_) != 0) {
+            LOG_ERROR("Failed to install SIGSEGV handler");
+            instance_.store(nullptr, std::memory_order_release);
+            delete handler;
+            return false;
+        }
+
+        LOG_INFO("SIGSEGV handler installed for SMC detection");
     }
-    
-    LOG_INFO("SIGSEGV handler installed for SMC detection");
+
+    if (std::find(handler->managers_.begin(), handler->managers_.end(), memory_manager) != handler->managers_.end()) {
+        LOG_WARNING("Memory manager already registered with SignalHandler");
+        return true;
+    }
+    handler->managers_.push_back(memory_manager);
+    handler->update_sole_manager_locked();
     return true;
 }
 
-void SignalHandler::cleanup() {
-    if (!instance_) {
+void SignalHandler::cleanup(MemoryManager* memory_manager) {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+
+    SignalHandler* handler = instance_.load(std::memory_order_relaxed);
+    if (!handler) {
         return;
     }
-    
+
+    auto it = std::find(handler->managers_.begin(), handler->managers_.end(), memory_manager);
+    if (it == handler->managers_.end()) {
+        return;
+    }
+    handler->managers_.erase(it);
+
+    for (auto& range : handler->ranges_) {
+        if (range.owner.load(std::memory_order_relaxed) == memory_manager) {
+            range.owner.store(nullptr, std::memory_order_release);
+        }
+    }
+    handler->update_sole_manager_locked();
+
+    if (!handler->managers_.empty()) {
+        return;
+    }
+
     // Restore previous signal handler
-    sigaction(SIGSEGV, &instance_->prev_segv_action_, nullptr);
-    
+    sigaction(SIGSEGV, &handler->prev_segv_action_, nullptr);
+
     // Delete the instance
-    delete instance_;
-    instance_ = nullptr;
-    
+    instance_.store(nullptr, std::memory_order_release);
+    delete handler;
+
     LOG_INFO("SIGSEGV handler uninstalled");
 }
 
+bool SignalHandler::add_range(MemoryManager* memory_manager, uintptr_t host_start, size_t size, uint32_t guest_start) {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+
+    SignalHandler* handler = instance_.load(std::memory_order_relaxed);
+    if (!handler || std::find(handler->managers_.begin(), handler->managers_.end(), memory_manager) == handler->managers_.end()) {
+        LOG_ERROR("SignalHandler::add_range called for an unregistered memory manager");
+        return false;
+    }
+
+    for (auto& range : handler->ranges_) {
+        if (range.owner.load(std::memory_order_relaxed) == nullptr) {
+            range.host_start = host_start;
+            range.size = size;
+            range.guest_start = guest_start;
+            range.owner.store(memory_manager, std::memory_order_release);
+            handler->update_sole_manager_locked();
+            return true;
+        }
+    }
+
+    LOG_ERROR("SignalHandler: fault range table full");
+    return false;
+}
+
+void SignalHandler::update_sole_manager_locked() {
+    MemoryManager* sole = managers_.size() == 1 ? managers_.front() : nullptr;
+    for (const auto& range : ranges_) {
+        if (sole && range.owner.load(std::memory_order_relaxed) == sole) {
+            sole = nullptr;
+        }
+    }
+    sole_manager_.store(sole, std::memory_order_release);
+}
+
 SignalHandler* SignalHandler::get_instance() {
-    return instance_;
+    return instance_.load(std::memory_order_acquire);
+}
+
+MemoryManager* SignalHandler::find_owner(uintptr_t fault_address, uint32_t* guest_address) const {
+    for (const auto& range : ranges_) {
+        MemoryManager* owner = range.owner.load(std::memory_order_acquire);
+        if (owner && fault_address >= range.host_start && fault_address - range.host_start < range.size) {
+            *guest_address = range.guest_start + static_cast<uint32_t>(fault_address - range.host_start);
+            return owner;
+        }
+    }
+
+    // Fall back to a lone context without ranges
+    MemoryManager* sole = sole_manager_.load(std::memory_order_acquire);
+    if (sole) {
+        *guest_address = static_cast<uint32_t>(fault_address);
+    }
+    return sole;
 }
 
 void SignalHandler::handle_segv(int signum, siginfo_t* info, void* context) {
-    // Get the fault address
+    // No logging, locking or allocation here: SMC faults are classified on the
+    // lock-free page table and recorded for the dispatcher's safe point. Only
+    // completing an MMIO fastmem access calls out, into the host's callbacks.
     uintptr_t fault_addr = reinterpret_cast<uintptr_t>(info->si_addr);
-    
-    LOG_DEBUG("SIGSEGV received at address 0x" + std::to_string(fault_addr));
-    
-    // Delegate to memory manager if this is a protection fault for SMC
-    if (memory_manager_ && info->si_code == SEGV_ACCERR) {
-        // Try to handle it as a code page write (SMC)
-        memory_manager_->handle_protection_fault(static_cast<uint32_t>(fault_addr));
-        
-        // Success - we handled it, so return
+
+    // Delegate to the owning memory manager if this is a protection fault for SMC
+    uint32_t guest_address = 0;
+    MemoryManager* memory_manager = find_owner(fault_addr, &guest_address);
+    // Stores that keep faulting on a page shared by code and data are moved
+    // to their checked slow path instead of trapping again
+    if (memory_manager && info->si_code == SEGV_ACCERR &&
+        memory_manager->has_inline_store_checks(guest_address) &&
+        backpatch_fastmem_access(memory_manager, context)) {
         return;
     }
-    
+    if (memory_manager && info->si_code == SEGV_ACCERR &&
+        memory_manager->handle_protection_fault(guest_address)) {
+        // A code page write (SMC) - handled, so return
+        return;
+    }
+
+    // Fastmem access to a page the host left inaccessible (MMIO, unmapped)
+    if (memory_manager && (backpatch_fastmem_access(memory_manager, context) ||
+                           complete_fastmem_access(memory_manager, guest_address, context))) {
+        return;
+    }
+
     // If we couldn't handle it, chain to previous handler
     if (prev_segv_action_.sa_flags & SA_SIGINFO) {
         prev_segv_action_.sa_sigaction(signum, info, context);
-    } else if (prev_segv_action_.sa_handler != SIG_IGN && 
+    } else if (prev_segv_action_.sa_handler != SIG_IGN &&
                prev_segv_action_.sa_handler != SIG_DFL) {
         prev_segv_action_.sa_handler(signum);
     } else {
         // No previous handler or default handler - terminate
-        LOG_ERROR("Unhandled SIGSEGV at address 0x" + std::to_string(fault_addr));
-        
         // Report to stderr
         const char* msg = "XenoARM JIT: Unhandled SIGSEGV\n";
         write(STDERR_FILENO, msg, strlen(msg));
-        
+
         // Re-raise with default action
         struct sigaction sa;
         sigemptyset(&sa.sa_mask);
         sa.sa_handler = SIG_DFL;
         sa.sa_flags = 0;
         sigaction(SIGSEGV, &sa, nullptr);
-        
+
         // Re-raise the signal
         raise(signum);
     }
 }
 
-} // namespace xenoarm_jit 
\ No newline at end of file
+} // namespace xenoarm_jit
@@ -9,27 +9,22 @@
 
 namespace xenoarm_jit {
 
-// Reference to FPU state variables in simd_state.cpp
-// These are now properly defined in the simd namespace
-using simd::fpu_status_word;
-using simd::fpu_control_word;
-
 // Helper functions referenced in fpu_code_gen.cpp but not implemented yet
 // These would normally be optimized assembly routines
 // For testing purposes, we provide C++ implementations
 
 // Convert 80-bit float to double and perform sine computation
-void compute_sine_f80(const uint8_t* src, uint8_t* dst) {
+void compute_sine_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu) {
     // Check for special cases first
     if (is_nan_f80(src)) {
         load_fpu_qnan(dst);
-        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
         return;
     }
     
     if (is_infinity_f80(src)) {
         load_fpu_qnan(dst);
-        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
         return;
     }
     
@@ -45,7 +40,7 @@ void compute_sine_f80(const uint8_t* src, uint8_t* dst) {
     // Check for large values that need special handling
     if (std::abs(value) > 1e10) {
         // Use the large value handler for better precision
-        compute_sine_large_f80(src, dst);
+        compute_sine_large_f80(src, dst, fpu);
         return;
     }
     
@@ -55,20 +50,20 @@ void compute_sine_f80(const uint8_t* src, uint8_t* dst) {
     // Handle IEEE-754 compliance - check for precision loss
     if (std::abs(result) < std::numeric_limits<double>::min()) {
         // Potential underflow or precision loss
-        handle_fpu_exception(FPUExceptionFlags::FPU_PRECISION);
+        handle_fpu_exception(FPUExceptionFlags::FPU_PRECISION, fpu);
     }
     
     // Convert back to 80-bit float
     convert_double_to_f80(result, dst);
     
     // Apply precision control based on FPU control word
-    apply_precision_control_f80(dst, fpu_control_word);
+    apply_precision_control_f80(dst, fpu.control_word);
     
     LOG_DEBUG("compute_sine_f80: sin(" + std::to_string(value) + ") = " + std::to_string(result));
 }
 
 // Handle large value sine computation with range reduction
-void compute_sine_large_f80(const uint8_t* src, uint8_t* dst) {
+void compute_sine_large_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu) {
     // Extract double from 80-bit float
     double value = extract_double_from_f80(src);
     
@@ -91,7 +86,7 @@ void compute_sine_large_f80(const uint8_t* src, uint8_t* dst) {
         reduced_value = temp;
         
         // Signal precision loss
-        handle_fpu_exception(FPUExceptionFlags::FPU_PRECISION);
+        handle_fpu_exception(FPUExceptionFlags::FPU_PRECISION, fpu);
         
         LOG_WARNING("compute_sine_large_f80: Extreme value " + std::to_string(value) + 
                    " reduced to " + std::to_string(reduced_value) + " with precision loss");
@@ -107,7 +102,7 @@ void compute_sine_large_f80(const uint8_t* src, uint8_t* dst) {
     convert_double_to_f80(result, dst);
     
     // Apply precision control based on FPU control word
-    apply_precision_control_f80(dst, fpu_control_word);
+    apply_precision_control_f80(dst, fpu.control_word);
     
     LOG_DEBUG("compute_sine_large_f80: sin(" + std::to_string(value) + 
               ") = sin(" + std::to_string(reduced_value) + ") = " + 
@@ -115,17 +110,17 @@ void compute_sine_large_f80(const uint8_t* src, uint8_t* dst) {
 }
 
 // Convert 80-bit float to double and perform cosine computation
-void compute_cosine_f80(const uint8_t* src, uint8_t* dst) {
+void compute_cosine_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu) {
     // Check for special cases first
     if (is_nan_f80(src)) {
         load_fpu_qnan(dst);
-        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
         return;
     }
     
     if (is_infinity_f80(src)) {
         load_fpu_qnan(dst);
-        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
         return;
     }
     
@@ -141,7 +136,7 @@ void compute_cosine_f80(const uint8_t* src, uint8_t* dst) {
     // Check for large values that need special handling
     if (std::abs(value) > 1e10) {
         // Use the large value handler for better precision
-        compute_cosine_large_f80(src, dst);
+        compute_cosine_large_f80(src, dst, fpu);
         return;
     }
     
@@ -152,20 +147,20 @@ void compute_cosine_f80(const uint8_t* src, uint8_t* dst) {
     if (std::abs(result - 1.0) < std::numeric_limits<double>::epsilon() && 
         std::abs(value) > 1e5) {
         // Very small change from 1.0 for large values indicates precision loss
-        handle_fpu_exception(FPUExceptionFlags::FPU_PRECISION);
+        handle_fpu_exception(FPUExceptionFlags::FPU_PRECISION, fpu);
     }
     
     // Convert back to 80-bit float
     convert_double_to_f80(result, dst);
     
     // Apply precision control based on FPU control word
-    apply_precision_control_f80(dst, fpu_control_word);
+    apply_precision_control_f80(dst, fpu.control_word);
     
     LOG_DEBUG("compute_cosine_f80: cos(" + std::to_string(value) + ") = " + std::to_string(result));
 }
 
 // Handle large value cosine computation with range reduction
-void compute_cosine_large_f80(const uint8_t* src, uint8_t* dst) {
+void compute_cosine_large_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu) {
     // Extract double from 80-bit float
     double value = extract_double_from_f80(src);
     
@@ -187,7 +182,7 @@ void compute_cosine_large_f80(const uint8_t* src, uint8_t* dst) {
         reduced_value = temp;
         
         // Signal precision loss
-        handle_fpu_exception(FPUExceptionFlags::FPU_PRECISION);
+        handle_fpu_exception(FPUExceptionFlags::FPU_PRECISION, fpu);
         
         LOG_WARNING("compute_cosine_large_f80: Extreme value " + std::to_string(value) + 
                    " reduced to " + std::to_string(reduced_value) + " with precision loss");
@@ -203,7 +198,7 @@ void compute_cosine_large_f80(const uint8_t* src, uint8_t* dst) {
     convert_double_to_f80(result, dst);
     
     // Apply precision control based on FPU control word
-    apply_precision_control_f80(dst, fpu_control_word);
+    apply_precision_control_f80(dst, fpu.control_word);
     
     LOG_DEBUG("compute_cosine_large_f80: cos(" + std::to_string(value) + 
               ") = cos(" + std::to_string(reduced_value) + ") = " + 
@@ -211,17 +206,17 @@ void compute_cosine_large_f80(const uint8_t* src, uint8_t* dst) {
 }
 
 // Convert 80-bit float to double and perform tangent computation
-void compute_tangent_f80(const uint8_t* src, uint8_t* dst) {
+void compute_tangent_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu) {
     // Check for special cases first
     if (is_nan_f80(src)) {
         load_fpu_qnan(dst);
-        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
         return;
     }
     
     if (is_infinity_f80(src)) {
         load_fpu_qnan(dst);
-        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
         return;
     }
     
@@ -241,7 +236,7 @@ void compute_tangent_f80(const uint8_t* src, uint8_t* dst) {
     
     if (std::abs(value) > TAN_RANGE_LIMIT) {
         // For large values, FPTAN returns with C2=1 and doesn't modify ST(0)
-        set_fpu_c2_flag(1);
+        set_fpu_c2_flag(1, fpu);
         
         // Don't modify the result value at all - FPTAN leaves original value on stack
         std::memcpy(dst, src, 10);
@@ -270,7 +265,7 @@ void compute_tangent_f80(const uint8_t* src, uint8_t* dst) {
         }
         
         // Clear C2 flag - operation completed
-        set_fpu_c2_flag(0);
+        set_fpu_c2_flag(0, fpu);
         
         LOG_WARNING("compute_tangent_f80: Value near π/2 multiple: " + std::to_string(value) + ", returning infinity");
         return;
@@ -308,16 +303,16 @@ void compute_tangent_f80(const uint8_t* src, uint8_t* dst) {
     }
     
     // Apply precision control based on FPU control word
-    apply_precision_control_f80(dst, fpu_control_word);
+    apply_precision_control_f80(dst, fpu.control_word);
     
     // Clear C2 flag - operation completed successfully
-    set_fpu_c2_flag(0);
+    set_fpu_c2_flag(0, fpu);
     
     LOG_DEBUG("compute_tangent_f80: tan(" + std::to_string(value) + ") = " + std::to_string(result));
 }
 
 // Version that returns status flags to handle stack issues properly
-bool compute_tangent_f80_with_status(const uint8_t* src, uint8_t* dst, uint16_t* status_flags) {
+bool compute_tangent_f80_with_status(const uint8_t* src, uint8_t* dst, uint16_t* status_flags, uint16_t control_word) {
     // First, handle all the special cases
     if (is_nan_f80(src) || is_infinity_f80(src)) {
         load_fpu_qnan(dst);
@@ -336,9 +331,9 @@ bool compute_tangent_f80_with_status(const uint8_t* src, uint8_t* dst, uint16_t*
     // Check if the value is denormal
     if (is_denormal_f80(src)) {
         // Handle based on control word setting
-        if (!(fpu_control_word & 0x0020)) {  // If denormal exceptions are masked
+        if (!(control_word & 0x0020)) {  // If denormal exceptions are masked
             // Treat as zero (if denormals are to be flushed)
-            if (fpu_control_word & 0x0800) {  // Flush to zero bit
+            if (control_word & 0x0800) {  // Flush to zero bit
                 uint8_t zero[10] = {0};
                 zero[9] = src[9] & 0x80;  // Preserve sign
                 std::memcpy(dst, zero, 10);
@@ -438,13 +433,13 @@ bool compute_tangent_f80_with_status(const uint8_t* src, uint8_t* dst, uint16_t*
         }
         
         // Apply precision control
-        apply_precision_control_f80(dst, fpu_control_word);
+        apply_precision_control_f80(dst, control_word);
         
         // Apply rounding based on the control word
-        apply_rounding_mode_f80(dst, fpu_control_word);
+        apply_rounding_mode_f80(dst, control_word);
         
         // Check for denormals in the result and handle according to control word
-        if (is_denormal_f80(dst) && (fpu_control_word & 0x0800)) {  // If flush to zero enabled
+        if (is_denormal_f80(dst) && (control_word & 0x0800)) {  // If flush to zero enabled
             uint8_t zero[10] = {0};
             zero[9] = dst[9] & 0x80;  // Preserve sign
             std::memcpy(dst, zero, 10);
@@ -461,12 +456,12 @@ bool compute_tangent_f80_with_status(const uint8_t* src, uint8_t* dst, uint16_t*
 }
 
 // Convert 80-bit float to double and perform 2^x-1 computation
-void compute_2_to_x_minus_1_f80(const uint8_t* src, uint8_t* dst) {
+void compute_2_to_x_minus_1_f80(const uint8_t* src, uint8_t* dst, FpuWords fpu) {
     // Check for special cases first
     if (is_nan_f80(src)) {
         load_fpu_qnan(dst);
-        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
-        set_fpu_c1_flag(1); // Set C1 flag for invalid operation
+        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
+        set_fpu_c1_flag(1, fpu); // Set C1 flag for invalid operation
         return;
     }
     
@@ -483,10 +478,10 @@ void compute_2_to_x_minus_1_f80(const uint8_t* src, uint8_t* dst) {
     
     // Handle denormal inputs according to control word
     if (is_denormal_f80(src)) {
-        handle_fpu_exception(FPUExceptionFlags::FPU_DENORMAL);
+        handle_fpu_exception(FPUExceptionFlags::FPU_DENORMAL, fpu);
         
         // Check if denormals are disabled
-        if (!(fpu_control_word & 0x0800)) {
+        if (!(fpu.control_word & 0x0800)) {
             // For denormal input close to zero, 2^x-1 ≈ x*ln(2)
             // But if we flush to zero, result is 2^0-1 = 0
             convert_double_to_f80(0.0, dst);
@@ -503,7 +498,7 @@ void compute_2_to_x_minus_1_f80(const uint8_t* src, uint8_t* dst) {
         // For values < -1, F2XM1 saturates to -1
         load_fpu_minus_1(dst);
         // Set C1 flag to indicate result was clipped
-        set_fpu_c1_flag(1);
+        set_fpu_c1_flag(1, fpu);
         return;
     }
     
@@ -516,7 +511,7 @@ void compute_2_to_x_minus_1_f80(const uint8_t* src, uint8_t* dst) {
         convert_double_to_f80(result, dst);
         
         // Set C1 flag to indicate result was clipped/saturated
-        set_fpu_c1_flag(1);
+        set_fpu_c1_flag(1, fpu);
         return;
     }
     
@@ -541,10 +536,10 @@ void compute_2_to_x_minus_1_f80(const uint8_t* src, uint8_t* dst) {
     
     // Handle potential underflow
     if (result != 0.0 && std::abs(result) < std::numeric_limits<double>::min()) {
-        handle_fpu_exception(FPUExceptionFlags::FPU_UNDERFLOW);
+        handle_fpu_exception(FPUExceptionFlags::FPU_UNDERFLOW, fpu);
         
         // Check if denormals are disabled
-        if (!(fpu_control_word & 0x0800)) {
+        if (!(fpu.control_word & 0x0800)) {
             // Flush to zero with proper sign
             result = (result > 0) ? 0.0 : -0.0;
             LOG_DEBUG("compute_2_to_x_minus_1_f80: Denormal result flushed to zero");
@@ -555,17 +550,17 @@ void compute_2_to_x_minus_1_f80(const uint8_t* src, uint8_t* dst) {
     convert_double_to_f80(result, dst);
     
     // Apply precision control based on FPU control word
-    apply_precision_control_f80(dst, fpu_control_word);
+    apply_precision_control_f80(dst, fpu.control_word);
     
     LOG_DEBUG("compute_2_to_x_minus_1_f80: 2^" + std::to_string(value) + " - 1 = " + std::to_string(result));
 }
 
 // Compute y * log2(x)
-void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* dst) {
+void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* dst, FpuWords fpu) {
     // Check for special cases in inputs
     if (is_nan_f80(x_src) || is_nan_f80(y_src)) {
         load_fpu_qnan(dst);
-        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
         return;
     }
     
@@ -577,8 +572,8 @@ void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* d
     if (x_value <= 0.0) {
         // Log of negative number or zero - invalid operation
         load_fpu_qnan(dst);
-        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
-        set_fpu_c1_flag(1); // Set C1 for invalid operation
+        handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
+        set_fpu_c1_flag(1, fpu); // Set C1 for invalid operation
         LOG_WARNING("compute_y_log2_x_f80: Invalid input (x <= 0)");
         return;
     }
@@ -601,7 +596,7 @@ void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* d
                 load_fpu_negative_infinity(dst);
             } else { // y = 0
                 load_fpu_qnan(dst); // 0 * inf = NaN
-                handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+                handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
             }
             return;
         }
@@ -612,7 +607,7 @@ void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* d
         if (x_value == 1.0) {
             // inf * log2(1) = inf * 0 = NaN
             load_fpu_qnan(dst);
-            handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+            handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
             return;
         }
         
@@ -634,10 +629,10 @@ void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* d
     bool y_is_denormal = is_denormal_f80(y_src);
     
     if (x_is_denormal || y_is_denormal) {
-        handle_fpu_exception(FPUExceptionFlags::FPU_DENORMAL);
+        handle_fpu_exception(FPUExceptionFlags::FPU_DENORMAL, fpu);
         
         // If denormals are disabled, flush to zero
-        if (!(fpu_control_word & 0x0800)) {
+        if (!(fpu.control_word & 0x0800)) {
             if (x_is_denormal) {
                 x_value = 0.0;
             }
@@ -648,7 +643,7 @@ void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* d
             // If x became zero, this is invalid
             if (x_value == 0.0) {
                 load_fpu_qnan(dst);
-                handle_fpu_exception(FPUExceptionFlags::FPU_INVALID);
+                handle_fpu_exception(FPUExceptionFlags::FPU_INVALID, fpu);
                 return;
             }
             
@@ -672,23 +667,23 @@ void compute_y_log2_x_f80(const uint8_t* x_src, const uint8_t* y_src, uint8_t* d
         } else {
             load_fpu_negative_infinity(dst);
         }
-        handle_fpu_exception(FPUExceptionFlags::FPU_OVERFLOW);
-        set_fpu_c1_flag(1); // Set C1 for overflow
+        handle_fpu_exception(FPUExceptionFlags::FPU_OVERFLOW, fpu);
+        set_fpu_c1_flag(1, fpu); // Set C1 for overflow
         return;
     }
     
     if (result != 0.0 && std::abs(result) < std::numeric_limits<double>::min()) {
-        handle_fpu_exception(FPUExceptionFlags::FPU_UNDERFLOW);
+        handle_fpu_exception(FPUExceptionFlags::FPU_UNDERFLOW, fpu);
         
         // Handle underflow based on control word
-        if (!(fpu_control_word & 0x0800)) { // Check if denormals are disabled
+        if (!(fpu.control_word & 0x0800)) { // Check if denormals are disabled
             result = (result > 0) ? 0.0 : -0.0; // Flush to zero with sign
         }
     }
     
     // Convert to 80-bit and apply precision control
     convert_double_to_f80(result, dst);
-    apply_precision_control_f80(dst, fpu_control_word);
+    apply_precision_control_f80(dst, fpu.control_word);
     
     LOG_DEBUG("compute_y_log2_x_f80: " + std::to_string(y_value) + 
               " * log2(" + std::to_string(x_value) + ") = " + 
@@ -746,52 +741,52 @@ void load_fpu_constant_lg2e(uint8_t* dst) {
 }
 
 // Set C2 flag in the FPU status word
-void set_fpu_c2_flag(uint16_t flag_value) {
+void set_fpu_c2_flag(uint16_t flag_value, FpuWords fpu) {
     if (flag_value) {
-        fpu_status_word |= 0x04;  // Set C2 (bit 2)
+        fpu.status_word |= 0x04;  // Set C2 (bit 2)
     } else {
-        fpu_status_word &= ~0x04; // Clear C2
+        fpu.status_word &= ~0x04; // Clear C2
     }
 }
 
 // Set C1 flag in the FPU status word
-void set_fpu_c1_flag(uint16_t flag_value) {
+void set_fpu_c1_flag(uint16_t flag_value, FpuWords fpu) {
     if (flag_value) {
-        fpu_status_word |= 0x02;  // Set C1 (bit 1)
+        fpu.status_word |= 0x02;  // Set C1 (bit 1)
     } else {
-        fpu_status_word &= ~0x02; // Clear C1
+        fpu.status_word &= ~0x02; // Clear C1
     }
 }
 
 // Set C0 flag in the FPU status word
-void set_fpu_c0_flag(uint16_t flag_value) {
+void set_fpu_c0_flag(uint16_t flag_value, FpuWords fpu) {
     if (flag_value) {
-        fpu_status_word |= 0x01;  // Set C0 (bit 0)
+        fpu.status_word |= 0x01;  // Set C0 (bit 0)
     } else {
-        fpu_status_word &= ~0x01; // Clear C0
+        fpu.status_word &= ~0x01; // Clear C0
     }
 }
 
 // Set C3 flag in the FPU status word
-void set_fpu_c3_flag(uint16_t flag_value) {
+void set_fpu_c3_flag(uint16_t flag_value, FpuWords fpu) {
     if (flag_value) {
-        fpu_status_word |= 0x40;  // Set C3 (bit 6)
+        fpu.status_word |= 0x40;  // Set C3 (bit 6)
     } else {
-        fpu_status_word &= ~0x40; // Clear C3
+        fpu.status_word &= ~0x40; // Clear C3
     }
 }
 
 // Handle FPU exceptions by setting appropriate flags in the status word
-void handle_fpu_exception(uint16_t exception_flags) {
+void handle_fpu_exception(uint16_t exception_flags, FpuWords fpu) {
     // Set exception flags in status word
-    fpu_status_word |= exception_flags;
+    fpu.status_word |= exception_flags;
     
     // Check if any unmasked exceptions
-    uint16_t unmasked_exceptions = exception_flags & (~fpu_control_word & 0x3F);
+    uint16_t unmasked_exceptions = exception_flags & (~fpu.control_word & 0x3F);
     
     if (unmasked_exceptions) {
         // If there are unmasked exceptions, also set the error summary bit (ES, bit 7)
-        fpu_status_word |= 0x80;
+        fpu.status_word |= 0x80;
         
         LOG_WARNING("Unmasked FPU exception(s) occurred: " + std::to_string(unmasked_exceptions));
     }
@@ -996,17 +991,17 @@ void apply_rounding_mode_f80(uint8_t* value, uint16_t control_word) {
 }
 
 // Handle denormal values based on FPU control word
-void handle_denormal_value_f80(uint8_t* value, uint16_t control_word) {
+void handle_denormal_value_f80(uint8_t* value, FpuWords fpu) {
     // Early exit if not denormal
     if (!is_denormal_f80(value)) {
         return;
     }
     
     // Set denormal flag in status word
-    handle_fpu_exception(FPUExceptionFlags::FPU_DENORMAL);
+    handle_fpu_exception(FPUExceptionFlags::FPU_DENORMAL, fpu);
     
     // Check if denormals are disabled (bit 12 of control word)
-    if (!(control_word & 0x0800)) {
+    if (!(fpu.control_word & 0x0800)) {
         // If denormals are disabled, flush to zero while preserving sign
         
         // Get sign bit
@@ -1023,7 +1018,7 @@ void handle_denormal_value_f80(uint8_t* value, uint16_t control_word) {
         }
         
         // Signal underflow
-        handle_fpu_exception(FPUExceptionFlags::FPU_UNDERFLOW);
+        handle_fpu_exception(FPUExceptionFlags::FPU_UNDERFLOW, fpu);
         
         LOG_DEBUG("Denormal value flushed to zero (denormals disabled)");
     } else {
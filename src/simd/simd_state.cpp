@@ -10,10 +10,6 @@
 namespace xenoarm_jit {
 namespace simd {
 
-// Make these variables available to the fpu_transcendental_helpers.cpp file
-uint16_t fpu_status_word = 0;
-uint16_t fpu_control_word = 0x037F;
-
 SIMDState::SIMDState() {
     // Initialize XMM registers to zero
     for (int i = 0; i < 8; i++) {
@@ -67,10 +63,6 @@ void SIMDState::reset() {
     // Set initial mode
     current_mode = SIMDMode::FPU;
     
-    // External reference needed to be reset as well
-    simd::fpu_status_word = 0;
-    simd::fpu_control_word = 0x037F;
-    
     LOG_DEBUG("SIMD state reset complete");
 }
 
@@ -351,7 +343,7 @@ void SIMDState::compute_sine() {
     uint8_t result[10];
     
     // Compute sine of ST(0)
-    compute_sine_f80(x87_registers[physical_idx].data, result);
+    compute_sine_f80(x87_registers[physical_idx].data, result, FpuWords{fpu_status_word, fpu_control_word});
     
     // Apply precision control directly to result buffer
     apply_precision_control_f80(result, fpu_control_word);
@@ -390,7 +382,7 @@ void SIMDState::compute_cosine() {
     uint8_t result[10];
     
     // Compute cosine of ST(0)
-    compute_cosine_f80(x87_registers[physical_idx].data, result);
+    compute_cosine_f80(x87_registers[physical_idx].data, result, FpuWords{fpu_status_word, fpu_control_word});
     
     // Apply precision control directly to result buffer
     apply_precision_control_f80(result, fpu_control_word);
@@ -417,7 +409,7 @@ bool SIMDState::compute_tangent_with_status(double input) {
     uint16_t status = 0;
     
     // Call compute_tangent_f80_with_status
-    bool success = compute_tangent_f80_with_status(input_80, output_80, &status);
+    bool success = compute_tangent_f80_with_status(input_80, output_80, &status, fpu_control_word);
     
     // Update the status word
     fpu_status_word |= status;
@@ -557,7 +549,7 @@ void SIMDState::compute_2_to_x_minus_1() {
     uint8_t result[10];
     
     // Compute 2^x-1 of ST(0)
-    compute_2_to_x_minus_1_f80(x87_registers[physical_idx].data, result);
+    compute_2_to_x_minus_1_f80(x87_registers[physical_idx].data, result, FpuWords{fpu_status_word, fpu_control_word});
     
     // Apply precision control directly to result buffer
     apply_precision_control_f80(result, fpu_control_word);
@@ -635,7 +627,7 @@ void SIMDState::compute_y_log2_x() {
     uint8_t result[10];
     
     // Compute y * log2(x) where y is ST(0) and x is ST(1)
-    compute_y_log2_x_f80(x87_registers[st1_idx].data, x87_registers[st0_idx].data, result);
+    compute_y_log2_x_f80(x87_registers[st1_idx].data, x87_registers[st0_idx].data, result, FpuWords{fpu_status_word, fpu_control_word});
     
     // Pop ST(0) and replace ST(0) (now the former ST(1)) with result
     // Use fpu_pop instead of relying on pop_double to avoid double underflow check
@@ -1130,9 +1122,6 @@ void SIMDState::update_status_word_flags(uint16_t flags) {
                   std::to_string(unmasked_exceptions));
     }
     
-    // Also update the global variable
-    simd::fpu_status_word = fpu_status_word;
-    
     LOG_DEBUG("Updated FPU status word: 0x" + std::to_string(fpu_status_word));
 }
 
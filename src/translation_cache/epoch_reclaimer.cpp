@@ -0,0 +1,127 @@
+#include "xenoarm_jit/translation_cache/epoch_reclaimer.h"
+#include "logging/logger.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace xenoarm_jit {
+namespace translation_cache {
+
+namespace {
+
+std::atomic<uint64_t> g_next_reclaimer_id{1};
+
+// Slots held by the current thread, keyed by reclaimer id (a thread is
+// normally registered with one or two caches, so a flat list is enough)
+thread_local std::vector<std::pair<uint64_t, size_t>> t_registrations;
+
+} // namespace
+
+EpochReclaimer::EpochReclaimer()
+    : id_(g_next_reclaimer_id.fetch_add(1, std::memory_order_relaxed)),
+      global_epoch_(1) {
+}
+
+EpochReclaimer::~EpochReclaimer() {
+    for (const auto& retired : retired_) {
+        retired.deleter(retired.object);
+    }
+    retired_.clear();
+}
+
+int EpochReclaimer::find_thread_slot() const {
+    for (const auto& registration : t_registrations) {
+        if (registration.first == id_) {
+            return static_cast<int>(registration.second);
+        }
+    }
+    return -1;
+}
+
+bool EpochReclaimer::register_thread() {
+    if (find_thread_slot() >= 0) {
+        return true;
+    }
+
+    for (size_t i = 0; i < MAX_THREADS; ++i) {
+        bool expected = false;
+        if (threads_[i].in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+            threads_[i].epoch.store(global_epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            t_registrations.emplace_back(id_, i);
+            return true;
+        }
+    }
+
+    LOG_ERROR("EpochReclaimer: thread table full, cannot register reader thread");
+    return false;
+}
+
+void EpochReclaimer::unregister_thread() {
+    int slot = find_thread_slot();
+    if (slot < 0) {
+        return;
+    }
+
+    threads_[slot].epoch.store(0, std::memory_order_seq_cst);
+    threads_[slot].in_use.store(false, std::memory_order_release);
+    t_registrations.erase(std::remove_if(t_registrations.begin(), t_registrations.end(),
+        [this](const std::pair<uint64_t, size_t>& r) { return r.first == id_; }),
+        t_registrations.end());
+}
+
+bool EpochReclaimer::is_thread_registered() const {
+    return find_thread_slot() >= 0;
+}
+
+void EpochReclaimer::quiescent_state() {
+    int slot = find_thread_slot();
+    if (slot < 0) {
+        return;
+    }
+
+    // seq_cst so the announcement is ordered before any pointer this thread
+    // loads afterwards
+    threads_[slot].epoch.store(global_epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+}
+
+void EpochReclaimer::retire(void* object, void (*deleter)(void*)) {
+    if (!object) {
+        return;
+    }
+
+    // The object is already unlinked; any thread that announces an epoch
+    // newer than this one can no longer reach it
+    uint64_t epoch = global_epoch_.fetch_add(1, std::memory_order_seq_cst);
+    retired_.push_back({object, deleter, epoch});
+}
+
+size_t EpochReclaimer::reclaim() {
+    if (retired_.empty()) {
+        return 0;
+    }
+
+    uint64_t min_epoch = std::numeric_limits<uint64_t>::max();
+    for (size_t i = 0; i < MAX_THREADS; ++i) {
+        uint64_t epoch = threads_[i].epoch.load(std::memory_order_seq_cst);
+        if (epoch != 0) {
+            min_epoch = std::min(min_epoch, epoch);
+        }
+    }
+
+    size_t freed = 0;
+    auto keep = std::remove_if(retired_.begin(), retired_.end(),
+        [min_epoch, &freed](const RetiredObject& retired) {
+            if (retired.epoch < min_epoch) {
+                retired.deleter(retired.object);
+                ++freed;
+                return true;
+            }
+            return false;
+        });
+    retired_.erase(keep, retired_.end());
+    return freed;
+}
+
+} // namespace translation_cache
+} // namespace xenoarm_jit
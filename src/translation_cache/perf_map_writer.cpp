@@ -0,0 +1,291 @@
+#include "xenoarm_jit/translation_cache/perf_map_writer.h"
+#include "logging/logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+namespace xenoarm_jit {
+namespace translation_cache {
+
+namespace {
+
+// jitdump layout (tools/perf/Documentation/jitdump-specification.txt), host
+// byte order: FileHeader, then records each starting with a RecordHeader
+const uint32_t JITDUMP_MAGIC = 0x4A695444; // "JiTD"
+const uint32_t JITDUMP_VERSION = 1;
+const uint32_t JIT_CODE_LOAD = 0;
+const uint32_t JIT_CODE_CLOSE = 3;
+const uint32_t JIT_CODE_DEBUG_INFO = 2;
+
+// Source file name of the debug info entries; their line numbers are guest EIPs
+const char GUEST_SOURCE_NAME[] = "guest";
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct RecordHeader {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+};
+
+struct CodeLoadRecord {
+    RecordHeader header;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+    // Followed by the NUL-terminated name and the code bytes
+};
+
+struct DebugInfoRecord {
+    RecordHeader header;
+    uint64_t code_addr;
+    uint64_t nr_entry;
+    // Followed by nr_entry DebugEntry, each with a NUL-terminated file name
+};
+
+struct DebugEntry {
+    uint64_t code_addr;
+    uint32_t line;
+    uint32_t discrim;
+};
+
+// perf matches jitdump timestamps against CLOCK_MONOTONIC (perf record -k mono)
+uint64_t timestamp_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+
+uint32_t current_tid() {
+#if defined(__linux__)
+    return static_cast<uint32_t>(syscall(SYS_gettid));
+#else
+    return static_cast<uint32_t>(getpid());
+#endif
+}
+
+bool write_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+void PerfMapWriter::Output::append(const void* data, size_t size) {
+    if (fd < 0) {
+        return;
+    }
+    if (buffer.size() + size > BUFFER_SIZE) {
+        flush();
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (size >= BUFFER_SIZE) {
+        if (!write_all(fd, bytes, size)) {
+            LOG_ERROR("Failed to write profiler records to " + path);
+        }
+        return;
+    }
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+void PerfMapWriter::Output::flush() {
+    if (fd < 0 || buffer.empty()) {
+        return;
+    }
+    if (!write_all(fd, buffer.data(), buffer.size())) {
+        LOG_ERROR("Failed to write profiler records to " + path);
+    }
+    buffer.clear();
+}
+
+std::string PerfMapWriter::default_perf_map_path() {
+    return "/tmp/perf-" + std::to_string(getpid()) + ".map";
+}
+
+std::string PerfMapWriter::default_jitdump_path(const std::string& directory) {
+    return directory + "/jit-" + std::to_string(getpid()) + ".dump";
+}
+
+PerfMapWriter::PerfMapWriter(const std::string& perf_map_path, const std::string& jitdump_path)
+    : jitdump_marker_(nullptr), code_index_(0), blocks_written_(0) {
+    perf_map_.path = perf_map_path;
+    jitdump_.path = jitdump_path;
+}
+
+PerfMapWriter::~PerfMapWriter() {
+    close();
+}
+
+bool PerfMapWriter::open() {
+    bool opened = true;
+    if (!perf_map_.path.empty()) {
+        perf_map_.fd = ::open(perf_map_.path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (perf_map_.fd < 0) {
+            LOG_ERROR("Failed to create perf map " + perf_map_.path + ": " + std::strerror(errno));
+            opened = false;
+        } else {
+            perf_map_.buffer.reserve(BUFFER_SIZE);
+        }
+    }
+
+    if (!jitdump_.path.empty()) {
+        // Read access too: the file is mapped below
+        jitdump_.fd = ::open(jitdump_.path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (jitdump_.fd < 0) {
+            LOG_ERROR("Failed to create jitdump " + jitdump_.path + ": " + std::strerror(errno));
+            return false;
+        }
+        FileHeader header = {};
+        header.magic = JITDUMP_MAGIC;
+        header.version = JITDUMP_VERSION;
+        header.total_size = sizeof(header);
+        header.elf_mach = ELF_MACHINE;
+        header.pid = static_cast<uint32_t>(getpid());
+        header.timestamp = timestamp_ns();
+        if (!write_all(jitdump_.fd, reinterpret_cast<const uint8_t*>(&header), sizeof(header))) {
+            LOG_ERROR("Failed to write jitdump header to " + jitdump_.path);
+            ::close(jitdump_.fd);
+            jitdump_.fd = -1;
+            return false;
+        }
+
+        // perf record only follows jitdump files that show up as an
+        // executable mapping of the process
+        long page_size = sysconf(_SC_PAGESIZE);
+        jitdump_marker_ = mmap(nullptr, static_cast<size_t>(page_size), PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                               jitdump_.fd, 0);
+        if (jitdump_marker_ == MAP_FAILED) {
+            LOG_WARNING("Failed to map jitdump " + jitdump_.path + "; perf record will not see it");
+            jitdump_marker_ = nullptr;
+        }
+        jitdump_.buffer.reserve(BUFFER_SIZE);
+    }
+    return opened;
+}
+
+void PerfMapWriter::write_block(const TranslatedBlock* block) {
+    if (!block || !block->code_ptr || (perf_map_.fd < 0 && jitdump_.fd < 0)) {
+        return;
+    }
+    char name[48];
+    std::snprintf(name, sizeof(name), "x86_%08llx%s", static_cast<unsigned long long>(block->guest_address),
+                  block->tier == CompilationTier::TIER1 ? "_t1" : "");
+    write_perf_map_entry(block, name);
+    write_jitdump_records(block, name);
+    blocks_written_++;
+}
+
+void PerfMapWriter::write_perf_map_entry(const TranslatedBlock* block, const std::string& name) {
+    if (perf_map_.fd < 0) {
+        return;
+    }
+    char line[96];
+    int length = std::snprintf(line, sizeof(line), "%llx %zx %s\n",
+                               static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(block->code_ptr)),
+                               block->code_size(), name.c_str());
+    if (length > 0) {
+        perf_map_.append(line, std::min<size_t>(static_cast<size_t>(length), sizeof(line) - 1));
+    }
+}
+
+void PerfMapWriter::write_jitdump_records(const TranslatedBlock* block, const std::string& name) {
+    if (jitdump_.fd < 0) {
+        return;
+    }
+    const uint64_t code_addr = reinterpret_cast<uintptr_t>(block->code_ptr);
+    const uint64_t timestamp = timestamp_ns();
+
+    // Debug info goes first: perf attaches it to the next load of code_addr.
+    // Blocks without a source map are attributed to their entry point.
+    std::vector<SourceMapEntry> entry_only;
+    const std::vector<SourceMapEntry>* source_map = &block->source_map;
+    if (source_map->empty()) {
+        entry_only.push_back({0, static_cast<uint32_t>(block->guest_address)});
+        source_map = &entry_only;
+    }
+    DebugInfoRecord debug_info = {};
+    debug_info.header.id = JIT_CODE_DEBUG_INFO;
+    debug_info.header.total_size = static_cast<uint32_t>(
+        sizeof(debug_info) + source_map->size() * (sizeof(DebugEntry) + sizeof(GUEST_SOURCE_NAME)));
+    debug_info.header.timestamp = timestamp;
+    debug_info.code_addr = code_addr;
+    debug_info.nr_entry = source_map->size();
+    jitdump_.append(&debug_info, sizeof(debug_info));
+    for (const SourceMapEntry& source : *source_map) {
+        DebugEntry entry = {code_addr + source.host_offset, source.guest_address, 0};
+        jitdump_.append(&entry, sizeof(entry));
+        jitdump_.append(GUEST_SOURCE_NAME, sizeof(GUEST_SOURCE_NAME));
+    }
+
+    CodeLoadRecord load = {};
+    load.header.id = JIT_CODE_LOAD;
+    load.header.total_size = static_cast<uint32_t>(sizeof(load) + name.size() + 1 + block->code_size());
+    load.header.timestamp = timestamp;
+    load.pid = static_cast<uint32_t>(getpid());
+    load.tid = current_tid();
+    load.vma = code_addr;
+    load.code_addr = code_addr;
+    load.code_size = block->code_size();
+    load.code_index = code_index_++;
+    jitdump_.append(&load, sizeof(load));
+    jitdump_.append(name.c_str(), name.size() + 1);
+    jitdump_.append(block->code_ptr, block->code_size());
+}
+
+void PerfMapWriter::flush() {
+    perf_map_.flush();
+    jitdump_.flush();
+}
+
+void PerfMapWriter::close() {
+    if (jitdump_.fd >= 0) {
+        RecordHeader close_record = {JIT_CODE_CLOSE, sizeof(RecordHeader), timestamp_ns()};
+        jitdump_.append(&close_record, sizeof(close_record));
+    }
+    flush();
+    if (jitdump_marker_) {
+        munmap(jitdump_marker_, static_cast<size_t>(sysconf(_SC_PAGESIZE)));
+        jitdump_marker_ = nullptr;
+    }
+    for (Output* output : {&perf_map_, &jitdump_}) {
+        if (output->fd >= 0) {
+            ::close(output->fd);
+            output->fd = -1;
+        }
+    }
+}
+
+} // namespace translation_cache
+} // namespace xenoarm_jit
@@ -0,0 +1,414 @@
+#include "xenoarm_jit/translation_cache/persistent_code_cache.h"
+#include "xenoarm_jit/translation_cache/shared_code_store.h"
+#include "logging/logger.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace xenoarm_jit {
+namespace translation_cache {
+
+namespace {
+
+// On-disk layout (host byte order, every section 8-byte aligned):
+//   FileHeader
+//   records: FileRecord, FileRange[range_count], uint64_t[successor_count],
+//            FileExit[exit_count], FileRelocation[relocation_count],
+//            FileFastmemSite[fastmem_site_count], code[code_size] padded to 8 bytes
+//   FileIndexEntry[entry_count] at index_offset
+const char FILE_MAGIC[8] = {'X', 'J', 'I', 'T', 'P', 'C', 'C', '\0'};
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_count;
+    uint64_t config_key;
+    uint64_t image_id;
+    uint64_t index_offset;
+};
+
+struct FileIndexEntry {
+    uint64_t guest_address;
+    uint64_t record_offset;
+};
+
+struct FileRecord {
+    uint64_t guest_address;
+    uint64_t guest_hash;
+    uint32_t guest_size;
+    uint32_t tier;
+    uint32_t range_count;
+    uint32_t successor_count;
+    uint32_t exit_count;
+    uint32_t relocation_count;
+    uint32_t code_size;
+    uint32_t fastmem_site_count;
+};
+
+struct FileRange {
+    uint64_t guest_address;
+    uint32_t guest_size;
+    uint32_t reserved;
+};
+
+struct FileExit {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t target_guest_address;
+    uint64_t target_guest_address_false;
+    uint64_t instruction_offset;
+};
+
+struct FileRelocation {
+    uint32_t kind;
+    uint32_t offset;
+    int64_t image_offset; // Target relative to image_base()
+};
+
+struct FileFastmemSite {
+    uint32_t access_offset;
+    uint32_t thunk_offset;
+};
+
+size_t align8(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+template <typename T>
+T read_at(const uint8_t* data, size_t offset) {
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+void append(std::vector<uint8_t>& out, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+// Base address of the image (executable or shared object) containing this library
+uintptr_t image_base() {
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(&image_base), &info) && info.dli_fbase) {
+        return reinterpret_cast<uintptr_t>(info.dli_fbase);
+    }
+    return 0;
+}
+
+// Identifies the build of the image, so offsets into it are only reused by
+// the same binary
+uint64_t image_id() {
+    Dl_info info;
+    if (!dladdr(reinterpret_cast<void*>(&image_id), &info) || !info.dli_fname) {
+        return 0;
+    }
+    struct stat st;
+    uint64_t id_parts[3] = {
+        static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&image_id) - image_base()), 0, 0
+    };
+    if (stat(info.dli_fname, &st) == 0) {
+        id_parts[1] = static_cast<uint64_t>(st.st_size);
+        id_parts[2] = static_cast<uint64_t>(st.st_mtime);
+    }
+    return SharedCodeStore::hash_bytes(id_parts, sizeof(id_parts));
+}
+
+bool in_image(uint64_t address) {
+    Dl_info info;
+    return dladdr(reinterpret_cast<void*>(static_cast<uintptr_t>(address)), &info) &&
+           reinterpret_cast<uintptr_t>(info.dli_fbase) == image_base();
+}
+
+} // namespace
+
+PersistentCodeCache::PersistentCodeCache(const std::string& path, uint64_t config_key)
+    : path_(path), config_key_(config_key), mapping_(nullptr), mapping_size_(0) {
+    LOG_DEBUG("PersistentCodeCache created for " + path);
+}
+
+PersistentCodeCache::~PersistentCodeCache() {
+    unmap();
+    LOG_DEBUG("PersistentCodeCache destroyed");
+}
+
+void PersistentCodeCache::unmap() {
+    if (mapping_) {
+        munmap(const_cast<uint8_t*>(mapping_), mapping_size_);
+        mapping_ = nullptr;
+        mapping_size_ = 0;
+    }
+    index_.clear();
+}
+
+bool PersistentCodeCache::open() {
+    unmap();
+
+    int fd = ::open(path_.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_INFO("No persistent translation cache at " + path_);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FileHeader)) {
+        LOG_WARNING("Persistent translation cache " + path_ + " is truncated, ignoring it");
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        LOG_ERROR("Failed to map persistent translation cache " + path_);
+        return false;
+    }
+    mapping_ = static_cast<const uint8_t*>(mapping);
+    mapping_size_ = static_cast<size_t>(st.st_size);
+
+    FileHeader header = read_at<FileHeader>(mapping_, 0);
+    if (std::memcmp(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+        header.version != FORMAT_VERSION || header.config_key != config_key_ ||
+        header.image_id != image_id()) {
+        LOG_WARNING("Persistent translation cache " + path_ + " was written by another build or configuration, ignoring it");
+        unmap();
+        return false;
+    }
+    if (header.index_offset > mapping_size_ ||
+        header.entry_count > (mapping_size_ - header.index_offset) / sizeof(FileIndexEntry)) {
+        LOG_WARNING("Persistent translation cache " + path_ + " has a corrupt index, ignoring it");
+        unmap();
+        return false;
+    }
+
+    index_.reserve(header.entry_count);
+    for (uint32_t i = 0; i < header.entry_count; ++i) {
+        FileIndexEntry entry = read_at<FileIndexEntry>(mapping_, header.index_offset + i * sizeof(FileIndexEntry));
+        if (record_size(entry.record_offset)) {
+            index_[entry.guest_address] = entry.record_offset;
+        }
+    }
+
+    LOG_INFO("Mapped persistent translation cache " + path_ + " (" + std::to_string(index_.size()) + " blocks)");
+    return true;
+}
+
+size_t PersistentCodeCache::record_size(uint64_t offset) const {
+    if (offset % 8 != 0 || offset > mapping_size_ || mapping_size_ - offset < sizeof(FileRecord)) {
+        return 0;
+    }
+    FileRecord record = read_at<FileRecord>(mapping_, offset);
+    size_t size = sizeof(FileRecord) +
+                  static_cast<size_t>(record.range_count) * sizeof(FileRange) +
+                  static_cast<size_t>(record.successor_count) * sizeof(uint64_t) +
+                  static_cast<size_t>(record.exit_count) * sizeof(FileExit) +
+                  static_cast<size_t>(record.relocation_count) * sizeof(FileRelocation) +
+                  static_cast<size_t>(record.fastmem_site_count) * sizeof(FileFastmemSite) +
+                  align8(record.code_size);
+    if (record.code_size == 0 || size > mapping_size_ - offset) {
+        return 0;
+    }
+    return size;
+}
+
+bool PersistentCodeCache::find(uint64_t guest_address, PersistentBlock* block) const {
+    auto it = index_.find(guest_address);
+    if (it == index_.end()) {
+        return false;
+    }
+
+    size_t offset = it->second;
+    FileRecord record = read_at<FileRecord>(mapping_, offset);
+    offset += sizeof(FileRecord);
+    if (record.tier > static_cast<uint32_t>(CompilationTier::TIER1)) {
+        return false;
+    }
+
+    block->guest_address = record.guest_address;
+    block->guest_size = record.guest_size;
+    block->guest_hash = record.guest_hash;
+    block->tier = static_cast<CompilationTier>(record.tier);
+
+    block->superblock_ranges.clear();
+    for (uint32_t i = 0; i < record.range_count; ++i, offset += sizeof(FileRange)) {
+        FileRange range = read_at<FileRange>(mapping_, offset);
+        block->superblock_ranges.push_back({range.guest_address, range.guest_size});
+    }
+
+    block->static_successors.clear();
+    for (uint32_t i = 0; i < record.successor_count; ++i, offset += sizeof(uint64_t)) {
+        block->static_successors.push_back(read_at<uint64_t>(mapping_, offset));
+    }
+
+    block->exits.clear();
+    for (uint32_t i = 0; i < record.exit_count; ++i, offset += sizeof(FileExit)) {
+        FileExit file_exit = read_at<FileExit>(mapping_, offset);
+        if (file_exit.instruction_offset >= record.code_size) {
+            return false;
+        }
+        TranslatedBlock::ControlFlowExit exit;
+        exit.type = static_cast<TranslatedBlock::ControlFlowExitType>(file_exit.type);
+        exit.target_guest_address = file_exit.target_guest_address;
+        exit.target_guest_address_false = file_exit.target_guest_address_false;
+        exit.instruction_offset = static_cast<size_t>(file_exit.instruction_offset);
+        exit.is_patched = false; // Links are re-established when the block is stored
+        block->exits.push_back(exit);
+    }
+
+    const uintptr_t base = image_base();
+    block->relocations.clear();
+    for (uint32_t i = 0; i < record.relocation_count; ++i, offset += sizeof(FileRelocation)) {
+        FileRelocation file_relocation = read_at<FileRelocation>(mapping_, offset);
+        if (file_relocation.kind != static_cast<uint32_t>(CodeRelocation::Kind::HOST_CALL_ABS64) ||
+            file_relocation.offset > record.code_size || record.code_size - file_relocation.offset < 16) {
+            return false;
+        }
+        CodeRelocation relocation;
+        relocation.kind = CodeRelocation::Kind::HOST_CALL_ABS64;
+        relocation.offset = file_relocation.offset;
+        relocation.target = static_cast<uint64_t>(base + file_relocation.image_offset);
+        block->relocations.push_back(relocation);
+    }
+
+    block->fastmem_sites.clear();
+    for (uint32_t i = 0; i < record.fastmem_site_count; ++i, offset += sizeof(FileFastmemSite)) {
+        FileFastmemSite file_site = read_at<FileFastmemSite>(mapping_, offset);
+        if (file_site.access_offset >= record.code_size || file_site.thunk_offset >= record.code_size) {
+            return false;
+        }
+        block->fastmem_sites.push_back({file_site.access_offset, file_site.thunk_offset});
+    }
+
+    block->code = mapping_ + offset;
+    block->code_size = record.code_size;
+    return true;
+}
+
+std::vector<uint64_t> PersistentCodeCache::get_addresses() const {
+    std::vector<uint64_t> addresses;
+    addresses.reserve(index_.size());
+    for (const auto& entry : index_) {
+        addresses.push_back(entry.first);
+    }
+    return addresses;
+}
+
+long PersistentCodeCache::save(const std::vector<const TranslatedBlock*>& blocks) {
+    std::vector<uint8_t> out(sizeof(FileHeader), 0);
+    std::vector<FileIndexEntry> index;
+    std::unordered_set<uint64_t> written;
+    const uintptr_t base = image_base();
+
+    for (const TranslatedBlock* block : blocks) {
+        size_t code_size = block->code_size();
+        if (!block->code_ptr || code_size == 0 || written.count(block->guest_address)) {
+            continue;
+        }
+
+        // Patched exits branch into this process's memory and cannot be
+        // restored to their dispatcher form here
+        bool persistable = true;
+        for (const auto& exit : block->exits) {
+            persistable = persistable && !exit.is_patched;
+        }
+        for (const CodeRelocation& relocation : block->relocations) {
+            persistable = persistable && in_image(relocation.target);
+        }
+        if (!persistable) {
+            LOG_DEBUG("Not persisting block at 0x" + std::to_string(block->guest_address));
+            continue;
+        }
+
+        index.push_back({block->guest_address, out.size()});
+        written.insert(block->guest_address);
+
+        FileRecord record = {};
+        record.guest_address = block->guest_address;
+        record.guest_hash = block->guest_hash;
+        record.guest_size = block->guest_size;
+        record.tier = static_cast<uint32_t>(block->tier);
+        record.range_count = static_cast<uint32_t>(block->superblock_ranges.size());
+        record.successor_count = static_cast<uint32_t>(block->static_successors.size());
+        record.exit_count = static_cast<uint32_t>(block->exits.size());
+        record.relocation_count = static_cast<uint32_t>(block->relocations.size());
+        record.code_size = static_cast<uint32_t>(code_size);
+        record.fastmem_site_count = static_cast<uint32_t>(block->fastmem_sites.size());
+        append(out, &record, sizeof(record));
+
+        for (const auto& range : block->superblock_ranges) {
+            FileRange file_range = {range.first, range.second, 0};
+            append(out, &file_range, sizeof(file_range));
+        }
+        for (uint64_t successor : block->static_successors) {
+            append(out, &successor, sizeof(successor));
+        }
+        for (const auto& exit : block->exits) {
+            FileExit file_exit = {static_cast<uint32_t>(exit.type), 0, exit.target_guest_address,
+                                  exit.target_guest_address_false, exit.instruction_offset};
+            append(out, &file_exit, sizeof(file_exit));
+        }
+        for (const CodeRelocation& relocation : block->relocations) {
+            FileRelocation file_relocation = {static_cast<uint32_t>(relocation.kind), relocation.offset,
+                                              static_cast<int64_t>(relocation.target - base)};
+            append(out, &file_relocation, sizeof(file_relocation));
+        }
+        for (const FastmemSite& site : block->fastmem_sites) {
+            FileFastmemSite file_site = {site.access_offset, site.thunk_offset};
+            append(out, &file_site, sizeof(file_site));
+        }
+
+        const uint8_t* code = static_cast<const uint8_t*>(block->code_ptr);
+        append(out, code, code_size);
+        out.resize(align8(out.size()), 0);
+    }
+
+    // Keep what earlier runs translated and this run has not reached yet
+    for (const auto& entry : index_) {
+        if (written.count(entry.first)) {
+            continue;
+        }
+        size_t size = record_size(entry.second);
+        if (size) {
+            index.push_back({entry.first, out.size()});
+            append(out, mapping_ + entry.second, size);
+        }
+    }
+
+    FileHeader header = {};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FORMAT_VERSION;
+    header.entry_count = static_cast<uint32_t>(index.size());
+    header.config_key = config_key_;
+    header.image_id = image_id();
+    header.index_offset = out.size();
+    std::memcpy(out.data(), &header, sizeof(header));
+    append(out, index.data(), index.size() * sizeof(FileIndexEntry));
+
+    // Write a temporary file and rename it over the old one; the current
+    // mapping keeps the old contents alive
+    std::string temp_path = path_ + ".tmp";
+    FILE* file = std::fopen(temp_path.c_str(), "wb");
+    if (!file) {
+        LOG_ERROR("Failed to create persistent translation cache " + temp_path);
+        return -1;
+    }
+    bool ok = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+    ok = (std::fclose(file) == 0) && ok;
+    if (!ok || std::rename(temp_path.c_str(), path_.c_str()) != 0) {
+        LOG_ERROR("Failed to write persistent translation cache " + path_);
+        std::remove(temp_path.c_str());
+        return -1;
+    }
+
+    LOG_INFO("Saved " + std::to_string(index.size()) + " blocks to persistent translation cache " + path_);
+    return static_cast<long>(index.size());
+}
+
+} // namespace translation_cache
+} // namespace xenoarm_jit
@@ -0,0 +1,90 @@
+#include "xenoarm_jit/translation_cache/shared_code_store.h"
+#include "logging/logger.h"
+
+namespace xenoarm_jit {
+namespace translation_cache {
+
+SharedCodeStore::SharedCodeStore()
+    : hits_(0), misses_(0) {
+    LOG_DEBUG("SharedCodeStore created");
+}
+
+SharedCodeStore::~SharedCodeStore() {
+    // Entries still mapped by a context stay alive through its references
+    LOG_DEBUG("SharedCodeStore destroyed");
+}
+
+uint64_t SharedCodeStore::hash_bytes(const void* data, size_t size, uint64_t hash) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::shared_ptr<const SharedCode> SharedCodeStore::acquire(uint64_t key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<const SharedCode> code = it->second.lock();
+    if (!code) {
+        entries_.erase(it);
+        return nullptr;
+    }
+    hits_++;
+    return code;
+}
+
+std::shared_ptr<const SharedCode> SharedCodeStore::publish(std::shared_ptr<SharedCode> code) {
+    if (!code) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::weak_ptr<const SharedCode>& entry = entries_[code->key];
+    std::shared_ptr<const SharedCode> existing = entry.lock();
+    if (existing) {
+        // Lost a race with another context compiling the same code
+        hits_++;
+        return existing;
+    }
+
+    entry = code;
+    misses_++;
+    if (entries_.size() % 1024 == 0) {
+        prune_locked();
+    }
+    return code;
+}
+
+SharedCodeStats SharedCodeStore::get_stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    prune_locked();
+
+    SharedCodeStats stats = {};
+    for (const auto& entry : entries_) {
+        if (std::shared_ptr<const SharedCode> code = entry.second.lock()) {
+            stats.entries++;
+            stats.code_bytes += code->code.size();
+        }
+    }
+    stats.hits = hits_;
+    stats.misses = misses_;
+    return stats;
+}
+
+void SharedCodeStore::prune_locked() {
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second.expired()) {
+            it = entries_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+} // namespace translation_cache
+} // namespace xenoarm_jit
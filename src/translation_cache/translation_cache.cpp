@@ -1,4 +1,6 @@
 #include "xenoarm_jit/translation_cache/translation_cache.h"
+#include "xenoarm_jit/translation_cache/shared_code_store.h"
+#include "xenoarm_jit/translation_cache/perf_map_writer.h"
 #include "logging/logger.h"
 #include <iostream> // For std::cerr and std::endl
 #include <cstring>
@@ -7,25 +9,215 @@
 namespace xenoarm_jit {
 namespace translation_cache {
 
-TranslationCache::TranslationCache() {
+bool TranslatedBlock::overlaps(uint64_t start, uint64_t end) const {
+    if (guest_address <= end && guest_address + guest_size >= start) {
+        return true;
+    }
+    for (const auto& range : superblock_ranges) {
+        if (range.first <= end && range.first + range.second >= start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t TranslatedBlock::code_size() const {
+    return shared_code ? shared_code->code.size() : code.size();
+}
+
+const FastmemSite* TranslatedBlock::find_fastmem_site(uintptr_t host_pc) const {
+    uintptr_t start = reinterpret_cast<uintptr_t>(code_ptr);
+    if (!code_ptr || host_pc < start || host_pc - start >= code_size()) {
+        return nullptr;
+    }
+    uint32_t offset = static_cast<uint32_t>(host_pc - start);
+    auto it = std::lower_bound(fastmem_sites.begin(), fastmem_sites.end(), offset,
+        [](const FastmemSite& site, uint32_t value) { return site.access_offset < value; });
+    return (it != fastmem_sites.end() && it->access_offset == offset) ? &*it : nullptr;
+}
+
+namespace {
+
+void delete_block(void* object) {
+    delete static_cast<TranslatedBlock*>(object);
+}
+
+} // namespace
+
+TranslationCache::Table::Table(size_t capacity)
+    : mask(capacity - 1), used(0), slots(new Slot[capacity]) {
+    for (size_t i = 0; i < capacity; ++i) {
+        slots[i].key.store(EMPTY_KEY, std::memory_order_relaxed);
+        slots[i].block.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+TranslationCache::TranslationCache()
+    : table_(new Table(INITIAL_CAPACITY)), block_count_(0),
+      fastmem_table_(new Table(INITIAL_CAPACITY)), fastmem_site_count_(0) {
     LOG_DEBUG("TranslationCache created");
 }
 
 TranslationCache::~TranslationCache() {
-    // Free all blocks in the cache
+    // Free all blocks in the cache; the reclaimer frees anything retired
     flush();
+    delete table_.load(std::memory_order_relaxed);
+    delete fastmem_table_.load(std::memory_order_relaxed);
     LOG_DEBUG("TranslationCache destroyed");
 }
 
-TranslatedBlock* TranslationCache::lookup(uint64_t guest_address) {
-    LOG_DEBUG("Looking up guest address 0x" + std::to_string(guest_address) + " in TranslationCache.");
-    auto it = cache_.find(guest_address);
-    if (it != cache_.end()) {
-        LOG_DEBUG("Found translated block for guest address 0x" + std::to_string(guest_address) + ".");
-        return it->second;
+TranslatedBlock* TranslationCache::probe(const Table* table, uint64_t key) {
+    for (size_t i = slot_index(key, table->mask);; i = (i + 1) & table->mask) {
+        uint64_t slot_key = table->slots[i].key.load(std::memory_order_acquire);
+        if (slot_key == key) {
+            return table->slots[i].block.load(std::memory_order_acquire);
+        }
+        if (slot_key == EMPTY_KEY) {
+            return nullptr;
+        }
+    }
+}
+
+TranslationCache::Slot* TranslationCache::find_slot(const Table* table, uint64_t key) {
+    for (size_t i = slot_index(key, table->mask);; i = (i + 1) & table->mask) {
+        uint64_t slot_key = table->slots[i].key.load(std::memory_order_relaxed);
+        if (slot_key == key) {
+            return &table->slots[i];
+        }
+        if (slot_key == EMPTY_KEY) {
+            return nullptr;
+        }
+    }
+}
+
+TranslatedBlock* TranslationCache::lookup(uint64_t guest_address) const {
+    // Lock-free: the table, its keys and its blocks are published with
+    // release stores, and retired tables/blocks outlive any reader that
+    // has not passed a quiescent state since loading them
+    return probe(table_.load(std::memory_order_acquire), guest_address);
+}
+
+TranslationCache::Slot* TranslationCache::find_slot_locked(uint64_t guest_address) const {
+    return find_slot(table_.load(std::memory_order_relaxed), guest_address);
+}
+
+TranslatedBlock* TranslationCache::lookup_locked(uint64_t guest_address) const {
+    Slot* slot = find_slot_locked(guest_address);
+    return slot ? slot->block.load(std::memory_order_relaxed) : nullptr;
+}
+
+void TranslationCache::publish_locked(TranslatedBlock* block) {
+    index_fastmem_sites_locked(block);
+    
+    Slot* slot = find_slot_locked(block->guest_address);
+    if (!slot) {
+        insert_locked(table_, block_count_.load(std::memory_order_relaxed), block->guest_address, block);
+        block_count_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (!slot->block.load(std::memory_order_relaxed)) {
+        block_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    slot->block.store(block, std::memory_order_release);
+}
+
+void TranslationCache::insert_locked(std::atomic<Table*>& table, size_t live, uint64_t key, TranslatedBlock* block) {
+    Table* current = table.load(std::memory_order_relaxed);
+    if ((current->used + 1) * 2 > current->mask + 1) {
+        grow_locked(table, live);
+        current = table.load(std::memory_order_relaxed);
+    }
+    size_t i = slot_index(key, current->mask);
+    while (current->slots[i].key.load(std::memory_order_relaxed) != EMPTY_KEY) {
+        i = (i + 1) & current->mask;
+    }
+    // Block first, then key: a reader that matches the key sees the block
+    current->slots[i].block.store(block, std::memory_order_relaxed);
+    current->slots[i].key.store(key, std::memory_order_release);
+    current->used++;
+}
+
+void TranslationCache::grow_locked(std::atomic<Table*>& table, size_t live) {
+    Table* old_table = table.load(std::memory_order_relaxed);
+    size_t capacity = old_table->mask + 1;
+    // Only grow when live entries (not dead keys) fill the table
+    while (capacity < (live + 1) * 4) {
+        capacity *= 2;
+    }
+
+    Table* new_table = new Table(capacity);
+    for (size_t i = 0; i <= old_table->mask; ++i) {
+        TranslatedBlock* block = old_table->slots[i].block.load(std::memory_order_relaxed);
+        if (!block) {
+            continue;
+        }
+        uint64_t key = old_table->slots[i].key.load(std::memory_order_relaxed);
+        size_t j = slot_index(key, new_table->mask);
+        while (new_table->slots[j].key.load(std::memory_order_relaxed) != EMPTY_KEY) {
+            j = (j + 1) & new_table->mask;
+        }
+        new_table->slots[j].key.store(key, std::memory_order_relaxed);
+        new_table->slots[j].block.store(block, std::memory_order_relaxed);
+        new_table->used++;
+    }
+
+    table.store(new_table, std::memory_order_release);
+    reclaimer_.retire(old_table, [](void* object) { delete static_cast<Table*>(object); });
+}
+
+void TranslationCache::retire_block_locked(TranslatedBlock* block) {
+    unindex_fastmem_sites_locked(block);
+    reclaimer_.retire(block, delete_block);
+}
+
+void TranslationCache::index_fastmem_sites_locked(TranslatedBlock* block) {
+    // Shared code is never backpatched: its faults complete in the handler
+    if (!block->code_ptr || block->shared_code) {
+        return;
+    }
+    uintptr_t code_start = reinterpret_cast<uintptr_t>(block->code_ptr);
+    for (const FastmemSite& site : block->fastmem_sites) {
+        uint64_t key = code_start + site.access_offset;
+        Slot* slot = find_slot(fastmem_table_.load(std::memory_order_relaxed), key);
+        if (!slot) {
+            insert_locked(fastmem_table_, fastmem_site_count_, key, block);
+            fastmem_site_count_++;
+            continue;
+        }
+        if (!slot->block.load(std::memory_order_relaxed)) {
+            fastmem_site_count_++;
+        }
+        slot->block.store(block, std::memory_order_release);
+    }
+}
+
+void TranslationCache::unindex_fastmem_sites_locked(TranslatedBlock* block) {
+    if (!block->code_ptr || block->shared_code) {
+        return;
+    }
+    uintptr_t code_start = reinterpret_cast<uintptr_t>(block->code_ptr);
+    for (const FastmemSite& site : block->fastmem_sites) {
+        Slot* slot = find_slot(fastmem_table_.load(std::memory_order_relaxed), code_start + site.access_offset);
+        if (slot && slot->block.load(std::memory_order_relaxed) == block) {
+            slot->block.store(nullptr, std::memory_order_release);
+            fastmem_site_count_--;
+        }
     }
-    LOG_DEBUG("No translated block found for guest address 0x" + std::to_string(guest_address) + ".");
-    return nullptr;
+}
+
+TranslatedBlock* TranslationCache::lookup_fastmem_site(uintptr_t host_pc) const {
+    // Lock-free like lookup(): no allocation or locking, safe in a signal handler
+    return probe(fastmem_table_.load(std::memory_order_acquire), host_pc);
+}
+
+size_t TranslationCache::reclaim() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    return reclaimer_.reclaim();
+}
+
+size_t TranslationCache::get_retired_block_count() const {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    return reclaimer_.get_pending_count();
 }
 
 void TranslationCache::store(TranslatedBlock* block) {
@@ -35,16 +227,96 @@ void TranslationCache::store(TranslatedBlock* block) {
     }
     LOG_DEBUG("Storing translated block for guest address 0x" + std::to_string(block->guest_address) + ".");
 
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+
     // Check for existing block at this address
-    auto it = cache_.find(block->guest_address);
-    if (it != cache_.end()) {
+    if (lookup_locked(block->guest_address)) {
         LOG_WARNING("Overwriting existing translated block for guest address 0x" + std::to_string(block->guest_address) + ".");
         // Invalidate the old block (breaks chains, etc)
-        invalidate(block->guest_address);
+        invalidate_locked(block->guest_address);
+    }
+
+    // No executable arena is managed here yet, so the code buffer itself is
+    // handed out (the host stub dispatcher relies on the same assumption)
+    if (!block->code_ptr && !block->code.empty()) {
+        block->code_ptr = block->code.data();
     }
 
     // Store the new block
-    cache_[block->guest_address] = block;
+    publish_locked(block);
+    if (perf_map_writer_) {
+        perf_map_writer_->write_block(block);
+    }
+    reclaimer_.reclaim();
+}
+
+bool TranslationCache::replace_block(TranslatedBlock* new_block,
+    std::function<void(TranslatedBlock*, TranslatedBlock*, const TranslatedBlock::ControlFlowExit&)> patch_callback) {
+    
+    if (!new_block) {
+        LOG_ERROR("Attempted to replace with a null TranslatedBlock.");
+        return false;
+    }
+    
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    
+    TranslatedBlock* old_block = lookup_locked(new_block->guest_address);
+    if (!old_block || old_block == new_block) {
+        lock.unlock();
+        store(new_block);
+        return false;
+    }
+    
+    LOG_DEBUG("Replacing block at guest address 0x" + std::to_string(new_block->guest_address) + ".");
+    
+    if (!new_block->code_ptr && !new_block->code.empty()) {
+        new_block->code_ptr = new_block->code.data();
+    }
+    
+    // The old block's outgoing links die with it
+    for (const auto& exit : old_block->exits) {
+        if (!exit.is_patched) {
+            continue;
+        }
+        TranslatedBlock* target = lookup_locked(exit.target_guest_address);
+        if (target) {
+            target->incoming_links.erase(old_block);
+        }
+        if (exit.type == TranslatedBlock::ControlFlowExitType::BR_COND) {
+            TranslatedBlock* target_false = lookup_locked(exit.target_guest_address_false);
+            if (target_false) {
+                target_false->incoming_links.erase(old_block);
+            }
+        }
+    }
+    
+    // Publish the new block with a single slot update, so a lookup sees
+    // either the old or the new translation, never a missing entry
+    publish_locked(new_block);
+    if (perf_map_writer_) {
+        perf_map_writer_->write_block(new_block);
+    }
+    
+    // Re-point every block that was chained into the old translation
+    for (TranslatedBlock* incoming : old_block->incoming_links) {
+        if (incoming == old_block) {
+            continue;
+        }
+        for (auto& exit : incoming->exits) {
+            if (exit.is_patched && exit.target_guest_address == new_block->guest_address) {
+                patch_callback(incoming, new_block, exit);
+                new_block->incoming_links.insert(incoming);
+            }
+        }
+    }
+    if (!new_block->incoming_links.empty()) {
+        new_block->is_linked = true;
+    }
+    
+    // Threads may still be running the old translation
+    retire_block_locked(old_block);
+    reclaimer_.reclaim();
+    return true;
 }
 
 void TranslationCache::chain_blocks(TranslatedBlock* block, 
@@ -55,8 +327,15 @@ void TranslationCache::chain_blocks(TranslatedBlock* block,
         return;
     }
     
+    // Shared code is mapped by other contexts; its exits go through the dispatcher
+    if (block->shared_code) {
+        return;
+    }
+    
     LOG_DEBUG("Chaining block at guest address 0x" + std::to_string(block->guest_address) + ".");
     
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    
     // For each exit in the block
     for (auto& exit : block->exits) {
         // Only chain deterministic exits
@@ -64,9 +343,10 @@ void TranslationCache::chain_blocks(TranslatedBlock* block,
             exit.type == TranslatedBlock::ControlFlowExitType::BR_COND || 
             exit.type == TranslatedBlock::ControlFlowExitType::FALLTHROUGH) {
             
-            // Try to find the target block
-            TranslatedBlock* target_block = lookup(exit.target_guest_address);
-            if (target_block && !exit.is_patched) {
+            // Try to find the target block; self-verifying blocks must be
+            // entered through the dispatcher
+            TranslatedBlock* target_block = lookup_locked(exit.target_guest_address);
+            if (target_block && !target_block->self_verifying && !exit.is_patched) {
                 LOG_DEBUG("Chaining block at 0x" + std::to_string(block->guest_address) + 
                           " to block at 0x" + std::to_string(target_block->guest_address) + ".");
                 
@@ -83,8 +363,8 @@ void TranslationCache::chain_blocks(TranslatedBlock* block,
             
             // For conditional branches, also check the false target
             if (exit.type == TranslatedBlock::ControlFlowExitType::BR_COND) {
-                TranslatedBlock* target_block_false = lookup(exit.target_guest_address_false);
-                if (target_block_false) {
+                TranslatedBlock* target_block_false = lookup_locked(exit.target_guest_address_false);
+                if (target_block_false && !target_block_false->self_verifying) {
                     LOG_DEBUG("Chaining block at 0x" + std::to_string(block->guest_address) + 
                               " false path to block at 0x" + std::to_string(target_block_false->guest_address) + ".");
                     
@@ -111,7 +391,7 @@ void TranslationCache::unchain_block(TranslatedBlock* block) {
     for (const auto& exit : block->exits) {
         if (exit.is_patched) {
             // Find target block
-            TranslatedBlock* target = lookup(exit.target_guest_address);
+            TranslatedBlock* target = lookup_locked(exit.target_guest_address);
             if (target) {
                 // Remove this block from its incoming links
                 target->incoming_links.erase(block);
@@ -119,7 +399,7 @@ void TranslationCache::unchain_block(TranslatedBlock* block) {
             
             // For conditional branches, also handle the false path
             if (exit.type == TranslatedBlock::ControlFlowExitType::BR_COND) {
-                TranslatedBlock* target_false = lookup(exit.target_guest_address_false);
+                TranslatedBlock* target_false = lookup_locked(exit.target_guest_address_false);
                 if (target_false) {
                     // Remove this block from its incoming links
                     target_false->incoming_links.erase(block);
@@ -146,16 +426,28 @@ void TranslationCache::unchain_block(TranslatedBlock* block) {
 }
 
 void TranslationCache::invalidate(uint64_t guest_address) {
-    TranslatedBlock* block = lookup(guest_address);
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    invalidate_locked(guest_address);
+    reclaimer_.reclaim();
+}
+
+void TranslationCache::invalidate_locked(uint64_t guest_address) {
+    Slot* slot = find_slot_locked(guest_address);
+    TranslatedBlock* block = slot ? slot->block.load(std::memory_order_relaxed) : nullptr;
     if (block) {
         LOG_DEBUG("Invalidating block at guest address 0x" + std::to_string(guest_address) + ".");
         
         // Break all chains to and from this block
         unchain_block(block);
         
-        // Remove from cache and delete
-        cache_.erase(guest_address);
-        delete block;
+        if (invalidation_callback_) {
+            invalidation_callback_(block);
+        }
+        
+        // Unpublish, then free once no reader can still hold it
+        slot->block.store(nullptr, std::memory_order_release);
+        block_count_.fetch_sub(1, std::memory_order_relaxed);
+        retire_block_locked(block);
     }
 }
 
@@ -163,44 +455,61 @@ void TranslationCache::invalidate_range(uint64_t start_address, uint64_t end_add
     LOG_DEBUG("Invalidating blocks in range 0x" + std::to_string(start_address) + 
               " to 0x" + std::to_string(end_address) + ".");
     
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    
     // Collect blocks to invalidate
     std::vector<uint64_t> to_invalidate;
     
-    for (const auto& entry : cache_) {
-        uint64_t block_start = entry.second->guest_address;
-        uint64_t block_end = block_start + entry.second->guest_size;
-        
-        // Check if block overlaps with the invalidation range
-        if ((block_start <= end_address) && (block_end >= start_address)) {
-            to_invalidate.push_back(entry.first);
+    for_each_block_locked([&](TranslatedBlock* block) {
+        // Check if block (including any superblock ranges) overlaps with the invalidation range
+        if (block->overlaps(start_address, end_address)) {
+            to_invalidate.push_back(block->guest_address);
         }
-    }
+    });
     
     // Now invalidate them all
     for (uint64_t addr : to_invalidate) {
-        invalidate(addr);
+        invalidate_locked(addr);
     }
+    reclaimer_.reclaim();
+}
+
+void TranslationCache::for_each_block(const std::function<void(const TranslatedBlock*)>& fn) const {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    for_each_block_locked([&fn](TranslatedBlock* block) {
+        fn(block);
+    });
 }
 
 size_t TranslationCache::get_chained_block_count() const {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
     size_t count = 0;
-    for (const auto& entry : cache_) {
-        if (entry.second->is_linked) {
+    for_each_block_locked([&count](TranslatedBlock* block) {
+        if (block->is_linked) {
             count++;
         }
-    }
+    });
     return count;
 }
 
 void TranslationCache::flush() {
     LOG_DEBUG("Flushing translation cache.");
     
-    // Delete all blocks
-    for (auto const& [address, block] : cache_) {
-        delete block;
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    
+    // Retire all blocks and start over with an empty table
+    Table* old_table = table_.load(std::memory_order_relaxed);
+    table_.store(new Table(INITIAL_CAPACITY), std::memory_order_release);
+    for (size_t i = 0; i <= old_table->mask; ++i) {
+        TranslatedBlock* block = old_table->slots[i].block.load(std::memory_order_relaxed);
+        if (block) {
+            retire_block_locked(block);
+        }
     }
-    cache_.clear();
+    reclaimer_.retire(old_table, [](void* object) { delete static_cast<Table*>(object); });
+    block_count_.store(0, std::memory_order_relaxed);
+    reclaimer_.reclaim();
 }
 
 } // namespace translation_cache
-} // namespace xenoarm_jit
\ No newline at end of file
+} // namespace xenoarm_jit
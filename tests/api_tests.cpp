@@ -137,7 +137,7 @@ XenoARM_JIT::GuestException ApiTest::last_exception = {XenoARM_JIT::EXCEPTION_NO
 
 // Test basic JIT initialization and shutdown
 TEST_F(ApiTest, InitShutdown) {
-    // Initialize JIT and then try to initialize again - should fail
+    // A second context can be created alongside the fixture's and is independent of it
     XenoARM_JIT::JitConfig config;
     config.page_size = 4096;
     config.log_callback = log_callback;
@@ -154,12 +154,13 @@ TEST_F(ApiTest, InitShutdown) {
     config.write_memory_u64 = write_memory_u64;
     config.write_memory_block = write_memory_block;
     
-    // Try to initialize again - should fail
     XenoARM_JIT::JitContext* context2 = XenoARM_JIT::Jit_Init(config);
-    EXPECT_EQ(context2, nullptr); // Second init should fail
+    ASSERT_NE(context2, nullptr);
+    EXPECT_NE(context2, jit);
+    EXPECT_NE(context2->translation_cache, jit->translation_cache);
+    EXPECT_NE(context2->memory_manager, jit->memory_manager);
     
-    // For the purposes of the test, we'll manually check the log output
-    EXPECT_TRUE(true); // Skip the check since we don't have a way to capture the log output
+    XenoARM_JIT::Jit_Shutdown(context2);
 }
 
 // Test translation API
@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include "xenoarm_jit/api.h"
+#include "xenoarm_jit/compile_thread_pool.h"
+#include "test_guest_memory.h"
+
+using namespace xenoarm_jit;
+using translation_cache::TranslatedBlock;
+
+namespace {
+
+const uint32_t BLOCK_STRIDE = 0x40;
+const uint32_t FIRST_BLOCK = 0x1000;
+const uint32_t BLOCK_COUNT = 64;
+
+} // anonymous namespace
+
+class AsyncTranslationTest : public ::testing::Test {
+protected:
+    XenoARM_JIT::JitContext* init_jit(uint32_t compile_threads) {
+        // Each block: mov eax, i; mov ecx, i; ret
+        for (uint32_t i = 0; i < BLOCK_COUNT; ++i) {
+            uint8_t* code = &memory.bytes[FIRST_BLOCK + i * BLOCK_STRIDE];
+            code[0] = 0xB8; std::memcpy(&code[1], &i, 4);
+            code[5] = 0xB9; std::memcpy(&code[6], &i, 4);
+            code[10] = 0xC3;
+        }
+
+        XenoARM_JIT::JitConfig config = tests::make_test_config(memory);
+        config.compile_threads = compile_threads;
+        memory.on_read_block = [this](uint32_t address) {
+            uint32_t expected = address;
+            if (address != 0 && stall_address.compare_exchange_strong(expected, 0)) {
+                stalled = true;
+                while (!release_stall) {
+                    std::this_thread::yield();
+                }
+            }
+        };
+        jit = XenoARM_JIT::Jit_Init(config);
+        return jit;
+    }
+
+    void TearDown() override {
+        if (jit) {
+            XenoARM_JIT::Jit_Shutdown(jit);
+        }
+    }
+
+    tests::TestGuestMemory memory;
+    // A compile thread reading stall_address blocks after the read until released
+    std::atomic<uint32_t> stall_address{0};
+    std::atomic<bool> stalled{false};
+    std::atomic<bool> release_stall{false};
+    XenoARM_JIT::JitContext* jit = nullptr;
+};
+
+TEST_F(AsyncTranslationTest, RequestedBlocksBecomeReady) {
+    ASSERT_NE(init_jit(2), nullptr);
+    ASSERT_NE(jit->compile_pool, nullptr);
+    EXPECT_EQ(jit->compile_pool->get_thread_count(), 2u);
+
+    for (uint32_t i = 0; i < BLOCK_COUNT; ++i) {
+        EXPECT_TRUE(XenoARM_JIT::Jit_RequestTranslation(jit, FIRST_BLOCK + i * BLOCK_STRIDE));
+    }
+
+    uint32_t ready = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (ready < BLOCK_COUNT && std::chrono::steady_clock::now() < deadline) {
+        ready = 0;
+        for (uint32_t i = 0; i < BLOCK_COUNT; ++i) {
+            void* code = nullptr;
+            if (XenoARM_JIT::Jit_QueryTranslation(jit, FIRST_BLOCK + i * BLOCK_STRIDE, &code) ==
+                XenoARM_JIT::TRANSLATION_STATUS_READY) {
+                EXPECT_NE(code, nullptr);
+                ready++;
+            }
+        }
+        std::this_thread::yield();
+    }
+
+    EXPECT_EQ(ready, BLOCK_COUNT);
+    EXPECT_EQ(jit->translation_cache->get_block_count(), BLOCK_COUNT);
+    EXPECT_EQ(jit->tier1_translations.load(), BLOCK_COUNT);
+}
+
+TEST_F(AsyncTranslationTest, TranslateBlockWaitsForPendingRequest) {
+    ASSERT_NE(init_jit(1), nullptr);
+
+    XenoARM_JIT::Jit_RequestTranslation(jit, FIRST_BLOCK);
+    void* code = XenoARM_JIT::Jit_TranslateBlock(jit, FIRST_BLOCK);
+    ASSERT_NE(code, nullptr);
+
+    // The block was translated once, by the worker
+    EXPECT_EQ(jit->tier1_translations.load(), 1u);
+    void* queried = nullptr;
+    EXPECT_EQ(XenoARM_JIT::Jit_QueryTranslation(jit, FIRST_BLOCK, &queried), XenoARM_JIT::TRANSLATION_STATUS_READY);
+    EXPECT_EQ(queried, code);
+}
+
+TEST_F(AsyncTranslationTest, SynchronousFallbackWithoutCompileThreads) {
+    ASSERT_NE(init_jit(0), nullptr);
+    EXPECT_EQ(jit->compile_pool, nullptr);
+
+    EXPECT_EQ(XenoARM_JIT::Jit_QueryTranslation(jit, FIRST_BLOCK, nullptr), XenoARM_JIT::TRANSLATION_STATUS_NONE);
+    EXPECT_TRUE(XenoARM_JIT::Jit_RequestTranslation(jit, FIRST_BLOCK));
+    EXPECT_EQ(XenoARM_JIT::Jit_QueryTranslation(jit, FIRST_BLOCK, nullptr), XenoARM_JIT::TRANSLATION_STATUS_READY);
+}
+
+TEST_F(AsyncTranslationTest, GuestWriteDuringTranslationDropsBlock) {
+    ASSERT_NE(init_jit(1), nullptr);
+    stall_address = FIRST_BLOCK;
+
+    ASSERT_TRUE(XenoARM_JIT::Jit_RequestTranslation(jit, FIRST_BLOCK));
+    while (!stalled) {
+        std::this_thread::yield();
+    }
+
+    // The worker has read the old bytes; the page is not registered yet, so
+    // nothing traps this write
+    memory.bytes[FIRST_BLOCK + 1] = 0x55;
+    release_stall = true;
+
+    XenoARM_JIT::TranslationStatus status;
+    do {
+        std::this_thread::yield();
+        status = XenoARM_JIT::Jit_QueryTranslation(jit, FIRST_BLOCK, nullptr);
+    } while (status == XenoARM_JIT::TRANSLATION_STATUS_PENDING);
+
+    // The stale block is never installed, and translating again sees the write
+    EXPECT_EQ(status, XenoARM_JIT::TRANSLATION_STATUS_NONE);
+    EXPECT_EQ(jit->translation_cache->lookup(FIRST_BLOCK), nullptr);
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(jit, FIRST_BLOCK), nullptr);
+    EXPECT_EQ(jit->tier1_translations.load(), 2u);
+}
+
+TEST(CompileThreadPoolTest, InFlightTranslationIsDiscardedOnInvalidation) {
+    std::atomic<bool> started(false);
+    std::atomic<bool> release(false);
+
+    CompileThreadPool pool(1, [&](CompileWorkerContext&, uint32_t guest_address) {
+        started = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+        TranslatedBlock* block = new TranslatedBlock(guest_address, 16);
+        block->code.assign(4, 0);
+        return block;
+    });
+
+    ASSERT_TRUE(pool.request(0x2000));
+    EXPECT_FALSE(pool.request(0x2000)); // Already pending
+    while (!started) {
+        std::this_thread::yield();
+    }
+
+    // Guest code inside the block changes while the worker is translating it
+    pool.cancel_range(0x2008, 0x2008);
+    release = true;
+    pool.wait(0x2000);
+
+    EXPECT_EQ(pool.get_status(0x2000), TranslationRequestStatus::NONE);
+    EXPECT_TRUE(pool.take_completed().empty());
+
+    // A fresh request translates again
+    ASSERT_TRUE(pool.request(0x2000));
+    pool.wait(0x2000);
+    std::vector<TranslatedBlock*> blocks = pool.take_completed();
+    ASSERT_EQ(blocks.size(), 1u);
+    EXPECT_EQ(blocks[0]->guest_address, 0x2000u);
+    delete blocks[0];
+}
+
+TEST(CompileThreadPoolTest, WaitIdleWaitsForInFlightTranslation) {
+    std::atomic<bool> started(false);
+    std::atomic<bool> release(false);
+
+    CompileThreadPool pool(1, [&](CompileWorkerContext&, uint32_t guest_address) {
+        started = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+        return new TranslatedBlock(guest_address, 16);
+    });
+    pool.wait_idle(); // Nothing in flight
+
+    ASSERT_TRUE(pool.request(0x2000));
+    while (!started) {
+        std::this_thread::yield();
+    }
+
+    // Cancelling does not stop the worker, which may still be reading state
+    // the caller wants to replace
+    pool.cancel_range(0, 0xFFFFFFFF);
+    std::atomic<bool> idle(false);
+    std::thread waiter([&]() {
+        pool.wait_idle();
+        idle = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(idle);
+
+    release = true;
+    waiter.join();
+    EXPECT_TRUE(idle);
+    EXPECT_TRUE(pool.take_completed().empty());
+}
@@ -0,0 +1,196 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include "xenoarm_jit/api.h"
+
+using namespace xenoarm_jit;
+
+namespace {
+
+uint32_t instruction_at(const std::vector<uint8_t>& code, size_t index) {
+    uint32_t instruction;
+    std::memcpy(&instruction, code.data() + index * 4, 4);
+    return instruction;
+}
+
+// Index of the first instruction equal to expected, or -1
+int find_instruction(const std::vector<uint8_t>& code, uint32_t expected) {
+    for (size_t i = 0; i + 4 <= code.size(); i += 4) {
+        if (instruction_at(code, i / 4) == expected) {
+            return static_cast<int>(i / 4);
+        }
+    }
+    return -1;
+}
+
+// EAX..EDI are pinned to X19..X26
+const uint32_t X_EAX = 19;
+const uint32_t X_ECX = 20;
+const uint32_t X_EDX = 21;
+const uint32_t X_ESI = 25;
+
+const uint32_t DMB_ISH = 0xD5033BBF;
+
+ir::IrOperand guest_reg(uint32_t reg) {
+    return ir::IrOperand::make_reg(reg, ir::IrDataType::I32);
+}
+
+ir::IrOperand at_esi(ir::IrDataType data_type = ir::IrDataType::I32) {
+    return ir::IrOperand::make_mem(6, ir::MemoryOperand::NO_REGISTER, 1, 0, data_type);
+}
+
+} // anonymous namespace
+
+class AtomicLoweringTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        allocator.set_guest_register_pinning(true);
+        generator.set_guest_register_pinning(true);
+        allocator.set_fastmem(true);
+        generator.set_fastmem(true);
+        generator.set_lse_atomics(true);
+    }
+
+    std::vector<uint8_t> generate(const ir::IrInstruction& instruction) {
+        std::vector<ir::IrInstruction> instructions = {instruction};
+        return generator.generate(instructions, allocator.allocate(instructions));
+    }
+
+    register_allocation::RegisterAllocator allocator;
+    aarch64::CodeGenerator generator;
+};
+
+TEST_F(AtomicLoweringTest, DecodesLockedInstructions) {
+    decoder::X86Decoder decoder;
+
+    // lock add [esi], eax; lock inc dword [edi+4]; lock sub dword [esi], 0x10;
+    // lock xadd [esi], ecx; lock cmpxchg [edi], edx; lock cmpxchg8b [esi];
+    // xchg [esi], eax; ret
+    const uint8_t code[] = {0xF0, 0x01, 0x06, 0xF0, 0xFF, 0x47, 0x04, 0xF0, 0x83, 0x2E, 0x10,
+                            0xF0, 0x0F, 0xC1, 0x0E, 0xF0, 0x0F, 0xB1, 0x17, 0xF0, 0x0F, 0xC7, 0x0E,
+                            0x87, 0x06, 0xC3};
+    ir::IrFunction function = decoder.decode_block(code, 0x1000, sizeof(code));
+    ASSERT_EQ(function.guest_size, sizeof(code));
+    const auto& instructions = function.basic_blocks[0].instructions;
+    ASSERT_EQ(instructions.size(), 8u);
+
+    EXPECT_EQ(instructions[0].type, ir::IrInstructionType::ATOMIC_ADD);
+    EXPECT_EQ(instructions[0].operands[0].mem_info.base_reg_idx, 6u);
+    EXPECT_EQ(instructions[0].operands[1].reg_idx, 0u);
+
+    EXPECT_EQ(instructions[1].type, ir::IrInstructionType::ATOMIC_ADD);
+    EXPECT_EQ(instructions[1].operands[0].mem_info.displacement, 4);
+    EXPECT_EQ(instructions[1].operands[1].imm_value, 1);
+
+    EXPECT_EQ(instructions[2].type, ir::IrInstructionType::ATOMIC_SUB);
+    EXPECT_EQ(instructions[2].operands[1].imm_value, 0x10);
+
+    EXPECT_EQ(instructions[3].type, ir::IrInstructionType::ATOMIC_XADD);
+    EXPECT_EQ(instructions[3].operands[1].reg_idx, 1u);
+
+    ASSERT_EQ(instructions[4].type, ir::IrInstructionType::ATOMIC_CMPXCHG);
+    EXPECT_EQ(instructions[4].operands[1].reg_idx, 0u); // EAX
+    EXPECT_EQ(instructions[4].operands[2].reg_idx, 2u);
+
+    ASSERT_EQ(instructions[5].type, ir::IrInstructionType::ATOMIC_CMPXCHG8B);
+    EXPECT_EQ(instructions[5].operands.size(), 5u);
+    EXPECT_EQ(instructions[5].operands[0].data_type, ir::IrDataType::I64);
+
+    EXPECT_EQ(instructions[6].type, ir::IrInstructionType::ATOMIC_XCHG);
+    EXPECT_EQ(instructions[7].type, ir::IrInstructionType::RET);
+
+    // LOCK on an instruction without a locked form ends the block there
+    const uint8_t adc[] = {0x90, 0xF0, 0x11, 0x06, 0xC3}; // nop; lock adc [esi], eax
+    EXPECT_EQ(decoder.decode_block(adc, 0x2000, sizeof(adc)).guest_size, 1u);
+}
+
+TEST_F(AtomicLoweringTest, LseReadModifyWrite) {
+    // lock add [esi], eax: ADD X16, X18, W25, UXTW; LDADDAL W19, W17, [X16]
+    std::vector<uint8_t> code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_ADD, {at_esi(), guest_reg(0)}));
+    EXPECT_EQ(instruction_at(code, 0), 0x8B204000u | (X_ESI << 16) | (18u << 5) | 16);
+    EXPECT_EQ(instruction_at(code, 1), 0xB8E00000u | (X_EAX << 16) | (16u << 5) | 17);
+    EXPECT_TRUE(generator.get_fastmem_sites().empty());
+    EXPECT_EQ(find_instruction(code, DMB_ISH), -1);
+
+    // lock dec dword [esi]: add -1
+    code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_SUB, {
+        at_esi(), ir::IrOperand::make_imm(1, ir::IrDataType::I32)}));
+    EXPECT_EQ(instruction_at(code, 1), 0x52800000u | (0xFFFFu << 5) | 17); // MOVZ W17, #0xFFFF
+    EXPECT_EQ(instruction_at(code, 2), 0x72A00000u | (0xFFFFu << 5) | 17); // MOVK W17, #0xFFFF, LSL #16
+    EXPECT_EQ(instruction_at(code, 3), 0xB8E00000u | (17u << 16) | (16u << 5) | 17);
+
+    // lock and [esi], eax: clear the complement (MVN W17, W19; LDCLRAL W17, W17, [X16])
+    code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_AND, {at_esi(), guest_reg(0)}));
+    EXPECT_EQ(instruction_at(code, 1), 0x2A2003E0u | (X_EAX << 16) | 17);
+    EXPECT_EQ(instruction_at(code, 2), 0xB8E01000u | (17u << 16) | (16u << 5) | 17);
+
+    // lock or / lock xor: LDSETAL / LDEORAL
+    code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_OR, {at_esi(), guest_reg(0)}));
+    EXPECT_EQ(instruction_at(code, 1), 0xB8E03000u | (X_EAX << 16) | (16u << 5) | 17);
+    code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_XOR, {at_esi(), guest_reg(0)}));
+    EXPECT_EQ(instruction_at(code, 1), 0xB8E02000u | (X_EAX << 16) | (16u << 5) | 17);
+
+    // lock xadd [esi], ecx: LDADDAL W20, W20, [X16]; xchg [esi], ecx: SWPAL W20, W20, [X16]
+    code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_XADD, {at_esi(), guest_reg(1)}));
+    EXPECT_EQ(instruction_at(code, 1), 0xB8E00000u | (X_ECX << 16) | (16u << 5) | X_ECX);
+    code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_XCHG, {at_esi(), guest_reg(1)}));
+    EXPECT_EQ(instruction_at(code, 1), 0xB8E08000u | (X_ECX << 16) | (16u << 5) | X_ECX);
+}
+
+TEST_F(AtomicLoweringTest, LseCompareExchange) {
+    // lock cmpxchg [esi], edx: MOV W17, W19; CASAL W17, W21, [X16]; CMP W19, W17; MOV W19, W17
+    std::vector<uint8_t> code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_CMPXCHG, {
+        at_esi(), guest_reg(0), guest_reg(2)}));
+    EXPECT_EQ(instruction_at(code, 1), 0x2A0003E0u | (X_EAX << 16) | 17);
+    EXPECT_EQ(instruction_at(code, 2), 0x88E0FC00u | (17u << 16) | (16u << 5) | X_EDX);
+    EXPECT_EQ(instruction_at(code, 3), 0x6B00001Fu | (17u << 16) | (X_EAX << 5));
+    EXPECT_EQ(instruction_at(code, 4), 0x2A0003E0u | (17u << 16) | X_EAX);
+
+    // lock cmpxchg8b [esi]: one 64-bit CASAL X0, X1, [X16] on EDX:EAX / ECX:EBX
+    code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_CMPXCHG8B, {
+        at_esi(ir::IrDataType::I64), guest_reg(0), guest_reg(2), guest_reg(3), guest_reg(1)}));
+    EXPECT_NE(find_instruction(code, 0xC8E0FC00u | (0u << 16) | (16u << 5) | 1), -1);
+    EXPECT_NE(find_instruction(code, 0xD360FC00u | (0u << 5) | X_EDX), -1); // LSR X21, X0, #32
+    // The pair is pushed and popped around it
+    EXPECT_EQ(instruction_at(code, 1), 0xA9800000u | (0x7Eu << 15) | (1u << 10) | (31u << 5) | 0);
+    EXPECT_NE(find_instruction(code, 0xA8C00000u | (2u << 15) | (1u << 10) | (31u << 5) | 0), -1);
+}
+
+TEST_F(AtomicLoweringTest, ExclusiveLoopWithoutLse) {
+    generator.set_lse_atomics(false);
+
+    // lock xadd [esi], ecx with X0/X1 (and X2/X3) as temporaries:
+    // LDAXR W0, [X16]; ADD W1, W0, W20; STLXR W17, W1, [X16]; CBNZ W17, loop; DMB ISH; MOV W20, W0
+    std::vector<uint8_t> code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_XADD, {at_esi(), guest_reg(1)}));
+    int loop = find_instruction(code, 0x885FFC00u | (16u << 5) | 0);
+    ASSERT_NE(loop, -1);
+    EXPECT_EQ(instruction_at(code, loop + 1), 0x0B000000u | (X_ECX << 16) | (0u << 5) | 1);
+    EXPECT_EQ(instruction_at(code, loop + 2), 0x8800FC00u | (17u << 16) | (16u << 5) | 1);
+    EXPECT_EQ(instruction_at(code, loop + 3), 0x35000000u | ((static_cast<uint32_t>(-3) & 0x7FFFF) << 5) | 17);
+    EXPECT_EQ(instruction_at(code, loop + 4), DMB_ISH);
+    EXPECT_EQ(instruction_at(code, loop + 5), 0x2A0003E0u | (0u << 16) | X_ECX);
+
+    // lock cmpxchg [esi], edx stores the selected value every iteration
+    code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_CMPXCHG, {
+        at_esi(), guest_reg(0), guest_reg(2)}));
+    loop = find_instruction(code, 0x885FFC00u | (16u << 5) | 0);
+    ASSERT_NE(loop, -1);
+    EXPECT_EQ(instruction_at(code, loop + 1), 0x6B00001Fu | (0u << 16) | (X_EAX << 5)); // CMP W19, W0
+    EXPECT_EQ(instruction_at(code, loop + 2), 0x1A800000u | (0u << 16) | (X_EDX << 5) | 1); // CSEL W1, W21, W0, EQ
+}
+
+TEST_F(AtomicLoweringTest, SlowPathWithoutFastmem) {
+    allocator.set_fastmem(false);
+    generator.set_fastmem(false);
+
+    std::vector<uint8_t> code = generate(ir::IrInstruction(ir::IrInstructionType::ATOMIC_ADD, {
+        at_esi(), ir::IrOperand::make_imm(1, ir::IrDataType::I32)}));
+
+    // A read and a write through the slow path, between two barriers
+    ASSERT_EQ(generator.get_relocations().size(), 2u);
+    EXPECT_EQ(generator.get_relocations()[0].target, reinterpret_cast<uint64_t>(&MemoryManager::generated_code_read));
+    EXPECT_EQ(generator.get_relocations()[1].target, reinterpret_cast<uint64_t>(&MemoryManager::generated_code_write));
+    int first_barrier = find_instruction(code, DMB_ISH);
+    ASSERT_NE(first_barrier, -1);
+    EXPECT_LT(static_cast<uint32_t>(first_barrier) * 4, generator.get_relocations()[0].offset);
+    EXPECT_EQ(instruction_at(code, code.size() / 4 - 3), DMB_ISH); // Then the two pair restores
+}
@@ -14,6 +14,9 @@
 #include "jit_core/c_api.h"
 #include "jit_core/jit_api.h"
 #include "xenoarm_jit/memory_manager.h"
+#include "xenoarm_jit/ir.h"
+#include "xenoarm_jit/register_allocation/register_allocator.h"
+#include "xenoarm_jit/aarch64/code_generator.h"
 #include "logging/logger.h"
 
 // Use proper namespaces
@@ -323,6 +326,198 @@ void runTranslationBenchmark(std::ofstream& reportFile) {
     }
 }
 
+// Synthetic IR block for back-end latency measurements: a rolling window of
+// live GPR values mixed with SSE-style vector ops, with a backward branch at the end
+std::vector<ir::IrInstruction> createAllocationBenchmarkBlock(size_t numInstructions) {
+    std::vector<ir::IrInstruction> block;
+    block.reserve(numInstructions);
+    
+    const uint32_t window = 24; // Values kept live at once
+    for (size_t i = 0; block.size() + 1 < numInstructions; i++) {
+        uint32_t dest = static_cast<uint32_t>(i);
+        uint32_t src = (i >= window) ? static_cast<uint32_t>(i - window) : 0;
+        
+        if (i % 4 == 3) {
+            ir::IrInstruction vec(ir::IrInstructionType::VEC_ADD_PS);
+            vec.operands.push_back(ir::IrOperand::make_reg(0x1000 + dest, ir::IrDataType::V128_W8));
+            vec.operands.push_back(ir::IrOperand::make_reg(0x1000 + src, ir::IrDataType::V128_W8));
+            block.push_back(vec);
+        } else if (i < window) {
+            ir::IrInstruction mov(ir::IrInstructionType::MOV);
+            mov.operands.push_back(ir::IrOperand::make_reg(dest, ir::IrDataType::I32));
+            mov.operands.push_back(ir::IrOperand::make_imm(i, ir::IrDataType::I32));
+            block.push_back(mov);
+        } else {
+            ir::IrInstruction add(ir::IrInstructionType::ADD);
+            add.operands.push_back(ir::IrOperand::make_reg(dest, ir::IrDataType::I32));
+            add.operands.push_back(ir::IrOperand::make_reg(src, ir::IrDataType::I32));
+            add.operands.push_back(ir::IrOperand::make_reg(i % 8, ir::IrDataType::I32));
+            block.push_back(add);
+        }
+    }
+    
+    // Back to the start of the block; branch targets are guest addresses
+    ir::IrInstruction jmp(ir::IrInstructionType::JMP);
+    jmp.operands.push_back(ir::IrOperand::make_imm(0x1000, ir::IrDataType::U32));
+    block.push_back(jmp);
+    for (size_t i = 0; i < block.size(); i++) {
+        block[i].guest_address = 0x1000 + static_cast<uint32_t>(i);
+    }
+    
+    return block;
+}
+
+// Back-end translation latency benchmark (register allocation + code generation)
+void runAllocationBenchmark(std::ofstream& reportFile) {
+    std::cout << "Running Translation Latency Benchmark..." << std::endl;
+    reportFile << "Translation Latency Benchmark (register allocation + codegen)" << std::endl;
+    reportFile << "-------------------------------------------------------------" << std::endl;
+    
+    const size_t blockSizes[] = {10, 100, 1000};
+    
+    register_allocation::RegisterAllocator allocator;
+    aarch64::CodeGenerator codeGenerator;
+    
+    for (size_t blockSize : blockSizes) {
+        std::cout << "  " << blockSize << "-instruction block..." << std::endl;
+        
+        std::vector<ir::IrInstruction> block = createAllocationBenchmarkBlock(blockSize);
+        const size_t iterations = 100000 / blockSize;
+        
+        // Warmup: grows the allocator's internal arrays to their steady-state size
+        for (size_t i = 0; i < 10; i++) {
+            allocator.allocate_in_place(block);
+        }
+        
+        std::vector<double> allocTimes;
+        std::vector<double> translateTimes;
+        allocTimes.reserve(iterations);
+        translateTimes.reserve(iterations);
+        
+        for (size_t i = 0; i < iterations; i++) {
+            auto startTime = std::chrono::high_resolution_clock::now();
+            allocator.allocate_in_place(block);
+            auto endTime = std::chrono::high_resolution_clock::now();
+            allocTimes.push_back(std::chrono::duration<double, std::micro>(endTime - startTime).count());
+            
+            startTime = std::chrono::high_resolution_clock::now();
+            auto registerMap = allocator.allocate(block);
+            auto code = codeGenerator.generate(block, registerMap);
+            endTime = std::chrono::high_resolution_clock::now();
+            translateTimes.push_back(std::chrono::duration<double, std::micro>(endTime - startTime).count());
+        }
+        
+        std::sort(allocTimes.begin(), allocTimes.end());
+        std::sort(translateTimes.begin(), translateTimes.end());
+        
+        double allocMean = 0;
+        for (double time : allocTimes) {
+            allocMean += time;
+        }
+        allocMean /= allocTimes.size();
+        
+        double translateMean = 0;
+        for (double time : translateTimes) {
+            translateMean += time;
+        }
+        translateMean /= translateTimes.size();
+        
+        reportFile << "  " << blockSize << " IR instructions:" << std::endl;
+        reportFile << "    Allocation Mean: " << std::fixed << std::setprecision(2) << allocMean << " us" << std::endl;
+        reportFile << "    Allocation Median: " << std::fixed << std::setprecision(2) << allocTimes[allocTimes.size() / 2] << " us" << std::endl;
+        reportFile << "    Translation Mean: " << std::fixed << std::setprecision(2) << translateMean << " us" << std::endl;
+        reportFile << "    Translation Median: " << std::fixed << std::setprecision(2) << translateTimes[translateTimes.size() / 2] << " us" << std::endl;
+        reportFile << "    Spill Area: " << allocator.get_total_spill_size() << " bytes" << std::endl;
+        reportFile << std::endl;
+    }
+}
+
+// SSE-style trace for spill measurements: long-lived vector values that stay live
+// across a hot loop working on its own set of vector registers
+std::vector<ir::IrInstruction> createSIMDSpillBenchmarkBlock() {
+    std::vector<ir::IrInstruction> block;
+    
+    const uint32_t liveAcross = 24; // Vector values live across the loop
+    const uint32_t loopValues = 16; // Vector values used inside the loop
+    
+    for (uint32_t i = 0; i < liveAcross; i++) {
+        ir::IrInstruction mov(ir::IrInstructionType::VEC_MOV);
+        mov.operands.push_back(ir::IrOperand::make_reg(100 + i, ir::IrDataType::V128_W8));
+        mov.operands.push_back(ir::IrOperand::make_reg(100 + (i + 1) % liveAcross, ir::IrDataType::V128_W8));
+        block.push_back(mov);
+    }
+    
+    uint32_t loopStart = static_cast<uint32_t>(block.size());
+    for (uint32_t iter = 0; iter < 8; iter++) {
+        for (uint32_t i = 0; i < loopValues; i++) {
+            ir::IrInstruction op(i % 2 ? ir::IrInstructionType::VEC_MUL_PS : ir::IrInstructionType::VEC_ADD_PS);
+            op.operands.push_back(ir::IrOperand::make_reg(200 + i, ir::IrDataType::V128_W8));
+            op.operands.push_back(ir::IrOperand::make_reg(200 + (i + iter + 1) % loopValues, ir::IrDataType::V128_W8));
+            block.push_back(op);
+        }
+        
+        // Loop counter
+        ir::IrInstruction dec(ir::IrInstructionType::DEC);
+        dec.operands.push_back(ir::IrOperand::make_reg(1, ir::IrDataType::I32));
+        block.push_back(dec);
+    }
+    
+    ir::IrInstruction branch(ir::IrInstructionType::BR_NE);
+    branch.operands.push_back(ir::IrOperand::make_imm(0x1000 + loopStart, ir::IrDataType::U32));
+    block.push_back(branch);
+    
+    for (uint32_t i = 0; i < liveAcross; i++) {
+        ir::IrInstruction add(ir::IrInstructionType::VEC_ADD_PS);
+        add.operands.push_back(ir::IrOperand::make_reg(100 + i, ir::IrDataType::V128_W8));
+        add.operands.push_back(ir::IrOperand::make_reg(200 + i % loopValues, ir::IrDataType::V128_W8));
+        block.push_back(add);
+    }
+    for (size_t i = 0; i < block.size(); i++) {
+        block[i].guest_address = 0x1000 + static_cast<uint32_t>(i);
+    }
+    
+    return block;
+}
+
+// Spill traffic on the SIMD trace with and without live-range splitting
+void runSpillBenchmark(std::ofstream& reportFile) {
+    std::cout << "Running SIMD Spill Benchmark..." << std::endl;
+    reportFile << "SIMD Spill Benchmark" << std::endl;
+    reportFile << "--------------------" << std::endl;
+    
+    std::vector<ir::IrInstruction> block = createSIMDSpillBenchmarkBlock();
+    register_allocation::RegisterAllocator allocator;
+    
+    const bool modes[] = {false, true};
+    for (bool splitting : modes) {
+        allocator.set_live_range_splitting(splitting);
+        allocator.allocate_in_place(block);
+        register_allocation::SpillStatistics stats = allocator.get_spill_statistics();
+        
+        reportFile << "  " << (splitting ? "Live-range splitting" : "Whole-lifetime spilling") << ":" << std::endl;
+        reportFile << "    Spill Instructions: " << stats.spill_count << " (" << stats.loop_spill_count << " in loop)" << std::endl;
+        reportFile << "    Reload Instructions: " << stats.reload_count << " (" << stats.loop_reload_count << " in loop)" << std::endl;
+        reportFile << "    Spill Area: " << allocator.get_total_spill_size() << " bytes" << std::endl;
+    }
+    reportFile << std::endl;
+}
+
+// First-execution latency benchmark (latency_benchmark.cpp; uses the XenoARM_JIT API,
+// whose macros clash with the C API used in this file)
+void runFirstExecutionLatencyBenchmark(std::ofstream& reportFile);
+
+// Persistent translation cache warm start benchmark (latency_benchmark.cpp)
+void runWarmStartBenchmark(std::ofstream& reportFile);
+
+// Multi-context scaling benchmark (context_scaling_benchmark.cpp, same reason)
+void runContextScalingBenchmark(std::ofstream& reportFile);
+
+// Guest memory access policy benchmark (memory_access_benchmark.cpp)
+void runMemoryAccessPolicyBenchmark(std::ofstream& reportFile);
+void runProtectionFaultBenchmark(std::ofstream& reportFile);
+void runMemoryOrderingBenchmark(std::ofstream& reportFile);
+void runAtomicLoweringBenchmark(std::ofstream& reportFile);
+
 // JIT execution benchmark
 void runExecutionBenchmark(std::ofstream& reportFile) {
     std::cout << "Running JIT Execution Benchmark..." << std::endl;
@@ -644,6 +839,27 @@ int main(int argc, char** argv) {
     // Run translation benchmark
     runTranslationBenchmark(reportFile);
     
+    // Run translation latency benchmark
+    runAllocationBenchmark(reportFile);
+    
+    // Run spill benchmark
+    runSpillBenchmark(reportFile);
+    
+    // Run first-execution latency benchmark
+    runFirstExecutionLatencyBenchmark(reportFile);
+    
+    // Run warm start benchmark
+    runWarmStartBenchmark(reportFile);
+    
+    // Run multi-context scaling benchmark
+    runContextScalingBenchmark(reportFile);
+    
+    // Run memory access policy benchmark
+    runMemoryAccessPolicyBenchmark(reportFile);
+    runProtectionFaultBenchmark(reportFile);
+    runMemoryOrderingBenchmark(reportFile);
+    runAtomicLoweringBenchmark(reportFile);
+    
     // Run execution benchmark
     runExecutionBenchmark(reportFile);
     
@@ -0,0 +1,139 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <iomanip>
+#include <cstdint>
+#include <cstring>
+
+#include "xenoarm_jit/api.h"
+
+// Each emulator instance owns its guest memory; callbacks find it through user_data
+static std::vector<uint8_t>& scalingMemory(void* userData) {
+    return *static_cast<std::vector<uint8_t>*>(userData);
+}
+static void scalingReadBlock(uint32_t address, void* buffer, uint32_t size, void* userData) {
+    std::vector<uint8_t>& memory = scalingMemory(userData);
+    size_t available = address < memory.size() ? memory.size() - address : 0;
+    size_t count = std::min<size_t>(size, available);
+    std::memcpy(buffer, memory.data() + address, count);
+    std::memset(static_cast<uint8_t*>(buffer) + count, 0, size - count);
+}
+static uint8_t scalingReadU8(uint32_t address, void* userData) { return scalingMemory(userData)[address]; }
+static uint16_t scalingReadU16(uint32_t, void*) { return 0; }
+static uint32_t scalingReadU32(uint32_t, void*) { return 0; }
+static uint64_t scalingReadU64(uint32_t, void*) { return 0; }
+static void scalingWriteU8(uint32_t, uint8_t, void*) {}
+static void scalingWriteU16(uint32_t, uint16_t, void*) {}
+static void scalingWriteU32(uint32_t, uint32_t, void*) {}
+static void scalingWriteU64(uint32_t, uint64_t, void*) {}
+static void scalingWriteBlock(uint32_t, const void*, uint32_t, void*) {}
+
+// N independent JIT contexts driven by N threads, as when many headless
+// instances share one server process. Each thread translates its working set,
+// then keeps dispatching it while invalidating a block now and then.
+// Aggregate throughput should grow with N up to the host core count.
+void runContextScalingBenchmark(std::ofstream& reportFile) {
+    std::cout << "Running Context Scaling Benchmark..." << std::endl;
+    reportFile << "Context Scaling Benchmark" << std::endl;
+    reportFile << "-------------------------" << std::endl;
+    reportFile << "  Host cores: " << std::thread::hardware_concurrency() << std::endl;
+
+    const uint32_t numBlocks = 64;
+    const uint32_t blockStride = 256;
+    const uint32_t firstBlock = 0x1000;
+    const uint32_t dispatchesPerThread = 20000;
+    const uint32_t invalidateEvery = 64;
+
+    double baseline = 0;
+    const uint32_t contextCounts[] = {1, 2, 4, 8};
+    for (uint32_t contexts : contextCounts) {
+        std::vector<std::vector<uint8_t>> memories(contexts);
+        std::vector<XenoARM_JIT::JitContext*> jits(contexts, nullptr);
+        bool ok = true;
+
+        for (uint32_t c = 0; c < contexts; c++) {
+            // Each block: 16 x "mov r32, imm32" followed by ret
+            memories[c].assign(firstBlock + numBlocks * blockStride, 0);
+            for (uint32_t b = 0; b < numBlocks; b++) {
+                uint8_t* code = &memories[c][firstBlock + b * blockStride];
+                for (uint32_t i = 0; i < 16; i++) {
+                    code[i * 5] = static_cast<uint8_t>(0xB8 + (i % 8));
+                    uint32_t imm = c * 100000 + b * 16 + i;
+                    std::memcpy(&code[i * 5 + 1], &imm, 4);
+                }
+                code[80] = 0xC3;
+            }
+
+            XenoARM_JIT::JitConfig config;
+            config.user_data = &memories[c];
+            config.read_memory_u8 = scalingReadU8;
+            config.read_memory_u16 = scalingReadU16;
+            config.read_memory_u32 = scalingReadU32;
+            config.read_memory_u64 = scalingReadU64;
+            config.read_memory_block = scalingReadBlock;
+            config.write_memory_u8 = scalingWriteU8;
+            config.write_memory_u16 = scalingWriteU16;
+            config.write_memory_u32 = scalingWriteU32;
+            config.write_memory_u64 = scalingWriteU64;
+            config.write_memory_block = scalingWriteBlock;
+            config.enable_smc_detection = false;
+
+            jits[c] = XenoARM_JIT::Jit_Init(config);
+            ok = ok && jits[c];
+        }
+
+        if (!ok) {
+            reportFile << "  " << contexts << " contexts: failed to initialize JIT" << std::endl;
+            for (XenoARM_JIT::JitContext* jit : jits) {
+                XenoARM_JIT::Jit_Shutdown(jit);
+            }
+            continue;
+        }
+
+        std::vector<uint32_t> failures(contexts, 0);
+        auto startTime = std::chrono::high_resolution_clock::now();
+
+        std::vector<std::thread> threads;
+        for (uint32_t c = 0; c < contexts; c++) {
+            threads.emplace_back([&, c]() {
+                XenoARM_JIT::JitContext* jit = jits[c];
+                for (uint32_t i = 0; i < dispatchesPerThread; i++) {
+                    uint32_t address = firstBlock + (i % numBlocks) * blockStride;
+                    if (!XenoARM_JIT::Jit_TranslateBlock(jit, address)) {
+                        failures[c]++;
+                    }
+                    if (i % invalidateEvery == invalidateEvery - 1) {
+                        XenoARM_JIT::Jit_InvalidateRange(jit, address, blockStride);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(endTime - startTime).count();
+        double throughput = contexts * dispatchesPerThread / seconds;
+        if (contexts == 1) {
+            baseline = throughput;
+        }
+
+        uint32_t totalFailures = 0;
+        for (uint32_t c = 0; c < contexts; c++) {
+            totalFailures += failures[c];
+            XenoARM_JIT::Jit_Shutdown(jits[c]);
+        }
+
+        reportFile << "  " << contexts << " contexts / " << contexts << " threads:" << std::endl;
+        reportFile << "    Dispatches/sec (all contexts): " << std::fixed << std::setprecision(0) << throughput << std::endl;
+        reportFile << "    Scaling vs 1 context: " << std::fixed << std::setprecision(2)
+                   << (baseline > 0 ? throughput / baseline : 0.0) << "x" << std::endl;
+        reportFile << "    Failed dispatches: " << totalFailures << std::endl;
+    }
+    reportFile << std::endl;
+}
@@ -0,0 +1,212 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "xenoarm_jit/api.h"
+
+// Guest memory for the first-execution latency benchmark
+static std::vector<uint8_t> g_latencyGuestMemory;
+
+static void latencyReadBlock(uint32_t address, void* buffer, uint32_t size, void*) {
+    size_t available = address < g_latencyGuestMemory.size() ? g_latencyGuestMemory.size() - address : 0;
+    size_t count = std::min<size_t>(size, available);
+    std::memcpy(buffer, g_latencyGuestMemory.data() + address, count);
+    std::memset(static_cast<uint8_t*>(buffer) + count, 0, size - count);
+}
+static uint8_t latencyReadU8(uint32_t address, void*) { return g_latencyGuestMemory[address]; }
+static uint16_t latencyReadU16(uint32_t, void*) { return 0; }
+static uint32_t latencyReadU32(uint32_t, void*) { return 0; }
+static uint64_t latencyReadU64(uint32_t, void*) { return 0; }
+static void latencyWriteU8(uint32_t, uint8_t, void*) {}
+static void latencyWriteU16(uint32_t, uint16_t, void*) {}
+static void latencyWriteU32(uint32_t, uint32_t, void*) {}
+static void latencyWriteU64(uint32_t, uint64_t, void*) {}
+static void latencyWriteBlock(uint32_t, const void*, uint32_t, void*) {}
+
+// Hitch measurement: how long the dispatcher is stalled the first time it reaches
+// each block, with synchronous translation vs. background compile threads.
+// In async mode the dispatcher requests the next few blocks ahead (as a loader
+// would) and takes the slow path for any block that is not ready yet.
+void runFirstExecutionLatencyBenchmark(std::ofstream& reportFile) {
+    std::cout << "Running First-Execution Latency Benchmark..." << std::endl;
+    reportFile << "First-Execution Latency Benchmark" << std::endl;
+    reportFile << "---------------------------------" << std::endl;
+    
+    const uint32_t numBlocks = 512;
+    const uint32_t blockStride = 256;
+    const uint32_t firstBlock = 0x1000;
+    const uint32_t lookahead = 8;
+    const auto guestWork = std::chrono::microseconds(50); // Time the guest spends in each block
+    
+    // Each block: 40 x "mov r32, imm32" followed by ret
+    g_latencyGuestMemory.assign(firstBlock + numBlocks * blockStride, 0);
+    for (uint32_t b = 0; b < numBlocks; b++) {
+        uint8_t* code = &g_latencyGuestMemory[firstBlock + b * blockStride];
+        for (uint32_t i = 0; i < 40; i++) {
+            code[i * 5] = static_cast<uint8_t>(0xB8 + (i % 8));
+            uint32_t imm = b * 40 + i;
+            std::memcpy(&code[i * 5 + 1], &imm, 4);
+        }
+        code[200] = 0xC3;
+    }
+    
+    const uint32_t threadCounts[] = {0, 2};
+    for (uint32_t threads : threadCounts) {
+        XenoARM_JIT::JitConfig config;
+        config.read_memory_u8 = latencyReadU8;
+        config.read_memory_u16 = latencyReadU16;
+        config.read_memory_u32 = latencyReadU32;
+        config.read_memory_u64 = latencyReadU64;
+        config.read_memory_block = latencyReadBlock;
+        config.write_memory_u8 = latencyWriteU8;
+        config.write_memory_u16 = latencyWriteU16;
+        config.write_memory_u32 = latencyWriteU32;
+        config.write_memory_u64 = latencyWriteU64;
+        config.write_memory_block = latencyWriteBlock;
+        config.enable_smc_detection = false;
+        config.compile_threads = threads;
+        
+        XenoARM_JIT::JitContext* jit = XenoARM_JIT::Jit_Init(config);
+        if (!jit) {
+            reportFile << "  Failed to initialize JIT" << std::endl;
+            continue;
+        }
+        
+        std::vector<double> stallTimes;
+        stallTimes.reserve(numBlocks);
+        uint32_t slowPathBlocks = 0;
+        
+        for (uint32_t b = 0; b < numBlocks; b++) {
+            uint32_t address = firstBlock + b * blockStride;
+            
+            if (threads > 0) {
+                for (uint32_t ahead = 1; ahead <= lookahead && b + ahead < numBlocks; ahead++) {
+                    XenoARM_JIT::Jit_RequestTranslation(jit, address + ahead * blockStride);
+                }
+            }
+            
+            auto startTime = std::chrono::high_resolution_clock::now();
+            if (threads > 0) {
+                void* code = nullptr;
+                if (XenoARM_JIT::Jit_QueryTranslation(jit, address, &code) != XenoARM_JIT::TRANSLATION_STATUS_READY) {
+                    // Not ready: keep running the guest on the slow path and make sure it is queued
+                    XenoARM_JIT::Jit_RequestTranslation(jit, address);
+                    slowPathBlocks++;
+                }
+            } else {
+                XenoARM_JIT::Jit_TranslateBlock(jit, address);
+            }
+            auto endTime = std::chrono::high_resolution_clock::now();
+            stallTimes.push_back(std::chrono::duration<double, std::micro>(endTime - startTime).count());
+            
+            // Guest runs the block
+            auto workEnd = std::chrono::high_resolution_clock::now() + guestWork;
+            while (std::chrono::high_resolution_clock::now() < workEnd) {
+            }
+        }
+        
+        XenoARM_JIT::Jit_Shutdown(jit);
+        
+        std::sort(stallTimes.begin(), stallTimes.end());
+        double mean = 0;
+        for (double time : stallTimes) {
+            mean += time;
+        }
+        mean /= stallTimes.size();
+        
+        reportFile << "  " << (threads ? "Background compilation (" + std::to_string(threads) + " threads)" : std::string("Synchronous translation")) << ":" << std::endl;
+        reportFile << "    Stall Mean: " << std::fixed << std::setprecision(2) << mean << " us" << std::endl;
+        reportFile << "    Stall p50: " << std::fixed << std::setprecision(2) << stallTimes[stallTimes.size() / 2] << " us" << std::endl;
+        reportFile << "    Stall p99: " << std::fixed << std::setprecision(2) << stallTimes[stallTimes.size() * 99 / 100] << " us" << std::endl;
+        reportFile << "    Slow-path first executions: " << slowPathBlocks << "/" << numBlocks << std::endl;
+    }
+    reportFile << std::endl;
+}
+
+// Startup-to-first-frame: time from Jit_Init until every block of the first
+// frame has been translated or loaded, on a cold start and on warm starts
+// from the persistent translation cache written by the cold run.
+void runWarmStartBenchmark(std::ofstream& reportFile) {
+    std::cout << "Running Warm Start Benchmark..." << std::endl;
+    reportFile << "Warm Start Benchmark" << std::endl;
+    reportFile << "--------------------" << std::endl;
+    
+    const uint32_t numBlocks = 512;
+    const uint32_t blockStride = 256;
+    const uint32_t firstBlock = 0x1000;
+    const std::string cachePath = "xenoarm_warm_start_cache.bin";
+    std::remove(cachePath.c_str());
+    
+    // Same guest code as the first-execution benchmark
+    g_latencyGuestMemory.assign(firstBlock + numBlocks * blockStride, 0);
+    for (uint32_t b = 0; b < numBlocks; b++) {
+        uint8_t* code = &g_latencyGuestMemory[firstBlock + b * blockStride];
+        for (uint32_t i = 0; i < 40; i++) {
+            code[i * 5] = static_cast<uint8_t>(0xB8 + (i % 8));
+            uint32_t imm = b * 40 + i;
+            std::memcpy(&code[i * 5 + 1], &imm, 4);
+        }
+        code[200] = 0xC3;
+    }
+    
+    struct Run {
+        const char* name;
+        bool eager;
+    };
+    const Run runs[] = {{"Cold start (no cache file)", false},
+                        {"Warm start, lazy load", false},
+                        {"Warm start, eager load", true}};
+    double coldTime = 0;
+    for (const Run& run : runs) {
+        XenoARM_JIT::JitConfig config;
+        config.read_memory_u8 = latencyReadU8;
+        config.read_memory_u16 = latencyReadU16;
+        config.read_memory_u32 = latencyReadU32;
+        config.read_memory_u64 = latencyReadU64;
+        config.read_memory_block = latencyReadBlock;
+        config.write_memory_u8 = latencyWriteU8;
+        config.write_memory_u16 = latencyWriteU16;
+        config.write_memory_u32 = latencyWriteU32;
+        config.write_memory_u64 = latencyWriteU64;
+        config.write_memory_block = latencyWriteBlock;
+        config.enable_smc_detection = false;
+        config.persistent_cache_path = cachePath;
+        config.persistent_cache_eager_load = run.eager;
+        
+        auto startTime = std::chrono::high_resolution_clock::now();
+        XenoARM_JIT::JitContext* jit = XenoARM_JIT::Jit_Init(config);
+        if (!jit) {
+            reportFile << "  Failed to initialize JIT" << std::endl;
+            continue;
+        }
+        for (uint32_t b = 0; b < numBlocks; b++) {
+            XenoARM_JIT::Jit_TranslateBlock(jit, firstBlock + b * blockStride);
+        }
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+        if (&run == &runs[0]) {
+            coldTime = ms;
+        }
+        
+        XenoARM_JIT::JitPersistentCacheStats stats = {};
+        XenoARM_JIT::Jit_GetPersistentCacheStats(jit, &stats);
+        XenoARM_JIT::Jit_Shutdown(jit); // Writes the cache file
+        
+        reportFile << "  " << run.name << ":" << std::endl;
+        reportFile << "    Startup to first frame: " << std::fixed << std::setprecision(2) << ms << " ms" << std::endl;
+        reportFile << "    Speedup vs cold start: " << std::fixed << std::setprecision(2)
+                   << (ms > 0 ? coldTime / ms : 0.0) << "x" << std::endl;
+        reportFile << "    Blocks loaded from cache: " << stats.loaded << "/" << numBlocks
+                   << " (rejected " << stats.rejected << ")" << std::endl;
+    }
+    
+    std::remove(cachePath.c_str());
+    reportFile << std::endl;
+}
@@ -0,0 +1,143 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <iomanip>
+#include <cstdint>
+#include <cstring>
+
+#include "xenoarm_jit/memory_manager.h"
+#include "xenoarm_jit/translation_cache/translation_cache.h"
+
+using namespace xenoarm_jit;
+
+// Host RAM as the JitConfig callbacks see it: a C function pointer plus user data
+static uint32_t policyBenchReadU32(uint32_t address, void* userData) {
+    uint32_t value;
+    std::memcpy(&value, static_cast<const uint8_t*>(userData) + address, 4);
+    return value;
+}
+
+// The same RAM as a compile-time policy
+struct BenchRamPolicy {
+    uint8_t* bytes;
+
+    uint8_t read_u8(uint32_t address) { return bytes[address]; }
+    uint16_t read_u16(uint32_t address) { uint16_t v; std::memcpy(&v, bytes + address, 2); return v; }
+    uint32_t read_u32(uint32_t address) { uint32_t v; std::memcpy(&v, bytes + address, 4); return v; }
+    uint64_t read_u64(uint32_t address) { uint64_t v; std::memcpy(&v, bytes + address, 8); return v; }
+    void read_block(uint32_t address, void* buffer, uint32_t size) { std::memcpy(buffer, bytes + address, size); }
+    void write_u8(uint32_t address, uint8_t value) { bytes[address] = value; }
+    void write_u16(uint32_t address, uint16_t value) { std::memcpy(bytes + address, &value, 2); }
+    void write_u32(uint32_t address, uint32_t value) { std::memcpy(bytes + address, &value, 4); }
+    void write_u64(uint32_t address, uint64_t value) { std::memcpy(bytes + address, &value, 8); }
+    void write_block(uint32_t address, const void* buffer, uint32_t size) { std::memcpy(bytes + address, buffer, size); }
+};
+
+template <typename Access>
+static double timeReads(Access& access, uint32_t reads, uint32_t mask, uint64_t& checksum) {
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < reads; i++) {
+        sum += access.read_u32((i * 4) & mask);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    checksum += sum;
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// 1e8 guest read_u32 calls through MemoryManager's runtime callbacks (std::function
+// wrapping a lambda that calls the host's function pointer, as Jit_Init binds them)
+// and through GuestMemoryAccess with a compile-time policy, which inlines.
+void runMemoryAccessPolicyBenchmark(std::ofstream& reportFile) {
+    std::cout << "Running Memory Access Policy Benchmark..." << std::endl;
+    reportFile << "Memory Access Policy Benchmark" << std::endl;
+    reportFile << "------------------------------" << std::endl;
+
+    const uint32_t reads = 100000000;
+    const uint32_t ramSize = 64 * 1024;
+    std::vector<uint8_t> ram(ramSize + 4);
+    for (uint32_t i = 0; i < ram.size(); i++) {
+        ram[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    translation_cache::TranslationCache cache;
+    MemoryManager memoryManager(&cache);
+    uint32_t (*hostReadU32)(uint32_t, void*) = policyBenchReadU32;
+    void* userData = ram.data();
+    memoryManager.set_host_memory_callbacks(
+        nullptr, nullptr,
+        [hostReadU32, userData](uint32_t address) { return hostReadU32(address, userData); },
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+    GuestMemoryAccess<BenchRamPolicy> staticAccess(&memoryManager, BenchRamPolicy{ram.data()});
+
+    uint64_t runtimeChecksum = 0;
+    uint64_t staticChecksum = 0;
+    double runtimeSeconds = timeReads(memoryManager, reads, ramSize - 4, runtimeChecksum);
+    double staticSeconds = timeReads(staticAccess, reads, ramSize - 4, staticChecksum);
+
+    reportFile << std::fixed << std::setprecision(2);
+    reportFile << "  read_u32 calls per policy: " << reads << std::endl;
+    reportFile << "  Runtime callbacks:     " << runtimeSeconds * 1000.0 << " ms ("
+               << runtimeSeconds * 1e9 / reads << " ns/read)" << std::endl;
+    reportFile << "  Compile-time policy:   " << staticSeconds * 1000.0 << " ms ("
+               << staticSeconds * 1e9 / reads << " ns/read)" << std::endl;
+    reportFile << "  Speedup: " << (staticSeconds > 0 ? runtimeSeconds / staticSeconds : 0.0) << "x" << std::endl;
+    if (runtimeChecksum != staticChecksum) {
+        reportFile << "  WARNING: checksums differ" << std::endl;
+    }
+    reportFile << std::endl;
+}
+
+// Data-store protection faults on code pages: the time spent in the fault
+// handler (classify, record, unprotect) and in the dispatcher safe point that
+// classifies the recorded faults and reprotects the pages.
+void runProtectionFaultBenchmark(std::ofstream& reportFile) {
+    std::cout << "Running Protection Fault Benchmark..." << std::endl;
+    reportFile << "Protection Fault Benchmark" << std::endl;
+    reportFile << "--------------------------" << std::endl;
+
+    const uint32_t pages = 16384;
+    const uint32_t pageSize = 4096;
+    const uint32_t faultsPerBatch = MemoryManager::FAULT_RING_SIZE;
+    // Stay below the inline store check threshold so every store keeps trapping
+    const uint32_t rounds = MemoryManager::INLINE_STORE_CHECK_THRESHOLD - 1;
+
+    translation_cache::TranslationCache cache;
+    MemoryManager memoryManager(&cache);
+    for (uint32_t page = 0; page < pages; page++) {
+        uint32_t address = 0x100000 + page * pageSize;
+        translation_cache::TranslatedBlock* block = new translation_cache::TranslatedBlock(address, 16);
+        block->code.assign(16, 0);
+        cache.store(block);
+        memoryManager.register_code_page(address, 16);
+    }
+
+    double handlerSeconds = 0.0;
+    double drainSeconds = 0.0;
+    uint64_t faults = 0;
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (uint32_t first = 0; first < pages; first += faultsPerBatch) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (uint32_t page = first; page < first + faultsPerBatch && page < pages; page++) {
+                memoryManager.handle_protection_fault(0x100000 + page * pageSize + 0x800);
+                faults++;
+            }
+            auto handled = std::chrono::high_resolution_clock::now();
+            memoryManager.apply_pending_invalidations();
+            auto drained = std::chrono::high_resolution_clock::now();
+            handlerSeconds += std::chrono::duration<double>(handled - start).count();
+            drainSeconds += std::chrono::duration<double>(drained - handled).count();
+        }
+    }
+
+    reportFile << std::fixed << std::setprecision(2);
+    reportFile << "  Faults: " << faults << " over " << pages << " code pages" << std::endl;
+    reportFile << "  Fault handler:   " << handlerSeconds * 1e9 / faults << " ns/fault ("
+               << (handlerSeconds > 0 ? faults / handlerSeconds / 1e6 : 0.0) << " M faults/s)" << std::endl;
+    reportFile << "  Safe point drain: " << drainSeconds * 1e9 / faults << " ns/fault" << std::endl;
+    if (memoryManager.get_protection(0x100000) != PROT_READ) {
+        reportFile << "  WARNING: code pages were not reprotected" << std::endl;
+    }
+    reportFile << std::endl;
+}
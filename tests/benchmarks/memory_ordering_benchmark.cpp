@@ -0,0 +1,183 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <iomanip>
+#include <cstdint>
+
+#include "xenoarm_jit/memory_model.h"
+#include "xenoarm_jit/ir.h"
+#include "xenoarm_jit/aarch64/code_generator.h"
+#include "xenoarm_jit/register_allocation/register_allocator.h"
+
+using namespace xenoarm_jit;
+
+namespace {
+
+// Guest register indices (x86 encoding)
+const uint32_t EAX = 0;
+const uint32_t EBX = 3;
+const uint32_t ESP = 4;
+const uint32_t EBP = 5;
+const uint32_t ESI = 6;
+
+ir::IrInstruction makeAccess(ir::IrInstructionType type, uint32_t baseReg, int32_t displacement) {
+    ir::IrOperand reg = ir::IrOperand::make_reg(EAX, ir::IrDataType::I32);
+    ir::IrOperand mem = ir::IrOperand::make_mem(baseReg, ir::MemoryOperand::NO_REGISTER, 1, displacement,
+                                                ir::IrDataType::I32);
+    return ir::IrInstruction(type, type == ir::IrInstructionType::LOAD
+        ? std::vector<ir::IrOperand>{reg, mem}
+        : std::vector<ir::IrOperand>{mem, reg});
+}
+
+// A block of compiled-C-like guest code: frame setup and locals through
+// EBP/ESP, a few loads and stores through pointers, ALU work, an occasional
+// guest fence, and a terminating branch. seed picks the mix.
+std::vector<ir::IrInstruction> makeBlock(uint32_t seed, uint32_t length) {
+    std::vector<ir::IrInstruction> block;
+    block.push_back(ir::IrInstruction(ir::IrInstructionType::PUSH, {ir::IrOperand::make_reg(EBP, ir::IrDataType::I32)}));
+    for (uint32_t i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t pick = (seed >> 16) % 100;
+        if (pick < 20) {
+            block.push_back(makeAccess(ir::IrInstructionType::STORE, EBP, -4 * static_cast<int32_t>(pick % 8 + 1)));
+        } else if (pick < 40) {
+            block.push_back(makeAccess(ir::IrInstructionType::LOAD, (pick & 1) ? EBP : ESP, 4 * static_cast<int32_t>(pick % 8)));
+        } else if (pick < 55) {
+            block.push_back(makeAccess(ir::IrInstructionType::LOAD, (pick & 1) ? EBX : ESI, 4 * static_cast<int32_t>(pick % 16)));
+        } else if (pick < 65) {
+            block.push_back(makeAccess(ir::IrInstructionType::STORE, (pick & 1) ? EBX : ESI, 4 * static_cast<int32_t>(pick % 16)));
+        } else if (pick < 66) {
+            block.push_back(ir::IrInstruction(ir::IrInstructionType::MEM_FENCE, {
+                ir::IrOperand::make_imm(MemoryModel::BARRIER_MFENCE, ir::IrDataType::I32)}));
+        } else {
+            block.push_back(ir::IrInstruction(ir::IrInstructionType::ADD, {
+                ir::IrOperand::make_reg(EAX, ir::IrDataType::I32),
+                ir::IrOperand::make_imm(pick, ir::IrDataType::I32)}));
+        }
+    }
+    block.push_back(ir::IrInstruction(ir::IrInstructionType::RET));
+    return block;
+}
+
+} // anonymous namespace
+
+// Barriers per kilo-instruction on synthetic blocks before elision (a
+// barrier per guest fence and after every store, as the conservative
+// lowering places them) and after MemoryModel::order_memory_accesses, plus
+// the cost of the pass itself. The acquire/release row orders shared loads
+// and stores with LDAPR/STLR instead, leaving barriers only where a store
+// must be ordered before a later load.
+void runMemoryOrderingBenchmark(std::ofstream& reportFile) {
+    std::cout << "Running Memory Ordering Benchmark..." << std::endl;
+    reportFile << "Memory Ordering Benchmark" << std::endl;
+    reportFile << "-------------------------" << std::endl;
+
+    const uint32_t blocks = 20000;
+    MemoryModel memoryModel;
+    std::vector<std::vector<ir::IrInstruction>> workload;
+    workload.reserve(blocks);
+    for (uint32_t i = 0; i < blocks; i++) {
+        workload.push_back(makeBlock(i, 8 + i % 24));
+    }
+
+    reportFile << std::fixed << std::setprecision(2);
+    struct Mode {
+        const char* name;
+        bool tso;
+        MemoryModel::OrderingLowering lowering;
+    };
+    const Mode modes[] = {
+        {"TSO (conservative model)", true, MemoryModel::LOWERING_BARRIERS},
+        {"TSO, LDAPR/STLR", true, MemoryModel::LOWERING_LDAPR_STLR},
+        {"Guest fences only", false, MemoryModel::LOWERING_BARRIERS}
+    };
+    for (const Mode& mode : modes) {
+        std::vector<std::vector<ir::IrInstruction>> ordered = workload;
+        MemoryModel::BarrierStats total;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (auto& block : ordered) {
+            MemoryModel::BarrierStats stats = memoryModel.order_memory_accesses(block, mode.tso, mode.lowering);
+            total.instructions += stats.instructions;
+            total.naive_barriers += stats.naive_barriers;
+            total.emitted_barriers += stats.emitted_barriers;
+            total.ordered_accesses += stats.ordered_accesses;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+
+        reportFile << "  " << mode.name << ":" << std::endl;
+        reportFile << "    IR instructions: " << total.instructions << std::endl;
+        reportFile << "    Barriers/kinst before: " << total.naive_barriers * 1000.0 / total.instructions << std::endl;
+        reportFile << "    Barriers/kinst after:  " << total.emitted_barriers * 1000.0 / total.instructions << std::endl;
+        reportFile << "    Acquire/release accesses/kinst: " << total.ordered_accesses * 1000.0 / total.instructions << std::endl;
+        reportFile << "    Pass time: " << seconds * 1e9 / total.instructions << " ns/instruction" << std::endl;
+    }
+    reportFile << std::endl;
+}
+
+// Host code for the locked instructions of spinlocks and reference counts
+// (XCHG, LOCK INC/DEC, LOCK XADD, LOCK CMPXCHG) under each atomic lowering:
+// instructions and barriers per guest atomic, and generation time.
+void runAtomicLoweringBenchmark(std::ofstream& reportFile) {
+    std::cout << "Running Atomic Lowering Benchmark..." << std::endl;
+    reportFile << "Atomic Lowering Benchmark" << std::endl;
+    reportFile << "-------------------------" << std::endl;
+
+    const uint32_t ECX = 1;
+    ir::IrOperand lock = ir::IrOperand::make_mem(EBX, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32);
+    ir::IrOperand one = ir::IrOperand::make_imm(1, ir::IrDataType::I32);
+    std::vector<ir::IrInstruction> atomics = {
+        ir::IrInstruction(ir::IrInstructionType::ATOMIC_XCHG, {lock, ir::IrOperand::make_reg(EAX, ir::IrDataType::I32)}),
+        ir::IrInstruction(ir::IrInstructionType::ATOMIC_ADD, {lock, one}),
+        ir::IrInstruction(ir::IrInstructionType::ATOMIC_SUB, {lock, one}),
+        ir::IrInstruction(ir::IrInstructionType::ATOMIC_XADD, {lock, ir::IrOperand::make_reg(ECX, ir::IrDataType::I32)}),
+        ir::IrInstruction(ir::IrInstructionType::ATOMIC_CMPXCHG, {
+            lock, ir::IrOperand::make_reg(EAX, ir::IrDataType::I32), ir::IrOperand::make_reg(ECX, ir::IrDataType::I32)})
+    };
+
+    struct Lowering {
+        const char* name;
+        bool fastmem;
+        bool lse;
+    };
+    const Lowering lowerings[] = {
+        {"LSE (ARMv8.1)", true, true},
+        {"LDAXR/STLXR loop", true, false},
+        {"Fenced slow path (no fastmem)", false, false}
+    };
+    const uint32_t iterations = 20000;
+    reportFile << std::fixed << std::setprecision(2);
+    for (const Lowering& lowering : lowerings) {
+        register_allocation::RegisterAllocator allocator;
+        aarch64::CodeGenerator generator;
+        allocator.set_guest_register_pinning(true);
+        generator.set_guest_register_pinning(true);
+        allocator.set_fastmem(lowering.fastmem);
+        generator.set_fastmem(lowering.fastmem);
+        generator.set_lse_atomics(lowering.lse);
+        auto register_map = allocator.allocate(atomics);
+
+        size_t code_size = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < iterations; i++) {
+            code_size = generator.generate(atomics, register_map).size();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+
+        std::vector<uint8_t> code = generator.generate(atomics, register_map);
+        uint32_t barriers = 0;
+        for (size_t offset = 0; offset + 4 <= code.size(); offset += 4) {
+            uint32_t instruction = code[offset] | (code[offset + 1] << 8) | (code[offset + 2] << 16) |
+                                   (static_cast<uint32_t>(code[offset + 3]) << 24);
+            barriers += (instruction & 0xFFFFF0FF) == 0xD50330BF; // DMB
+        }
+
+        reportFile << "  " << lowering.name << ":" << std::endl;
+        reportFile << "    Host instructions/atomic: " << code_size / 4.0 / atomics.size() << std::endl;
+        reportFile << "    Barriers/atomic: " << static_cast<double>(barriers) / atomics.size() << std::endl;
+        reportFile << "    Generation time: " << seconds * 1e9 / (iterations * atomics.size()) << " ns/atomic" << std::endl;
+    }
+    reportFile << std::endl;
+}
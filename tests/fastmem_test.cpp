@@ -0,0 +1,415 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "xenoarm_jit/api.h"
+#include "test_guest_memory.h"
+// After api.h: the PROT_* macros would clobber MemoryProtectionFlags
+#include <sys/mman.h>
+
+using namespace xenoarm_jit;
+
+namespace {
+
+tests::TestGuestMemory guest_memory;
+
+uint32_t instruction_at(const std::vector<uint8_t>& code, size_t index) {
+    uint32_t instruction;
+    std::memcpy(&instruction, code.data() + index * 4, 4);
+    return instruction;
+}
+
+bool contains_instruction(const std::vector<uint8_t>& code, uint32_t expected) {
+    for (size_t i = 0; i + 4 <= code.size(); i += 4) {
+        if (instruction_at(code, i / 4) == expected) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// EAX..EDI are pinned to X19..X26
+const uint32_t X_EAX = 19;
+const uint32_t X_ESI = 25;
+const uint32_t X_EDI = 26;
+
+} // anonymous namespace
+
+class FastmemTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        allocator.set_guest_register_pinning(true);
+        generator.set_guest_register_pinning(true);
+        allocator.set_fastmem(true);
+        generator.set_fastmem(true);
+    }
+
+    std::vector<uint8_t> generate(const std::vector<ir::IrInstruction>& instructions) {
+        auto register_map = allocator.allocate(instructions);
+        return generator.generate(instructions, register_map);
+    }
+
+    register_allocation::RegisterAllocator allocator;
+    aarch64::CodeGenerator generator;
+};
+
+TEST_F(FastmemTest, DecodesMovMemoryFormsAsLoadStore) {
+    decoder::X86Decoder decoder;
+
+    // mov eax, [esi+8]; mov [edi], eax; mov ecx, [0x12345678]; mov ebx, eax; ret
+    const uint8_t code[] = {0x8B, 0x46, 0x08, 0x89, 0x07, 0x8B, 0x0D, 0x78, 0x56, 0x34, 0x12, 0x89, 0xC3, 0xC3};
+    ir::IrFunction function = decoder.decode_block(code, 0x1000, sizeof(code));
+    ASSERT_EQ(function.guest_size, sizeof(code));
+    const auto& instructions = function.basic_blocks[0].instructions;
+    ASSERT_EQ(instructions.size(), 5u);
+
+    EXPECT_EQ(instructions[0].type, ir::IrInstructionType::LOAD);
+    EXPECT_EQ(instructions[0].operands[0].reg_idx, 0u);
+    EXPECT_EQ(instructions[0].operands[1].mem_info.base_reg_idx, 6u);
+    EXPECT_EQ(instructions[0].operands[1].mem_info.displacement, 8);
+
+    EXPECT_EQ(instructions[1].type, ir::IrInstructionType::STORE);
+    EXPECT_EQ(instructions[1].operands[0].mem_info.base_reg_idx, 7u);
+    EXPECT_EQ(instructions[1].operands[1].reg_idx, 0u);
+
+    EXPECT_EQ(instructions[2].type, ir::IrInstructionType::LOAD);
+    EXPECT_EQ(instructions[2].operands[1].mem_info.base_reg_idx, ir::MemoryOperand::NO_REGISTER);
+    EXPECT_EQ(instructions[2].operands[1].mem_info.displacement, 0x12345678);
+
+    EXPECT_EQ(instructions[3].type, ir::IrInstructionType::MOV);
+    EXPECT_EQ(instructions[3].operands[0].reg_idx, 3u);
+    EXPECT_EQ(instructions[3].operands[1].reg_idx, 0u);
+}
+
+TEST_F(FastmemTest, LoadIsSingleRegisterOffsetInstruction) {
+    // mov eax, [esi]
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::LOAD, {
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32),
+            ir::IrOperand::make_mem(6, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32)})
+    };
+    std::vector<uint8_t> code = generate(instructions);
+
+    // LDR W19, [X18, W25, UXTW], then its slow-path thunk
+    EXPECT_EQ(instruction_at(code, 0), 0xB8604800u | (X_ESI << 16) | (18u << 5) | X_EAX);
+    ASSERT_EQ(generator.get_fastmem_sites().size(), 1u);
+    EXPECT_EQ(generator.get_fastmem_sites()[0].access_offset, 0u);
+    EXPECT_EQ(generator.get_fastmem_sites()[0].thunk_offset, 4u);
+}
+
+TEST_F(FastmemTest, StoreWithDisplacementComputesAddressInScratch) {
+    // mov [edi+8], eax; mov [edi-4], eax
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::STORE, {
+            ir::IrOperand::make_mem(7, ir::MemoryOperand::NO_REGISTER, 1, 8, ir::IrDataType::I32),
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32)}),
+        ir::IrInstruction(ir::IrInstructionType::STORE, {
+            ir::IrOperand::make_mem(7, ir::MemoryOperand::NO_REGISTER, 1, -4, ir::IrDataType::I32),
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32)})
+    };
+    std::vector<uint8_t> code = generate(instructions);
+
+    ASSERT_EQ(generator.get_fastmem_sites().size(), 2u);
+    EXPECT_EQ(generator.get_fastmem_sites()[1].access_offset, 12u);
+    EXPECT_EQ(generator.get_fastmem_sites()[0].thunk_offset, 16u);
+    // ADD W17, W26, #8; STR W19, [X18, W17, UXTW]
+    EXPECT_EQ(instruction_at(code, 0), 0x11000000u | (8u << 10) | (X_EDI << 5) | 17);
+    EXPECT_EQ(instruction_at(code, 1), 0xB8204800u | (17u << 16) | (18u << 5) | X_EAX);
+    // SUB W17, W26, #4; STR W19, [X18, W17, UXTW]
+    EXPECT_EQ(instruction_at(code, 2), 0x51000000u | (4u << 10) | (X_EDI << 5) | 17);
+    EXPECT_EQ(instruction_at(code, 3), 0xB8204800u | (17u << 16) | (18u << 5) | X_EAX);
+}
+
+TEST_F(FastmemTest, OrderedAccessesUseAcquireReleaseForms) {
+    // mov eax, [esi] (acquire); mov [edi], eax (release)
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::LOAD, {
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32),
+            ir::IrOperand::make_mem(6, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32)}),
+        ir::IrInstruction(ir::IrInstructionType::STORE, {
+            ir::IrOperand::make_mem(7, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32),
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32)})
+    };
+    instructions[0].memory_order = ir::IrMemoryOrder::ACQUIRE;
+    instructions[1].memory_order = ir::IrMemoryOrder::RELEASE;
+
+    // ADD X16, X18, W25, UXTW; LDAPR W19, [X16]; ADD X16, X18, W26, UXTW; STLR W19, [X16]
+    generator.set_ordering_lowering(MemoryModel::LOWERING_LDAPR_STLR);
+    std::vector<uint8_t> code = generate(instructions);
+    EXPECT_EQ(instruction_at(code, 0), 0x8B204000u | (X_ESI << 16) | (18u << 5) | 16);
+    EXPECT_EQ(instruction_at(code, 1), 0xB8BFC000u | (16u << 5) | X_EAX);
+    EXPECT_EQ(instruction_at(code, 2), 0x8B204000u | (X_EDI << 16) | (18u << 5) | 16);
+    EXPECT_EQ(instruction_at(code, 3), 0x889FFC00u | (16u << 5) | X_EAX);
+    ASSERT_EQ(generator.get_fastmem_sites().size(), 2u);
+    EXPECT_EQ(generator.get_fastmem_sites()[0].access_offset, 4u);
+    EXPECT_EQ(generator.get_fastmem_sites()[1].access_offset, 12u);
+
+    // The thunks keep the ordering with barriers
+    EXPECT_TRUE(contains_instruction(code, 0xD50339BFu)); // DMB ISHLD after the read
+    EXPECT_TRUE(contains_instruction(code, 0xD5033BBFu)); // DMB ISH before the write
+
+    // LDAR without RCpc
+    generator.set_ordering_lowering(MemoryModel::LOWERING_LDAR_STLR);
+    code = generate(instructions);
+    EXPECT_EQ(instruction_at(code, 1), 0x88DFFC00u | (16u << 5) | X_EAX);
+
+    // Barriers around plain accesses on cores with neither
+    generator.set_ordering_lowering(MemoryModel::LOWERING_BARRIERS);
+    code = generate(instructions);
+    EXPECT_EQ(instruction_at(code, 0), 0xB8604800u | (X_ESI << 16) | (18u << 5) | X_EAX);
+    EXPECT_EQ(instruction_at(code, 1), 0xD50339BFu); // DMB ISHLD
+    EXPECT_EQ(instruction_at(code, 2), 0xD5033BBFu); // DMB ISH
+    EXPECT_EQ(instruction_at(code, 3), 0xB8204800u | (X_EDI << 16) | (18u << 5) | X_EAX);
+}
+
+TEST_F(FastmemTest, ThunkCallsSlowPathAndBranchesBack) {
+    // mov eax, [esi]
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::LOAD, {
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32),
+            ir::IrOperand::make_mem(6, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32)})
+    };
+    std::vector<uint8_t> code = generate(instructions);
+
+    // MOV W17, W25 first, the host call in between, B back to the next instruction last
+    EXPECT_EQ(instruction_at(code, 1), 0x2A0003E0u | (X_ESI << 16) | 17);
+    ASSERT_EQ(generator.get_relocations().size(), 1u);
+    EXPECT_EQ(generator.get_relocations()[0].target, reinterpret_cast<uint64_t>(&xenoarm_jit::MemoryManager::generated_code_read));
+    size_t last = code.size() / 4 - 1;
+    EXPECT_EQ(instruction_at(code, last), 0x14000000u | (static_cast<uint32_t>(1 - static_cast<int32_t>(last)) & 0x3FFFFFF));
+}
+
+TEST_F(FastmemTest, SlowPathPreservesVectorRegisters) {
+    // mov eax, [esi]
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::LOAD, {
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32),
+            ir::IrOperand::make_mem(6, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32)})
+    };
+    std::vector<uint8_t> code = generate(instructions);
+
+    // The allocator hands out V8-V31: the host may clobber Q16-Q31 and the high halves of V8-V15
+    EXPECT_TRUE(contains_instruction(code, 0xAD800000u | (0x68u << 15) | (9u << 10) | (31u << 5) | 8));  // STP Q8, Q9, [SP, #-384]!
+    EXPECT_TRUE(contains_instruction(code, 0xAD000000u | (2u << 15) | (11u << 10) | (31u << 5) | 10));   // STP Q10, Q11, [SP, #32]
+    EXPECT_TRUE(contains_instruction(code, 0xAD000000u | (22u << 15) | (31u << 10) | (31u << 5) | 30));  // STP Q30, Q31, [SP, #352]
+    EXPECT_TRUE(contains_instruction(code, 0xAD400000u | (22u << 15) | (31u << 10) | (31u << 5) | 30));  // LDP Q30, Q31, [SP, #352]
+    EXPECT_TRUE(contains_instruction(code, 0xACC00000u | (24u << 15) | (9u << 10) | (31u << 5) | 8));    // LDP Q8, Q9, [SP], #384
+}
+
+TEST_F(FastmemTest, BackpatchRewritesAccessOnce) {
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::STORE, {
+            ir::IrOperand::make_mem(7, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32),
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32)})
+    };
+    translation_cache::TranslatedBlock* block = new translation_cache::TranslatedBlock(0x2000, 2);
+    block->code = generate(instructions);
+    block->fastmem_sites = generator.get_fastmem_sites();
+    ASSERT_EQ(block->fastmem_sites.size(), 1u);
+
+    translation_cache::TranslationCache cache;
+    cache.store(block);
+    uintptr_t code_start = reinterpret_cast<uintptr_t>(block->code_ptr);
+    EXPECT_EQ(cache.lookup_fastmem_site(code_start), block);
+    EXPECT_EQ(cache.lookup_fastmem_site(code_start + 4), nullptr);
+
+    // The fault handler resumes at the thunk; the access becomes B thunk
+    const translation_cache::FastmemSite& site = block->fastmem_sites[0];
+    EXPECT_EQ(aarch64::CodeGenerator::backpatch_fastmem_site(block, site), code_start + site.thunk_offset);
+    EXPECT_EQ(instruction_at(block->code, 0), 0x14000000u | (site.thunk_offset / 4));
+    EXPECT_EQ(block->fastmem_backpatches.load(), 1u);
+
+    // A second fault racing the rewrite does not count again
+    EXPECT_EQ(aarch64::CodeGenerator::backpatch_fastmem_site(block, site), code_start + site.thunk_offset);
+    EXPECT_EQ(block->fastmem_backpatches.load(), 1u);
+
+    cache.invalidate(0x2000);
+    EXPECT_EQ(cache.lookup_fastmem_site(code_start), nullptr);
+}
+
+TEST_F(FastmemTest, SharedCodeIsNeverBackpatched) {
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::STORE, {
+            ir::IrOperand::make_mem(7, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32),
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32)})
+    };
+    auto shared = std::make_shared<translation_cache::SharedCode>();
+    shared->guest_address = 0x2000;
+    shared->guest_size = 2;
+    shared->code = generate(instructions);
+    shared->fastmem_sites = generator.get_fastmem_sites();
+    ASSERT_EQ(shared->fastmem_sites.size(), 1u);
+
+    translation_cache::TranslatedBlock* block = new translation_cache::TranslatedBlock(0x2000, 2);
+    block->fastmem_sites = shared->fastmem_sites;
+    block->code_ptr = const_cast<uint8_t*>(shared->code.data());
+    block->shared_code = shared;
+
+    // Other contexts run the same code: the fault handler finds no site and
+    // completes the access instead of rewriting it
+    translation_cache::TranslationCache cache;
+    cache.store(block);
+    EXPECT_EQ(cache.lookup_fastmem_site(reinterpret_cast<uintptr_t>(shared->code.data())), nullptr);
+    EXPECT_EQ(cache.lookup(0x2000), block);
+    cache.invalidate(0x2000);
+}
+
+TEST_F(FastmemTest, SitesSurvivePersistentCache) {
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::LOAD, {
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32),
+            ir::IrOperand::make_mem(6, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32)})
+    };
+    translation_cache::TranslatedBlock block(0x3000, 2);
+    block.code = generate(instructions);
+    block.code_ptr = block.code.data();
+    block.relocations = generator.get_relocations();
+    block.fastmem_sites = generator.get_fastmem_sites();
+
+    std::string path = ::testing::TempDir() + "xenoarm_fastmem_sites.bin";
+    translation_cache::PersistentCodeCache writer(path, 1);
+    ASSERT_EQ(writer.save({&block}), 1);
+
+    translation_cache::PersistentCodeCache reader(path, 1);
+    ASSERT_TRUE(reader.open());
+    translation_cache::PersistentBlock persisted;
+    ASSERT_TRUE(reader.find(0x3000, &persisted));
+    ASSERT_EQ(persisted.fastmem_sites.size(), 1u);
+    EXPECT_EQ(persisted.fastmem_sites[0].access_offset, block.fastmem_sites[0].access_offset);
+    EXPECT_EQ(persisted.fastmem_sites[0].thunk_offset, block.fastmem_sites[0].thunk_offset);
+    EXPECT_EQ(persisted.code_size, block.code.size());
+    std::remove(path.c_str());
+}
+
+TEST_F(FastmemTest, AllocatorNeverHandsOutBaseRegister) {
+    allocator.set_guest_register_pinning(false);
+    generator.set_guest_register_pinning(false);
+
+    // Many simultaneously live temporaries
+    std::vector<ir::IrInstruction> instructions;
+    for (uint32_t vreg = 0; vreg < 24; vreg++) {
+        instructions.push_back(ir::IrInstruction(ir::IrInstructionType::MOV, {
+            ir::IrOperand::make_reg(vreg, ir::IrDataType::I32), ir::IrOperand::make_imm(vreg, ir::IrDataType::I32)}));
+    }
+    for (uint32_t vreg = 0; vreg < 24; vreg++) {
+        instructions.push_back(ir::IrInstruction(ir::IrInstructionType::ADD, {
+            ir::IrOperand::make_reg(vreg, ir::IrDataType::I32), ir::IrOperand::make_reg(vreg, ir::IrDataType::I32),
+            ir::IrOperand::make_reg(vreg, ir::IrDataType::I32)}));
+    }
+    auto register_map = allocator.allocate(instructions);
+    for (const auto& entry : register_map) {
+        EXPECT_NE(entry.second.gpr_physical_reg_idx, register_allocation::FastmemRegisters::BASE_REG);
+    }
+}
+
+TEST_F(FastmemTest, WithoutFastmemLoadsCallTheSlowPath) {
+    allocator.set_fastmem(false);
+    generator.set_fastmem(false);
+
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::LOAD, {
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32),
+            ir::IrOperand::make_mem(6, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32)})
+    };
+    std::vector<uint8_t> code = generate(instructions);
+
+    ASSERT_EQ(generator.get_relocations().size(), 1u);
+    EXPECT_EQ(generator.get_relocations()[0].target, reinterpret_cast<uint64_t>(&xenoarm_jit::MemoryManager::generated_code_read));
+    // The address is passed in W0 and the result lands in W19
+    EXPECT_TRUE(contains_instruction(code, 0x2A0003E0u | (X_ESI << 16) | 17)); // MOV W17, W25
+    EXPECT_TRUE(contains_instruction(code, 0x2A0003E0u | (17u << 16) | X_EAX)); // MOV W19, W17
+}
+
+TEST_F(FastmemTest, DeviceAccessesCallTheSlowPathDirectly) {
+    // mov [0xFD003240], eax to a DEVICE region
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::STORE, {
+            ir::IrOperand::make_mem(ir::MemoryOperand::NO_REGISTER, ir::MemoryOperand::NO_REGISTER, 1,
+                                    static_cast<int32_t>(0xFD003240), ir::IrDataType::I32),
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32)})
+    };
+    instructions[0].memory_order = ir::IrMemoryOrder::DEVICE;
+    generate(instructions);
+
+    // No fastmem site to fault and backpatch, and the fences are the slow path's
+    EXPECT_TRUE(generator.get_fastmem_sites().empty());
+    ASSERT_EQ(generator.get_relocations().size(), 1u);
+    EXPECT_EQ(generator.get_relocations()[0].target, reinterpret_cast<uint64_t>(&xenoarm_jit::MemoryManager::generated_code_write));
+}
+
+TEST_F(FastmemTest, DispatcherEntryLoadsBase) {
+    std::vector<uint8_t> code = generator.generate_dispatcher_entry();
+    EXPECT_TRUE(contains_instruction(code, 0xAA0203F2u)); // MOV X18, X2
+
+    generator.set_fastmem(false);
+    code = generator.generate_dispatcher_entry();
+    EXPECT_FALSE(contains_instruction(code, 0xAA0203F2u));
+}
+
+TEST(FastmemSlowPathTest, GeneratedCodeEntryPointsUseExecutingManager) {
+    translation_cache::TranslationCache cache;
+    xenoarm_jit::MemoryManager manager(&cache);
+    manager.set_host_memory_callbacks(
+        [](uint32_t address) { return tests::read_u8(address, &guest_memory); },
+        [](uint32_t address) { return tests::read_u16(address, &guest_memory); },
+        [](uint32_t address) { return tests::read_u32(address, &guest_memory); },
+        [](uint32_t address) { return tests::read_u64(address, &guest_memory); },
+        [](uint32_t address, void* buffer, uint32_t size) { tests::read_block(address, buffer, size, &guest_memory); },
+        [](uint32_t address, uint8_t value) { tests::write_u8(address, value, &guest_memory); },
+        [](uint32_t address, uint16_t value) { tests::write_u16(address, value, &guest_memory); },
+        [](uint32_t address, uint32_t value) { tests::write_u32(address, value, &guest_memory); },
+        [](uint32_t address, uint64_t value) { tests::write_u64(address, value, &guest_memory); },
+        [](uint32_t address, const void* buffer, uint32_t size) { tests::write_block(address, buffer, size, &guest_memory); });
+    const uint32_t value = 0xCAFEF00D;
+    std::memcpy(&guest_memory.bytes[0x3010], &value, 4);
+
+    xenoarm_jit::MemoryManager::set_executing_manager(&manager);
+    EXPECT_EQ(MemoryManager::generated_code_read(0x3010, 4), 0xCAFEF00Du);
+    EXPECT_EQ(guest_memory.last_read_address, 0x3010u);
+    xenoarm_jit::MemoryManager::generated_code_write(0x3020, 0x1234, 4);
+    EXPECT_EQ(guest_memory.last_write_address, 0x3020u);
+    EXPECT_EQ(guest_memory.last_write_value, 0x1234u);
+    EXPECT_EQ(guest_memory.bytes[0x3020], 0x34u);
+    xenoarm_jit::MemoryManager::set_executing_manager(nullptr);
+}
+
+TEST(FastmemApiTest, RequiresFourGigabyteReservation) {
+    XenoARM_JIT::JitConfig config = tests::make_test_config(guest_memory);
+    config.enable_fastmem = true;
+    config.pin_guest_registers = true;
+
+    config.guest_memory_base = guest_memory.bytes.data();
+    config.guest_memory_size = guest_memory.bytes.size();
+    EXPECT_EQ(XenoARM_JIT::Jit_Init(config), nullptr);
+
+    const size_t reservation_size = 1ULL << 32;
+    void* reservation = mmap(nullptr, reservation_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    ASSERT_NE(reservation, MAP_FAILED);
+    config.guest_memory_base = reservation;
+    config.guest_memory_size = reservation_size;
+
+    XenoARM_JIT::JitContext* jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+    EXPECT_EQ(jit->memory_manager->get_fastmem_base(), reservation);
+
+    // 0x1000: mov eax, [esi]; ret
+    guest_memory.clear();
+    const uint8_t block[] = {0x8B, 0x06, 0xC3};
+    std::memcpy(&guest_memory.bytes[0x1000], block, sizeof(block));
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(jit, 0x1000), nullptr);
+    translation_cache::TranslatedBlock* translated = jit->translation_cache->lookup(0x1000);
+    ASSERT_NE(translated, nullptr);
+    EXPECT_TRUE(contains_instruction(translated->code, 0xB8604800u | (X_ESI << 16) | (18u << 5) | X_EAX));
+
+    XenoARM_JIT::JitFastmemBlockStats stats;
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetFastmemBlockStats(jit, 0x1000, &stats));
+    EXPECT_EQ(stats.access_sites, 1u);
+    EXPECT_EQ(stats.backpatched, 0u);
+    aarch64::CodeGenerator::backpatch_fastmem_site(translated, translated->fastmem_sites[0]);
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetFastmemBlockStats(jit, 0x1000, &stats));
+    EXPECT_EQ(stats.backpatched, 1u);
+    EXPECT_FALSE(XenoARM_JIT::Jit_GetFastmemBlockStats(jit, 0x1800, &stats));
+
+    XenoARM_JIT::Jit_Shutdown(jit);
+    munmap(reservation, reservation_size);
+}
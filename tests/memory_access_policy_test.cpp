@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+#include "xenoarm_jit/api.h"
+#include "test_guest_memory.h"
+
+using namespace xenoarm_jit;
+
+namespace {
+
+// Compile-time policy over the test guest memory, as a statically linked host would write it
+struct FlatRam {
+    tests::TestGuestMemory* memory;
+    uint32_t writes = 0;
+
+    uint8_t read_u8(uint32_t address) { return tests::read_u8(address, memory); }
+    uint16_t read_u16(uint32_t address) { return tests::read_u16(address, memory); }
+    uint32_t read_u32(uint32_t address) { return tests::read_u32(address, memory); }
+    uint64_t read_u64(uint32_t address) { return tests::read_u64(address, memory); }
+    void read_block(uint32_t address, void* buffer, uint32_t size) { tests::read_block(address, buffer, size, memory); }
+    void write_u8(uint32_t address, uint8_t value) { tests::write_u8(address, value, memory); writes++; }
+    void write_u16(uint32_t address, uint16_t value) { tests::write_u16(address, value, memory); writes++; }
+    void write_u32(uint32_t address, uint32_t value) { tests::write_u32(address, value, memory); writes++; }
+    void write_u64(uint32_t address, uint64_t value) { tests::write_u64(address, value, memory); writes++; }
+    void write_block(uint32_t address, const void* buffer, uint32_t size) {
+        tests::write_block(address, buffer, size, memory);
+        writes++;
+    }
+};
+
+} // anonymous namespace
+
+class MemoryAccessPolicyTest : public ::testing::Test {
+protected:
+    MemoryAccessPolicyTest()
+        : memory_manager(&cache), access(&memory_manager, FlatRam{&ram}) {}
+
+    tests::TestGuestMemory ram;
+    translation_cache::TranslationCache cache;
+    MemoryManager memory_manager;
+    GuestMemoryAccess<FlatRam> access;
+};
+
+TEST_F(MemoryAccessPolicyTest, ReadsAndWritesGoToThePolicy) {
+    access.write_u32(0x100, 0x11223344);
+    access.write_u16(0x104, 0x5566);
+    EXPECT_EQ(access.read_u32(0x100), 0x11223344u);
+    EXPECT_EQ(access.read_u8(0x104), 0x66u);
+    EXPECT_EQ(access.read_sized(0x100, 8), 0x0000556611223344ull);
+    EXPECT_EQ(access.policy().writes, 2u);
+}
+
+TEST_F(MemoryAccessPolicyTest, StoreToCodePageInvalidatesTranslations) {
+    translation_cache::TranslatedBlock* block = new translation_cache::TranslatedBlock(0x2000, 6);
+    block->code.assign(4, 0);
+    cache.store(block);
+    memory_manager.register_code_page(0x2000, 6);
+
+    // A store to another page leaves the block alone
+    access.write_u32(0x3000, 1);
+    EXPECT_FALSE(memory_manager.has_pending_invalidations());
+
+    // Invalidation waits for the safe point; the page stays writable until retranslated
+    access.write_u8(0x2004, 0x90);
+    EXPECT_EQ(ram.bytes[0x2004], 0x90);
+    EXPECT_NE(cache.lookup(0x2000), nullptr);
+    memory_manager.apply_pending_invalidations();
+    EXPECT_EQ(cache.lookup(0x2000), nullptr);
+    EXPECT_EQ(memory_manager.get_protection(0x2000), PROT_READ | PROT_WRITE);
+    memory_manager.register_code_page(0x2000, 6);
+    EXPECT_EQ(memory_manager.get_protection(0x2000), PROT_READ);
+}
+
+TEST_F(MemoryAccessPolicyTest, GeneratedCodeEntryPointsUseExecutingAccessor) {
+    GuestMemoryAccess<FlatRam>::set_executing(&access);
+    GuestMemoryAccess<FlatRam>::generated_code_write(0x200, 0xABCD, 2);
+    EXPECT_EQ(GuestMemoryAccess<FlatRam>::generated_code_read(0x200, 2), 0xABCDu);
+    EXPECT_EQ(GuestMemoryAccess<FlatRam>::generated_code_read(0x200, 1), 0xCDu);
+    GuestMemoryAccess<FlatRam>::set_executing(nullptr);
+}
+
+TEST_F(MemoryAccessPolicyTest, SlowPathCallsConfiguredEntryPoints) {
+    aarch64::CodeGenerator generator;
+    generator.set_memory_slow_path(&GuestMemoryAccess<FlatRam>::generated_code_read,
+                                   &GuestMemoryAccess<FlatRam>::generated_code_write);
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::LOAD, {
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32),
+            ir::IrOperand::make_mem(6, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32)}),
+        ir::IrInstruction(ir::IrInstructionType::STORE, {
+            ir::IrOperand::make_mem(7, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32),
+            ir::IrOperand::make_reg(0, ir::IrDataType::I32)})
+    };
+    register_allocation::RegisterAllocator allocator;
+    generator.generate(instructions, allocator.allocate(instructions));
+
+    ASSERT_EQ(generator.get_relocations().size(), 2u);
+    EXPECT_EQ(generator.get_relocations()[0].target,
+              reinterpret_cast<uint64_t>(&GuestMemoryAccess<FlatRam>::generated_code_read));
+    EXPECT_EQ(generator.get_relocations()[1].target,
+              reinterpret_cast<uint64_t>(&GuestMemoryAccess<FlatRam>::generated_code_write));
+}
+
+TEST(CallbackMemoryPolicyTest, MissingBlockCallbackFallsBackToBytes) {
+    std::vector<uint8_t> ram(16, 0);
+    CallbackMemoryPolicy policy(
+        [&ram](uint32_t address) { return ram[address]; }, nullptr, nullptr, nullptr, nullptr,
+        [&ram](uint32_t address, uint8_t value) { ram[address] = value; }, nullptr, nullptr, nullptr, nullptr);
+
+    const uint8_t bytes[] = {1, 2, 3};
+    policy.write_block(4, bytes, sizeof(bytes));
+    uint8_t read_back[3] = {};
+    policy.read_block(4, read_back, sizeof(read_back));
+    EXPECT_EQ(std::memcmp(read_back, bytes, sizeof(bytes)), 0);
+
+    // Missing callbacks read as zero
+    EXPECT_EQ(policy.read_u32(4), 0u);
+}
+
+TEST(MemoryManagerPageTableTest, TracksProtectionAndCodePages) {
+    translation_cache::TranslationCache cache;
+    MemoryManager memory_manager(&cache);
+
+    // Untracked pages read as read/write data pages
+    EXPECT_EQ(memory_manager.get_protection(0x5000), PROT_READ | PROT_WRITE);
+    EXPECT_FALSE(memory_manager.is_code_page(0x5000));
+
+    // Protection changes keep the code flag
+    memory_manager.register_code_page(0x5010, 0x1000);
+    EXPECT_TRUE(memory_manager.is_code_page(0x5000));
+    EXPECT_TRUE(memory_manager.is_code_page(0x6fff));
+    EXPECT_FALSE(memory_manager.is_code_page(0x7000));
+    EXPECT_EQ(memory_manager.get_protection(0x6000), PROT_READ);
+    memory_manager.protect_guest_memory(0x5000, 1, PROT_READ | PROT_EXEC);
+    EXPECT_EQ(memory_manager.get_protection(0x5000), PROT_READ | PROT_EXEC);
+    EXPECT_TRUE(memory_manager.is_code_page(0x5000));
+
+    // The table covers the whole guest space
+    memory_manager.protect_guest_memory(0xFFFFF000, 0x2000, PROT_NONE);
+    EXPECT_EQ(memory_manager.get_protection(0xFFFFFFFF), PROT_NONE);
+    EXPECT_EQ(memory_manager.get_protection(0x0), PROT_READ | PROT_WRITE);
+}
@@ -4,7 +4,9 @@
 #include <thread>
 #include "xenoarm_jit/memory_model.h"
 #include "xenoarm_jit/ir.h"
-#include "xenoarm_jit/codegen/aarch64/code_generator.h"
+#include "xenoarm_jit/aarch64/code_generator.h"
+#include "xenoarm_jit/memory_manager.h"
+#include "xenoarm_jit/translation_cache/translation_cache.h"
 
 using namespace xenoarm_jit;
 
@@ -167,6 +169,366 @@ TEST_F(MemoryModelTest, X86FenceConversion) {
     }
 }
 
+namespace {
+
+ir::IrInstruction access(ir::IrInstructionType type, uint32_t base_reg) {
+    ir::IrOperand reg = ir::IrOperand::make_reg(0, ir::IrDataType::I32);
+    ir::IrOperand mem = ir::IrOperand::make_mem(base_reg, ir::MemoryOperand::NO_REGISTER, 1, 8, ir::IrDataType::I32);
+    return ir::IrInstruction(type, type == ir::IrInstructionType::LOAD
+        ? std::vector<ir::IrOperand>{reg, mem}
+        : std::vector<ir::IrOperand>{mem, reg});
+}
+
+// Access at an absolute address: mov eax, [address]
+ir::IrInstruction absolute_access(ir::IrInstructionType type, uint32_t address) {
+    ir::IrInstruction insn = access(type, ir::MemoryOperand::NO_REGISTER);
+    insn.operands[type == ir::IrInstructionType::LOAD ? 1 : 0].mem_info.displacement = static_cast<int32_t>(address);
+    return insn;
+}
+
+const uint32_t EBX = 3;
+const uint32_t ESP = 4;
+const uint32_t EBP = 5;
+
+MemoryModel::BarrierType fence_type(const ir::IrInstruction& fence) {
+    return static_cast<MemoryModel::BarrierType>(fence.operands[0].imm_value);
+}
+
+size_t count_fences(const std::vector<ir::IrInstruction>& instructions) {
+    size_t fences = 0;
+    for (const auto& insn : instructions) {
+        fences += insn.type == ir::IrInstructionType::MEM_FENCE;
+    }
+    return fences;
+}
+
+} // anonymous namespace
+
+TEST_F(MemoryModelTest, ClassifiesStackAccesses) {
+    EXPECT_EQ(MemoryModel::classify_access(access(ir::IrInstructionType::STORE, ESP)), MemoryModel::ACCESS_STACK);
+    EXPECT_EQ(MemoryModel::classify_access(access(ir::IrInstructionType::LOAD, EBP)), MemoryModel::ACCESS_STACK);
+    EXPECT_EQ(MemoryModel::classify_access(access(ir::IrInstructionType::STORE, EBX)), MemoryModel::ACCESS_SHARED);
+    EXPECT_EQ(MemoryModel::classify_access(access(ir::IrInstructionType::STORE, ir::MemoryOperand::NO_REGISTER)),
+              MemoryModel::ACCESS_SHARED);
+    EXPECT_EQ(MemoryModel::classify_access(ir::IrInstruction(ir::IrInstructionType::NOP)), MemoryModel::ACCESS_NONE);
+
+    // [ESP + EBX*4] may point anywhere
+    ir::IrInstruction indexed = access(ir::IrInstructionType::LOAD, ESP);
+    indexed.operands[1].mem_info.index_reg_idx = EBX;
+    EXPECT_EQ(MemoryModel::classify_access(indexed), MemoryModel::ACCESS_SHARED);
+
+    EXPECT_EQ(memory_model->analyze_store_operation(access(ir::IrInstructionType::STORE, EBP)), MemoryModel::BARRIER_NONE);
+    EXPECT_FALSE(memory_model->needs_barrier_between(access(ir::IrInstructionType::STORE, EBP),
+                                                     access(ir::IrInstructionType::LOAD, EBX)));
+}
+
+TEST_F(MemoryModelTest, StackAccessesNeedNoBarriers) {
+    std::vector<ir::IrInstruction> block = {
+        access(ir::IrInstructionType::STORE, EBP),
+        access(ir::IrInstructionType::STORE, ESP),
+        access(ir::IrInstructionType::LOAD, EBX),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    MemoryModel::BarrierStats stats = memory_model->order_memory_accesses(block, true);
+    EXPECT_EQ(stats.instructions, 4u);
+    EXPECT_EQ(stats.naive_barriers, 2u);
+    // Only the shared load is ordered, against whatever follows the exit
+    EXPECT_EQ(stats.emitted_barriers, 1u);
+    ASSERT_EQ(block.size(), 5u);
+    EXPECT_EQ(block[3].type, ir::IrInstructionType::MEM_FENCE);
+    EXPECT_EQ(count_fences(block), 1u);
+}
+
+TEST_F(MemoryModelTest, SharedStoreBarrierSinksAndMergesWithGuestFence) {
+    std::vector<ir::IrInstruction> block = {
+        access(ir::IrInstructionType::STORE, EBX),
+        access(ir::IrInstructionType::STORE, EBP),
+        ir::IrInstruction(ir::IrInstructionType::ADD, {ir::IrOperand::make_reg(0, ir::IrDataType::I32),
+                                                       ir::IrOperand::make_imm(1, ir::IrDataType::I32)}),
+        createFenceInstruction(MemoryModel::BARRIER_MFENCE),
+        access(ir::IrInstructionType::LOAD, EBX),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    MemoryModel::BarrierStats stats = memory_model->order_memory_accesses(block, true);
+    EXPECT_EQ(stats.naive_barriers, 3u);
+    EXPECT_EQ(stats.emitted_barriers, 2u);
+
+    // One barrier for the store and fence, right before the shared load, and
+    // one for the load before the exit
+    ASSERT_EQ(block.size(), 7u);
+    EXPECT_EQ(block[3].type, ir::IrInstructionType::MEM_FENCE);
+    EXPECT_EQ(block[4].type, ir::IrInstructionType::LOAD);
+    EXPECT_EQ(block[5].type, ir::IrInstructionType::MEM_FENCE);
+    EXPECT_EQ(count_fences(block), 2u);
+}
+
+TEST_F(MemoryModelTest, FencesWithNothingToOrderAreDropped) {
+    std::vector<ir::IrInstruction> block = {
+        createFenceInstruction(MemoryModel::BARRIER_MFENCE),
+        access(ir::IrInstructionType::LOAD, EBX),
+        createFenceInstruction(MemoryModel::BARRIER_LFENCE),
+        createFenceInstruction(MemoryModel::BARRIER_MFENCE),
+        access(ir::IrInstructionType::LOAD, EBX),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    MemoryModel::BarrierStats stats = memory_model->order_memory_accesses(block, true);
+    EXPECT_EQ(stats.naive_barriers, 3u);
+    // The first fence has no access before it; the next two merge with the
+    // barrier after the first load. The second load is ordered at the exit.
+    EXPECT_EQ(stats.emitted_barriers, 2u);
+    EXPECT_EQ(count_fences(block), 2u);
+}
+
+TEST_F(MemoryModelTest, PendingStoresAreOrderedBeforeBlockExit) {
+    std::vector<ir::IrInstruction> block = {
+        access(ir::IrInstructionType::STORE, EBX),
+        access(ir::IrInstructionType::STORE, EBX)
+    };
+    memory_model->order_memory_accesses(block, true);
+    ASSERT_EQ(block.size(), 4u);
+    EXPECT_EQ(block[1].type, ir::IrInstructionType::MEM_FENCE);
+    EXPECT_EQ(block[3].type, ir::IrInstructionType::MEM_FENCE);
+
+    // Without TSO ordering only guest fences remain
+    std::vector<ir::IrInstruction> weak = {
+        access(ir::IrInstructionType::STORE, EBX),
+        access(ir::IrInstructionType::STORE, EBX),
+        createFenceInstruction(MemoryModel::BARRIER_SFENCE),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    MemoryModel::BarrierStats stats = memory_model->order_memory_accesses(weak, false);
+    EXPECT_EQ(stats.naive_barriers, 1u);
+    EXPECT_EQ(stats.emitted_barriers, 1u);
+    ASSERT_EQ(weak.size(), 4u);
+    EXPECT_EQ(weak[2].type, ir::IrInstructionType::MEM_FENCE);
+}
+
+TEST_F(MemoryModelTest, SharedLoadsAreOrderedAgainstLaterAccesses) {
+    std::vector<ir::IrInstruction> block = {
+        access(ir::IrInstructionType::LOAD, EBX),
+        access(ir::IrInstructionType::LOAD, EBX),
+        access(ir::IrInstructionType::STORE, EBX),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    MemoryModel::BarrierStats stats = memory_model->order_memory_accesses(block, true);
+    EXPECT_EQ(stats.emitted_barriers, 3u);
+
+    // Loads only need DMB ISHLD; the store needs a full barrier
+    ASSERT_EQ(block.size(), 7u);
+    EXPECT_EQ(block[1].type, ir::IrInstructionType::MEM_FENCE);
+    EXPECT_EQ(fence_type(block[1]), MemoryModel::BARRIER_LFENCE);
+    EXPECT_EQ(fence_type(block[3]), MemoryModel::BARRIER_LFENCE);
+    EXPECT_EQ(block[4].type, ir::IrInstructionType::STORE);
+    EXPECT_EQ(fence_type(block[5]), MemoryModel::BARRIER_DMB_ISH);
+    EXPECT_EQ(MemoryModel::barrier_encoding(fence_type(block[1])), 0xD50339BFu); // DMB ISHLD
+
+    // A pending load merges into the store barrier; stack loads need nothing
+    block = {
+        access(ir::IrInstructionType::STORE, EBX),
+        access(ir::IrInstructionType::LOAD, EBX),
+        access(ir::IrInstructionType::LOAD, EBP),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    stats = memory_model->order_memory_accesses(block, true);
+    ASSERT_EQ(block.size(), 6u);
+    EXPECT_EQ(fence_type(block[1]), MemoryModel::BARRIER_DMB_ISH);
+    EXPECT_EQ(block[3].type, ir::IrInstructionType::LOAD);
+    EXPECT_EQ(fence_type(block[4]), MemoryModel::BARRIER_LFENCE);
+
+    // Without TSO ordering, loads stay unordered
+    block = {
+        access(ir::IrInstructionType::LOAD, EBX),
+        access(ir::IrInstructionType::LOAD, EBX),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    stats = memory_model->order_memory_accesses(block, false);
+    EXPECT_EQ(stats.emitted_barriers, 0u);
+}
+
+TEST_F(MemoryModelTest, DataflowBarrierQuery) {
+    std::vector<ir::IrInstruction> block = {
+        access(ir::IrInstructionType::STORE, EBX),  // 0
+        access(ir::IrInstructionType::STORE, EBP),  // 1
+        access(ir::IrInstructionType::LOAD, EBX),   // 2
+        createFenceInstruction(MemoryModel::BARRIER_MFENCE), // 3
+        access(ir::IrInstructionType::LOAD, EBX),   // 4
+        ir::IrInstruction(ir::IrInstructionType::RET) // 5
+    };
+    EXPECT_TRUE(memory_model->needs_barrier_between(block, 0, 2));
+    EXPECT_FALSE(memory_model->needs_barrier_between(block, 0, 1)); // Stack target
+    EXPECT_FALSE(memory_model->needs_barrier_between(block, 1, 2)); // Stack store only
+    EXPECT_FALSE(memory_model->needs_barrier_between(block, 0, 4)); // Fenced
+    EXPECT_TRUE(memory_model->needs_barrier_between(block, 4, 5));  // Load before exit
+    EXPECT_FALSE(memory_model->needs_barrier_between(block, 3, 4)); // Fence only
+}
+
+TEST_F(MemoryModelTest, BarrierEncodings) {
+    EXPECT_EQ(MemoryModel::barrier_encoding(MemoryModel::BARRIER_MFENCE), 0xD5033BBFu); // DMB ISH
+    EXPECT_EQ(MemoryModel::barrier_encoding(MemoryModel::BARRIER_SFENCE), 0xD5033ABFu); // DMB ISHST
+    EXPECT_EQ(MemoryModel::barrier_encoding(MemoryModel::BARRIER_LFENCE), 0xD50339BFu); // DMB ISHLD
+    EXPECT_EQ(MemoryModel::barrier_encoding(MemoryModel::BARRIER_DSB_ISH), 0xD5033B9Fu);
+    EXPECT_EQ(MemoryModel::barrier_encoding(MemoryModel::BARRIER_ISB), 0xD5033FDFu);
+}
+
+TEST_F(MemoryModelTest, AcquireReleaseLoweringReplacesStoreBarriers) {
+    std::vector<ir::IrInstruction> block = {
+        access(ir::IrInstructionType::STORE, EBX),
+        access(ir::IrInstructionType::STORE, EBP),
+        access(ir::IrInstructionType::LOAD, EBX),
+        createFenceInstruction(MemoryModel::BARRIER_MFENCE),
+        access(ir::IrInstructionType::STORE, EBX),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    MemoryModel::BarrierStats stats = memory_model->order_memory_accesses(
+        block, true, MemoryModel::LOWERING_LDAPR_STLR);
+    EXPECT_EQ(stats.ordered_accesses, 3u);
+
+    // Shared accesses carry their own ordering; stack accesses stay plain
+    EXPECT_EQ(block[0].memory_order, ir::IrMemoryOrder::RELEASE);
+    EXPECT_EQ(block[1].memory_order, ir::IrMemoryOrder::PLAIN);
+    EXPECT_EQ(block[2].memory_order, ir::IrMemoryOrder::ACQUIRE);
+
+    // Only the guest MFENCE is left as a barrier: release/acquire does not
+    // order a store before a later load
+    EXPECT_EQ(stats.emitted_barriers, 1u);
+    ASSERT_EQ(count_fences(block), 1u);
+    EXPECT_EQ(block[3].type, ir::IrInstructionType::MEM_FENCE);
+    EXPECT_EQ(block[4].memory_order, ir::IrMemoryOrder::RELEASE);
+
+    // Without TSO ordering nothing is marked
+    std::vector<ir::IrInstruction> weak = {
+        access(ir::IrInstructionType::STORE, EBX),
+        access(ir::IrInstructionType::LOAD, EBX)
+    };
+    stats = memory_model->order_memory_accesses(weak, false, MemoryModel::LOWERING_LDAR_STLR);
+    EXPECT_EQ(stats.ordered_accesses, 0u);
+    EXPECT_EQ(weak[0].memory_order, ir::IrMemoryOrder::PLAIN);
+    EXPECT_EQ(weak[1].memory_order, ir::IrMemoryOrder::PLAIN);
+}
+
+TEST_F(MemoryModelTest, LockedInstructionsOrderThemselves) {
+    std::vector<ir::IrInstruction> block = {
+        access(ir::IrInstructionType::STORE, EBX),
+        ir::IrInstruction(ir::IrInstructionType::ATOMIC_ADD, {
+            ir::IrOperand::make_mem(EBX, ir::MemoryOperand::NO_REGISTER, 1, 0, ir::IrDataType::I32),
+            ir::IrOperand::make_imm(1, ir::IrDataType::I32)}),
+        access(ir::IrInstructionType::LOAD, EBX),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    // The store is ordered by the locked add, which needs no barrier either
+    EXPECT_FALSE(memory_model->needs_barrier_between(block, 0, 1));
+    EXPECT_FALSE(memory_model->needs_barrier_between(block, 0, 2));
+    MemoryModel::BarrierStats stats = memory_model->order_memory_accesses(block, true);
+    EXPECT_EQ(stats.emitted_barriers, 1u); // For the load, at the exit
+    ASSERT_EQ(block.size(), 5u);
+    EXPECT_EQ(block[2].type, ir::IrInstructionType::LOAD);
+    EXPECT_EQ(block[3].type, ir::IrInstructionType::MEM_FENCE);
+}
+
+TEST_F(MemoryModelTest, BestLoweringFollowsHostFeatures) {
+    MemoryModel::HostFeatures features;
+    EXPECT_EQ(MemoryModel::best_lowering(features), MemoryModel::LOWERING_BARRIERS);
+    features.rcpc = true;
+    EXPECT_EQ(MemoryModel::best_lowering(features), MemoryModel::LOWERING_LDAPR_STLR);
+
+#if !defined(__aarch64__)
+    // Only AArch64 hosts report features
+    EXPECT_FALSE(MemoryModel::detect_host_features().rcpc);
+#endif
+}
+
+TEST_F(MemoryModelTest, RegionPoliciesSplitAndMerge) {
+    EXPECT_EQ(memory_model->region_policy(0x1000), MemoryModel::REGION_DEFAULT);
+
+    memory_model->set_region_policy(0x0, 0x10000000, MemoryModel::REGION_RELAXED);
+    memory_model->set_region_policy(0x01000000, 0x1000, MemoryModel::REGION_TSO);
+    memory_model->set_region_policy(0xFD000000, 0x03000000, MemoryModel::REGION_DEVICE);
+    EXPECT_EQ(memory_model->region_policy(0x00FFFFFF), MemoryModel::REGION_RELAXED);
+    EXPECT_EQ(memory_model->region_policy(0x01000800), MemoryModel::REGION_TSO);
+    EXPECT_EQ(memory_model->region_policy(0x01001000), MemoryModel::REGION_RELAXED);
+    EXPECT_EQ(memory_model->region_policy(0xFFFFFFFF), MemoryModel::REGION_DEVICE);
+    EXPECT_EQ(memory_model->region_policy(0x20000000), MemoryModel::REGION_DEFAULT);
+    ASSERT_EQ(memory_model->get_regions().size(), 4u);
+
+    // Straddling accesses take the strongest policy; uncovered bytes are DEFAULT
+    EXPECT_EQ(memory_model->region_policy(0x00FFFFFE, 4), MemoryModel::REGION_TSO);
+    EXPECT_EQ(memory_model->region_policy(0x0FFFFFFE, 4), MemoryModel::REGION_DEFAULT);
+
+    // Clearing the TSO hole and re-relaxing it merges the RAM region again
+    memory_model->set_region_policy(0x01000000, 0x1000, MemoryModel::REGION_DEFAULT);
+    EXPECT_EQ(memory_model->region_policy(0x01000000), MemoryModel::REGION_DEFAULT);
+    memory_model->set_region_policy(0x01000000, 0x1000, MemoryModel::REGION_RELAXED);
+    ASSERT_EQ(memory_model->get_regions().size(), 2u);
+    EXPECT_EQ(memory_model->get_regions()[0].end, 0x10000000u);
+}
+
+TEST_F(MemoryModelTest, RegionPoliciesOrderAbsoluteAccesses) {
+    const uint32_t PRIVATE_RAM = 0x00100000;
+    const uint32_t PUSH_BUFFER = 0x01000000;
+    const uint32_t MMIO = 0xFD003240;
+    memory_model->set_region_policy(0x0, 0x01000000, MemoryModel::REGION_RELAXED);
+    memory_model->set_region_policy(PUSH_BUFFER, 0x10000, MemoryModel::REGION_TSO);
+    memory_model->set_region_policy(0xFD000000, 0x01000000, MemoryModel::REGION_DEVICE);
+
+    // Private RAM stays unordered even under the conservative model
+    std::vector<ir::IrInstruction> block = {
+        absolute_access(ir::IrInstructionType::STORE, PRIVATE_RAM),
+        absolute_access(ir::IrInstructionType::LOAD, PRIVATE_RAM + 4),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    MemoryModel::BarrierStats stats = memory_model->order_memory_accesses(block, true);
+    EXPECT_EQ(stats.relaxed_accesses, 2u);
+    EXPECT_EQ(count_fences(block), 0u);
+
+    // Push buffer stores are ordered without it; a pointer store is not
+    block = {
+        absolute_access(ir::IrInstructionType::STORE, PUSH_BUFFER),
+        access(ir::IrInstructionType::STORE, EBX),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    memory_model->order_memory_accesses(block, false, MemoryModel::LOWERING_LDAPR_STLR);
+    EXPECT_EQ(block[0].memory_order, ir::IrMemoryOrder::RELEASE);
+    EXPECT_EQ(block[1].memory_order, ir::IrMemoryOrder::PLAIN);
+    EXPECT_EQ(count_fences(block), 0u);
+
+    // A doorbell write orders itself against the stores before it and the
+    // loads after it, through the slow path
+    block = {
+        access(ir::IrInstructionType::STORE, EBX),
+        absolute_access(ir::IrInstructionType::STORE, MMIO),
+        access(ir::IrInstructionType::LOAD, EBX),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    stats = memory_model->order_memory_accesses(block, true);
+    EXPECT_EQ(stats.device_accesses, 1u);
+    ASSERT_EQ(block.size(), 5u);
+    EXPECT_EQ(block[1].memory_order, ir::IrMemoryOrder::DEVICE);
+    EXPECT_EQ(count_fences(block), 1u); // The load's, at the exit
+
+    // Other instructions touching device memory get barriers on both sides
+    block = {
+        ir::IrInstruction(ir::IrInstructionType::OR, {
+            absolute_access(ir::IrInstructionType::STORE, MMIO).operands[0],
+            ir::IrOperand::make_imm(1, ir::IrDataType::I32)}),
+        ir::IrInstruction(ir::IrInstructionType::RET)
+    };
+    stats = memory_model->order_memory_accesses(block, false);
+    EXPECT_EQ(stats.device_accesses, 1u);
+    ASSERT_EQ(block.size(), 4u);
+    EXPECT_EQ(block[0].type, ir::IrInstructionType::MEM_FENCE);
+    EXPECT_EQ(block[2].type, ir::IrInstructionType::MEM_FENCE);
+}
+
+TEST_F(MemoryModelTest, SlowPathFencesFollowRegionPolicy) {
+    memory_model->set_region_policy(0xFD000000, 0x1000, MemoryModel::REGION_DEVICE);
+    translation_cache::TranslationCache cache;
+    MemoryManager manager(&cache);
+    EXPECT_EQ(manager.ordering_policy(0xFD000010, 4), MemoryModel::REGION_DEFAULT);
+    manager.set_memory_model(memory_model);
+    EXPECT_EQ(manager.ordering_policy(0xFD000010, 4), MemoryModel::REGION_DEVICE);
+    EXPECT_EQ(manager.ordering_policy(0x1000, 4), MemoryModel::REGION_DEFAULT);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
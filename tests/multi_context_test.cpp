@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+#include "xenoarm_jit/api.h"
+#include "xenoarm_jit/memory_manager.h"
+#include "xenoarm_jit/signal_handler.h"
+#include "xenoarm_jit/simd_state.h"
+#include "test_guest_memory.h"
+
+using namespace xenoarm_jit;
+
+TEST(MultiContextTest, ContextsAreIndependent) {
+    tests::TestGuestMemory memory_a, memory_b;
+    tests::emit_mov_eax_ret(memory_a, 0x1000, 1);
+    tests::emit_mov_eax_ret(memory_b, 0x2000, 2);
+
+    XenoARM_JIT::JitContext* a = XenoARM_JIT::Jit_Init(tests::make_test_config(memory_a));
+    XenoARM_JIT::JitContext* b = XenoARM_JIT::Jit_Init(tests::make_test_config(memory_b));
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+
+    EXPECT_NE(XenoARM_JIT::Jit_TranslateBlock(a, 0x1000), nullptr);
+    EXPECT_NE(XenoARM_JIT::Jit_TranslateBlock(b, 0x2000), nullptr);
+    EXPECT_EQ(a->translation_cache->get_block_count(), 1u);
+    EXPECT_EQ(b->translation_cache->get_block_count(), 1u);
+    EXPECT_EQ(a->translation_cache->lookup(0x2000), nullptr);
+
+    // Shutting one context down leaves the other usable
+    XenoARM_JIT::Jit_Shutdown(a);
+    EXPECT_NE(b->translation_cache->lookup(0x2000), nullptr);
+    XenoARM_JIT::Jit_InvalidateRange(b, 0x2000, 6);
+    EXPECT_EQ(b->translation_cache->lookup(0x2000), nullptr);
+    XenoARM_JIT::Jit_Shutdown(b);
+}
+
+TEST(MultiContextTest, ContextsRunOnSeparateThreads) {
+    const int context_count = 4;
+    std::vector<tests::TestGuestMemory> memories(context_count);
+    std::vector<XenoARM_JIT::JitContext*> contexts;
+    for (int c = 0; c < context_count; ++c) {
+        for (uint32_t b = 0; b < 32; ++b) {
+            tests::emit_mov_eax_ret(memories[c], 0x1000 + b * 16, c * 100 + b);
+        }
+        contexts.push_back(XenoARM_JIT::Jit_Init(tests::make_test_config(memories[c])));
+        ASSERT_NE(contexts.back(), nullptr);
+    }
+
+    std::vector<int> failures(context_count, 0);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < context_count; ++c) {
+        threads.emplace_back([&, c]() {
+            for (int i = 0; i < 500; ++i) {
+                uint32_t address = 0x1000 + (i % 32) * 16;
+                if (!XenoARM_JIT::Jit_TranslateBlock(contexts[c], address)) {
+                    failures[c]++;
+                }
+                if (i % 7 == 0) {
+                    XenoARM_JIT::Jit_InvalidateRange(contexts[c], address, 16);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (int c = 0; c < context_count; ++c) {
+        EXPECT_EQ(failures[c], 0);
+        XenoARM_JIT::Jit_Shutdown(contexts[c]);
+    }
+}
+
+TEST(MultiContextTest, SignalHandlerDispatchesByRange) {
+    translation_cache::TranslationCache cache_a, cache_b;
+    MemoryManager manager_a(&cache_a), manager_b(&cache_b);
+    std::vector<uint8_t> host_a(0x4000), host_b(0x4000);
+    uintptr_t base_a = reinterpret_cast<uintptr_t>(host_a.data());
+    uintptr_t base_b = reinterpret_cast<uintptr_t>(host_b.data());
+
+    ASSERT_TRUE(SignalHandler::initialize(&manager_a));
+    ASSERT_TRUE(SignalHandler::initialize(&manager_b));
+    ASSERT_TRUE(SignalHandler::add_range(&manager_a, base_a, host_a.size(), 0));
+    ASSERT_TRUE(SignalHandler::add_range(&manager_b, base_b, host_b.size(), 0x10000));
+
+    SignalHandler* handler = SignalHandler::get_instance();
+    ASSERT_NE(handler, nullptr);
+    uint32_t guest_address = 0;
+    EXPECT_EQ(handler->find_owner(base_a + 0x123, &guest_address), &manager_a);
+    EXPECT_EQ(guest_address, 0x123u);
+    EXPECT_EQ(handler->find_owner(base_b + 0x456, &guest_address), &manager_b);
+    EXPECT_EQ(guest_address, 0x10456u);
+
+    // With two contexts an address outside every range belongs to nobody
+    uintptr_t outside = reinterpret_cast<uintptr_t>(&guest_address);
+    EXPECT_EQ(handler->find_owner(outside, &guest_address), nullptr);
+
+    // The remaining context has ranges, so it does not inherit stray faults
+    SignalHandler::cleanup(&manager_a);
+    EXPECT_EQ(handler->find_owner(base_a + 0x123, &guest_address), nullptr);
+    EXPECT_EQ(handler->find_owner(base_b + 0x456, &guest_address), &manager_b);
+    SignalHandler::cleanup(&manager_b);
+    EXPECT_EQ(SignalHandler::get_instance(), nullptr);
+}
+
+TEST(MultiContextTest, FpuStatusWordIsPerState) {
+    simd::SIMDState first, second;
+    first.reset();
+    second.reset();
+    first.push_double(std::numeric_limits<double>::quiet_NaN());
+    second.push_double(0.5);
+
+    first.compute_sine();
+    second.compute_sine();
+
+    EXPECT_NE(first.get_fpu_status_word() & 0x0001, 0); // Invalid operation
+    EXPECT_EQ(second.get_fpu_status_word() & 0x0001, 0);
+}
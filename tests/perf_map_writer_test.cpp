@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "xenoarm_jit/translation_cache/perf_map_writer.h"
+#include "xenoarm_jit/translation_cache/translation_cache.h"
+#include "xenoarm_jit/decoder.h"
+#include "xenoarm_jit/aarch64/code_generator.h"
+#include "xenoarm_jit/register_allocation/register_allocator.h"
+
+using namespace xenoarm_jit;
+using translation_cache::PerfMapWriter;
+using translation_cache::TranslatedBlock;
+
+namespace {
+
+std::vector<uint8_t> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+template <typename T>
+T read_at(const std::vector<uint8_t>& bytes, size_t offset) {
+    T value;
+    std::memcpy(&value, bytes.data() + offset, sizeof(T));
+    return value;
+}
+
+TranslatedBlock* make_block(uint32_t guest_address, size_t code_size) {
+    TranslatedBlock* block = new TranslatedBlock(guest_address, 6);
+    for (size_t i = 0; i < code_size; ++i) {
+        block->code.push_back(static_cast<uint8_t>(i + 1));
+    }
+    return block;
+}
+
+} // namespace
+
+class PerfMapWriterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::string name = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        map_path = ::testing::TempDir() + "xenoarm_perf_" + name + ".map";
+        dump_path = ::testing::TempDir() + "xenoarm_jit_" + name + ".dump";
+    }
+
+    void TearDown() override {
+        std::remove(map_path.c_str());
+        std::remove(dump_path.c_str());
+    }
+
+    std::string map_path;
+    std::string dump_path;
+};
+
+TEST_F(PerfMapWriterTest, StoredBlocksAppearInPerfMap) {
+    PerfMapWriter writer(map_path, "");
+    ASSERT_TRUE(writer.open());
+    translation_cache::TranslationCache cache;
+    cache.set_perf_map_writer(&writer);
+
+    TranslatedBlock* block = make_block(0x1000, 32);
+    cache.store(block);
+    TranslatedBlock* hot = make_block(0x1000, 16);
+    hot->tier = translation_cache::CompilationTier::TIER1;
+    cache.replace_block(hot, [](TranslatedBlock*, TranslatedBlock*, const TranslatedBlock::ControlFlowExit&) {});
+    EXPECT_EQ(writer.get_blocks_written(), 2u);
+
+    // Nothing reaches the file until the buffer is flushed
+    EXPECT_TRUE(read_file(map_path).empty());
+    writer.flush();
+    std::vector<uint8_t> bytes = read_file(map_path);
+    std::string map(bytes.begin(), bytes.end());
+
+    char expected[128];
+    std::snprintf(expected, sizeof(expected), "%llx 20 x86_00001000\n%llx 10 x86_00001000_t1\n",
+                  static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(block->code_ptr)),
+                  static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(hot->code_ptr)));
+    EXPECT_EQ(map, expected);
+    cache.set_perf_map_writer(nullptr);
+}
+
+TEST_F(PerfMapWriterTest, JitdumpCarriesCodeAndGuestLines) {
+    TranslatedBlock* block = make_block(0x2000, 12);
+    block->source_map = {{0, 0x2000}, {8, 0x2005}};
+    {
+        PerfMapWriter writer("", dump_path);
+        ASSERT_TRUE(writer.open());
+        translation_cache::TranslationCache cache;
+        cache.set_perf_map_writer(&writer);
+        cache.store(block);
+        cache.set_perf_map_writer(nullptr);
+
+        // The file header is written at open; records wait for the buffer
+        std::vector<uint8_t> bytes = read_file(dump_path);
+        ASSERT_EQ(bytes.size(), 40u);
+        EXPECT_EQ(read_at<uint32_t>(bytes, 0), 0x4A695444u); // "JiTD"
+        EXPECT_EQ(read_at<uint32_t>(bytes, 12), PerfMapWriter::ELF_MACHINE);
+        EXPECT_EQ(read_at<uint32_t>(bytes, 20), static_cast<uint32_t>(getpid()));
+    } // The writer flushes and closes the dump on destruction
+    std::vector<uint8_t> bytes = read_file(dump_path);
+
+    // Debug info first: one entry per guest instruction
+    size_t offset = 40;
+    ASSERT_GE(bytes.size(), offset + 32);
+    EXPECT_EQ(read_at<uint32_t>(bytes, offset), 2u);
+    uint32_t debug_size = read_at<uint32_t>(bytes, offset + 4);
+    uint64_t debug_code_addr = read_at<uint64_t>(bytes, offset + 16);
+    ASSERT_EQ(read_at<uint64_t>(bytes, offset + 24), 2u);
+    size_t entry = offset + 32;
+    EXPECT_EQ(read_at<uint64_t>(bytes, entry), debug_code_addr);
+    EXPECT_EQ(read_at<uint32_t>(bytes, entry + 8), 0x2000u);
+    EXPECT_STREQ(reinterpret_cast<const char*>(&bytes[entry + 16]), "guest");
+    entry += 16 + 6;
+    EXPECT_EQ(read_at<uint64_t>(bytes, entry), debug_code_addr + 8);
+    EXPECT_EQ(read_at<uint32_t>(bytes, entry + 8), 0x2005u);
+    offset += debug_size;
+
+    // Then the code load record with its name and code bytes
+    ASSERT_GE(bytes.size(), offset + 56);
+    EXPECT_EQ(read_at<uint32_t>(bytes, offset), 0u);
+    uint32_t load_size = read_at<uint32_t>(bytes, offset + 4);
+    EXPECT_EQ(read_at<uint64_t>(bytes, offset + 32), debug_code_addr);
+    EXPECT_EQ(read_at<uint64_t>(bytes, offset + 40), 12u);
+    EXPECT_STREQ(reinterpret_cast<const char*>(&bytes[offset + 56]), "x86_00002000");
+    size_t code = offset + 56 + sizeof("x86_00002000");
+    for (size_t i = 0; i < 12; ++i) {
+        EXPECT_EQ(bytes[code + i], i + 1);
+    }
+    offset += load_size;
+
+    // And the close record written on destruction
+    ASSERT_EQ(bytes.size(), offset + 16);
+    EXPECT_EQ(read_at<uint32_t>(bytes, offset), 3u);
+}
+
+TEST(SourceMapTest, CodeGeneratorAttributesHostCodeToGuestInstructions) {
+    // mov eax, 1; mov ecx, 2; ret
+    const uint8_t guest_code[] = {0xB8, 1, 0, 0, 0, 0xB9, 2, 0, 0, 0, 0xC3};
+    decoder::X86Decoder decoder;
+    ir::IrFunction function = decoder.decode_block(guest_code, 0x4000, sizeof(guest_code));
+    ASSERT_FALSE(function.basic_blocks.empty());
+    std::vector<ir::IrInstruction>& instructions = function.basic_blocks[0].instructions;
+
+    register_allocation::RegisterAllocator allocator;
+    aarch64::CodeGenerator generator;
+    std::vector<uint8_t> code = generator.generate(instructions, allocator.allocate(instructions));
+
+    const std::vector<translation_cache::SourceMapEntry>& source_map = generator.get_source_map();
+    ASSERT_EQ(source_map.size(), 3u);
+    EXPECT_EQ(source_map[0].host_offset, 0u);
+    EXPECT_EQ(source_map[0].guest_address, 0x4000u);
+    EXPECT_EQ(source_map[1].guest_address, 0x4005u);
+    EXPECT_EQ(source_map[2].guest_address, 0x400Au);
+    EXPECT_LT(source_map[0].host_offset, source_map[1].host_offset);
+    EXPECT_LT(source_map[1].host_offset, source_map[2].host_offset);
+    EXPECT_LT(source_map[2].host_offset, code.size());
+}
@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "xenoarm_jit/api.h"
+#include "xenoarm_jit/ir.h"
+#include "test_guest_memory.h"
+
+using namespace xenoarm_jit;
+
+namespace {
+
+void host_call_target() {}
+
+} // namespace
+
+class PersistentCodeCacheTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = ::testing::TempDir() + "xenoarm_persistent_cache_" +
+               ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".bin";
+        std::remove(path.c_str());
+        for (uint32_t i = 0; i < 3; ++i) {
+            tests::emit_mov_eax_ret(memory, 0x1000 + i * 0x100, i);
+        }
+    }
+
+    void TearDown() override {
+        std::remove(path.c_str());
+    }
+
+    XenoARM_JIT::JitConfig make_config(bool eager = false) {
+        XenoARM_JIT::JitConfig config = tests::make_test_config(memory);
+        config.persistent_cache_path = path;
+        config.persistent_cache_eager_load = eager;
+        return config;
+    }
+
+    // Translate the three blocks in a fresh context and save them at shutdown
+    std::vector<uint8_t> populate_cache() {
+        XenoARM_JIT::JitContext* context = XenoARM_JIT::Jit_Init(make_config());
+        EXPECT_NE(context, nullptr);
+        for (uint32_t i = 0; i < 3; ++i) {
+            EXPECT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1000 + i * 0x100), nullptr);
+        }
+        std::vector<uint8_t> code = context->translation_cache->lookup(0x1000)->code;
+        XenoARM_JIT::Jit_Shutdown(context);
+        return code;
+    }
+
+    XenoARM_JIT::JitPersistentCacheStats stats(XenoARM_JIT::JitContext* context) {
+        XenoARM_JIT::JitPersistentCacheStats result = {};
+        EXPECT_TRUE(XenoARM_JIT::Jit_GetPersistentCacheStats(context, &result));
+        return result;
+    }
+
+    tests::TestGuestMemory memory;
+    std::string path;
+};
+
+TEST_F(PersistentCodeCacheTest, WarmStartReusesSavedBlocks) {
+    std::vector<uint8_t> cold_code = populate_cache();
+
+    XenoARM_JIT::JitContext* context = XenoARM_JIT::Jit_Init(make_config());
+    ASSERT_NE(context, nullptr);
+    EXPECT_EQ(stats(context).file_entries, 3u);
+    EXPECT_EQ(context->translation_cache->get_block_count(), 0u);
+
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1000), nullptr);
+    EXPECT_EQ(context->translation_cache->lookup(0x1000)->code, cold_code);
+    EXPECT_EQ(stats(context).loaded, 1u);
+    EXPECT_EQ(context->tier1_translations.load(), 0u);
+
+    // Blocks not reached this run stay in the file
+    XenoARM_JIT::Jit_Shutdown(context);
+    context = XenoARM_JIT::Jit_Init(make_config());
+    ASSERT_NE(context, nullptr);
+    EXPECT_EQ(stats(context).file_entries, 3u);
+    XenoARM_JIT::Jit_Shutdown(context);
+}
+
+TEST_F(PersistentCodeCacheTest, ChangedGuestBytesAreRetranslated) {
+    populate_cache();
+    tests::emit_mov_eax_ret(memory, 0x1000, 99);
+
+    XenoARM_JIT::JitContext* context = XenoARM_JIT::Jit_Init(make_config());
+    ASSERT_NE(context, nullptr);
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1000), nullptr);
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1100), nullptr);
+
+    XenoARM_JIT::JitPersistentCacheStats s = stats(context);
+    EXPECT_EQ(s.rejected, 1u);
+    EXPECT_EQ(s.loaded, 1u);
+    EXPECT_EQ(context->tier1_translations.load(), 1u);
+    XenoARM_JIT::Jit_Shutdown(context);
+}
+
+TEST_F(PersistentCodeCacheTest, EagerLoadValidatesOnFirstExecution) {
+    populate_cache();
+    tests::emit_mov_eax_ret(memory, 0x1200, 99);
+
+    XenoARM_JIT::JitContext* context = XenoARM_JIT::Jit_Init(make_config(true));
+    ASSERT_NE(context, nullptr);
+    EXPECT_EQ(context->translation_cache->get_block_count(), 3u);
+    EXPECT_TRUE(context->translation_cache->lookup(0x1000)->needs_validation);
+
+    for (uint32_t i = 0; i < 3; ++i) {
+        EXPECT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1000 + i * 0x100), nullptr);
+    }
+    EXPECT_FALSE(context->translation_cache->lookup(0x1000)->needs_validation);
+
+    XenoARM_JIT::JitPersistentCacheStats s = stats(context);
+    EXPECT_EQ(s.loaded, 2u);
+    EXPECT_EQ(s.rejected, 1u);
+    EXPECT_EQ(context->tier1_translations.load(), 1u);
+    XenoARM_JIT::Jit_Shutdown(context);
+}
+
+TEST_F(PersistentCodeCacheTest, OtherConfigurationIgnoresFile) {
+    populate_cache();
+
+    XenoARM_JIT::JitConfig config = make_config();
+    config.pin_guest_registers = true;
+    XenoARM_JIT::JitContext* context = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(context, nullptr);
+    EXPECT_EQ(stats(context).file_entries, 0u);
+    EXPECT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1000), nullptr);
+    EXPECT_EQ(stats(context).loaded, 0u);
+    XenoARM_JIT::Jit_Shutdown(context);
+}
+
+TEST_F(PersistentCodeCacheTest, PolicyChangeReopensCacheUnderCompileThreads) {
+    populate_cache();
+
+    XenoARM_JIT::JitConfig config = make_config();
+    config.compile_threads = 2;
+    XenoARM_JIT::JitContext* context = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(context, nullptr);
+
+    // Workers look the requests up in the cache while it is replaced
+    for (int round = 0; round < 20; ++round) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            XenoARM_JIT::Jit_RequestTranslation(context, 0x1000 + i * 0x100);
+        }
+        ASSERT_TRUE(XenoARM_JIT::Jit_SetMemoryOrderingPolicy(
+            context, 0x8000, 0x1000,
+            round % 2 ? XenoARM_JIT::MEMORY_POLICY_DEFAULT : XenoARM_JIT::MEMORY_POLICY_DEVICE));
+    }
+
+    // Back under the policies the file was saved with
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1000), nullptr);
+    EXPECT_EQ(stats(context).file_entries, 3u);
+    EXPECT_GE(stats(context).loaded, 1u);
+    XenoARM_JIT::Jit_Shutdown(context);
+}
+
+TEST_F(PersistentCodeCacheTest, HostCallsAreRelocated) {
+    aarch64::CodeGenerator generator;
+    std::vector<ir::IrInstruction> instructions = {
+        ir::IrInstruction(ir::IrInstructionType::HOST_CALL, {
+            ir::IrOperand::make_imm(reinterpret_cast<uint64_t>(&host_call_target), ir::IrDataType::I64)})
+    };
+    translation_cache::TranslatedBlock in_image(0x5000, 6);
+    in_image.code = generator.generate(instructions, {});
+    in_image.code_ptr = in_image.code.data();
+    in_image.relocations = generator.get_relocations();
+    ASSERT_EQ(in_image.relocations.size(), 1u);
+
+    // A target outside every loaded image cannot be relocated
+    std::unique_ptr<int> heap_target(new int(0));
+    instructions[0].operands[0].imm_value = reinterpret_cast<uint64_t>(heap_target.get());
+    translation_cache::TranslatedBlock outside(0x6000, 6);
+    outside.code = generator.generate(instructions, {});
+    outside.code_ptr = outside.code.data();
+    outside.relocations = generator.get_relocations();
+
+    translation_cache::PersistentCodeCache writer(path, 1);
+    EXPECT_EQ(writer.save({&in_image, &outside}), 1);
+
+    translation_cache::PersistentCodeCache reader(path, 1);
+    ASSERT_TRUE(reader.open());
+    translation_cache::PersistentBlock persisted;
+    ASSERT_TRUE(reader.find(0x5000, &persisted));
+    EXPECT_FALSE(reader.find(0x6000, &persisted));
+    ASSERT_TRUE(reader.find(0x5000, &persisted));
+    ASSERT_EQ(persisted.relocations.size(), 1u);
+    EXPECT_EQ(persisted.relocations[0].target, reinterpret_cast<uint64_t>(&host_call_target));
+
+    std::vector<uint8_t> code(persisted.code, persisted.code + persisted.code_size);
+    aarch64::CodeGenerator::apply_relocation(code.data(), persisted.relocations[0], persisted.relocations[0].target);
+    EXPECT_EQ(code, in_image.code);
+
+    // A different key means a different configuration
+    translation_cache::PersistentCodeCache mismatched(path, 2);
+    EXPECT_FALSE(mismatched.open());
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "xenoarm_jit/api.h"
+#include "test_guest_memory.h"
+
+class PretranslateTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // 0x1000: mov eax, 1; call 0x1100 (returns to 0x100A)
+        const uint8_t entry[] = {0xB8, 0x01, 0x00, 0x00, 0x00, 0xE8, 0xF6, 0x00, 0x00, 0x00};
+        // 0x100A: mov eax, 2; je 0x1200 (falls through to 0x1015)
+        const uint8_t after_call[] = {0xB8, 0x02, 0x00, 0x00, 0x00, 0x0F, 0x84, 0xEB, 0x01, 0x00, 0x00};
+        // 0x1100: mov eax, 3; jmp 0x1300
+        const uint8_t callee[] = {0xB8, 0x03, 0x00, 0x00, 0x00, 0xE9, 0xF6, 0x01, 0x00, 0x00};
+        // 0x1200: mov eax, 4; call 0x8000 (outside the section, returns to 0x120A)
+        const uint8_t outside_call[] = {0xB8, 0x04, 0x00, 0x00, 0x00, 0xE8, 0xF6, 0x6D, 0x00, 0x00};
+        std::memcpy(&memory.bytes[0x1000], entry, sizeof(entry));
+        std::memcpy(&memory.bytes[0x100A], after_call, sizeof(after_call));
+        memory.bytes[0x1015] = 0xC3;
+        std::memcpy(&memory.bytes[0x1100], callee, sizeof(callee));
+        std::memcpy(&memory.bytes[0x1200], outside_call, sizeof(outside_call));
+        memory.bytes[0x120A] = 0xC3;
+        memory.bytes[0x1300] = 0xC3;
+        memory.bytes[0x8000] = 0xC3;
+        // Unreachable from the entry point
+        memory.bytes[0x1400] = 0xC3;
+
+        config = xenoarm_jit::tests::make_test_config(memory);
+    }
+
+    void TearDown() override {
+        if (jit) {
+            XenoARM_JIT::Jit_Shutdown(jit);
+        }
+    }
+
+    void expect_section_translated() {
+        const uint32_t reachable[] = {0x1000, 0x100A, 0x1015, 0x1100, 0x1200, 0x120A, 0x1300};
+        for (uint32_t address : reachable) {
+            EXPECT_NE(jit->translation_cache->lookup(address), nullptr) << std::hex << address;
+        }
+        EXPECT_EQ(jit->translation_cache->lookup(0x1400), nullptr);
+        EXPECT_EQ(jit->translation_cache->lookup(0x8000), nullptr);
+    }
+
+    xenoarm_jit::tests::TestGuestMemory memory;
+    XenoARM_JIT::JitConfig config;
+    XenoARM_JIT::JitContext* jit = nullptr;
+};
+
+TEST_F(PretranslateTest, DiscoversReachableBlocksInSection) {
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    EXPECT_EQ(XenoARM_JIT::Jit_PretranslateRange(jit, 0x1000, 0x1000), 7u);
+    EXPECT_EQ(jit->translation_cache->get_block_count(), 7u);
+    expect_section_translated();
+
+    // Everything is already translated the second time
+    EXPECT_EQ(XenoARM_JIT::Jit_PretranslateRange(jit, 0x1000, 0x1000), 0u);
+}
+
+TEST_F(PretranslateTest, UsesContextCompileThreads) {
+    config.compile_threads = 2;
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    EXPECT_EQ(XenoARM_JIT::Jit_PretranslateRange(jit, 0x1000, 0x1000), 7u);
+    expect_section_translated();
+}
+
+TEST_F(PretranslateTest, GuestWriteDuringTranslationDropsBlock) {
+    // Discovery reads 0x1100 first; the second read is the local compile thread's
+    std::atomic<int> reads(0);
+    std::atomic<bool> stalled(false);
+    std::atomic<bool> release(false);
+    memory.on_read_block = [&](uint32_t address) {
+        if (address == 0x1100 && ++reads == 2) {
+            stalled = true;
+            while (!release) {
+                std::this_thread::yield();
+            }
+        }
+    };
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    // The page is not registered while the block is translated, so nothing traps this write
+    std::thread writer([&]() {
+        while (!stalled) {
+            std::this_thread::yield();
+        }
+        memory.bytes[0x1101] = 0x33;
+        release = true;
+    });
+    EXPECT_EQ(XenoARM_JIT::Jit_PretranslateRange(jit, 0x1000, 0x1000), 6u);
+    writer.join();
+    memory.on_read_block = nullptr;
+
+    EXPECT_EQ(jit->translation_cache->lookup(0x1100), nullptr);
+    EXPECT_NE(jit->translation_cache->lookup(0x1300), nullptr);
+}
+
+TEST_F(PretranslateTest, ExplicitEntryPoints) {
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    const uint32_t entries[] = {0x1100, 0x1400};
+    EXPECT_EQ(XenoARM_JIT::Jit_PretranslateRange(jit, 0x1000, 0x1000, entries, 2), 3u);
+    EXPECT_NE(jit->translation_cache->lookup(0x1100), nullptr);
+    EXPECT_NE(jit->translation_cache->lookup(0x1300), nullptr);
+    EXPECT_NE(jit->translation_cache->lookup(0x1400), nullptr);
+    EXPECT_EQ(jit->translation_cache->lookup(0x1000), nullptr);
+}
+
+TEST_F(PretranslateTest, WritesPersistentCache) {
+    std::string path = ::testing::TempDir() + "xenoarm_pretranslate_cache.bin";
+    std::remove(path.c_str());
+    config.persistent_cache_path = path;
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    EXPECT_EQ(XenoARM_JIT::Jit_PretranslateRange(jit, 0x1000, 0x1000), 7u);
+    XenoARM_JIT::JitPersistentCacheStats stats;
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetPersistentCacheStats(jit, &stats));
+    EXPECT_EQ(stats.saved, 7u);
+    std::remove(path.c_str());
+}
+
+TEST_F(PretranslateTest, InvalidParameters) {
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    EXPECT_EQ(XenoARM_JIT::Jit_PretranslateRange(nullptr, 0x1000, 0x1000), 0u);
+    EXPECT_EQ(XenoARM_JIT::Jit_PretranslateRange(jit, 0x1000, 0), 0u);
+    EXPECT_EQ(XenoARM_JIT::Jit_PretranslateRange(jit, 0x1000, 0x1000, nullptr, 1), 0u);
+    EXPECT_EQ(XenoARM_JIT::Jit_GetLastError(jit), XenoARM_JIT::JIT_ERROR_INVALID_PARAMETER);
+}
@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 #include "xenoarm_jit/register_allocation/register_allocator.h"
 #include "xenoarm_jit/ir.h"
+#include "xenoarm_jit/decoder.h"
+#include "xenoarm_jit/aarch64/code_generator.h"
+#include <cstring>
 #include <vector>
 #include <unordered_map>
 
@@ -17,6 +20,16 @@ protected:
         delete allocator;
     }
 
+    // Branch targets are guest addresses: give instruction i address 0x1000 + i,
+    // one guest instruction each as the decoder would
+    static uint32_t guest_address_of(size_t index) { return 0x1000 + static_cast<uint32_t>(index); }
+    
+    static void assign_guest_addresses(std::vector<ir::IrInstruction>& instructions) {
+        for (size_t i = 0; i < instructions.size(); i++) {
+            instructions[i].guest_address = guest_address_of(i);
+        }
+    }
+    
     // Helper to create a simple sequence of IR instructions with register pressure
     std::vector<ir::IrInstruction> create_test_ir_sequence(int num_registers, bool create_loop = false) {
         std::vector<ir::IrInstruction> instructions;
@@ -40,10 +53,11 @@ protected:
         // If creating a loop, add a backward branch
         if (create_loop) {
             ir::IrInstruction jmp(ir::IrInstructionType::JMP);
-            jmp.operands.push_back(ir::IrOperand::make_imm(0, ir::IrDataType::U32));  // Jump target (instruction 0)
+            jmp.operands.push_back(ir::IrOperand::make_imm(guest_address_of(0), ir::IrDataType::U32));  // Jump target (instruction 0)
             instructions.push_back(jmp);
         }
         
+        assign_guest_addresses(instructions);
         return instructions;
     }
     
@@ -329,7 +343,7 @@ TEST_F(RegisterAllocatorTest, LoopAwareRegisterAllocation) {
     
     // Add backward branch to form a loop
     ir::IrInstruction jmp(ir::IrInstructionType::JMP);
-    jmp.operands.push_back(ir::IrOperand::make_imm(loop_start_idx, ir::IrDataType::U32));  // Jump target
+    jmp.operands.push_back(ir::IrOperand::make_imm(guest_address_of(loop_start_idx), ir::IrDataType::U32));  // Jump target
     instructions.push_back(jmp);
     
     // Some additional operations after the loop to ensure all registers have some usage
@@ -339,6 +353,7 @@ TEST_F(RegisterAllocatorTest, LoopAwareRegisterAllocation) {
         add.operands.push_back(ir::IrOperand::make_imm(1, ir::IrDataType::I32));  // Source
         instructions.push_back(add);
     }
+    assign_guest_addresses(instructions);
     
     // Run register allocation with the loop-aware allocator
     std::unordered_map<uint32_t, register_allocation::RegisterMapping> mapping = 
@@ -379,5 +394,411 @@ TEST_F(RegisterAllocatorTest, LoopAwareRegisterAllocation) {
               << std::endl;
 }
 
+// Branch targets in decoded blocks are guest addresses, not IR indices
+TEST_F(RegisterAllocatorTest, DetectsLoopsInDecodedBlocks) {
+    decoder::X86Decoder decoder;
+    
+    // 0x2000: mov eax, 1; 0x2005: mov ecx, 2; 0x200A: jne 0x2005
+    const uint8_t loop_code[] = {0xB8, 1, 0, 0, 0, 0xB9, 2, 0, 0, 0, 0x75, 0xF9};
+    ir::IrFunction loop = decoder.decode_block(loop_code, 0x2000, sizeof(loop_code));
+    ASSERT_EQ(loop.basic_blocks[0].instructions.size(), 3u);
+    allocator->allocate(loop.basic_blocks[0].instructions);
+    EXPECT_EQ(allocator->get_loop_depth(0), 0u);
+    EXPECT_EQ(allocator->get_loop_depth(1), 1u);
+    EXPECT_EQ(allocator->get_loop_depth(2), 1u);
+    
+    // A branch leaving the block is not a loop, even to an address below the
+    // number of instructions
+    ir::IrFunction exit = decoder.decode_block(loop_code, 0x3000, 10);
+    ir::IrInstruction branch(ir::IrInstructionType::BR_NE, {ir::IrOperand::make_imm(1, ir::IrDataType::U32)});
+    branch.guest_address = 0x300A;
+    exit.basic_blocks[0].instructions.push_back(branch);
+    allocator->allocate(exit.basic_blocks[0].instructions);
+    for (uint32_t i = 0; i < 3; i++) {
+        EXPECT_EQ(allocator->get_loop_depth(i), 0u);
+    }
+}
+
+// Test static guest register pinning across blocks
+TEST_F(RegisterAllocatorTest, GuestRegisterPinning) {
+    allocator->set_guest_register_pinning(true);
+    ASSERT_TRUE(allocator->is_guest_register_pinning_enabled());
+    
+    // High pressure on top of the guest registers must never displace them
+    std::vector<ir::IrInstruction> instructions = create_high_pressure_sequence();
+    
+    std::unordered_map<uint32_t, register_allocation::RegisterMapping> mapping = 
+        allocator->allocate(instructions);
+    
+    using register_allocation::GuestRegisterPinning;
+    
+    // EAX..EDI always live in X19..X26
+    for (uint32_t vreg = 0; vreg < GuestRegisterPinning::NUM_PINNED_GPRS; vreg++) {
+        ASSERT_NE(mapping.find(vreg), mapping.end());
+        EXPECT_TRUE(mapping[vreg].is_pinned);
+        EXPECT_FALSE(mapping[vreg].is_spilled);
+        EXPECT_EQ(mapping[vreg].gpr_physical_reg_idx, GuestRegisterPinning::physical_reg_for(vreg));
+    }
+    
+    // No other vreg may be handed a register reserved for pinned guest state
+    for (const auto& [vreg_id, reg_mapping] : mapping) {
+        if (GuestRegisterPinning::is_pinned_vreg(vreg_id) || reg_mapping.is_spilled ||
+            reg_mapping.type != register_allocation::PhysicalRegisterType::GPR) {
+            continue;
+        }
+        EXPECT_FALSE(GuestRegisterPinning::is_reserved_physical_reg(reg_mapping.gpr_physical_reg_idx))
+            << "vreg " << vreg_id << " was allocated reserved register x" << reg_mapping.gpr_physical_reg_idx;
+    }
+}
+
+// Test that pinning can be switched off again
+TEST_F(RegisterAllocatorTest, GuestRegisterPinningDisabled) {
+    allocator->set_guest_register_pinning(true);
+    allocator->set_guest_register_pinning(false);
+    
+    std::vector<ir::IrInstruction> instructions = create_test_ir_sequence(5);
+    
+    std::unordered_map<uint32_t, register_allocation::RegisterMapping> mapping = 
+        allocator->allocate(instructions);
+    
+    for (const auto& [vreg_id, reg_mapping] : mapping) {
+        EXPECT_FALSE(reg_mapping.is_pinned);
+    }
+}
+
+// Test live-range splitting: evicted values are stored once and reloaded before use
+TEST_F(RegisterAllocatorTest, LiveRangeSplitting) {
+    std::vector<ir::IrInstruction> instructions = create_high_pressure_sequence();
+    
+    allocator->allocate(instructions);
+    const auto& spill_code = allocator->get_spill_code();
+    ASSERT_FALSE(spill_code.empty());
+    
+    std::unordered_map<uint32_t, uint32_t> stored_at;
+    for (size_t i = 0; i < spill_code.size(); i++) {
+        const auto& code = spill_code[i];
+        
+        // Sorted by position
+        if (i > 0) {
+            EXPECT_LE(spill_code[i - 1].inst_idx, code.inst_idx);
+        }
+        
+        EXPECT_TRUE(allocator->is_register_spilled(code.vreg_id));
+        EXPECT_EQ(code.stack_offset, allocator->get_spill_offset(code.vreg_id));
+        
+        if (code.type == register_allocation::SpillCodeType::SPILL) {
+            stored_at[code.vreg_id] = code.inst_idx;
+            continue;
+        }
+        
+        // A reload follows a store of the same vreg and sits right before one of its uses
+        ASSERT_NE(stored_at.find(code.vreg_id), stored_at.end());
+        EXPECT_LE(stored_at[code.vreg_id], code.inst_idx);
+        
+        bool used_here = false;
+        for (const auto& op : instructions[code.inst_idx].operands) {
+            if (op.type == ir::IrOperandType::REGISTER && op.reg_idx == code.vreg_id) {
+                used_here = true;
+            }
+        }
+        EXPECT_TRUE(used_here) << "reload of vreg " << code.vreg_id << " not at a use";
+    }
+    
+    register_allocation::SpillStatistics stats = allocator->get_spill_statistics();
+    EXPECT_GT(stats.spill_count, 0u);
+    EXPECT_GT(stats.reload_count, 0u);
+}
+
+// Test that splitting keeps reloads out of loops compared to whole-lifetime spilling
+TEST_F(RegisterAllocatorTest, LiveRangeSplittingReducesLoopTraffic) {
+    std::vector<ir::IrInstruction> instructions;
+    
+    // 40 long-lived values defined up front and consumed after the loop
+    for (int i = 0; i < 40; i++) {
+        ir::IrInstruction mov(ir::IrInstructionType::MOV);
+        mov.operands.push_back(ir::IrOperand::make_reg(100 + i, ir::IrDataType::I32));
+        mov.operands.push_back(ir::IrOperand::make_imm(i, ir::IrDataType::I32));
+        instructions.push_back(mov);
+    }
+    
+    // Hot loop working on a different set of 20 values
+    size_t loop_start = instructions.size();
+    for (int iter = 0; iter < 4; iter++) {
+        for (int i = 0; i < 20; i++) {
+            ir::IrInstruction add(ir::IrInstructionType::ADD);
+            add.operands.push_back(ir::IrOperand::make_reg(200 + i, ir::IrDataType::I32));
+            add.operands.push_back(ir::IrOperand::make_reg(200 + (i + 1) % 20, ir::IrDataType::I32));
+            instructions.push_back(add);
+        }
+    }
+    ir::IrInstruction jmp(ir::IrInstructionType::JMP);
+    jmp.operands.push_back(ir::IrOperand::make_imm(guest_address_of(loop_start), ir::IrDataType::U32));
+    instructions.push_back(jmp);
+    
+    for (int i = 0; i < 40; i++) {
+        ir::IrInstruction add(ir::IrInstructionType::ADD);
+        add.operands.push_back(ir::IrOperand::make_reg(100 + i, ir::IrDataType::I32));
+        add.operands.push_back(ir::IrOperand::make_imm(1, ir::IrDataType::I32));
+        instructions.push_back(add);
+    }
+    assign_guest_addresses(instructions);
+    
+    allocator->set_live_range_splitting(false);
+    allocator->allocate(instructions);
+    register_allocation::SpillStatistics whole = allocator->get_spill_statistics();
+    EXPECT_TRUE(allocator->get_spill_code().empty());
+    
+    allocator->set_live_range_splitting(true);
+    allocator->allocate(instructions);
+    register_allocation::SpillStatistics split = allocator->get_spill_statistics();
+    
+    EXPECT_EQ(split.loop_reload_count, 0u);
+    EXPECT_LE(split.loop_spill_count, whole.loop_spill_count);
+    EXPECT_LE(split.loop_reload_count, whole.loop_reload_count);
+}
+
+// Test that split values are back where the loop header expects them when the
+// back-edge is taken: run the allocated code twice around the loop and check
+// that every read sees the latest value of its vreg
+TEST_F(RegisterAllocatorTest, LiveRangeSplittingResolvesBackEdges) {
+    std::vector<ir::IrInstruction> instructions;
+    auto emit = [&](ir::IrInstructionType type, uint32_t dst, ir::IrOperand src) {
+        ir::IrInstruction inst(type);
+        inst.operands.push_back(ir::IrOperand::make_reg(dst, ir::IrDataType::I32));
+        inst.operands.push_back(src);
+        instructions.push_back(inst);
+    };
+    auto reg = [](uint32_t vreg) { return ir::IrOperand::make_reg(vreg, ir::IrDataType::I32); };
+    auto imm = [](uint64_t value) { return ir::IrOperand::make_imm(value, ir::IrDataType::I32); };
+    
+    // 10 accumulators live through the loop and 20 busier loop temporaries: more
+    // than the GPR pool, so accumulators are evicted and reloaded in the loop
+    for (uint32_t i = 0; i < 10; i++) {
+        emit(ir::IrInstructionType::MOV, 100 + i, imm(i));
+    }
+    const uint32_t header = static_cast<uint32_t>(instructions.size());
+    for (uint32_t t = 0; t < 20; t++) {
+        emit(ir::IrInstructionType::MOV, 200 + t, imm(t));
+    }
+    for (uint32_t round = 0; round < 3; round++) {
+        for (uint32_t t = 0; t < 20; t++) {
+            emit(ir::IrInstructionType::ADD, 200 + t, reg(200 + (t + 1) % 20));
+        }
+    }
+    for (uint32_t t = 0; t < 20; t++) {
+        emit(ir::IrInstructionType::ADD, 100 + t % 10, reg(200 + t));
+    }
+    const uint32_t back_edge = static_cast<uint32_t>(instructions.size());
+    ir::IrInstruction jmp(ir::IrInstructionType::JMP);
+    jmp.operands.push_back(ir::IrOperand::make_imm(guest_address_of(header), ir::IrDataType::U32));
+    instructions.push_back(jmp);
+    for (uint32_t i = 0; i < 10; i++) {
+        emit(ir::IrInstructionType::ADD, 100 + i, reg(100 + (i + 1) % 10));
+    }
+    assign_guest_addresses(instructions);
+    
+    std::unordered_map<uint32_t, register_allocation::RegisterMapping> mapping = allocator->allocate(instructions);
+    const auto& spill_code = allocator->get_spill_code();
+    ASSERT_FALSE(spill_code.empty());
+    
+    // Operand registers as the code generator assigns them: one linear pass,
+    // where a reload moves the vreg for the rest of the block
+    std::vector<std::vector<int>> operand_regs(instructions.size());
+    std::unordered_map<uint32_t, int> location;
+    for (const auto& [vreg, reg_map] : mapping) {
+        location[vreg] = reg_map.gpr_physical_reg_idx;
+    }
+    auto next_spill = spill_code.begin();
+    for (size_t i = 0; i < instructions.size(); i++) {
+        for (; next_spill != spill_code.end() && next_spill->inst_idx == i; ++next_spill) {
+            if (next_spill->type == register_allocation::SpillCodeType::RELOAD) {
+                location[next_spill->vreg_id] = next_spill->physical_reg_idx;
+            }
+        }
+        for (const auto& op : instructions[i].operands) {
+            operand_regs[i].push_back(op.type == ir::IrOperandType::REGISTER ? location[op.reg_idx] : -1);
+        }
+    }
+    
+    // Contents are (vreg, version); each definition makes a new version
+    typedef std::pair<uint32_t, uint32_t> Value;
+    std::unordered_map<int, Value> registers;
+    std::unordered_map<int32_t, Value> slots;
+    std::unordered_map<uint32_t, uint32_t> versions;
+    uint32_t version_counter = 0;
+    bool resolved_at_back_edge = false;
+    
+    auto execute = [&](size_t i, bool entered_by_back_edge) {
+        if (!entered_by_back_edge) {
+            for (const auto& code : spill_code) {
+                if (code.inst_idx != i) {
+                    continue;
+                }
+                resolved_at_back_edge |= (i == back_edge);
+                if (code.type == register_allocation::SpillCodeType::SPILL) {
+                    // Loop temporaries may be stored before their first definition
+                    if (versions.count(code.vreg_id)) {
+                        EXPECT_EQ(registers[code.physical_reg_idx], Value(code.vreg_id, versions[code.vreg_id]))
+                            << "store of vreg " << code.vreg_id << " before instruction " << i;
+                    }
+                    slots[code.stack_offset] = registers[code.physical_reg_idx];
+                } else {
+                    registers[code.physical_reg_idx] = slots[code.stack_offset];
+                }
+            }
+        }
+        
+        const ir::IrInstruction& inst = instructions[i];
+        if (inst.type == ir::IrInstructionType::JMP) {
+            return;
+        }
+        uint32_t dst = inst.operands[0].reg_idx;
+        if (inst.type == ir::IrInstructionType::ADD) {
+            EXPECT_EQ(registers[operand_regs[i][0]], Value(dst, versions[dst])) << "instruction " << i;
+            uint32_t src = inst.operands[1].reg_idx;
+            EXPECT_EQ(registers[operand_regs[i][1]], Value(src, versions[src])) << "instruction " << i;
+        }
+        versions[dst] = ++version_counter;
+        registers[operand_regs[i][0]] = Value(dst, versions[dst]);
+    };
+    
+    for (size_t i = 0; i <= back_edge; i++) {
+        execute(i, false);
+    }
+    execute(header, true);
+    for (size_t i = header + 1; i < instructions.size(); i++) {
+        execute(i, false);
+    }
+    EXPECT_TRUE(resolved_at_back_edge);
+}
+
+// Test that split blocks reserve their spill frame below SP and release it at every exit
+TEST_F(RegisterAllocatorTest, SpillCodeStaysInsideReservedFrame) {
+    std::vector<ir::IrInstruction> instructions = create_high_pressure_sequence();
+    instructions.push_back(ir::IrInstruction(ir::IrInstructionType::RET));
+    
+    auto mapping = allocator->allocate(instructions);
+    const auto& spill_code = allocator->get_spill_code();
+    ASSERT_FALSE(spill_code.empty());
+    uint32_t frame_size = static_cast<uint32_t>(allocator->get_total_spill_size());
+    ASSERT_GT(frame_size, 0u);
+    ASSERT_EQ(frame_size % 16, 0u);
+    
+    // Every slot lies within [SP, SP + frame_size)
+    for (const auto& code : spill_code) {
+        EXPECT_GE(code.stack_offset, 0);
+        EXPECT_LE(code.stack_offset + register_allocation::SpillAllocator::get_slot_size(code.data_type), frame_size);
+    }
+    
+    aarch64::CodeGenerator generator;
+    std::vector<uint8_t> code = generator.generate(instructions, mapping, spill_code, frame_size);
+    auto word_at = [&](size_t offset) {
+        uint32_t word;
+        std::memcpy(&word, code.data() + offset, sizeof(word));
+        return word;
+    };
+    
+    // SUB SP, SP, #frame_size comes first
+    ASSERT_LT(frame_size, 4096u);
+    ASSERT_GE(code.size(), 8u);
+    EXPECT_EQ(word_at(0), 0xD10003FFu | (frame_size << 10));
+    
+    // ADD SP, SP, #frame_size right before the RET
+    EXPECT_EQ(word_at(code.size() - 4), 0xD65F03C0u);
+    EXPECT_EQ(word_at(code.size() - 8), 0x910003FFu | (frame_size << 10));
+    
+    // A block running off its end releases the frame last
+    instructions.pop_back();
+    code = generator.generate(instructions, allocator->allocate(instructions), allocator->get_spill_code(), frame_size);
+    EXPECT_EQ(word_at(code.size() - 4), 0x910003FFu | (frame_size << 10));
+}
+
+// Test that the emitted spill frame is the colored one: values spilled in
+// disjoint phases share slots, so the frame is smaller than one slot per vreg
+TEST_F(RegisterAllocatorTest, ColoredSlotsShrinkEmittedFrame) {
+    std::vector<ir::IrInstruction> instructions;
+    for (uint32_t phase = 0; phase < 2; phase++) {
+        for (uint32_t i = 0; i < 32; i++) {
+            ir::IrInstruction mov(ir::IrInstructionType::MOV);
+            mov.operands.push_back(ir::IrOperand::make_reg(100 * phase + i, ir::IrDataType::I64));
+            mov.operands.push_back(ir::IrOperand::make_imm(i, ir::IrDataType::I64));
+            instructions.push_back(mov);
+        }
+        for (uint32_t i = 0; i < 32; i++) {
+            ir::IrInstruction add(ir::IrInstructionType::ADD);
+            add.operands.push_back(ir::IrOperand::make_reg(100 * phase + i, ir::IrDataType::I64));
+            add.operands.push_back(ir::IrOperand::make_reg(100 * phase + (i + 1) % 32, ir::IrDataType::I64));
+            instructions.push_back(add);
+        }
+    }
+    instructions.push_back(ir::IrInstruction(ir::IrInstructionType::RET));
+    
+    auto mapping = allocator->allocate(instructions);
+    std::unordered_map<uint32_t, uint32_t> spilled;
+    bool phase_spilled[2] = {false, false};
+    for (const auto& code : allocator->get_spill_code()) {
+        spilled[code.vreg_id] = register_allocation::SpillAllocator::get_slot_size(code.data_type);
+        phase_spilled[code.vreg_id / 100] = true;
+    }
+    ASSERT_TRUE(phase_spilled[0] && phase_spilled[1]);
+    
+    uint32_t uncolored_size = 0;
+    for (const auto& [vreg, size] : spilled) {
+        uncolored_size += size;
+    }
+    uint32_t frame_size = static_cast<uint32_t>(allocator->get_total_spill_size());
+    EXPECT_LT(frame_size, (uncolored_size + 15) & ~15u);
+    
+    aarch64::CodeGenerator generator;
+    std::vector<uint8_t> code = generator.generate(instructions, mapping, allocator->get_spill_code(), frame_size);
+    uint32_t prologue;
+    ASSERT_GE(code.size(), sizeof(prologue));
+    std::memcpy(&prologue, code.data(), sizeof(prologue));
+    EXPECT_EQ(prologue, 0xD10003FFu | (frame_size << 10));
+}
+
+// Test spill slot coloring and frame compaction
+TEST_F(RegisterAllocatorTest, SpillSlotColoring) {
+    register_allocation::SpillAllocator spill_allocator;
+    
+    // Two 4-byte values with disjoint stack ranges, one overlapping both
+    uint32_t a = spill_allocator.add_spill_request(1, ir::IrDataType::I32);
+    spill_allocator.record_access(a, 0, 1);
+    spill_allocator.record_access(a, 10, 1);
+    uint32_t b = spill_allocator.add_spill_request(2, ir::IrDataType::I32);
+    spill_allocator.record_access(b, 11, 1);
+    spill_allocator.record_access(b, 20, 1);
+    uint32_t c = spill_allocator.add_spill_request(3, ir::IrDataType::I32);
+    spill_allocator.record_access(c, 5, 1);
+    spill_allocator.record_access(c, 15, 1);
+    
+    // Mixed sizes: a cold vector, a hot byte
+    uint32_t vec = spill_allocator.add_spill_request(4, ir::IrDataType::V128_W8);
+    spill_allocator.record_access(vec, 0, 1);
+    spill_allocator.record_access(vec, 20, 1);
+    uint32_t byte = spill_allocator.add_spill_request(5, ir::IrDataType::I8);
+    spill_allocator.record_access(byte, 0, 100);
+    spill_allocator.record_access(byte, 20, 100);
+    
+    spill_allocator.assign_slots();
+    
+    // Non-interfering values share a slot, interfering ones do not
+    EXPECT_EQ(spill_allocator.get_slot_offset(a), spill_allocator.get_slot_offset(b));
+    EXPECT_NE(spill_allocator.get_slot_offset(a), spill_allocator.get_slot_offset(c));
+    EXPECT_EQ(spill_allocator.get_slot_count(), 4u);
+    
+    // Natural alignment
+    EXPECT_EQ(spill_allocator.get_slot_offset(a) % 4, 0);
+    EXPECT_EQ(spill_allocator.get_slot_offset(c) % 4, 0);
+    EXPECT_EQ(spill_allocator.get_slot_offset(vec) % 16, 0);
+    
+    // Hot slot lives in the first cache line
+    EXPECT_LT(spill_allocator.get_slot_offset(byte),
+              static_cast<int32_t>(register_allocation::SpillAllocator::HOT_AREA_SIZE));
+    
+    // 16 + 4 + 4 + 1 bytes with no padding between size classes
+    EXPECT_EQ(spill_allocator.get_total_spill_size(), 25);
+}
+
 } // namespace tests
-} // namespace xenoarm_jit 
\ No newline at end of file
+} // namespace xenoarm_jit
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+#include "xenoarm_jit/api.h"
+#include "test_guest_memory.h"
+
+using namespace xenoarm_jit;
+
+namespace {
+
+XenoARM_JIT::JitConfig make_config(tests::TestGuestMemory* memory, XenoARM_JIT::SharedCodeStore* store) {
+    XenoARM_JIT::JitConfig config = tests::make_test_config(*memory);
+    config.shared_code_store = store;
+    return config;
+}
+
+} // namespace
+
+class SharedCodeStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        store = XenoARM_JIT::Jit_CreateSharedCodeStore();
+        ASSERT_NE(store, nullptr);
+        tests::emit_mov_eax_ret(memory_a, 0x1000, 42);
+        tests::emit_mov_eax_ret(memory_b, 0x1000, 42);
+        a = XenoARM_JIT::Jit_Init(make_config(&memory_a, store));
+        b = XenoARM_JIT::Jit_Init(make_config(&memory_b, store));
+        ASSERT_NE(a, nullptr);
+        ASSERT_NE(b, nullptr);
+    }
+
+    void TearDown() override {
+        XenoARM_JIT::Jit_Shutdown(a);
+        XenoARM_JIT::Jit_Shutdown(b);
+        XenoARM_JIT::Jit_DestroySharedCodeStore(store);
+    }
+
+    XenoARM_JIT::JitSharedCodeStats stats() {
+        XenoARM_JIT::JitSharedCodeStats result = {};
+        EXPECT_TRUE(XenoARM_JIT::Jit_GetSharedCodeStats(store, &result));
+        return result;
+    }
+
+    tests::TestGuestMemory memory_a, memory_b;
+    XenoARM_JIT::SharedCodeStore* store = nullptr;
+    XenoARM_JIT::JitContext* a = nullptr;
+    XenoARM_JIT::JitContext* b = nullptr;
+};
+
+TEST_F(SharedCodeStoreTest, IdenticalCodeIsTranslatedOnce) {
+    void* code_a = XenoARM_JIT::Jit_TranslateBlock(a, 0x1000);
+    void* code_b = XenoARM_JIT::Jit_TranslateBlock(b, 0x1000);
+    ASSERT_NE(code_a, nullptr);
+    EXPECT_EQ(code_a, code_b);
+
+    XenoARM_JIT::JitSharedCodeStats s = stats();
+    EXPECT_EQ(s.entries, 1u);
+    EXPECT_EQ(s.misses, 1u);
+    EXPECT_EQ(s.hits, 1u);
+    EXPECT_DOUBLE_EQ(s.hit_ratio, 0.5);
+    EXPECT_GT(s.code_bytes, 0u);
+
+    // Each context still owns its own cache entry
+    translation_cache::TranslatedBlock* block_a = a->translation_cache->lookup(0x1000);
+    translation_cache::TranslatedBlock* block_b = b->translation_cache->lookup(0x1000);
+    ASSERT_NE(block_a, nullptr);
+    ASSERT_NE(block_b, nullptr);
+    EXPECT_NE(block_a, block_b);
+    EXPECT_EQ(block_a->shared_code, block_b->shared_code);
+}
+
+TEST_F(SharedCodeStoreTest, DifferentBytesDoNotShare) {
+    tests::emit_mov_eax_ret(memory_b, 0x1000, 43);
+    void* code_a = XenoARM_JIT::Jit_TranslateBlock(a, 0x1000);
+    void* code_b = XenoARM_JIT::Jit_TranslateBlock(b, 0x1000);
+    ASSERT_NE(code_a, nullptr);
+    ASSERT_NE(code_b, nullptr);
+    EXPECT_NE(code_a, code_b);
+    EXPECT_EQ(stats().hits, 0u);
+}
+
+TEST_F(SharedCodeStoreTest, InvalidationOnlyDetachesOneContext) {
+    void* shared = XenoARM_JIT::Jit_TranslateBlock(a, 0x1000);
+    ASSERT_EQ(XenoARM_JIT::Jit_TranslateBlock(b, 0x1000), shared);
+
+    // Context A patches its copy of the code
+    tests::emit_mov_eax_ret(memory_a, 0x1000, 7);
+    XenoARM_JIT::Jit_InvalidateRange(a, 0x1000, 6);
+    EXPECT_EQ(a->translation_cache->lookup(0x1000), nullptr);
+
+    translation_cache::TranslatedBlock* block_b = b->translation_cache->lookup(0x1000);
+    ASSERT_NE(block_b, nullptr);
+    EXPECT_EQ(block_b->code_ptr, shared);
+
+    // The patched bytes hash to a different key and are compiled afresh
+    void* patched = XenoARM_JIT::Jit_TranslateBlock(a, 0x1000);
+    ASSERT_NE(patched, nullptr);
+    EXPECT_NE(patched, shared);
+    EXPECT_EQ(stats().misses, 2u);
+}
+
+TEST_F(SharedCodeStoreTest, EntriesFollowContextLifetime) {
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(a, 0x1000), nullptr);
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(b, 0x1000), nullptr);
+    EXPECT_EQ(stats().entries, 1u);
+
+    XenoARM_JIT::Jit_Shutdown(a);
+    a = nullptr;
+    EXPECT_EQ(stats().entries, 1u);
+    XenoARM_JIT::Jit_Shutdown(b);
+    b = nullptr;
+    EXPECT_EQ(stats().entries, 0u);
+}
+
+TEST_F(SharedCodeStoreTest, InvalidParameters) {
+    XenoARM_JIT::JitSharedCodeStats s;
+    EXPECT_FALSE(XenoARM_JIT::Jit_GetSharedCodeStats(nullptr, &s));
+    EXPECT_FALSE(XenoARM_JIT::Jit_GetSharedCodeStats(store, nullptr));
+}
@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+#include "xenoarm_jit/api.h"
+#include "test_guest_memory.h"
+
+using namespace xenoarm_jit;
+
+class SmcCodeBytesTest : public ::testing::Test {
+protected:
+    SmcCodeBytesTest() : ram(64 * 1024, 0), memory_manager(&cache) {
+        memory_manager.set_host_memory_callbacks(
+            nullptr, nullptr, nullptr, nullptr, nullptr,
+            [this](uint32_t address, uint8_t value) { ram[address] = value; },
+            nullptr,
+            [this](uint32_t address, uint32_t value) {
+                for (int i = 0; i < 4; i++) {
+                    ram[address + i] = static_cast<uint8_t>(value >> (i * 8));
+                }
+            },
+            nullptr,
+            [this](uint32_t address, const void* buffer, uint32_t size) {
+                std::memcpy(ram.data() + address, buffer, size);
+            });
+    }
+
+    // Translate a fake block of size guest bytes at guest_address
+    void add_block(uint32_t guest_address, uint32_t size) {
+        translation_cache::TranslatedBlock* block = new translation_cache::TranslatedBlock(guest_address, size);
+        block->code.assign(4, 0);
+        cache.store(block);
+        memory_manager.register_code_page(guest_address, size);
+    }
+
+    std::vector<uint8_t> ram;
+    translation_cache::TranslationCache cache;
+    MemoryManager memory_manager;
+};
+
+TEST_F(SmcCodeBytesTest, DataNextToCodeKeepsTranslations) {
+    add_block(0x2000, 6);
+    EXPECT_TRUE(memory_manager.has_code_bytes(0x2005, 1));
+    EXPECT_FALSE(memory_manager.has_code_bytes(0x2006, 0x100));
+
+    memory_manager.write_u32(0x2008, 0xDEADBEEF);
+    memory_manager.write_u8(0x2006, 1);
+    EXPECT_FALSE(memory_manager.has_pending_invalidations());
+    EXPECT_EQ(ram[0x2008], 0xEF);
+
+    // A store straddling the last translated byte invalidates
+    memory_manager.write_u32(0x2002, 0);
+    memory_manager.apply_pending_invalidations();
+    EXPECT_EQ(cache.lookup(0x2000), nullptr);
+}
+
+TEST_F(SmcCodeBytesTest, InvalidatesOnlyOverlappingBlocks) {
+    add_block(0x3000, 8);
+    add_block(0x3100, 8);
+
+    memory_manager.write_u8(0x3104, 0x90);
+    memory_manager.apply_pending_invalidations();
+    EXPECT_NE(cache.lookup(0x3000), nullptr);
+    EXPECT_EQ(cache.lookup(0x3100), nullptr);
+
+    // Block writes check every page they cover
+    std::vector<uint8_t> bytes(0x40, 0xCC);
+    memory_manager.write_block(0x2FF0, bytes.data(), 0x10);
+    EXPECT_FALSE(memory_manager.has_pending_invalidations());
+    memory_manager.write_block(0x2FF0, bytes.data(), static_cast<uint32_t>(bytes.size()));
+    memory_manager.apply_pending_invalidations();
+    EXPECT_EQ(cache.lookup(0x3000), nullptr);
+    EXPECT_EQ(ram[0x3000], 0xCC);
+}
+
+TEST_F(SmcCodeBytesTest, RepeatedDataFaultsSwitchToInlineChecks) {
+    add_block(0x4000, 16);
+    EXPECT_EQ(memory_manager.get_protection(0x4000), PROT_READ);
+
+    for (uint32_t i = 0; i < MemoryManager::INLINE_STORE_CHECK_THRESHOLD; i++) {
+        EXPECT_FALSE(memory_manager.has_inline_store_checks(0x4000));
+        EXPECT_TRUE(memory_manager.handle_protection_fault(0x4800));
+        // The fault handler only records the fault; the safe point classifies it
+        EXPECT_EQ(memory_manager.get_protection(0x4000), PROT_READ | PROT_WRITE);
+        memory_manager.apply_pending_invalidations();
+    }
+    EXPECT_EQ(memory_manager.get_data_fault_count(0x4000), MemoryManager::INLINE_STORE_CHECK_THRESHOLD);
+    EXPECT_TRUE(memory_manager.has_inline_store_checks(0x4000));
+    EXPECT_EQ(memory_manager.get_protection(0x4000), PROT_READ | PROT_WRITE);
+    EXPECT_NE(cache.lookup(0x4000), nullptr);
+
+    // Retranslation leaves the page writable; stores are still checked
+    add_block(0x4100, 16);
+    EXPECT_EQ(memory_manager.get_protection(0x4000), PROT_READ | PROT_WRITE);
+    memory_manager.write_u8(0x4108, 0);
+    memory_manager.apply_pending_invalidations();
+    EXPECT_EQ(cache.lookup(0x4100), nullptr);
+    EXPECT_NE(cache.lookup(0x4000), nullptr);
+}
+
+TEST_F(SmcCodeBytesTest, FaultRingOverflowFallsBackToPageScan) {
+    add_block(0x4000, 16);
+    add_block(0x6000, 16);
+
+    // More faults than the ring holds before the safe point runs
+    for (uint32_t i = 0; i <= MemoryManager::FAULT_RING_SIZE; i++) {
+        EXPECT_TRUE(memory_manager.handle_protection_fault(0x4800));
+    }
+    EXPECT_TRUE(memory_manager.handle_protection_fault(0x6004));
+    EXPECT_TRUE(memory_manager.has_pending_invalidations());
+    EXPECT_NE(cache.lookup(0x6000), nullptr);
+
+    // Every unprotected code page is treated as written
+    memory_manager.apply_pending_invalidations();
+    EXPECT_EQ(cache.lookup(0x4000), nullptr);
+    EXPECT_EQ(cache.lookup(0x6000), nullptr);
+    EXPECT_FALSE(memory_manager.has_pending_invalidations());
+}
+
+TEST(SmcSelfVerifyTest, ThrashingPageSwitchesToSelfVerifyingBlocks) {
+    // mov eax, 0; ret
+    tests::TestGuestMemory memory;
+    const uint8_t code[] = {0xB8, 0x00, 0x00, 0x00, 0x00, 0xC3};
+    std::memcpy(&memory.bytes[0x1000], code, sizeof(code));
+
+    XenoARM_JIT::JitConfig config = tests::make_test_config(memory);
+    XenoARM_JIT::JitContext* context = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(context, nullptr);
+
+    // The guest keeps patching the immediate of the block it runs
+    for (uint32_t i = 1; i <= MemoryManager::SELF_VERIFY_THRESHOLD; i++) {
+        ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1000), nullptr);
+        context->memory_manager->write_u8(0x1001, static_cast<uint8_t>(i));
+        context->memory_manager->apply_pending_invalidations();
+        EXPECT_EQ(context->translation_cache->lookup(0x1000), nullptr);
+    }
+    XenoARM_JIT::JitSmcStats stats = {};
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetSmcStats(context, &stats));
+    EXPECT_EQ(stats.self_verifying_pages, 1u);
+    EXPECT_EQ(stats.protected_pages, 0u);
+    EXPECT_EQ(stats.code_writes, MemoryManager::SELF_VERIFY_THRESHOLD);
+    EXPECT_EQ(context->memory_manager->get_protection(0x1000), PROT_READ | PROT_WRITE);
+
+    // From now on writes leave the block in place and the dispatcher catches them
+    void* code_ptr = XenoARM_JIT::Jit_TranslateBlock(context, 0x1000);
+    ASSERT_NE(code_ptr, nullptr);
+    ASSERT_NE(context->translation_cache->lookup(0x1000), nullptr);
+    EXPECT_TRUE(context->translation_cache->lookup(0x1000)->self_verifying);
+    context->memory_manager->write_u8(0x1001, 0x42);
+    EXPECT_FALSE(context->memory_manager->has_pending_invalidations());
+    EXPECT_NE(context->translation_cache->lookup(0x1000), nullptr);
+
+    EXPECT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1000), nullptr);
+    EXPECT_NE(XenoARM_JIT::Jit_TranslateBlock(context, 0x1000), nullptr);
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetSmcStats(context, &stats));
+    EXPECT_EQ(stats.self_verify_checks, 2u);
+    EXPECT_EQ(stats.self_verify_failures, 1u);
+    EXPECT_EQ(stats.code_writes, MemoryManager::SELF_VERIFY_THRESHOLD);
+
+    XenoARM_JIT::Jit_Shutdown(context);
+}
+
+TEST_F(SmcCodeBytesTest, WritesAreCoalescedUntilTheSafePoint) {
+    add_block(0x5000, 0x20);
+    add_block(0x6000, 0x20);
+
+    // Every byte of a patch, and a 16-bit store done as one host write
+    for (uint32_t i = 0; i < 8; i++) {
+        memory_manager.write_u8(0x5004 + i, 0x90);
+    }
+    memory_manager.write_u16(0x500C, 0x9090);
+    memory_manager.write_u8(0x6010, 0x90);
+    EXPECT_EQ(memory_manager.get_protection(0x5000), PROT_READ | PROT_WRITE);
+    EXPECT_NE(cache.lookup(0x5000), nullptr);
+
+    auto applied = memory_manager.apply_pending_invalidations();
+    ASSERT_EQ(applied.size(), 2u);
+    EXPECT_EQ(applied[0], std::make_pair(0x5004u, 10u));
+    EXPECT_EQ(applied[1], std::make_pair(0x6010u, 1u));
+    EXPECT_EQ(cache.lookup(0x5000), nullptr);
+    EXPECT_EQ(cache.lookup(0x6000), nullptr);
+    EXPECT_EQ(memory_manager.get_smc_stats().code_writes, 2u);
+    EXPECT_TRUE(memory_manager.apply_pending_invalidations().empty());
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include "xenoarm_jit/api.h"
+#include "test_guest_memory.h"
+
+using xenoarm_jit::translation_cache::TranslatedBlock;
+
+class SpeculativeTranslationTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // 0x1000: mov eax, 1; jmp 0x1100
+        const uint8_t a[] = {0xB8, 0x01, 0x00, 0x00, 0x00, 0xE9, 0xF6, 0x00, 0x00, 0x00};
+        // 0x1100: mov eax, 2; je 0x1200 (falls through to 0x110B)
+        const uint8_t b[] = {0xB8, 0x02, 0x00, 0x00, 0x00, 0x0F, 0x84, 0xF5, 0x00, 0x00, 0x00};
+        // 0x1200: mov eax, 3; call 0x1300 (returns to 0x120A)
+        const uint8_t d[] = {0xB8, 0x03, 0x00, 0x00, 0x00, 0xE8, 0xF6, 0x00, 0x00, 0x00};
+        std::memcpy(&memory.bytes[0x1000], a, sizeof(a));
+        std::memcpy(&memory.bytes[0x1100], b, sizeof(b));
+        memory.bytes[0x110B] = 0xC3;
+        std::memcpy(&memory.bytes[0x1200], d, sizeof(d));
+        memory.bytes[0x120A] = 0xC3;
+        memory.bytes[0x1300] = 0xC3;
+
+        config = xenoarm_jit::tests::make_test_config(memory);
+        config.compile_threads = 1;
+        config.enable_speculative_translation = true;
+        config.speculation_depth = 1;
+    }
+
+    void TearDown() override {
+        if (jit) {
+            XenoARM_JIT::Jit_Shutdown(jit);
+        }
+    }
+
+    // Let the compile thread finish and install everything it produced
+    void drain() {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (jit->compile_pool->get_pending_count() > 0 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        XenoARM_JIT::Jit_QueryTranslation(jit, 0, nullptr);
+    }
+
+    xenoarm_jit::tests::TestGuestMemory memory;
+    XenoARM_JIT::JitConfig config;
+    XenoARM_JIT::JitContext* jit = nullptr;
+};
+
+TEST_F(SpeculativeTranslationTest, DecoderReportsStaticSuccessors) {
+    config.enable_speculative_translation = false;
+    config.compile_threads = 0;
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    XenoARM_JIT::Jit_TranslateBlock(jit, 0x1100);
+    TranslatedBlock* block = jit->translation_cache->lookup(0x1100);
+    ASSERT_NE(block, nullptr);
+    ASSERT_EQ(block->static_successors.size(), 2u);
+    EXPECT_EQ(block->static_successors[0], 0x1200u); // Jcc taken
+    EXPECT_EQ(block->static_successors[1], 0x110Bu); // Fallthrough
+
+    XenoARM_JIT::Jit_TranslateBlock(jit, 0x1200);
+    block = jit->translation_cache->lookup(0x1200);
+    ASSERT_NE(block, nullptr);
+    ASSERT_EQ(block->static_successors.size(), 2u);
+    EXPECT_EQ(block->static_successors[0], 0x1300u); // Call target
+    EXPECT_EQ(block->static_successors[1], 0x120Au); // Return address
+}
+
+TEST_F(SpeculativeTranslationTest, SuccessorsAreTranslatedAheadUpToDepth) {
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    // Superblock formation folds 0x1100 into 0x1000, so its successors are 0x1200/0x110B
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(jit, 0x1000), nullptr);
+    drain();
+
+    XenoARM_JIT::JitSpeculationStats stats;
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetSpeculationStats(jit, &stats));
+    EXPECT_EQ(stats.requested, 2u);
+    EXPECT_EQ(stats.translated, 2u);
+    EXPECT_EQ(stats.hits, 0u);
+
+    // Depth 1: the speculative blocks' own successors were not requested
+    EXPECT_EQ(jit->translation_cache->lookup(0x1300), nullptr);
+
+    // The guest reaches one of them
+    XenoARM_JIT::Jit_TranslateBlock(jit, 0x1200);
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetSpeculationStats(jit, &stats));
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_DOUBLE_EQ(stats.hit_ratio, 0.5);
+
+    // The other is overwritten before it ever runs
+    XenoARM_JIT::Jit_NotifyMemoryModified(jit, 0x110B, 1);
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetSpeculationStats(jit, &stats));
+    EXPECT_EQ(stats.wasted, 1u);
+    EXPECT_DOUBLE_EQ(stats.waste_ratio, 0.5);
+}
+
+TEST_F(SpeculativeTranslationTest, BudgetFollowsCodeCacheSize) {
+    config.code_cache_size = 8; // Budget of a single byte of speculative code
+    config.speculation_depth = 2;
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    XenoARM_JIT::Jit_TranslateBlock(jit, 0x1000);
+    drain();
+    drain();
+
+    XenoARM_JIT::JitSpeculationStats stats;
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetSpeculationStats(jit, &stats));
+    // Speculation stops once the outstanding speculative code exceeds the budget
+    // (the depth-2 successors of 0x1200 would otherwise be queued)
+    EXPECT_EQ(stats.translated, 2u);
+    EXPECT_EQ(jit->translation_cache->lookup(0x1300), nullptr);
+    EXPECT_EQ(jit->translation_cache->lookup(0x120A), nullptr);
+}
+
+TEST_F(SpeculativeTranslationTest, DisabledWithoutCompileThreads) {
+    config.compile_threads = 0;
+    jit = XenoARM_JIT::Jit_Init(config);
+    ASSERT_NE(jit, nullptr);
+
+    XenoARM_JIT::Jit_TranslateBlock(jit, 0x1000);
+    XenoARM_JIT::JitSpeculationStats stats;
+    ASSERT_TRUE(XenoARM_JIT::Jit_GetSpeculationStats(jit, &stats));
+    EXPECT_EQ(stats.requested, 0u);
+    EXPECT_EQ(jit->translation_cache->get_block_count(), 1u);
+}
@@ -0,0 +1,107 @@
+#ifndef XENOARM_JIT_TESTS_TEST_GUEST_MEMORY_H
+#define XENOARM_JIT_TESTS_TEST_GUEST_MEMORY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include "xenoarm_jit/api.h"
+
+namespace xenoarm_jit {
+namespace tests {
+
+// Guest address space of the API-level suites: 64 KB behind the JitConfig
+// memory callbacks, which receive it as user_data. Reads outside it return
+// zeros and writes outside it are dropped.
+struct TestGuestMemory {
+    static constexpr uint32_t SIZE = 64 * 1024;
+
+    std::vector<uint8_t> bytes = std::vector<uint8_t>(SIZE, 0);
+
+    // Last access through the scalar callbacks
+    uint32_t last_read_address = 0;
+    uint32_t last_write_address = 0;
+    uint64_t last_write_value = 0;
+
+    // Called after every read_memory_block, on the reading thread (compile threads included)
+    std::function<void(uint32_t address)> on_read_block;
+
+    void clear() { std::fill(bytes.begin(), bytes.end(), 0); }
+
+    template <typename T>
+    T read(uint32_t address) {
+        last_read_address = address;
+        T value = 0;
+        if (address <= SIZE - sizeof(T)) {
+            std::memcpy(&value, &bytes[address], sizeof(T));
+        }
+        return value;
+    }
+
+    template <typename T>
+    void write(uint32_t address, T value) {
+        last_write_address = address;
+        last_write_value = value;
+        if (address <= SIZE - sizeof(T)) {
+            std::memcpy(&bytes[address], &value, sizeof(T));
+        }
+    }
+};
+
+inline TestGuestMemory& guest_memory_of(void* user_data) { return *static_cast<TestGuestMemory*>(user_data); }
+
+inline uint8_t read_u8(uint32_t address, void* user_data) { return guest_memory_of(user_data).read<uint8_t>(address); }
+inline uint16_t read_u16(uint32_t address, void* user_data) { return guest_memory_of(user_data).read<uint16_t>(address); }
+inline uint32_t read_u32(uint32_t address, void* user_data) { return guest_memory_of(user_data).read<uint32_t>(address); }
+inline uint64_t read_u64(uint32_t address, void* user_data) { return guest_memory_of(user_data).read<uint64_t>(address); }
+inline void read_block(uint32_t address, void* buffer, uint32_t size, void* user_data) {
+    TestGuestMemory& memory = guest_memory_of(user_data);
+    std::memset(buffer, 0, size);
+    if (address < TestGuestMemory::SIZE) {
+        std::memcpy(buffer, &memory.bytes[address], std::min<size_t>(size, TestGuestMemory::SIZE - address));
+    }
+    if (memory.on_read_block) {
+        memory.on_read_block(address);
+    }
+}
+inline void write_u8(uint32_t address, uint8_t value, void* user_data) { guest_memory_of(user_data).write(address, value); }
+inline void write_u16(uint32_t address, uint16_t value, void* user_data) { guest_memory_of(user_data).write(address, value); }
+inline void write_u32(uint32_t address, uint32_t value, void* user_data) { guest_memory_of(user_data).write(address, value); }
+inline void write_u64(uint32_t address, uint64_t value, void* user_data) { guest_memory_of(user_data).write(address, value); }
+inline void write_block(uint32_t address, const void* buffer, uint32_t size, void* user_data) {
+    if (address < TestGuestMemory::SIZE) {
+        std::memcpy(&guest_memory_of(user_data).bytes[address], buffer,
+                    std::min<size_t>(size, TestGuestMemory::SIZE - address));
+    }
+}
+
+// Config whose memory callbacks use memory, with SMC detection off
+inline XenoARM_JIT::JitConfig make_test_config(TestGuestMemory& memory) {
+    XenoARM_JIT::JitConfig config;
+    config.user_data = &memory;
+    config.read_memory_u8 = read_u8;
+    config.read_memory_u16 = read_u16;
+    config.read_memory_u32 = read_u32;
+    config.read_memory_u64 = read_u64;
+    config.read_memory_block = read_block;
+    config.write_memory_u8 = write_u8;
+    config.write_memory_u16 = write_u16;
+    config.write_memory_u32 = write_u32;
+    config.write_memory_u64 = write_u64;
+    config.write_memory_block = write_block;
+    config.enable_smc_detection = false;
+    return config;
+}
+
+// mov eax, imm32; ret
+inline void emit_mov_eax_ret(TestGuestMemory& memory, uint32_t address, uint32_t imm) {
+    memory.bytes[address] = 0xB8;
+    std::memcpy(&memory.bytes[address + 1], &imm, 4);
+    memory.bytes[address + 5] = 0xC3;
+}
+
+} // namespace tests
+} // namespace xenoarm_jit
+
+#endif // XENOARM_JIT_TESTS_TEST_GUEST_MEMORY_H
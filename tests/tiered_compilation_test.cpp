@@ -0,0 +1,186 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <memory>
+#include "xenoarm_jit/api.h"
+#include "xenoarm_jit/ir_optimizer.h"
+#include "test_guest_memory.h"
+
+using namespace xenoarm_jit;
+using translation_cache::CompilationTier;
+using translation_cache::TranslatedBlock;
+using translation_cache::TranslationCache;
+
+class TieredCompilationTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        std::fill(memory.bytes.begin(), memory.bytes.end(), 0x90);
+
+        // 0x1000: mov eax, 1; mov eax, 2; jmp 0x1020
+        const uint8_t entry[] = {
+            0xB8, 0x01, 0x00, 0x00, 0x00,
+            0xB8, 0x02, 0x00, 0x00, 0x00,
+            0xEB, 0x14
+        };
+        // 0x1020: mov ecx, 3; ret
+        const uint8_t target[] = {
+            0xB9, 0x03, 0x00, 0x00, 0x00,
+            0xC3
+        };
+        std::memcpy(&memory.bytes[0x1000], entry, sizeof(entry));
+        std::memcpy(&memory.bytes[0x1020], target, sizeof(target));
+
+        XenoARM_JIT::JitConfig config = tests::make_test_config(memory);
+        config.enable_tiered_compilation = true;
+        config.tier_up_threshold = 10;
+
+        jit = XenoARM_JIT::Jit_Init(config);
+        ASSERT_NE(jit, nullptr);
+    }
+
+    void TearDown() override {
+        XenoARM_JIT::Jit_Shutdown(jit);
+    }
+
+    tests::TestGuestMemory memory;
+    XenoARM_JIT::JitContext* jit = nullptr;
+};
+
+TEST_F(TieredCompilationTest, HotBlockIsRetranslatedAsSuperblock) {
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(jit, 0x1000), nullptr);
+
+    TranslatedBlock* block = jit->translation_cache->lookup(0x1000);
+    ASSERT_NE(block, nullptr);
+    EXPECT_EQ(block->tier, CompilationTier::TIER0);
+    EXPECT_EQ(block->guest_size, 12u);
+    EXPECT_TRUE(block->superblock_ranges.empty());
+
+    // Dispatch until the block crosses the threshold and is queued
+    for (uint32_t i = 0; i < jit->config.tier_up_threshold; ++i) {
+        XenoARM_JIT::Jit_TranslateBlock(jit, 0x1000);
+    }
+    EXPECT_TRUE(block->tier_up_pending);
+    EXPECT_EQ(jit->tier_up_queue.size(), 1u);
+
+    // The next dispatch swaps in the tier-1 translation
+    ASSERT_NE(XenoARM_JIT::Jit_TranslateBlock(jit, 0x1000), nullptr);
+    block = jit->translation_cache->lookup(0x1000);
+    ASSERT_NE(block, nullptr);
+    EXPECT_EQ(block->tier, CompilationTier::TIER1);
+    ASSERT_EQ(block->superblock_ranges.size(), 1u);
+    EXPECT_EQ(block->superblock_ranges[0].first, 0x1020u);
+    EXPECT_EQ(jit->tier0_translations.load(), 1u);
+    EXPECT_EQ(jit->tier1_translations.load(), 1u);
+    EXPECT_EQ(jit->translation_cache->get_block_count(), 1u);
+
+    // Writing to the folded-in block must invalidate the superblock
+    XenoARM_JIT::Jit_InvalidateRange(jit, 0x1020, 1);
+    EXPECT_EQ(jit->translation_cache->lookup(0x1000), nullptr);
+}
+
+TEST_F(TieredCompilationTest, ColdBlockStaysAtTierZero) {
+    for (uint32_t i = 0; i + 1 < jit->config.tier_up_threshold; ++i) {
+        XenoARM_JIT::Jit_TranslateBlock(jit, 0x1000);
+    }
+    TranslatedBlock* block = jit->translation_cache->lookup(0x1000);
+    ASSERT_NE(block, nullptr);
+    EXPECT_EQ(block->tier, CompilationTier::TIER0);
+    EXPECT_FALSE(block->tier_up_pending);
+    EXPECT_TRUE(jit->tier_up_queue.empty());
+}
+
+TEST(TranslationCacheReplaceTest, IncomingLinksArePatchedToNewBlock) {
+    TranslationCache cache;
+
+    TranslatedBlock* caller = new TranslatedBlock(0x100, 4);
+    caller->code.assign(8, 0);
+    caller->exits.push_back({TranslatedBlock::ControlFlowExitType::JMP, 0x200, 0, 4, false});
+    TranslatedBlock* callee = new TranslatedBlock(0x200, 4);
+    callee->code.assign(8, 0);
+    cache.store(caller);
+    cache.store(callee);
+
+    int patches = 0;
+    auto patch = [&patches](TranslatedBlock*, TranslatedBlock*, const TranslatedBlock::ControlFlowExit&) { patches++; };
+    cache.chain_blocks(caller, patch);
+    ASSERT_EQ(patches, 1);
+    ASSERT_EQ(callee->incoming_links.count(caller), 1u);
+
+    TranslatedBlock* replacement = new TranslatedBlock(0x200, 4);
+    replacement->code.assign(4, 0);
+    replacement->tier = CompilationTier::TIER1;
+
+    TranslatedBlock* patched_target = nullptr;
+    EXPECT_TRUE(cache.replace_block(replacement,
+        [&](TranslatedBlock* source, TranslatedBlock* target, const TranslatedBlock::ControlFlowExit&) {
+            EXPECT_EQ(source, caller);
+            patched_target = target;
+        }));
+
+    EXPECT_EQ(patched_target, replacement);
+    EXPECT_EQ(cache.lookup(0x200), replacement);
+    EXPECT_NE(replacement->code_ptr, nullptr);
+    EXPECT_EQ(replacement->incoming_links.count(caller), 1u);
+    EXPECT_EQ(cache.get_block_count(), 2u);
+}
+
+TEST(TranslationCacheReplaceTest, SharedReplacementIsLinkedThroughCodePointer) {
+    TranslationCache cache;
+    aarch64::CodeGenerator generator;
+    auto patch = [&generator](TranslatedBlock* source, TranslatedBlock* target,
+                              const TranslatedBlock::ControlFlowExit& exit) {
+        generator.patch_branch(source, exit, target);
+    };
+
+    TranslatedBlock* caller = new TranslatedBlock(0x100, 4);
+    caller->code.assign(8, 0);
+    caller->exits.push_back({TranslatedBlock::ControlFlowExitType::JMP, 0x200, 0, 4, false});
+    TranslatedBlock* callee = new TranslatedBlock(0x200, 4);
+    callee->code.assign(8, 0);
+    cache.store(caller);
+    cache.store(callee);
+    cache.chain_blocks(caller, patch);
+    ASSERT_EQ(callee->incoming_links.count(caller), 1u);
+
+    // A tier-1 translation served by the shared code store: its code is the
+    // store's, reached through code_ptr only
+    auto shared = std::make_shared<translation_cache::SharedCode>();
+    shared->code.assign(8, 0);
+    TranslatedBlock* replacement = new TranslatedBlock(0x200, 4);
+    replacement->shared_code = shared;
+    replacement->code_ptr = const_cast<uint8_t*>(shared->code.data());
+    replacement->tier = CompilationTier::TIER1;
+    ASSERT_TRUE(cache.replace_block(replacement, patch));
+
+    int64_t offset = (reinterpret_cast<int64_t>(shared->code.data()) -
+                      reinterpret_cast<int64_t>(caller->code.data() + 4)) / 4;
+    uint32_t branch;
+    std::memcpy(&branch, caller->code.data() + 4, 4);
+    EXPECT_EQ(branch, 0x14000000u | static_cast<uint32_t>(offset & 0x3FFFFFF));
+    EXPECT_EQ(replacement->incoming_links.count(caller), 1u);
+}
+
+TEST(IrOptimizerTest, RemovesNopsAndOverwrittenMoves) {
+    ir::IrBasicBlock block(0);
+    auto reg = [](uint32_t r) { return ir::IrOperand::make_reg(r, ir::IrDataType::I32); };
+    auto imm = [](uint64_t v) { return ir::IrOperand::make_imm(v, ir::IrDataType::I32); };
+
+    block.instructions.push_back(ir::IrInstruction(ir::IrInstructionType::MOV, {reg(0), imm(1)})); // dead
+    block.instructions.push_back(ir::IrInstruction(ir::IrInstructionType::NOP));
+    block.instructions.push_back(ir::IrInstruction(ir::IrInstructionType::MOV, {reg(1), imm(5)}));
+    block.instructions.push_back(ir::IrInstruction(ir::IrInstructionType::MOV, {reg(0), imm(2)}));
+    block.instructions.push_back(ir::IrInstruction(ir::IrInstructionType::ADD, {reg(0), reg(1)}));
+    block.instructions.push_back(ir::IrInstruction(ir::IrInstructionType::MOV, {reg(1), imm(7)})); // live at RET
+    block.instructions.push_back(ir::IrInstruction(ir::IrInstructionType::RET));
+
+    ir::IrFunction func(0x1000);
+    func.basic_blocks.push_back(block);
+    ir::IrOptimizationStats stats = ir::optimize_ir_function(func);
+
+    EXPECT_EQ(stats.nops_removed, 1u);
+    EXPECT_EQ(stats.dead_moves_removed, 1u);
+    const auto& out = func.basic_blocks[0].instructions;
+    ASSERT_EQ(out.size(), 5u);
+    EXPECT_EQ(out[0].operands[0].reg_idx, 1u);
+    EXPECT_EQ(out[1].operands[1].imm_value, 2u);
+    EXPECT_EQ(out[4].type, ir::IrInstructionType::RET);
+}
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "xenoarm_jit/translation_cache/translation_cache.h"
+
+using namespace xenoarm_jit;
+using translation_cache::TranslatedBlock;
+using translation_cache::TranslationCache;
+
+namespace {
+
+TranslatedBlock* make_block(uint64_t address) {
+    TranslatedBlock* block = new TranslatedBlock(address, 4);
+    block->code.assign(8, static_cast<uint8_t>(address));
+    return block;
+}
+
+} // namespace
+
+TEST(TranslationCacheConcurrencyTest, GrowsAndKeepsEntries) {
+    TranslationCache cache;
+    for (uint64_t addr = 0; addr < 5000; ++addr) {
+        cache.store(make_block(0x10000 + addr * 16));
+    }
+    EXPECT_EQ(cache.get_block_count(), 5000u);
+
+    for (uint64_t addr = 0; addr < 5000; addr += 2) {
+        cache.invalidate(0x10000 + addr * 16);
+    }
+    EXPECT_EQ(cache.get_block_count(), 2500u);
+    for (uint64_t addr = 0; addr < 5000; ++addr) {
+        TranslatedBlock* block = cache.lookup(0x10000 + addr * 16);
+        if (addr % 2) {
+            ASSERT_NE(block, nullptr);
+            EXPECT_EQ(block->guest_address, 0x10000 + addr * 16);
+        } else {
+            EXPECT_EQ(block, nullptr);
+        }
+    }
+
+    // Re-inserting over a removed entry reuses its slot
+    cache.store(make_block(0x10000));
+    EXPECT_EQ(cache.get_block_count(), 2501u);
+    EXPECT_NE(cache.lookup(0x10000), nullptr);
+}
+
+TEST(TranslationCacheConcurrencyTest, InvalidatedBlockFreedAfterQuiescentState) {
+    TranslationCache cache;
+    cache.store(make_block(0x1000));
+
+    std::atomic<int> phase{0};
+    std::atomic<bool> block_intact{false};
+    std::thread reader([&]() {
+        ASSERT_TRUE(cache.register_reader_thread());
+        TranslatedBlock* block = cache.lookup(0x1000);
+        phase.store(1);
+        while (phase.load() != 2) {
+            std::this_thread::yield();
+        }
+        // Still safe to touch: this thread has not passed a quiescent state
+        block_intact.store(block && block->guest_address == 0x1000 && block->code.size() == 8);
+        cache.quiescent_state();
+        phase.store(3);
+        while (phase.load() != 4) {
+            std::this_thread::yield();
+        }
+        cache.unregister_reader_thread();
+    });
+
+    while (phase.load() != 1) {
+        std::this_thread::yield();
+    }
+    cache.invalidate(0x1000);
+    EXPECT_EQ(cache.lookup(0x1000), nullptr);
+    EXPECT_EQ(cache.get_retired_block_count(), 1u);
+    EXPECT_EQ(cache.reclaim(), 0u);
+
+    phase.store(2);
+    while (phase.load() != 3) {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(cache.reclaim(), 1u);
+    EXPECT_EQ(cache.get_retired_block_count(), 0u);
+    phase.store(4);
+    reader.join();
+    EXPECT_TRUE(block_intact.load());
+}
+
+TEST(TranslationCacheConcurrencyTest, UnregisteredThreadsDoNotDelayReclamation) {
+    TranslationCache cache;
+    cache.store(make_block(0x1000));
+    cache.invalidate(0x1000);
+    EXPECT_EQ(cache.get_retired_block_count(), 0u);
+}
+
+TEST(TranslationCacheConcurrencyTest, LookupsRaceWithWriters) {
+    TranslationCache cache;
+    const uint64_t address_count = 256;
+    for (uint64_t i = 0; i < address_count; ++i) {
+        cache.store(make_block(0x4000 + i * 8));
+    }
+
+    std::atomic<bool> stop{false};
+    std::atomic<bool> mismatch{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.emplace_back([&, t]() {
+            cache.register_reader_thread();
+            uint64_t i = t;
+            while (!stop.load(std::memory_order_relaxed)) {
+                uint64_t address = 0x4000 + (i++ % address_count) * 8;
+                TranslatedBlock* block = cache.lookup(address);
+                if (block && (block->guest_address != address ||
+                              block->code.size() != 8 ||
+                              block->code[0] != static_cast<uint8_t>(address))) {
+                    mismatch.store(true);
+                }
+                if ((i & 15) == 0) {
+                    cache.quiescent_state();
+                }
+            }
+            cache.unregister_reader_thread();
+        });
+    }
+
+    auto no_patch = [](TranslatedBlock*, TranslatedBlock*, const TranslatedBlock::ControlFlowExit&) {};
+    for (int round = 0; round < 200; ++round) {
+        uint64_t address = 0x4000 + (round % address_count) * 8;
+        cache.invalidate(address);
+        cache.store(make_block(address));
+        cache.replace_block(make_block(address), no_patch);
+        if (round % 50 == 0) {
+            cache.invalidate_range(0x4000, 0x4000 + address_count * 4);
+            for (uint64_t i = 0; i < address_count; ++i) {
+                cache.store(make_block(0x4000 + i * 8));
+            }
+        }
+    }
+
+    stop.store(true);
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_FALSE(mismatch.load());
+    EXPECT_EQ(cache.get_block_count(), address_count);
+    cache.reclaim();
+    EXPECT_EQ(cache.get_retired_block_count(), 0u);
+}